@@ -152,6 +152,7 @@ bool ACLRolesHandler::insertRole(QString f_id, ACLRole f_role)
         return false;
     }
     m_roles.insert(f_id, f_role);
+    emit rolesChanged();
     return true;
 }
 
@@ -165,22 +166,34 @@ bool ACLRolesHandler::removeRole(QString f_id)
         return false;
     }
     m_roles.remove(f_id);
+    emit rolesChanged();
     return true;
 }
 
 void ACLRolesHandler::clearRoles()
 {
     m_roles.clear();
+    emit rolesChanged();
 }
 
 bool ACLRolesHandler::loadFile(QString f_file_name)
+{
+    QHash<QString, ACLRole> l_roles;
+    if (!parseFile(f_file_name, l_roles)) {
+        return false;
+    }
+    setRoles(l_roles);
+    return true;
+}
+
+bool ACLRolesHandler::parseFile(QString f_file_name, QHash<QString, ACLRole> &f_roles)
 {
     QSettings l_settings(f_file_name, QSettings::IniFormat);
     if (!checkPermissionsIni(&l_settings)) {
         return false;
     }
 
-    m_roles.clear();
+    f_roles.clear();
     QStringList l_role_records;
     const QStringList l_group_list = l_settings.childGroups();
     for (const QString &i_group : l_group_list) {
@@ -207,13 +220,19 @@ bool ACLRolesHandler::loadFile(QString f_file_name)
                 l_role.setPermission(i_permission, l_value.toBool());
             }
         }
-        m_roles.insert(l_upper_group, std::move(l_role));
+        f_roles.insert(l_upper_group, std::move(l_role));
         l_settings.endGroup();
     }
 
     return true;
 }
 
+void ACLRolesHandler::setRoles(const QHash<QString, ACLRole> &f_roles)
+{
+    m_roles = f_roles;
+    emit rolesChanged();
+}
+
 bool ACLRolesHandler::saveFile(QString f_file_name)
 {
     QSettings l_settings(f_file_name, QSettings::IniFormat);
@@ -190,6 +190,25 @@ class ACLRolesHandler : public QObject
      */
     bool loadFile(QString f_filename);
 
+    /**
+     * @brief Loads the roles from the given file without modifying any handler.
+     *
+     * @details Read-only roles in the file are skipped. Safe to call from any thread.
+     *
+     * @param f_filename The filename may have no path, a relative path or an absolute path.
+     * @param f_roles Receives the loaded roles.
+     *
+     * @return True if successfull, false otherwise.
+     */
+    static bool parseFile(QString f_filename, QHash<QString, ACLRole> &f_roles);
+
+    /**
+     * @brief Replaces the current roles with the given ones.
+     *
+     * @param f_roles Roles as returned by parseFile().
+     */
+    void setRoles(const QHash<QString, ACLRole> &f_roles);
+
     /**
      * @brief Save the current roles to the given file. The file is saved to the INI format.
      *
@@ -206,7 +225,13 @@ class ACLRolesHandler : public QObject
      * @param Pointer to the QSettings object to verify.
      * @return True if okay., false otherwise.
      */
-    bool checkPermissionsIni(QSettings *f_settings);
+    static bool checkPermissionsIni(QSettings *f_settings);
+
+  signals:
+    /**
+     * @brief Emitted whenever a role was inserted, removed or replaced, so cached permissions can be resolved again.
+     */
+    void rolesChanged();
 
   private:
     /**
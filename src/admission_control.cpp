@@ -0,0 +1,153 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#include "admission_control.h"
+
+#include "network/aopacket.h"
+#include "packet/packet_factory.h"
+
+AdmissionControl::AdmissionControl()
+{
+    m_clock.start();
+}
+
+void AdmissionControl::setBannedRanges(const IPRangeSet &f_ranges)
+{
+    QMutexLocker l_locker(&m_lock);
+    m_banned_ranges = f_ranges;
+}
+
+void AdmissionControl::configure(int f_connection_limit, double f_rate, int f_burst)
+{
+    QMutexLocker l_locker(&m_lock);
+    m_connection_limit = f_connection_limit;
+    m_rate = f_rate;
+    m_burst = qMax(1, f_burst);
+    m_buckets.clear();
+}
+
+AdmissionControl::Verdict AdmissionControl::admit(const QHostAddress &f_address)
+{
+    if (f_address.isLoopback()) {
+        return Verdict::ADMITTED;
+    }
+
+    const QHostAddress l_address = normalizedAddress(f_address);
+    QMutexLocker l_locker(&m_lock);
+    const qint64 l_now = m_clock.elapsed();
+    if (l_now - m_last_prune > PRUNE_INTERVAL) {
+        pruneBuckets(l_now);
+    }
+
+    if (!takeToken(l_address, l_now)) {
+        return Verdict::RATE_LIMITED;
+    }
+    if (m_banned_ranges.contains(l_address)) {
+        return Verdict::BANNED_RANGE;
+    }
+
+    int &l_count = m_connections[l_address];
+    if (m_connection_limit > 0 && l_count >= m_connection_limit) {
+        if (l_count == 0) {
+            m_connections.remove(l_address);
+        }
+        return Verdict::CONNECTION_LIMIT;
+    }
+    l_count++;
+    return Verdict::ADMITTED;
+}
+
+void AdmissionControl::release(const QHostAddress &f_address)
+{
+    if (f_address.isLoopback()) {
+        return;
+    }
+
+    const QHostAddress l_address = normalizedAddress(f_address);
+    QMutexLocker l_locker(&m_lock);
+    auto l_it = m_connections.find(l_address);
+    if (l_it != m_connections.end() && --l_it.value() <= 0) {
+        m_connections.erase(l_it);
+    }
+}
+
+const QString &AdmissionControl::rejectionFrame(Verdict f_verdict)
+{
+    // Encoded on first use, as packets can only be built once the server registered them.
+    QMutexLocker l_locker(&m_lock);
+    QString &l_frame = m_rejection_frames[int(f_verdict)];
+    if (l_frame.isEmpty()) {
+        QString l_reason;
+        switch (f_verdict) {
+        case Verdict::SERVER_FULL:
+            l_reason = "Maximum playercount has been reached.";
+            break;
+        case Verdict::RATE_LIMITED:
+            l_reason = "You are connecting too quickly. Please wait a moment before trying again.";
+            break;
+        case Verdict::CONNECTION_LIMIT:
+            l_reason = "Too many connections from your IP address.";
+            break;
+        case Verdict::BANNED_RANGE:
+            l_reason = "Your IP has been banned by a moderator.";
+            break;
+        default:
+            break;
+        }
+        AOPacket *l_packet = PacketFactory::createPacket("BD", {l_reason});
+        l_frame = l_packet->toString();
+        delete l_packet;
+    }
+    return l_frame;
+}
+
+bool AdmissionControl::takeToken(const QHostAddress &f_address, qint64 f_now)
+{
+    if (m_rate <= 0) {
+        return true;
+    }
+
+    auto l_it = m_buckets.find(f_address);
+    if (l_it == m_buckets.end()) {
+        m_buckets.insert(f_address, {double(m_burst - 1), f_now});
+        return true;
+    }
+
+    TokenBucket &l_bucket = l_it.value();
+    l_bucket.tokens = qMin(double(m_burst), l_bucket.tokens + (f_now - l_bucket.updated) * m_rate / 1000.0);
+    l_bucket.updated = f_now;
+    if (l_bucket.tokens < 1.0) {
+        return false;
+    }
+    l_bucket.tokens -= 1.0;
+    return true;
+}
+
+void AdmissionControl::pruneBuckets(qint64 f_now)
+{
+    m_last_prune = f_now;
+    m_buckets.removeIf([this, f_now](const QHash<QHostAddress, TokenBucket>::iterator &f_it) {
+        return f_it.value().tokens + (f_now - f_it.value().updated) * m_rate / 1000.0 >= m_burst;
+    });
+}
+
+QHostAddress AdmissionControl::normalizedAddress(const QHostAddress &f_address)
+{
+    bool l_is_ipv4 = false;
+    const quint32 l_ipv4 = f_address.toIPv4Address(&l_is_ipv4);
+    return l_is_ipv4 ? QHostAddress(l_ipv4) : f_address;
+}
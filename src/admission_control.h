@@ -0,0 +1,141 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#ifndef ADMISSION_CONTROL_H
+#define ADMISSION_CONTROL_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QHostAddress>
+#include <QMutex>
+#include <QString>
+
+#include <array>
+
+#include "ip_range_set.h"
+
+/**
+ * @brief Decides whether a new connection may join before anything is allocated for it.
+ *
+ * @details Every address has a token bucket limiting how fast it may open connections, and a counter of its
+ * live connections replacing a scan over all clients. Both are looked up in constant time. Loopback addresses
+ * are exempt, like they are from the multiclient limit.
+ *
+ * Rejected connections are sent a BD packet that is only encoded once.
+ *
+ * The same instance is shared by the server and the acceptor threads, so all methods are thread-safe and every
+ * connection is counted exactly once, by whichever of them admitted it.
+ */
+class AdmissionControl
+{
+  public:
+    /**
+     * @brief The outcome of an admission check.
+     */
+    enum class Verdict
+    {
+        ADMITTED,
+        SERVER_FULL,        //!< The maximum playercount has been reached.
+        RATE_LIMITED,       //!< The address opened too many connections recently.
+        CONNECTION_LIMIT,   //!< The address already holds the maximum number of connections.
+        BANNED_RANGE,       //!< The address is part of a banned IP range.
+        VERDICT_COUNT
+    };
+
+    AdmissionControl();
+
+    /**
+     * @brief Replaces the banned IP ranges.
+     */
+    void setBannedRanges(const IPRangeSet &f_ranges);
+
+    /**
+     * @brief Changes the limits applied to new connections.
+     *
+     * @param f_connection_limit How many connections one address may hold at once. Zero or less disables the limit.
+     * @param f_rate How many connections per second an address may open in the long run. Zero or less disables rate limiting.
+     * @param f_burst How many connections an address may open at once before it is rate limited.
+     */
+    void configure(int f_connection_limit, double f_rate, int f_burst);
+
+    /**
+     * @brief Checks a new connection and counts it as live if it is admitted.
+     *
+     * @details Admitted connections must be handed back to release() once they close.
+     */
+    Verdict admit(const QHostAddress &f_address);
+
+    /**
+     * @brief Releases a connection counted by admit().
+     */
+    void release(const QHostAddress &f_address);
+
+    /**
+     * @brief Returns the encoded BD packet telling a client why it was rejected.
+     *
+     * @details Each packet is only encoded once.
+     */
+    const QString &rejectionFrame(Verdict f_verdict);
+
+  private:
+    struct TokenBucket
+    {
+        double tokens;
+        qint64 updated; //!< Milliseconds on #m_clock when the tokens were last refilled.
+    };
+
+    /**
+     * @brief Takes a token from the bucket of an address.
+     *
+     * @return False if the bucket is empty.
+     */
+    bool takeToken(const QHostAddress &f_address, qint64 f_now);
+
+    /**
+     * @brief Drops buckets that refilled completely, as they behave exactly like a new one.
+     */
+    void pruneBuckets(qint64 f_now);
+
+    /**
+     * @brief Returns IPv4-mapped IPv6 addresses as plain IPv4 addresses, so both count towards the same limits.
+     */
+    static QHostAddress normalizedAddress(const QHostAddress &f_address);
+
+    /**
+     * @brief How often full buckets are dropped, in milliseconds.
+     */
+    static constexpr qint64 PRUNE_INTERVAL = 60000;
+
+    /**
+     * @brief Guards all state below, as connections are admitted and released from several threads.
+     */
+    QMutex m_lock;
+
+    IPRangeSet m_banned_ranges;
+    int m_connection_limit = 0;
+    double m_rate = 0;
+    int m_burst = 0;
+
+    QElapsedTimer m_clock;
+    qint64 m_last_prune = 0;
+    QHash<QHostAddress, TokenBucket> m_buckets;
+    QHash<QHostAddress, int> m_connections;
+
+    std::array<QString, int(Verdict::VERDICT_COUNT)> m_rejection_frames;
+};
+
+#endif // ADMISSION_CONTROL_H
@@ -20,9 +20,14 @@
 #include "area_data.h"
 #include "command_extension.h"
 #include "config_manager.h"
+#include "metrics.h"
 #include "packet/packet_factory.h"
 #include "server.h"
 
+#include <QElapsedTimer>
+#include <QThread>
+#include <QTimerEvent>
+
 const QMap<QString, AOClient::CommandInfo> AOClient::COMMANDS{
     {"login", {{ACLRole::NONE}, 0, &AOClient::cmdLogin}},
     {"getarea", {{ACLRole::NONE}, 0, &AOClient::cmdGetArea}},
@@ -94,6 +99,7 @@ const QMap<QString, AOClient::CommandInfo> AOClient::COMMANDS{
     {"gimp", {{ACLRole::MUTE}, 1, &AOClient::cmdGimp}},
     {"ungimp", {{ACLRole::MUTE}, 1, &AOClient::cmdUnGimp}},
     {"baninfo", {{ACLRole::BAN}, 1, &AOClient::cmdBanInfo}},
+    {"searchlog", {{ACLRole::BAN}, 2, &AOClient::cmdSearchLog}},
     {"testify", {{ACLRole::CM}, 0, &AOClient::cmdTestify}},
     {"testimony", {{ACLRole::NONE}, 0, &AOClient::cmdTestimony}},
     {"examine", {{ACLRole::CM}, 0, &AOClient::cmdExamine}},
@@ -193,24 +199,9 @@ void AOClient::handlePacket(AOPacket *packet)
     qDebug() << "Received packet:" << packet->getPacketInfo().header << ":" << packet->getContent() << "args length:" << packet->getContent().length();
 #endif
 
-    qint64 current_tick = QDateTime::currentSecsSinceEpoch();
-    if (rate_limit_tick < current_tick) {
-        rate_limit_tick = current_tick;
-        packet_count = 0;
-    }
-
-    ++packet_count;
-    int hard_limit = ConfigManager::packetRateLimitHard();
-    int soft_limit = ConfigManager::packetRateLimitSoft();
-
-    if (hard_limit > 0 && packet_count >= hard_limit) {
-        sendPacket("BD", {"You have been disconnected for sending messages too quickly."});
-        m_socket->close();
+    if (!applyRateLimit(server->getRateLimiter().chargePacket(m_rate_bucket, packet->getPacketInfo().header))) {
         return;
     }
-    else if (soft_limit > 0 && packet_count >= soft_limit) {
-        sendServerMessage("You are sending messages too quickly. Please slow down.");
-    }
 
     AreaData *l_area = server->getAreaById(areaId());
 
@@ -230,7 +221,7 @@ void AOClient::handlePacket(AOPacket *packet)
         if (characterName().endsWith(" [AFK]")) {
             setCharacterName(characterName().remove(" [AFK]"));
         }
-        m_afk_timer->start(ConfigManager::afkTimeout() * 1000);
+        m_afk_timer.start(ConfigManager::afkTimeout() * 1000, this);
     }
 
     if (packet->getContent().length() < packet->getPacketInfo().min_args) {
@@ -240,6 +231,13 @@ void AOClient::handlePacket(AOPacket *packet)
         return;
     }
 
+    if (Metrics::isEnabled()) {
+        QElapsedTimer l_timer;
+        l_timer.start();
+        packet->handlePacket(l_area, *this);
+        Metrics::recordHandler(packet->getPacketInfo().header, l_timer.nsecsElapsed());
+        return;
+    }
     packet->handlePacket(l_area, *this);
 }
 
@@ -304,7 +302,7 @@ bool AOClient::changeCharacter(int char_id)
         return false;
     }
 
-    if (m_is_charcursed && !m_charcurse_list.contains(char_id)) {
+    if (m_is_charcursed && !cold().charcurse_list.contains(char_id)) {
         return false;
     }
 
@@ -329,7 +327,7 @@ bool AOClient::changeCharacter(int char_id)
 
 void AOClient::changePosition(QString new_pos)
 {
-    m_pos = new_pos;
+    m_pos = StringTable::share(new_pos);
     sendServerMessage("Position changed to " + m_pos + ".");
     sendPacket("SP", {m_pos});
 }
@@ -337,43 +335,89 @@ void AOClient::changePosition(QString new_pos)
 void AOClient::handleCommand(QString command, int argc, QStringList argv)
 {
     command = command.toLower();
-    QString l_target_command = command;
-    QVector<ACLRole::Permission> l_permissions;
 
-    // check for aliases
-    const QList<CommandExtension> l_extensions = server->getCommandExtensionCollection()->getExtensions();
-    for (const CommandExtension &i_extension : l_extensions) {
-        if (i_extension.checkCommandNameAndAlias(command)) {
-            l_target_command = i_extension.getCommandName();
-            l_permissions = i_extension.getPermissions();
-            break;
-        }
-    }
-
-    CommandInfo l_command = COMMANDS.value(l_target_command, {{ACLRole::NONE}, -1, &AOClient::cmdDefault});
-    if (l_permissions.isEmpty()) {
-        l_permissions.append(l_command.acl_permissions);
-    }
+    static const ResolvedCommand l_unknown_command{{{ACLRole::NONE}, -1, &AOClient::cmdDefault}, {}, true, false};
+    const CommandTable &l_table = server->getCommandTable();
+    auto l_entry = l_table.constFind(command);
+    const ResolvedCommand &l_command = l_entry == l_table.cend() ? l_unknown_command : l_entry.value();
 
-    bool l_has_permissions = false;
-    for (const ACLRole::Permission i_permission : qAsConst(l_permissions)) {
-        if (checkPermission(i_permission)) {
-            l_has_permissions = true;
-            break;
-        }
-    }
+    bool l_has_permissions = l_command.unrestricted ||
+                             bool(m_permissions & l_command.permissions) ||
+                             (l_command.requires_super && m_permissions.testFlag(ACLRole::SUPER));
     if (!l_has_permissions) {
         sendServerMessage("You do not have permission to use that command.");
         return;
     }
 
-    if (argc < l_command.minArgs) {
+    if (!applyRateLimit(server->getRateLimiter().chargeCommand(m_rate_bucket, command))) {
+        return;
+    }
+
+    if (argc < l_command.info.minArgs) {
         sendServerMessage("Invalid command syntax.");
         sendServerMessage("The expected syntax for this command is: \n" + ConfigManager::commandHelp(command).usage);
         return;
     }
 
-    (this->*(l_command.action))(argc, argv);
+    (this->*(l_command.info.action))(argc, argv);
+}
+
+bool AOClient::applyRateLimit(RateLimiter::Result f_result)
+{
+    switch (f_result) {
+    case RateLimiter::Result::ALLOWED:
+        return true;
+    case RateLimiter::Result::WARNED:
+        sendServerMessage("You are sending messages too quickly. Please slow down.");
+        return true;
+    case RateLimiter::Result::BUSY:
+        sendServerMessage("The server is busy. Please try again in a moment.");
+        return false;
+    case RateLimiter::Result::EXCEEDED:
+        sendPacket("BD", {"You have been disconnected for sending messages too quickly."});
+        m_socket->close();
+        return false;
+    }
+    return false;
+}
+
+AOClient::CommandTable AOClient::buildCommandTable(const CommandExtensionCollection &f_extensions)
+{
+    auto l_resolve = [](const CommandInfo &f_info, const QVector<ACLRole::Permission> &f_permissions) {
+        ResolvedCommand l_command{f_info, {}, false, false};
+        for (const ACLRole::Permission i_permission : f_permissions) {
+            if (i_permission == ACLRole::NONE) {
+                l_command.unrestricted = true;
+            }
+            else if (i_permission == ACLRole::SUPER) {
+                l_command.requires_super = true;
+            }
+            else {
+                l_command.permissions |= i_permission;
+            }
+        }
+        return l_command;
+    };
+
+    CommandTable l_table;
+    const QList<CommandExtension> l_extensions = f_extensions.getExtensions();
+    for (const CommandExtension &i_extension : l_extensions) {
+        const CommandInfo l_info = COMMANDS.value(i_extension.getCommandName(), {{ACLRole::NONE}, -1, &AOClient::cmdDefault});
+        const ResolvedCommand l_command = l_resolve(l_info, i_extension.getPermissions(l_info.acl_permissions));
+        const QStringList l_names = QStringList{i_extension.getCommandName()} + i_extension.getAliases();
+        for (const QString &i_name : l_names) {
+            if (!l_table.contains(i_name)) {
+                l_table.insert(i_name, l_command);
+            }
+        }
+    }
+
+    for (auto i = COMMANDS.cbegin(); i != COMMANDS.cend(); ++i) {
+        if (!l_table.contains(i.key())) {
+            l_table.insert(i.key(), l_resolve(i.value(), i.value().acl_permissions));
+        }
+    }
+    return l_table;
 }
 
 void AOClient::arup(ARUPType type, bool broadcast)
@@ -453,7 +497,25 @@ void AOClient::sendPacket(QString header)
     sendPacket(PacketFactory::createPacket(header, {}));
 }
 
+void AOClient::sendEncodedPackets(const QString &packets)
+{
+    m_socket->writeEncoded(packets);
+}
+
+void AOClient::sendMusiclist(AOPacket *packet, quint64 version)
+{
+    if (version == m_musiclist_version)
+        return;
+    m_musiclist_version = version;
+    sendPacket(packet);
+}
+
 void AOClient::calculateIpid()
+{
+    m_ipid = ipidForAddress(m_remote_ip);
+}
+
+QString AOClient::ipidForAddress(const QHostAddress &f_address)
 {
     // TODO: add support for longer ipids?
     // This reduces the (fairly high) chance of
@@ -463,9 +525,9 @@ void AOClient::calculateIpid()
 
     QCryptographicHash hash(QCryptographicHash::Md5); // Don't need security, just hashing for uniqueness
 
-    hash.addData(m_remote_ip.toString().toUtf8());
+    hash.addData(f_address.toString().toUtf8());
 
-    m_ipid = hash.result().toHex().right(8); // Use the last 8 characters (4 bytes)
+    return hash.result().toHex().right(8); // Use the last 8 characters (4 bytes)
 }
 
 void AOClient::sendServerMessage(QString message)
@@ -480,7 +542,7 @@ void AOClient::sendServerMessageArea(QString message)
 
 void AOClient::sendServerBroadcast(QString message)
 {
-    server->broadcast(PacketFactory::createPacket("CT", {ConfigManager::serverNickname(), message, "1"}));
+    server->broadcast(PacketFactory::createPacket("CT", {ConfigManager::serverNickname(), message, "1"}), Server::TARGET_TYPE::EVERYONE);
 }
 
 bool AOClient::checkPermission(ACLRole::Permission f_permission) const
@@ -489,20 +551,27 @@ bool AOClient::checkPermission(ACLRole::Permission f_permission) const
         return true;
     }
 
-    if ((f_permission == ACLRole::CM) && server->getAreaById(areaId())->owners().contains(clientId())) {
-        return true; // I'm sorry for this hack.
-    }
+    return m_permissions.testFlag(f_permission);
+}
 
-    if (!isAuthenticated()) {
-        return false;
+void AOClient::updatePermissions()
+{
+    ACLRole::Permissions l_permissions;
+    if (isAuthenticated()) {
+        if (ConfigManager::authType() == DataTypes::AuthType::SIMPLE) {
+            l_permissions = ACLRole::SUPER;
+        }
+        else {
+            l_permissions = server->getACLRolesHandler()->getRoleById(m_acl_role_id).getPermissions();
+        }
     }
 
-    if (ConfigManager::authType() == DataTypes::AuthType::SIMPLE) {
-        return true;
+    AreaData *l_area = server->getAreaById(areaId());
+    if (l_area != nullptr && l_area->owners().contains(clientId())) {
+        l_permissions |= ACLRole::CM; // I'm sorry for this hack.
     }
 
-    const ACLRole l_role = server->getACLRolesHandler()->getRoleById(m_acl_role_id);
-    return l_role.checkPermission(f_permission);
+    m_permissions = l_permissions;
 }
 
 QString AOClient::getIpid() const
@@ -557,6 +626,7 @@ void AOClient::setAreaId(const int f_area_id)
 {
     if (f_area_id != m_current_area) {
         m_current_area = f_area_id;
+        updatePermissions();
         Q_EMIT areaIdChanged(m_current_area);
     }
 }
@@ -569,11 +639,17 @@ QString AOClient::character() const
 void AOClient::setCharacter(const QString &f_character)
 {
     if (f_character != m_current_char) {
-        m_current_char = f_character;
+        m_current_char = StringTable::share(f_character);
+        m_current_char_key = StringTable::intern(m_current_char);
         Q_EMIT characterChanged(m_current_char);
     }
 }
 
+StringTable::Id AOClient::characterKey() const
+{
+    return m_current_char_key;
+}
+
 QString AOClient::characterName() const
 {
     return m_showname;
@@ -609,7 +685,6 @@ void AOClient::onAfkTimeout()
 AOClient::AOClient(Server *p_server, NetworkSocket *socket, QObject *parent, int user_id, MusicManager *p_manager) :
     QObject(parent),
     m_remote_ip(socket->peerAddress()),
-    m_password(""),
     m_joined(false),
     m_socket(socket),
     m_music_manager(p_manager),
@@ -617,17 +692,64 @@ AOClient::AOClient(Server *p_server, NetworkSocket *socket, QObject *parent, int
     m_id(user_id),
     m_current_area(0),
     m_current_char(""),
-    server(p_server),
-    rate_limit_tick(0),
-    packet_count(0)
+    server(p_server)
+{}
+
+qint64 AOClient::memoryFootprint() const
+{
+    // Strings shared with the string table or other clients are not counted, as they are not held by this client alone.
+    auto l_string = [](const QString &f_string) -> qint64 {
+        if (f_string.isNull() || !f_string.isDetached()) {
+            return 0;
+        }
+        return qint64(sizeof(QArrayData)) + (f_string.capacity() + 1) * qint64(sizeof(QChar));
+    };
+
+    qint64 l_bytes = sizeof(AOClient) + m_socket->memoryFootprint();
+    for (const QString *l_member : {&m_current_iniswap, &m_ooc_name, &m_showname, &m_hwid, &m_ipid, &m_last_message,
+                                    &m_acl_role_id, &m_emote, &m_offset, &m_flipping, &m_pos, &m_current_char}) {
+        l_bytes += l_string(*l_member);
+    }
+    if (m_cold) {
+        l_bytes += sizeof(ColdState) + l_string(m_cold->password) + l_string(m_cold->moderator_name);
+        if (m_cold->charcurse_list.isDetached()) {
+            l_bytes += qint64(sizeof(QArrayData)) + m_cold->charcurse_list.capacity() * qint64(sizeof(int));
+        }
+    }
+    return l_bytes;
+}
+
+const AOClient::ColdState &AOClient::cold() const
+{
+    static const ColdState l_empty;
+    return m_cold ? *m_cold : l_empty;
+}
+
+AOClient::ColdState &AOClient::editCold()
 {
-    m_afk_timer = new QTimer;
-    m_afk_timer->setSingleShot(true);
-    connect(m_afk_timer, &QTimer::timeout, this, &AOClient::onAfkTimeout);
+    if (!m_cold) {
+        m_cold = std::make_unique<ColdState>();
+    }
+    return *m_cold;
+}
+
+void AOClient::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() == m_afk_timer.timerId()) {
+        m_afk_timer.stop();
+        onAfkTimeout();
+        return;
+    }
+    QObject::timerEvent(event);
 }
 
 AOClient::~AOClient()
 {
+    // The search does not touch the client, but its result handler does.
+    if (m_cold && m_cold->log_search != nullptr) {
+        m_cold->log_search->wait();
+        delete m_cold->log_search;
+    }
     clientDisconnected();
     m_socket->deleteLater();
 }
@@ -19,7 +19,9 @@
 #define AOCLIENT_H
 
 #include <algorithm>
+#include <memory>
 
+#include <QBasicTimer>
 #include <QDateTime>
 #include <QHostAddress>
 #include <QRegularExpression>
@@ -27,8 +29,11 @@
 #include <QtGlobal>
 
 #include "acl_roles_handler.h"
+#include "command_extension.h"
 #include "network/aopacket.h"
 #include "network/network_socket.h"
+#include "rate_limiter.h"
+#include "string_table.h"
 
 class AreaData;
 class DBManager;
@@ -36,6 +41,7 @@ class MusicManager;
 class Server;
 class NetworkSocket;
 class AOPacket;
+class QThread;
 
 /**
  * @brief Represents a client connected to the server running Attorney Online 2 or one of its derivatives.
@@ -76,6 +82,32 @@ class AOClient : public QObject
      */
     static const QMap<QString, CommandInfo> COMMANDS;
 
+    /**
+     * @brief A command as resolved through the command extensions, ready to be dispatched.
+     */
+    struct ResolvedCommand
+    {
+        CommandInfo info;                 //!< The command the name or alias runs.
+        ACLRole::Permissions permissions; //!< Holding any single one of these permissions allows running the command.
+        bool unrestricted = false;        //!< True if the command requires no permission at all.
+        bool requires_super = false;      //!< True if holding every permission also allows running the command.
+    };
+
+    /**
+     * @brief Maps every lowercase command name and alias to the command it runs.
+     */
+    using CommandTable = QHash<QString, ResolvedCommand>;
+
+    /**
+     * @brief Builds the dispatch table for all commands with the given extensions applied.
+     *
+     * @details If an alias collides with the name or alias of another command, the extension
+     * that sorts first by command name wins, as it did when extensions were searched one by one.
+     *
+     * @param f_extensions The loaded command extensions.
+     */
+    static CommandTable buildCommandTable(const CommandExtensionCollection &f_extensions);
+
     /**
      * @brief Creates an instance of the AOClient class.
      *
@@ -130,6 +162,19 @@ class AOClient : public QObject
      */
     void calculateIpid();
 
+    /**
+     * @brief Returns the IPID of a client connecting from the given address.
+     */
+    static QString ipidForAddress(const QHostAddress &f_address);
+
+    /**
+     * @brief Returns an estimate of the memory held by the client and its socket, in bytes.
+     *
+     * @details Counts the objects themselves and the heap memory of their strings and lists. Memory held inside
+     * Qt, like the buffers of the WebSocket or signal connections, is not included.
+     */
+    qint64 memoryFootprint() const;
+
     /**
      * @brief Getter for the pointer to the server.
      *
@@ -149,6 +194,11 @@ class AOClient : public QObject
     QString character() const;
     void setCharacter(const QString &f_character);
 
+    /**
+     * @brief Returns the interned ID of the character name, for comparing it against other names.
+     */
+    StringTable::Id characterKey() const;
+
     QString characterName() const;
     void setCharacterName(const QString &f_showname);
 
@@ -161,9 +211,27 @@ class AOClient : public QObject
     QHostAddress m_remote_ip;
 
     /**
-     * @brief The stored character password for the client, used to be able to select passworded characters.
+     * @brief State that only some clients ever have, kept out of line so the others do not pay for it.
+     *
+     * @details Everything read while handling regular IC and OOC messages stays in AOClient itself.
+     */
+    struct ColdState
+    {
+        QString password;              //!< The stored character password, used to be able to select passworded characters.
+        QString moderator_name;        //!< If using advanced authentication, the moderator name the client logged in with.
+        QList<int> charcurse_list;     //!< The char IDs a charcursed player is allowed to switch to.
+        QThread *log_search = nullptr; //!< The running /searchlog of the client, joined when the client is destroyed.
+    };
+
+    /**
+     * @brief Returns the cold state of the client, which is empty if none was ever set.
      */
-    QString m_password;
+    const ColdState &cold() const;
+
+    /**
+     * @brief Returns the cold state of the client for changing it, allocating it first if needed.
+     */
+    ColdState &editCold();
 
     /**
      * @brief True if the client is actually in the server.
@@ -184,9 +252,9 @@ class AOClient : public QObject
     QString m_current_iniswap;
 
     /**
-     * @brief If using advanced authentication, this is the moderator name that the client has logged in with.
+     * @brief The interned ID of m_current_iniswap.
      */
-    QString m_moderator_name = "";
+    StringTable::Id m_current_iniswap_key = StringTable::EMPTY;
 
     /**
      * @brief The out-of-character name of the client, generally the nickname of the user themself.
@@ -203,34 +271,34 @@ class AOClient : public QObject
      *
      * @see AOClient::cmdG and AOClient::cmdToggleGlobal
      */
-    bool m_global_enabled = true;
+    bool m_global_enabled : 1 = true;
 
     /**
      * @brief If true, the client's messages will be sent in first-person mode.
      *
      * @see AOClient::cmdFirstPerson
      */
-    bool m_first_person = false;
+    bool m_first_person : 1 = false;
 
     /**
      * @brief If true, the client may not use in-character chat.
      */
-    bool m_is_muted = false;
+    bool m_is_muted : 1 = false;
 
     /**
      * @brief If true, the client may not use out-of-character chat.
      */
-    bool m_is_ooc_muted = false;
+    bool m_is_ooc_muted : 1 = false;
 
     /**
      * @brief If true, the client may not use the music list.
      */
-    bool m_is_dj_blocked = false;
+    bool m_is_dj_blocked : 1 = false;
 
     /**
      * @brief If true, the client may not use the judge controls.
      */
-    bool m_is_wtce_blocked = false;
+    bool m_is_wtce_blocked : 1 = false;
 
     /**
      * @brief Represents the client's client software, and its version.
@@ -253,60 +321,62 @@ class AOClient : public QObject
     ClientVersion m_version;
 
     /**
-     * @brief A list of 5 casing preferences (def, pro, judge, jury, steno)
+     * @brief The version of the last musiclist the client received, or 0 if it has not received one yet.
+     *
+     * @see MusicManager::musiclistVersion
      */
-    QList<bool> m_casing_preferences = {false, false, false, false, false};
+    quint64 m_musiclist_version = 0;
+
+    /**
+     * @brief The 5 casing preferences (def, pro, judge, jury, steno), one bit each starting from the lowest.
+     */
+    quint8 m_casing_preferences = 0;
 
     /**
      * @brief If true, the client's in-character messages will have their word order randomised.
      */
-    bool m_is_shaken = false;
+    bool m_is_shaken : 1 = false;
 
     /**
      * @brief If true, the client's in-character messages will have their vowels (English alphabet only) removed.
      */
-    bool m_is_disemvoweled = false;
+    bool m_is_disemvoweled : 1 = false;
 
     /**
      * @brief If true, the client's in-character messages will be overwritten by a randomly picked predetermined message.
      */
-    bool m_is_gimped = false;
+    bool m_is_gimped : 1 = false;
 
     /**
      * @brief If true, the client's in-character messages will be run through a chat parser to make them into Ye Olde English.
      */
-    bool m_is_medieval = false;
+    bool m_is_medieval : 1 = false;
 
     /**
      * @brief If true, the client will be marked as AFK in /getarea. Automatically applied when a configurable
      * amount of time has passed since the last interaction, or manually applied by /afk.
      */
-    bool m_is_afk = false;
+    bool m_is_afk : 1 = false;
 
     /**
      * @brief If true, the client will not recieve PM messages.
      */
-    bool m_pm_mute = false;
+    bool m_pm_mute : 1 = false;
 
     /**
      * @brief If true, the client will recieve advertisements.
      */
-    bool m_advert_enabled = true;
+    bool m_advert_enabled : 1 = true;
 
     /**
      * @brief If true, the client is restricted to only changing into certain characters.
      */
-    bool m_is_charcursed = false;
+    bool m_is_charcursed : 1 = false;
 
     /**
      * @brief Timer for tracking user interaction. Automatically restarted whenever a user interacts (i.e. sends any packet besides CH)
      */
-    QTimer *m_afk_timer;
-
-    /**
-     * @brief The list of char IDs a charcursed player is allowed to switch to.
-     */
-    QList<int> m_charcurse_list;
+    QBasicTimer m_afk_timer;
 
     /**
      * @brief Temporary client permission if client is allowed to save a testimony to server storage.
@@ -360,9 +430,19 @@ class AOClient : public QObject
      * @param f_permission The permission flags.
      *
      * @return True if the client has permission, false otherwise.
+     *
+     * @see updatePermissions
      */
     bool checkPermission(ACLRole::Permission f_permission) const;
 
+    /**
+     * @brief Resolves the permissions of the client's ACL role, and CM ownership of its current area, into #m_permissions.
+     *
+     * @details Has to be called whenever one of these inputs changes: logging in or out, the area the client is in,
+     * the owners of that area, and the ACL roles or authentication type on reload.
+     */
+    void updatePermissions();
+
     /**
      * @brief Returns if the client is a spectator.
      *
@@ -557,6 +637,11 @@ class AOClient : public QObject
      */
     QString m_acl_role_id;
 
+    /**
+     * @brief The permissions the client currently holds, as resolved by updatePermissions().
+     */
+    ACLRole::Permissions m_permissions;
+
     /**
      * @brief The character ID of the other character that the client wants to pair up with.
      *
@@ -643,6 +728,21 @@ class AOClient : public QObject
      */
     void sendPacket(QString header);
 
+    /**
+     * @brief Sends packets that have already been encoded to the client in a single frame.
+     *
+     * @param packets The concatenated output of AOPacket::toString() for each packet.
+     */
+    void sendEncodedPackets(const QString &packets);
+
+    /**
+     * @brief Sends an FM packet to the client if it does not have that version of the musiclist yet.
+     *
+     * @param packet The FM packet.
+     * @param version The version of the musiclist in the packet, see MusicManager::musiclistVersion().
+     */
+    void sendMusiclist(AOPacket *packet, quint64 version);
+
     /**
      * @brief A slot for when the client's AFK timer runs out.
      */
@@ -659,6 +759,12 @@ class AOClient : public QObject
     void characterNameChanged(const QString &);
     void areaIdChanged(int);
 
+  protected:
+    /**
+     * @brief Handles the AFK timer.
+     */
+    void timerEvent(QTimerEvent *event) override;
+
   private:
     /**
      * @brief The user ID of the client.
@@ -675,6 +781,16 @@ class AOClient : public QObject
      */
     QString m_current_char;
 
+    /**
+     * @brief The interned ID of m_current_char.
+     */
+    StringTable::Id m_current_char_key = StringTable::EMPTY;
+
+    /**
+     * @brief See ColdState. Null until something is stored in it.
+     */
+    std::unique_ptr<ColdState> m_cold;
+
     /**
      * @brief A pointer to the Server, used for updating server variables that depend on the client (e.g. amount of players in an area).
      */
@@ -1258,6 +1374,20 @@ class AOClient : public QObject
      */
     void cmdBanInfo(int argc, QStringList argv);
 
+    /**
+     * @brief Searches the log archive for events of an IPID, HWID or area.
+     *
+     * @details The first argument is the type of the lookup, either `ipid`, `hwid` or `area`.
+     *
+     * The second argument is the value to look up. Area names may contain spaces.
+     *
+     * The amount of days to search back can be given as `days=N` right after the lookup type, otherwise seven days
+     * are searched. The search itself runs on a separate thread and its result is sent once it is done.
+     *
+     * @iscommand
+     */
+    void cmdSearchLog(int argc, QStringList argv);
+
     /**
      * @brief Reloads all server configuration files.
      *
@@ -2132,14 +2262,16 @@ class AOClient : public QObject
     bool change_auth_started = false;
 
     /**
-     * @brief Timestamp (in seconds since Epoch) of the current tick.
+     * @brief The tokens the client has left for sending packets and commands.
      */
-    qint64 rate_limit_tick;
+    RateLimiter::Bucket m_rate_bucket;
 
     /**
-     * @brief Number of packets received for the current tick.
+     * @brief Acts on the result of charging a packet or command to #m_rate_bucket.
+     *
+     * @return False if the packet or command must not be handled.
      */
-    int packet_count;
+    bool applyRateLimit(RateLimiter::Result f_result);
 
   signals:
 
@@ -25,7 +25,35 @@
 
 #include <QRegularExpression>
 
-AreaData::AreaData(QString p_name, int p_index, MusicManager *p_music_manager = nullptr) :
+namespace {
+/**
+ * @brief Parses the owner tag of an evidence description into a set of case folded positions.
+ *
+ * @return An empty set if the evidence is shown to everyone.
+ */
+QSet<QString> parseEvidenceOwners(const QString &f_description)
+{
+    static const QRegularExpression ownerRegex("<owner=(.*?)>");
+    QRegularExpressionMatch match = ownerRegex.match(f_description);
+    if (!match.hasMatch()) {
+        // no match = show it to all
+        return {};
+    }
+
+    QSet<QString> l_owners;
+    const QStringList l_positions = match.captured(1).split(",");
+    for (const QString &l_position : l_positions) {
+        QString l_folded = l_position.toCaseFolded();
+        if (l_folded == QLatin1String("all")) {
+            return {};
+        }
+        l_owners.insert(l_folded);
+    }
+    return l_owners;
+}
+} // namespace
+
+AreaData::AreaData(const ConfigManager::AreaConfig &p_config, int p_index, MusicManager *p_music_manager = nullptr) :
     m_index(p_index),
     m_music_manager(p_music_manager),
     m_playerCount(0),
@@ -43,32 +71,28 @@ AreaData::AreaData(QString p_name, int p_index, MusicManager *p_music_manager =
     m_can_send_wtce(true),
     m_can_use_shouts(true)
 {
-    QStringList name_split = p_name.split(":");
-    name_split.removeFirst();
-    m_name = name_split.join(":");
+    m_name = p_config.name;
     if (m_name.isEmpty()) {
         m_name = "Unnamed Area";
     }
     m_display_name = "[" + QString::number(m_index) + "] " + m_name;
-    QSettings *areas_ini = ConfigManager::areaData();
-    areas_ini->beginGroup(p_name);
-    m_background = areas_ini->value("background", "gs4").toString();
-    m_isProtected = areas_ini->value("protected_area", "false").toBool();
-    m_iniswapAllowed = areas_ini->value("iniswap_allowed", "true").toBool();
-    m_bgLocked = areas_ini->value("bg_locked", "false").toBool();
-    m_eviMod = QVariant(areas_ini->value("evidence_mod", "FFA").toString().toUpper()).value<EvidenceMod>();
-    m_blankpostingAllowed = areas_ini->value("blankposting_allowed", "true").toBool();
-    m_area_message = areas_ini->value("area_message").toString();
-    m_send_area_message = areas_ini->value("send_area_message_on_join", false).toBool();
-    m_forceImmediate = areas_ini->value("force_immediate", "false").toBool();
-    m_toggleMusic = areas_ini->value("toggle_music", "true").toBool();
-    m_shownameAllowed = areas_ini->value("shownames_allowed", "true").toBool();
-    m_ignoreBgList = areas_ini->value("ignore_bglist", "false").toBool();
-    m_jukebox = areas_ini->value("jukebox_enabled", "false").toBool();
-    m_playcmd = areas_ini->value("playcmd_enabled", "false").toBool();
-    m_can_send_wtce = areas_ini->value("wtce_enabled", "true").toBool();
-    m_can_use_shouts = areas_ini->value("shouts_enabled", "true").toBool();
-    areas_ini->endGroup();
+    const QVariantHash &l_values = p_config.values;
+    m_background = l_values.value("background", "gs4").toString();
+    m_isProtected = l_values.value("protected_area", "false").toBool();
+    m_iniswapAllowed = l_values.value("iniswap_allowed", "true").toBool();
+    m_bgLocked = l_values.value("bg_locked", "false").toBool();
+    m_eviMod = QVariant(l_values.value("evidence_mod", "FFA").toString().toUpper()).value<EvidenceMod>();
+    m_blankpostingAllowed = l_values.value("blankposting_allowed", "true").toBool();
+    m_area_message = l_values.value("area_message").toString();
+    m_send_area_message = l_values.value("send_area_message_on_join", false).toBool();
+    m_forceImmediate = l_values.value("force_immediate", "false").toBool();
+    m_toggleMusic = l_values.value("toggle_music", "true").toBool();
+    m_shownameAllowed = l_values.value("shownames_allowed", "true").toBool();
+    m_ignoreBgList = l_values.value("ignore_bglist", "false").toBool();
+    m_jukebox = l_values.value("jukebox_enabled", "false").toBool();
+    m_playcmd = l_values.value("playcmd_enabled", "false").toBool();
+    m_can_send_wtce = l_values.value("wtce_enabled", "true").toBool();
+    m_can_use_shouts = l_values.value("shouts_enabled", "true").toBool();
     QTimer *timer1 = new QTimer();
     m_timers.append(timer1);
     QTimer *timer2 = new QTimer();
@@ -131,12 +155,14 @@ void AreaData::addOwner(int f_clientId)
 {
     m_owners.append(f_clientId);
     m_invited.append(f_clientId);
+    emit ownersChanged(f_clientId);
 }
 
 bool AreaData::removeOwner(int f_clientId)
 {
     m_owners.removeAll(f_clientId);
     m_invited.removeAll(f_clientId);
+    emit ownersChanged(f_clientId);
 
     if (m_owners.isEmpty() && m_locked != AreaData::FREE) {
         m_locked = AreaData::FREE;
@@ -275,21 +301,25 @@ QList<AreaData::Evidence> AreaData::evidence() const
 void AreaData::swapEvidence(int f_eviId1, int f_eviId2)
 {
     m_evidence.swapItemsAt(f_eviId1, f_eviId2);
+    m_evidence_owners.swapItemsAt(f_eviId1, f_eviId2);
 }
 
 void AreaData::appendEvidence(const AreaData::Evidence &f_evi_r)
 {
     m_evidence.append(f_evi_r);
+    m_evidence_owners.append(parseEvidenceOwners(f_evi_r.description));
 }
 
 void AreaData::deleteEvidence(int f_eviId)
 {
     m_evidence.removeAt(f_eviId);
+    m_evidence_owners.removeAt(f_eviId);
 }
 
 void AreaData::replaceEvidence(int f_eviId, const AreaData::Evidence &f_newEvi_r)
 {
     m_evidence.replace(f_eviId, f_newEvi_r);
+    m_evidence_owners.replace(f_eviId, parseEvidenceOwners(f_newEvi_r.description));
 }
 
 void AreaData::setEvidenceOwnerToAll(int f_eviId)
@@ -315,6 +345,7 @@ void AreaData::setEvidenceOwnerToAll(int f_eviId)
     }
 
     evidence.description = description;
+    m_evidence_owners[f_eviId].clear();
 }
 
 AreaData::Status AreaData::status() const
@@ -759,22 +790,11 @@ int AreaData::getEvidenceIndexByVisibleIndex(int f_visibleIndex, const QString &
         return -1;
     }
 
+    const EvidenceView l_view = evidenceView(f_clientPos, f_isCM);
     int visibleCount = 0;
     for (int i = 0; i < m_evidence.size(); ++i) {
-        const Evidence &evidence = m_evidence[i];
-
-        // Apply the same filtering logic as in updateEvidenceList
-        if (!f_isCM && m_eviMod == EvidenceMod::HIDDEN_CM) {
-            static const QRegularExpression ownerRegex("<owner=(.*?)>");
-            QRegularExpressionMatch match = ownerRegex.match(evidence.description);
-            if (match.hasMatch()) {
-                QStringList owners = match.captured(1).split(",");
-                if (!owners.contains("all", Qt::CaseSensitivity::CaseInsensitive) &&
-                    !owners.contains(f_clientPos, Qt::CaseSensitivity::CaseInsensitive)) {
-                    continue; // This evidence is not visible to the client
-                }
-            }
-            // no match = show it to all
+        if (!isEvidenceVisible(i, l_view)) {
+            continue; // This evidence is not visible to the client
         }
 
         // This evidence is visible, increment counter
@@ -793,30 +813,120 @@ int AreaData::getVisibleIndexByEvidenceIndex(int f_evidenceIndex, const QString
         return 0; // Invalid index or not visible
     }
 
+    const EvidenceView l_view = evidenceView(f_clientPos, f_isCM);
+    if (!isEvidenceVisible(f_evidenceIndex, l_view)) {
+        return 0; // Evidence not visible to this client
+    }
+
     int visibleCount = 0;
+    for (int i = 0; i <= f_evidenceIndex; ++i) {
+        if (isEvidenceVisible(i, l_view)) {
+            ++visibleCount;
+        }
+    }
+    return visibleCount; // Return the visible index (1-based)
+}
+
+AreaData::EvidenceView AreaData::evidenceView(const QString &f_clientPos, bool f_isCM) const
+{
+    if (f_isCM || m_eviMod != EvidenceMod::HIDDEN_CM) {
+        return {false, QString()};
+    }
+    return {true, f_clientPos.toCaseFolded()};
+}
+
+bool AreaData::isEvidenceVisible(int f_eviId, const EvidenceView &f_view) const
+{
+    if (!f_view.first) {
+        return true;
+    }
+    const QSet<QString> &l_owners = m_evidence_owners.at(f_eviId);
+    return l_owners.isEmpty() || l_owners.contains(f_view.second);
+}
+
+QStringList AreaData::evidenceList(const EvidenceView &f_view) const
+{
+    QStringList l_evidence_list;
+    QString l_evidence_format("%1&%2&%3");
     for (int i = 0; i < m_evidence.size(); ++i) {
+        if (!isEvidenceVisible(i, f_view)) {
+            continue;
+        }
         const Evidence &evidence = m_evidence[i];
+        l_evidence_list.append(l_evidence_format.arg(evidence.name, evidence.description, evidence.image));
+    }
+    return l_evidence_list;
+}
 
-        // Apply the same filtering logic as in updateEvidenceList
-        if (!f_isCM && m_eviMod == EvidenceMod::HIDDEN_CM) {
-            static const QRegularExpression ownerRegex("<owner=(.*?)>");
-            QRegularExpressionMatch match = ownerRegex.match(evidence.description);
-            if (match.hasMatch()) {
-                QStringList owners = match.captured(1).split(",");
-                if (!owners.contains("all", Qt::CaseSensitivity::CaseInsensitive) &&
-                    !owners.contains(f_clientPos, Qt::CaseSensitivity::CaseInsensitive)) {
-                    continue; // This evidence is not visible to the client
-                }
-            }
-            // no match = show it to all
-        }
+void AreaData::writeState(QDataStream &f_stream) const
+{
+    f_stream << qint32(m_evidence.size());
+    for (const Evidence &l_evidence : m_evidence) {
+        f_stream << l_evidence.name << l_evidence.description << l_evidence.image;
+    }
+    f_stream << qint32(m_status) << qint32(m_locked) << qint32(m_eviMod) << qint32(m_testimonyRecording);
+    f_stream << m_background << m_side << m_document << m_area_message << m_notecards;
+    f_stream << qint32(m_defHP) << qint32(m_proHP);
+    f_stream << m_currentMusic << m_currentAmbience << m_musicPlayedBy;
+    f_stream << m_testimony << qint32(m_statement) << m_judgelog << m_jukebox_queue;
+    f_stream << m_isProtected << m_shownameAllowed << m_iniswapAllowed << m_blankpostingAllowed << m_bgLocked
+             << m_forceImmediate << m_toggleMusic << m_ignoreBgList << m_send_area_message << m_jukebox << m_playcmd
+             << m_can_send_wtce << m_can_use_shouts << m_medieval_mode;
+}
 
-        // This evidence is visible, increment counter
-        ++visibleCount;
-        if (i == f_evidenceIndex) {
-            return visibleCount; // Return the visible index (1-based)
-        }
+bool AreaData::readState(QDataStream &f_stream)
+{
+    qint32 l_evidence_count;
+    f_stream >> l_evidence_count;
+    if (f_stream.status() != QDataStream::Ok || l_evidence_count < 0) {
+        return false;
+    }
+    m_evidence.clear();
+    m_evidence_owners.clear();
+    for (int i = 0; i < l_evidence_count && f_stream.status() == QDataStream::Ok; ++i) {
+        Evidence l_evidence;
+        f_stream >> l_evidence.name >> l_evidence.description >> l_evidence.image;
+        appendEvidence(l_evidence);
     }
 
-    return 0; // Evidence not visible to this client
+    qint32 l_status, l_locked, l_evidence_mod, l_testimony_recording, l_def_hp, l_pro_hp, l_statement;
+    f_stream >> l_status >> l_locked >> l_evidence_mod >> l_testimony_recording;
+    f_stream >> m_background >> m_side >> m_document >> m_area_message >> m_notecards;
+    f_stream >> l_def_hp >> l_pro_hp;
+    f_stream >> m_currentMusic >> m_currentAmbience >> m_musicPlayedBy;
+    f_stream >> m_testimony >> l_statement >> m_judgelog >> m_jukebox_queue;
+    f_stream >> m_isProtected >> m_shownameAllowed >> m_iniswapAllowed >> m_blankpostingAllowed >> m_bgLocked
+        >> m_forceImmediate >> m_toggleMusic >> m_ignoreBgList >> m_send_area_message >> m_jukebox >> m_playcmd
+        >> m_can_send_wtce >> m_can_use_shouts >> m_medieval_mode;
+    if (f_stream.status() != QDataStream::Ok) {
+        return false;
+    }
+
+    m_status = Status(l_status);
+    m_locked = LockStatus(l_locked);
+    m_eviMod = EvidenceMod(l_evidence_mod);
+    m_testimonyRecording = TestimonyRecording(l_testimony_recording);
+    m_defHP = qBound(0, int(l_def_hp), 10);
+    m_proHP = qBound(0, int(l_pro_hp), 10);
+    m_statement = l_statement;
+    return true;
+}
+
+void AreaData::restoreRoles(const QStringList &f_owner_ipids, const QStringList &f_invited_ipids)
+{
+    m_restored_owners = f_owner_ipids;
+    m_restored_invited = f_invited_ipids;
+    if (m_restored_owners.isEmpty()) {
+        m_locked = FREE;
+    }
+}
+
+void AreaData::claimRestoredRoles(int f_client_id, const QString &f_ipid)
+{
+    if (m_restored_owners.removeAll(f_ipid) > 0) {
+        addOwner(f_client_id);
+    }
+    else if (m_restored_invited.removeAll(f_ipid) > 0) {
+        invite(f_client_id);
+    }
 }
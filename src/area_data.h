@@ -18,17 +18,20 @@
 #ifndef AREA_DATA_H
 #define AREA_DATA_H
 
+#include <QDataStream>
 #include <QDebug>
 #include <QElapsedTimer>
 #include <QMap>
+#include <QPair>
 #include <QRandomGenerator>
+#include <QSet>
 #include <QSettings>
 #include <QString>
 #include <QTimer>
 
+#include "config_manager.h"
 #include "network/aopacket.h"
 
-class ConfigManager;
 class Logger;
 class MusicManager;
 class AOPacket;
@@ -44,11 +47,10 @@ class AreaData : public QObject
     /**
      * @brief Constructor for the AreaData class.
      *
-     * @param p_name The name of the area. This must be in the format of `"X:YYYYYY"`, where `X` is an integer,
-     * and `YYYYYY` is the actual name of the area.
+     * @param p_config The area's entry in areas.ini.
      * @param p_index The index of the area in the area list.
      */
-    AreaData(QString p_name, int p_index, MusicManager *p_music_manager);
+    AreaData(const ConfigManager::AreaConfig &p_config, int p_index, MusicManager *p_music_manager);
 
     /**
      * @brief The data for evidence in the area.
@@ -491,6 +493,37 @@ class AreaData : public QObject
      */
     int getVisibleIndexByEvidenceIndex(int f_evidenceIndex, const QString &f_clientPos, bool f_isCM) const;
 
+    /**
+     * @brief Identifies which evidence a client can see.
+     *
+     * @details The first member is true if the view is filtered by owner, in which case the second member is the
+     * case folded position of the client. Clients with equal views are shown the same evidence list.
+     */
+    using EvidenceView = QPair<bool, QString>;
+
+    /**
+     * @brief Returns the view of the evidence list a client at the given position has.
+     *
+     * @param f_clientPos The position of the client.
+     * @param f_isCM Whether the client is a Case Manager.
+     */
+    EvidenceView evidenceView(const QString &f_clientPos, bool f_isCM) const;
+
+    /**
+     * @brief Returns if a piece of evidence is shown in the given view.
+     *
+     * @param f_eviId The ID of the evidence.
+     * @param f_view The view of the client, see evidenceView().
+     */
+    bool isEvidenceVisible(int f_eviId, const EvidenceView &f_view) const;
+
+    /**
+     * @brief Returns the contents of an LE packet for the given view.
+     *
+     * @param f_view The view of the client, see evidenceView().
+     */
+    QStringList evidenceList(const EvidenceView &f_view) const;
+
     /**
      * @brief Returns the status of the area.
      *
@@ -1006,6 +1039,34 @@ class AreaData : public QObject
      */
     void startMessageFloodguard(int f_duration);
 
+    /**
+     * @brief Writes the state players built up in the area, like evidence, testimony and locks, to a stream.
+     *
+     * @details Owners and invited clients are left out, as client IDs do not survive a restart.
+     * See restoreRoles() for how they are carried over.
+     */
+    void writeState(QDataStream &f_stream) const;
+
+    /**
+     * @brief Restores the state written by writeState().
+     *
+     * @return False if the stream ended early or held invalid data. The area may then be partially restored.
+     */
+    bool readState(QDataStream &f_stream);
+
+    /**
+     * @brief Remembers the IPIDs of the area's owners and invited clients from before a restart.
+     *
+     * @details Clients with these IPIDs get their role back once they reconnect, see claimRestoredRoles().
+     * If no owner is left to come back, the area is unlocked.
+     */
+    void restoreRoles(const QStringList &f_owner_ipids, const QStringList &f_invited_ipids);
+
+    /**
+     * @brief Gives a reconnecting client the roles it had in the area before a restart.
+     */
+    void claimRestoredRoles(int f_client_id, const QString &f_ipid);
+
   public slots:
 
     /**
@@ -1041,6 +1102,13 @@ class AreaData : public QObject
      */
     void userJoinedArea(int f_area_index, int f_user_id);
 
+    /**
+     * @brief Signals that a client was added to or removed from the owners of the area.
+     *
+     * @param f_client_id The ID of the client.
+     */
+    void ownersChanged(int f_client_id);
+
   private:
     /**
      * @brief The list of timers available in the area.
@@ -1081,6 +1149,14 @@ class AreaData : public QObject
      */
     QList<Evidence> m_evidence;
 
+    /**
+     * @brief The case folded positions named in the owner tag of each piece of evidence, in the same order as #m_evidence.
+     *
+     * @details An empty set means the evidence is shown to everyone, either because it has no owner tag
+     * or because its owners include "all".
+     */
+    QList<QSet<QString>> m_evidence_owners;
+
     /**
      * @brief The amount of clients inside the area.
      */
@@ -1317,6 +1393,16 @@ class AreaData : public QObject
      */
     bool m_medieval_mode = false;
 
+    /**
+     * @brief IPIDs of owners from before a restart that have not reconnected yet.
+     */
+    QStringList m_restored_owners;
+
+    /**
+     * @brief IPIDs of invited clients from before a restart that have not reconnected yet.
+     */
+    QStringList m_restored_invited;
+
   private slots:
     /**
      * @brief Allow game messages to be broadcasted.
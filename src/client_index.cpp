@@ -0,0 +1,85 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#include "client_index.h"
+
+#include "aoclient.h"
+
+void ClientIndex::insert(AOClient *f_client)
+{
+    m_by_ipid[f_client->getIpid()].append(f_client);
+    m_by_ip[f_client->m_remote_ip].append(f_client);
+    insertHwid(f_client);
+}
+
+void ClientIndex::insertHwid(AOClient *f_client)
+{
+    const QString l_hwid = f_client->getHwid();
+    if (l_hwid.isEmpty()) {
+        return;
+    }
+    QList<AOClient *> &l_clients = m_by_hwid[l_hwid];
+    if (!l_clients.contains(f_client)) {
+        l_clients.append(f_client);
+    }
+}
+
+void ClientIndex::remove(AOClient *f_client)
+{
+    erase(m_by_ipid, f_client->getIpid(), f_client);
+    erase(m_by_ip, f_client->m_remote_ip, f_client);
+    const QString l_hwid = f_client->getHwid();
+    if (!l_hwid.isEmpty()) {
+        erase(m_by_hwid, l_hwid, f_client);
+    }
+}
+
+const QList<AOClient *> &ClientIndex::byIpid(const QString &f_ipid) const
+{
+    return find(m_by_ipid, f_ipid);
+}
+
+const QList<AOClient *> &ClientIndex::byHwid(const QString &f_hwid) const
+{
+    return find(m_by_hwid, f_hwid);
+}
+
+const QList<AOClient *> &ClientIndex::byIp(const QHostAddress &f_ip) const
+{
+    return find(m_by_ip, f_ip);
+}
+
+template <typename Key>
+const QList<AOClient *> &ClientIndex::find(const QHash<Key, QList<AOClient *>> &f_index, const Key &f_key)
+{
+    static const QList<AOClient *> l_none;
+    auto l_it = f_index.constFind(f_key);
+    return l_it == f_index.cend() ? l_none : l_it.value();
+}
+
+template <typename Key>
+void ClientIndex::erase(QHash<Key, QList<AOClient *>> &f_index, const Key &f_key, AOClient *f_client)
+{
+    auto l_it = f_index.find(f_key);
+    if (l_it == f_index.end()) {
+        return;
+    }
+    l_it.value().removeOne(f_client);
+    if (l_it.value().isEmpty()) {
+        f_index.erase(l_it);
+    }
+}
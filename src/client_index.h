@@ -0,0 +1,86 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#ifndef CLIENT_INDEX_H
+#define CLIENT_INDEX_H
+
+#include <QHash>
+#include <QHostAddress>
+#include <QList>
+#include <QString>
+
+class AOClient;
+
+/**
+ * @brief Looks up connected clients by IPID, HWID and remote IP without walking every client.
+ *
+ * @details Lookups return a reference into the index. It stays valid until the index changes, which happens
+ * whenever a client connects, identifies itself or disconnects. Copy the list before acting on the clients in a
+ * way that may disconnect them, like kicking or banning.
+ */
+class ClientIndex
+{
+  public:
+    /**
+     * @brief Indexes a new client by its IPID and remote IP, and by its HWID if it is already known.
+     */
+    void insert(AOClient *f_client);
+
+    /**
+     * @brief Indexes a client by its HWID once it sent one.
+     */
+    void insertHwid(AOClient *f_client);
+
+    /**
+     * @brief Removes a client from every index.
+     */
+    void remove(AOClient *f_client);
+
+    /**
+     * @brief Returns the clients with the given IPID.
+     */
+    const QList<AOClient *> &byIpid(const QString &f_ipid) const;
+
+    /**
+     * @brief Returns the clients with the given HWID.
+     */
+    const QList<AOClient *> &byHwid(const QString &f_hwid) const;
+
+    /**
+     * @brief Returns the clients connected from the given address.
+     */
+    const QList<AOClient *> &byIp(const QHostAddress &f_ip) const;
+
+  private:
+    /**
+     * @brief Returns the entry of a key, or an empty list.
+     */
+    template <typename Key>
+    static const QList<AOClient *> &find(const QHash<Key, QList<AOClient *>> &f_index, const Key &f_key);
+
+    /**
+     * @brief Removes a client from the entry of a key, dropping the entry once it is empty.
+     */
+    template <typename Key>
+    static void erase(QHash<Key, QList<AOClient *>> &f_index, const Key &f_key, AOClient *f_client);
+
+    QHash<QString, QList<AOClient *>> m_by_ipid;
+    QHash<QString, QList<AOClient *>> m_by_hwid;
+    QHash<QHostAddress, QList<AOClient *>> m_by_ip;
+};
+
+#endif // CLIENT_INDEX_H
@@ -0,0 +1,339 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#include "cluster_bus.h"
+#include "crypto_helper.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QJsonDocument>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QMessageAuthenticationCode>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QtEndian>
+
+namespace {
+// Compares two digests without stopping at the first difference, so the time taken does not tell how much matched.
+bool digestsEqual(const QByteArray &f_left, const QByteArray &f_right)
+{
+    if (f_left.size() != f_right.size()) {
+        return false;
+    }
+    char l_difference = 0;
+    for (qsizetype i = 0; i < f_left.size(); ++i) {
+        l_difference |= f_left[i] ^ f_right[i];
+    }
+    return l_difference == 0;
+}
+
+// The message counter as it goes into an HMAC.
+QByteArray counterBytes(quint64 f_counter)
+{
+    QByteArray l_bytes(sizeof(quint64), Qt::Uninitialized);
+    qToBigEndian(f_counter, l_bytes.data());
+    return l_bytes;
+}
+} // namespace
+
+ClusterBus::ClusterBus(const QString &f_node_name, const QString &f_address, const QString &f_secret, QObject *parent) :
+    QObject(parent),
+    m_node_name(f_node_name),
+    m_address(f_address),
+    m_secret(f_secret.toUtf8()),
+    m_host_lock(hostLockPath(f_address))
+{
+    // A lock left by a node that crashed is recognised by its process being gone, never by its age.
+    m_host_lock.setStaleLockTime(0);
+    if (isTcpAddress(f_address)) {
+        const qsizetype l_separator = f_address.lastIndexOf(':');
+        m_address = f_address.left(l_separator);
+        m_port = f_address.mid(l_separator + 1).toInt();
+    }
+
+    m_retry_timer = new QTimer(this);
+    m_retry_timer->setSingleShot(true);
+    m_retry_timer->setInterval(RETRY_INTERVAL);
+    connect(m_retry_timer, &QTimer::timeout, this, &ClusterBus::join);
+}
+
+bool ClusterBus::start()
+{
+    if (m_port != 0 && m_secret.isEmpty()) {
+        qCritical() << "[Cluster]"
+                    << "a secret is required to use the bus over TCP";
+        return false;
+    }
+    join();
+    return true;
+}
+
+bool ClusterBus::isTcpAddress(const QString &f_address)
+{
+    const qsizetype l_separator = f_address.lastIndexOf(':');
+    if (l_separator == -1) {
+        return false;
+    }
+    bool ok;
+    const int l_port = f_address.mid(l_separator + 1).toInt(&ok);
+    return ok && l_port > 0 && l_port <= 65535;
+}
+
+void ClusterBus::publish(const QString &f_type, const QJsonObject &f_payload)
+{
+    const QJsonObject l_message{{"node", m_node_name}, {"type", f_type}, {"payload", f_payload}};
+    const QByteArray l_json = QJsonDocument(l_message).toJson(QJsonDocument::Compact);
+    for (auto l_peer = m_peers.cbegin(); l_peer != m_peers.cend(); ++l_peer) {
+        if (l_peer->authenticated) {
+            send(l_peer.key(), l_json);
+        }
+    }
+}
+
+bool ClusterBus::isHub() const
+{
+    return m_local_server != nullptr || m_tcp_server != nullptr;
+}
+
+QString ClusterBus::nodeName() const
+{
+    return m_node_name;
+}
+
+void ClusterBus::join()
+{
+    if (m_port != 0) {
+        QTcpSocket *l_socket = new QTcpSocket(this);
+        connect(l_socket, &QTcpSocket::connected, this, [this, l_socket] { addPeer(l_socket); });
+        connect(l_socket, &QTcpSocket::disconnected, this, [this, l_socket] { removePeer(l_socket); });
+        connect(l_socket, &QTcpSocket::errorOccurred, this, [this, l_socket] { joinFailed(l_socket); });
+        l_socket->connectToHost(m_address, m_port);
+    }
+    else {
+        QLocalSocket *l_socket = new QLocalSocket(this);
+        connect(l_socket, &QLocalSocket::connected, this, [this, l_socket] { addPeer(l_socket); });
+        connect(l_socket, &QLocalSocket::disconnected, this, [this, l_socket] { removePeer(l_socket); });
+        connect(l_socket, &QLocalSocket::errorOccurred, this, [this, l_socket] { joinFailed(l_socket); });
+        l_socket->connectToServer(m_address);
+    }
+}
+
+bool ClusterBus::host()
+{
+    if (m_port != 0) {
+        // Only nodes on the machine owning this address can host, the others keep trying to join.
+        const QHostAddress l_bind_address(m_address);
+        if (l_bind_address.isNull()) {
+            return false;
+        }
+        m_tcp_server = new QTcpServer(this);
+        connect(m_tcp_server, &QTcpServer::newConnection, this, [this] {
+            while (QTcpSocket *l_socket = m_tcp_server->nextPendingConnection()) {
+                connect(l_socket, &QTcpSocket::disconnected, this, [this, l_socket] { removePeer(l_socket); });
+                addPeer(l_socket);
+            }
+        });
+        if (!m_tcp_server->listen(l_bind_address, m_port)) {
+            qWarning() << "[Cluster]"
+                       << "unable to host the bus:" << m_tcp_server->errorString();
+            delete m_tcp_server;
+            m_tcp_server = nullptr;
+            return false;
+        }
+    }
+    else {
+        // Nodes race to host once the previous one went away. Only the winner of the lock may touch the socket.
+        if (!m_host_lock.tryLock(0)) {
+            return false;
+        }
+        // Nobody holds the lock, so whatever is left of the socket belongs to a node that crashed.
+        QLocalServer::removeServer(m_address);
+        m_local_server = new QLocalServer(this);
+        // Other users on the machine may not even connect.
+        m_local_server->setSocketOptions(QLocalServer::UserAccessOption);
+        connect(m_local_server, &QLocalServer::newConnection, this, [this] {
+            while (QLocalSocket *l_socket = m_local_server->nextPendingConnection()) {
+                connect(l_socket, &QLocalSocket::disconnected, this, [this, l_socket] { removePeer(l_socket); });
+                addPeer(l_socket);
+            }
+        });
+        if (!m_local_server->listen(m_address)) {
+            qWarning() << "[Cluster]"
+                       << "unable to host the bus:" << m_local_server->errorString();
+            delete m_local_server;
+            m_local_server = nullptr;
+            m_host_lock.unlock();
+            return false;
+        }
+    }
+    qInfo() << "[Cluster]" << m_node_name << "is hosting the bus";
+    return true;
+}
+
+QString ClusterBus::hostLockPath(const QString &f_address)
+{
+    // QLocalServer puts sockets with a plain name into the temporary directory.
+    const QString l_socket = QDir::isAbsolutePath(f_address) ? f_address : QDir::temp().filePath(f_address);
+    return l_socket + ".lock";
+}
+
+void ClusterBus::joinFailed(QIODevice *f_socket)
+{
+    // Errors on an established connection are followed by a disconnect, which is handled there.
+    if (m_peers.contains(f_socket)) {
+        return;
+    }
+    f_socket->deleteLater();
+    if (!isHub() && !host()) {
+        m_retry_timer->start();
+    }
+}
+
+void ClusterBus::addPeer(QIODevice *f_peer)
+{
+    Peer l_state;
+    l_state.local_nonce = CryptoHelper::randbytes(NONCE_LENGTH);
+    m_peers.insert(f_peer, l_state);
+    connect(f_peer, &QIODevice::readyRead, this, [this, f_peer] { readPeer(f_peer); });
+    f_peer->write(QJsonDocument(QJsonObject{{"nonce", QString::fromLatin1(l_state.local_nonce.toHex())}}).toJson(QJsonDocument::Compact) + '\n');
+
+    QTimer::singleShot(HANDSHAKE_TIMEOUT, f_peer, [this, f_peer] {
+        if (m_peers.contains(f_peer) && !m_peers.value(f_peer).authenticated) {
+            reject(f_peer, "did not authenticate in time");
+        }
+    });
+}
+
+void ClusterBus::removePeer(QIODevice *f_peer)
+{
+    if (!m_peers.remove(f_peer)) {
+        return;
+    }
+    f_peer->deleteLater();
+    if (!isHub()) {
+        qWarning() << "[Cluster]"
+                   << "lost the connection to the bus, retrying";
+        m_retry_timer->start();
+    }
+}
+
+void ClusterBus::readPeer(QIODevice *f_peer)
+{
+    while (f_peer->canReadLine()) {
+        auto l_state = m_peers.find(f_peer);
+        if (l_state == m_peers.end()) {
+            return;
+        }
+        const QByteArray l_line = f_peer->readLine().chopped(1);
+        if (!l_state->authenticated) {
+            if (!handshake(f_peer, *l_state, l_line)) {
+                return;
+            }
+            continue;
+        }
+
+        // "<hex hmac> <json>"
+        const qsizetype l_separator = l_line.indexOf(' ');
+        const QByteArray l_json = l_line.mid(l_separator + 1);
+        const QByteArray l_expected = sign(l_state->local_nonce + counterBytes(l_state->received) + l_json);
+        if (l_separator == -1 || !digestsEqual(QByteArray::fromHex(l_line.left(l_separator)), l_expected)) {
+            reject(f_peer, "sent a message with an invalid signature");
+            return;
+        }
+        ++l_state->received;
+
+        if (isHub()) {
+            for (auto l_other = m_peers.cbegin(); l_other != m_peers.cend(); ++l_other) {
+                if (l_other.key() != f_peer && l_other->authenticated) {
+                    send(l_other.key(), l_json);
+                }
+            }
+        }
+
+        const QJsonObject l_message = QJsonDocument::fromJson(l_json).object();
+        const QString l_type = l_message["type"].toString();
+        if (l_type.isEmpty()) {
+            qWarning() << "[Cluster]"
+                       << "dropping malformed message";
+            continue;
+        }
+        emit messageReceived(l_message["node"].toString(), l_type, l_message["payload"].toObject());
+    }
+
+    if (f_peer->bytesAvailable() > MAX_MESSAGE_LENGTH) {
+        reject(f_peer, "sent an oversized message");
+    }
+}
+
+bool ClusterBus::handshake(QIODevice *f_peer, Peer &f_state, const QByteArray &f_line)
+{
+    const QJsonObject l_message = QJsonDocument::fromJson(f_line).object();
+
+    // First the nonce of the other side, which is answered with our proof.
+    if (f_state.remote_nonce.isEmpty()) {
+        f_state.remote_nonce = QByteArray::fromHex(l_message["nonce"].toString().toLatin1());
+        if (f_state.remote_nonce.size() != NONCE_LENGTH) {
+            reject(f_peer, "sent an invalid nonce");
+            return false;
+        }
+        const QByteArray l_proof = proof(isHub(), f_state.remote_nonce);
+        f_peer->write(QJsonDocument(QJsonObject{{"proof", QString::fromLatin1(l_proof.toHex())}}).toJson(QJsonDocument::Compact) + '\n');
+        return true;
+    }
+
+    // Then its proof of our nonce. It has to be made by the other side of the connection.
+    const QByteArray l_proof = QByteArray::fromHex(l_message["proof"].toString().toLatin1());
+    if (!digestsEqual(l_proof, proof(!isHub(), f_state.local_nonce))) {
+        reject(f_peer, "does not know the cluster secret");
+        return false;
+    }
+    f_state.authenticated = true;
+    if (!isHub()) {
+        qInfo() << "[Cluster]" << m_node_name << "joined the bus";
+    }
+    return true;
+}
+
+void ClusterBus::send(QIODevice *f_peer, const QByteArray &f_message)
+{
+    auto l_state = m_peers.find(f_peer);
+    if (l_state == m_peers.end()) {
+        return;
+    }
+    const QByteArray l_signature = sign(l_state->remote_nonce + counterBytes(l_state->sent) + f_message);
+    ++l_state->sent;
+    f_peer->write(l_signature.toHex() + ' ' + f_message + '\n');
+}
+
+void ClusterBus::reject(QIODevice *f_peer, const char *f_reason)
+{
+    qWarning() << "[Cluster]"
+               << "closing a connection that" << f_reason;
+    f_peer->close();
+}
+
+QByteArray ClusterBus::sign(const QByteArray &f_data) const
+{
+    return QMessageAuthenticationCode::hash(f_data, m_secret, QCryptographicHash::Sha256);
+}
+
+QByteArray ClusterBus::proof(bool f_hub, const QByteArray &f_nonce) const
+{
+    return sign((f_hub ? QByteArrayLiteral("akashi-cluster-hub") : QByteArrayLiteral("akashi-cluster-node")) + f_nonce);
+}
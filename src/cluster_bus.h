@@ -0,0 +1,250 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#ifndef CLUSTER_BUS_H
+#define CLUSTER_BUS_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QJsonObject>
+#include <QLockFile>
+#include <QObject>
+#include <QString>
+
+class QIODevice;
+class QLocalServer;
+class QTcpServer;
+class QTimer;
+
+/**
+ * @brief A message bus connecting several akashi processes.
+ *
+ * @details The first node to start hosts the bus and relays every message it receives to all other nodes. The others
+ * connect to it. If the hosting node goes away, the remaining nodes elect a new host by racing to listen on the
+ * address again. Over a local socket, the race is decided by a lock file next to the socket that the host holds for
+ * as long as it runs, so a losing node never removes the socket of the winner.
+ *
+ * Messages are JSON objects, one per line, carrying the name of the sending node, a type and a payload.
+ *
+ * Nodes prove to each other that they know the shared secret before anything else is exchanged. Each side sends a
+ * random nonce and answers the nonce of the other side with an HMAC of it, keyed with the secret and labelled with the
+ * side it was made by, so a proof cannot be reflected back. Every message afterwards carries an HMAC over the nonce of
+ * the receiving side, a per-connection message counter and the message, which rules out forged and replayed messages.
+ * The host checks every message before relaying it and signs it again for each receiver.
+ */
+class ClusterBus : public QObject
+{
+    Q_OBJECT
+
+  public:
+    /**
+     * @brief Creates a bus endpoint. Nothing is opened until start() is called.
+     *
+     * @param f_node_name The name of this node, sent along with every message.
+     * @param f_address A local socket name, or `host:port` to use TCP.
+     * @param f_secret The secret shared by all nodes. May only be empty for a local socket.
+     * @param parent Qt-based parent.
+     */
+    ClusterBus(const QString &f_node_name, const QString &f_address, const QString &f_secret, QObject *parent = nullptr);
+
+    /**
+     * @brief Joins the bus, or hosts it if no other node does.
+     *
+     * @return False if the bus cannot be used, because TCP was requested without a secret.
+     */
+    bool start();
+
+    /**
+     * @brief Returns true if the address is `host:port`, so the bus uses TCP.
+     */
+    static bool isTcpAddress(const QString &f_address);
+
+    /**
+     * @brief Sends a message to every other node.
+     *
+     * @details Messages published while the bus is not connected are dropped.
+     *
+     * @param f_type The type of the message.
+     * @param f_payload The content of the message.
+     */
+    void publish(const QString &f_type, const QJsonObject &f_payload);
+
+    /**
+     * @brief Returns true if this node hosts the bus.
+     */
+    bool isHub() const;
+
+    /**
+     * @brief Returns the name of this node.
+     */
+    QString nodeName() const;
+
+  signals:
+    /**
+     * @brief Emitted when another node published a message.
+     *
+     * @param f_node The name of the node the message came from.
+     * @param f_type The type of the message.
+     * @param f_payload The content of the message.
+     */
+    void messageReceived(const QString &f_node, const QString &f_type, const QJsonObject &f_payload);
+
+  private:
+    /**
+     * @brief Delay before trying to join again after losing the connection to the host, in milliseconds.
+     */
+    static constexpr int RETRY_INTERVAL = 5000;
+
+    /**
+     * @brief Longest message accepted from another node, in bytes.
+     */
+    static constexpr qint64 MAX_MESSAGE_LENGTH = 1 << 20;
+
+    /**
+     * @brief Time a new connection has to prove it knows the secret, in milliseconds.
+     */
+    static constexpr int HANDSHAKE_TIMEOUT = 10000;
+
+    /**
+     * @brief Length of the nonce each side of a connection sends, in bytes.
+     */
+    static constexpr int NONCE_LENGTH = 32;
+
+    /**
+     * @brief The authentication state of a connection to another node.
+     */
+    struct Peer
+    {
+        QByteArray local_nonce;  //!< The nonce sent to the other node. Its proof and messages are checked against it.
+        QByteArray remote_nonce; //!< The nonce the other node sent. Our proof and messages are made with it.
+        quint64 received = 0;    //!< Number of messages received, part of the next expected HMAC.
+        quint64 sent = 0;        //!< Number of messages sent, part of the next HMAC.
+        bool authenticated = false;
+    };
+    /**
+     * @brief Tries to connect to the node hosting the bus.
+     */
+    void join();
+
+    /**
+     * @brief Starts hosting the bus.
+     *
+     * @return False if another node was faster.
+     */
+    bool host();
+
+    /**
+     * @brief Returns the path of the lock file deciding which node hosts a local socket.
+     */
+    static QString hostLockPath(const QString &f_address);
+
+    /**
+     * @brief Handles a connection attempt that failed, by hosting the bus instead.
+     */
+    void joinFailed(QIODevice *f_socket);
+
+    /**
+     * @brief Starts exchanging messages over an established connection.
+     */
+    void addPeer(QIODevice *f_peer);
+
+    /**
+     * @brief Forgets a closed connection. A node that lost its host tries to join again.
+     */
+    void removePeer(QIODevice *f_peer);
+
+    /**
+     * @brief Reads and dispatches every complete message a peer sent.
+     */
+    void readPeer(QIODevice *f_peer);
+
+    /**
+     * @brief Handles a line sent before the peer was authenticated.
+     *
+     * @return False if the peer failed to authenticate.
+     */
+    bool handshake(QIODevice *f_peer, Peer &f_state, const QByteArray &f_line);
+
+    /**
+     * @brief Signs a message for a peer and sends it.
+     */
+    void send(QIODevice *f_peer, const QByteArray &f_message);
+
+    /**
+     * @brief Closes the connection to a peer that broke the protocol.
+     */
+    void reject(QIODevice *f_peer, const char *f_reason);
+
+    /**
+     * @brief Returns the HMAC-SHA256 of the data, keyed with the shared secret.
+     */
+    QByteArray sign(const QByteArray &f_data) const;
+
+    /**
+     * @brief Returns the proof of knowing the secret that one side sends in answer to a nonce.
+     *
+     * @param f_hub True for the proof made by the host of the bus.
+     */
+    QByteArray proof(bool f_hub, const QByteArray &f_nonce) const;
+
+    /**
+     * @brief The name of this node.
+     */
+    QString m_node_name;
+
+    /**
+     * @brief The local socket name, or the host for TCP.
+     */
+    QString m_address;
+
+    /**
+     * @brief The TCP port, or 0 to use a local socket.
+     */
+    quint16 m_port = 0;
+
+    /**
+     * @brief The secret shared by all nodes, as UTF-8.
+     */
+    QByteArray m_secret;
+
+    /**
+     * @brief Accepts other nodes while hosting over a local socket.
+     */
+    QLocalServer *m_local_server = nullptr;
+
+    /**
+     * @brief Held while hosting over a local socket. Only the node holding it may remove and listen on the socket.
+     */
+    QLockFile m_host_lock;
+
+    /**
+     * @brief Accepts other nodes while hosting over TCP.
+     */
+    QTcpServer *m_tcp_server = nullptr;
+
+    /**
+     * @brief The connected nodes while hosting, otherwise only the connection to the host.
+     */
+    QHash<QIODevice *, Peer> m_peers;
+
+    /**
+     * @brief Schedules the next attempt to join.
+     */
+    QTimer *m_retry_timer;
+};
+
+#endif // CLUSTER_BUS_H
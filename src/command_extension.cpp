@@ -109,16 +109,7 @@ QList<CommandExtension> CommandExtensionCollection::getExtensions() const
 
 bool CommandExtensionCollection::containsExtension(QString f_command_name) const
 {
-    if (m_extensions.contains(f_command_name)) {
-        return true;
-    }
-
-    for (const CommandExtension &i_extension : m_extensions) {
-        if (i_extension.checkCommandNameAndAlias(f_command_name)) {
-            return true;
-        }
-    }
-    return false;
+    return m_extensions.contains(f_command_name) || m_alias_index.contains(f_command_name.toLower());
 }
 
 CommandExtension CommandExtensionCollection::getExtension(QString f_command_name) const
@@ -126,13 +117,7 @@ CommandExtension CommandExtensionCollection::getExtension(QString f_command_name
     if (m_extensions.contains(f_command_name)) {
         return m_extensions.value(f_command_name);
     }
-
-    for (const CommandExtension &i_extension : m_extensions) {
-        if (i_extension.checkCommandNameAndAlias(f_command_name)) {
-            return i_extension;
-        }
-    }
-    return CommandExtension();
+    return m_extensions.value(m_alias_index.value(f_command_name.toLower()));
 }
 
 bool CommandExtensionCollection::loadFile(QString f_filename)
@@ -145,6 +130,7 @@ bool CommandExtensionCollection::loadFile(QString f_filename)
     }
 
     m_extensions.clear();
+    m_alias_index.clear();
     QStringList l_alias_records;
     QStringList l_command_records;
     const QStringList l_group_list = l_settings.childGroups();
@@ -187,5 +173,15 @@ bool CommandExtensionCollection::loadFile(QString f_filename)
         l_settings.endGroup();
     }
 
+    // An alias may still shadow the name of another command, in which case the first extension by name keeps it.
+    for (const CommandExtension &i_extension : qAsConst(m_extensions)) {
+        const QStringList l_names = QStringList{i_extension.getCommandName()} + i_extension.getAliases();
+        for (const QString &i_name : l_names) {
+            if (!m_alias_index.contains(i_name)) {
+                m_alias_index.insert(i_name, i_extension.getCommandName());
+            }
+        }
+    }
+
     return true;
 }
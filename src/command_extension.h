@@ -1,6 +1,7 @@
 #ifndef COMMAND_EXTENSION_H
 #define COMMAND_EXTENSION_H
 
+#include <QHash>
 #include <QMap>
 #include <QObject>
 #include <QString>
@@ -197,6 +198,11 @@ class CommandExtensionCollection : public QObject
      * @brief A map of extensions associated to a command name.
      */
     QMap<QString, CommandExtension> m_extensions;
+
+    /**
+     * @brief Maps the name and every alias of each extension to the name of the extended command.
+     */
+    QHash<QString, QString> m_alias_index;
 };
 
 #endif // COMMAND_EXTENSION_H
@@ -543,7 +543,7 @@ void AOClient::cmdWebfiles(int argc, QStringList argv)
             continue;
         }
 
-        if (l_client->character().toLower() != l_client->m_current_iniswap.toLower()) {
+        if (l_client->characterKey() != l_client->m_current_iniswap_key) {
             l_weblinks.append("https://attorneyonline.github.io/webDownloader/index.html?char=" + l_client->m_current_iniswap);
         }
     }
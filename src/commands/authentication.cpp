@@ -80,6 +80,7 @@ void AOClient::cmdSetRootPass(int argc, QStringList argv)
     sendServerMessage("Changing auth type and setting root password.\nLogin again with /login root [password]");
     m_authenticated = false;
     ConfigManager::setAuthType(DataTypes::AuthType::ADVANCED);
+    updatePermissions();
 
     QByteArray l_salt = CryptoHelper::randbytes(16);
 
@@ -204,7 +205,10 @@ void AOClient::cmdLogout(int argc, QStringList argv)
     }
     m_authenticated = false;
     m_acl_role_id = "";
-    m_moderator_name = "";
+    if (m_cold) {
+        m_cold->moderator_name.clear();
+    }
+    updatePermissions();
     sendPacket("AUTH", {"-1"}); // Client: "You were logged out."
 }
 
@@ -213,11 +217,11 @@ void AOClient::cmdChangePassword(int argc, QStringList argv)
     QString l_username;
     QString l_password = argv[0];
     if (argc == 1) {
-        if (m_moderator_name.isEmpty()) {
+        if (cold().moderator_name.isEmpty()) {
             sendServerMessage("You do not have permission to use that command. You must be logged in.");
             return;
         }
-        l_username = m_moderator_name;
+        l_username = cold().moderator_name;
     }
     else if (argc == 2) {
 
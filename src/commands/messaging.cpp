@@ -466,27 +466,27 @@ void AOClient::cmdCharCurse(int argc, QStringList argv)
     }
 
     if (argc == 1) {
-        l_target->m_charcurse_list.append(server->getCharID(l_target->character()));
+        l_target->editCold().charcurse_list.append(server->getCharID(l_target->character()));
     }
     else {
         argv.removeFirst();
         QStringList l_char_names = argv.join(" ").split(",");
 
-        l_target->m_charcurse_list.clear();
+        l_target->editCold().charcurse_list.clear();
         for (const QString &l_char_name : qAsConst(l_char_names)) {
             int char_id = server->getCharID(l_char_name);
             if (char_id == -1) {
                 sendServerMessage("Could not find character: " + l_char_name);
                 return;
             }
-            l_target->m_charcurse_list.append(char_id);
+            l_target->editCold().charcurse_list.append(char_id);
         }
     }
 
     l_target->m_is_charcursed = true;
 
     // Kick back to char select screen
-    if (!l_target->m_charcurse_list.contains(server->getCharID(l_target->character()))) {
+    if (!l_target->cold().charcurse_list.contains(server->getCharID(l_target->character()))) {
         l_target->changeCharacter(-1);
         server->updateCharsTaken(server->getAreaById(areaId()));
         l_target->sendPacket("DONE");
@@ -522,7 +522,7 @@ void AOClient::cmdUnCharCurse(int argc, QStringList argv)
         return;
     }
     l_target->m_is_charcursed = false;
-    l_target->m_charcurse_list.clear();
+    l_target->editCold().charcurse_list.clear();
     server->updateCharsTaken(server->getAreaById(areaId()));
     sendServerMessage("Uncharcursed player.");
     l_target->sendServerMessage("You were uncharcursed.");
@@ -21,8 +21,14 @@
 #include "command_extension.h"
 #include "config_manager.h"
 #include "db_manager.h"
+#include "logger/writer_archive.h"
 #include "server.h"
 
+#include <QElapsedTimer>
+#include <QMetaEnum>
+#include <QSharedPointer>
+#include <QThread>
+
 // This file is for commands under the moderation category in aoclient.h
 // Be sure to register the command in the header before adding it here!
 
@@ -59,7 +65,7 @@ void AOClient::cmdBan(int argc, QStringList argv)
         l_ban.moderator = "moderator";
         break;
     case DataTypes::AuthType::ADVANCED:
-        l_ban.moderator = m_moderator_name;
+        l_ban.moderator = cold().moderator_name;
         break;
     }
 
@@ -97,6 +103,7 @@ void AOClient::cmdBan(int argc, QStringList argv)
         server->getDatabaseManager()->addBan(l_ban);
         sendServerMessage("Banned " + l_ban.ipid + " for reason: " + l_ban.reason);
     }
+    server->clusterBan(l_ban);
 }
 
 void AOClient::cmdKick(int argc, QStringList argv)
@@ -120,15 +127,18 @@ void AOClient::cmdKick(int argc, QStringList argv)
 
     if (l_kick_counter > 0) {
         if (ConfigManager::authType() == DataTypes::AuthType::ADVANCED) {
-            emit logKick(m_moderator_name, l_target_ipid, l_reason);
+            emit logKick(cold().moderator_name, l_target_ipid, l_reason);
         }
         else {
             emit logKick("Moderator", l_target_ipid, l_reason);
         }
         sendServerMessage("Kicked " + QString::number(l_kick_counter) + " client(s) with ipid " + l_target_ipid + " for reason: " + l_reason);
     }
+    else if (server->isClustered())
+        sendServerMessage("User with ipid not found on this server, the kick was sent to the rest of the cluster.");
     else
         sendServerMessage("User with ipid not found!");
+    server->clusterKick(l_target_ipid, l_reason);
 }
 
 void AOClient::cmdMods(int argc, QStringList argv)
@@ -143,7 +153,7 @@ void AOClient::cmdMods(int argc, QStringList argv)
         if (l_client->m_authenticated) {
             l_entries << "---";
             if (ConfigManager::authType() != DataTypes::AuthType::SIMPLE) {
-                l_entries << "Moderator: " + l_client->m_moderator_name;
+                l_entries << "Moderator: " + l_client->cold().moderator_name;
                 l_entries << "Role:" << l_client->m_acl_role_id;
             }
             l_entries << "OOC name: " + l_client->name();
@@ -312,8 +322,14 @@ void AOClient::cmdUnBan(int argc, QStringList argv)
         sendServerMessage("Invalid ban ID.");
         return;
     }
-    else if (server->getDatabaseManager()->invalidateBan(l_target_ban))
+
+    const QList<DBManager::BanInfo> l_bans = server->getDatabaseManager()->getBanInfo("banid", argv[0]);
+    if (server->getDatabaseManager()->invalidateBan(l_target_ban)) {
+        for (const DBManager::BanInfo &l_ban : l_bans) {
+            server->clusterUnban(l_ban);
+        }
         sendServerMessage("Successfully invalidated ban " + argv[0] + ".");
+    }
     else
         sendServerMessage("Couldn't invalidate ban " + argv[0] + ", are you sure it exists?");
 }
@@ -545,14 +561,92 @@ void AOClient::cmdBanInfo(int argc, QStringList argv)
     sendServerMessage(l_ban_info.join("\n"));
 }
 
+void AOClient::cmdSearchLog(int argc, QStringList argv)
+{
+    WriterArchive::IndexKey l_key;
+    QString l_lookup_type = argv[0].toLower();
+    if (l_lookup_type == "ipid")
+        l_key = WriterArchive::IndexKey::IPID;
+    else if (l_lookup_type == "hwid")
+        l_key = WriterArchive::IndexKey::HWID;
+    else if (l_lookup_type == "area")
+        l_key = WriterArchive::IndexKey::AREA;
+    else {
+        sendServerMessage("Invalid ID type.");
+        return;
+    }
+
+    if (!ConfigManager::logArchiveEnabled()) {
+        sendServerMessage("The log archive is disabled on this server.");
+        return;
+    }
+
+    if (cold().log_search != nullptr) {
+        sendServerMessage("Your previous search is still running.");
+        return;
+    }
+
+    // The day count has to be marked explicitly, as area names may end in a number.
+    int l_value_start = 1;
+    int l_days = 7;
+    if (argv[1].startsWith("days=", Qt::CaseInsensitive)) {
+        bool ok;
+        l_days = argv[1].mid(5).toInt(&ok);
+        if (!ok || l_days < 1 || l_days > WriterArchive::MAX_SEARCH_DAYS) {
+            sendServerMessage("Invalid amount of days. Up to " + QString::number(WriterArchive::MAX_SEARCH_DAYS) + " days can be searched.");
+            return;
+        }
+        l_value_start = 2;
+    }
+    const QString l_value = argv.mid(l_value_start, argc - l_value_start).join(" ");
+    if (l_value.isEmpty()) {
+        sendServerMessage("Invalid command syntax.");
+        return;
+    }
+
+    // Reading the archive can take a while on a cold disk, so it is done off the game thread.
+    const int l_limit = 100;
+    const qint64 l_since = QDateTime::currentDateTimeUtc().addDays(-l_days).toMSecsSinceEpoch();
+    auto l_entries = QSharedPointer<QList<WriterArchive::Entry>>::create();
+    QElapsedTimer l_timer;
+    l_timer.start();
+    QThread *l_search = QThread::create([=] {
+        *l_entries = WriterArchive::search(l_key, l_value, l_since, l_limit);
+    });
+    // The client owns the thread. If it disconnects first, its destructor waits for the search and deletes it.
+    connect(l_search, &QThread::finished, this, [=, this] {
+        editCold().log_search = nullptr;
+        l_search->deleteLater();
+        QStringList l_result;
+        l_result << QString("Log archive for %1 %2 in the last %3 day(s): %4 result(s) in %5 ms")
+                        .arg(l_lookup_type, l_value, QString::number(l_days), QString::number(l_entries->size()),
+                             QString::number(l_timer.elapsed()));
+        if (l_entries->size() == l_limit)
+            l_result << "Only the newest " + QString::number(l_limit) + " results are shown.";
+        l_result << "-----";
+        const QMetaEnum l_types = QMetaEnum::fromType<WriterArchive::EntryType>();
+        for (const WriterArchive::Entry &l_entry : qAsConst(*l_entries)) {
+            l_result << QString("[%1][%2][%3][%4][%5(%6)] %7")
+                            .arg(QDateTime::fromMSecsSinceEpoch(l_entry.timestamp).toString("yyyy-MM-dd hh:mm:ss"), l_entry.area,
+                                 QString(l_types.valueToKey(int(l_entry.type))), l_entry.ipid, l_entry.char_name, l_entry.ooc_name,
+                                 l_entry.message);
+        }
+        sendServerMessage(l_result.join("\n"));
+    });
+    editCold().log_search = l_search;
+    l_search->start();
+}
+
 void AOClient::cmdReload(int argc, QStringList argv)
 {
     Q_UNUSED(argc);
     Q_UNUSED(argv);
 
     // Todo: Make this a signal when splitting AOClient and Server.
-    server->reloadSettings();
-    sendServerMessage("Reloaded configurations");
+    // The result is reported once the files have been read.
+    if (!server->reloadSettings(m_id)) {
+        sendServerMessage("A reload is already in progress.");
+    }
 }
 
 void AOClient::cmdForceImmediate(int argc, QStringList argv)
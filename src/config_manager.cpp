@@ -16,6 +16,7 @@
 //    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
 //////////////////////////////////////////////////////////////////////////////////////
 #include "config_manager.h"
+#include "cluster_bus.h"
 #include <QSqlDatabase>
 #include <QSqlQuery>
 
@@ -28,6 +29,7 @@ ConfigManager::CommandSettings *ConfigManager::m_commands = new CommandSettings(
 MusicList *ConfigManager::m_musicList = new MusicList;
 QHash<QString, ConfigManager::help> *ConfigManager::m_commands_help = new QHash<QString, ConfigManager::help>;
 QStringList *ConfigManager::m_ordered_list = new QStringList;
+QVariantHash ConfigManager::m_runtime_changes;
 
 bool ConfigManager::verifyServerConfig()
 {
@@ -83,53 +85,14 @@ bool ConfigManager::verifyServerConfig()
     }
 
     // Verify config settings
-    m_settings->beginGroup("Options");
-    bool ok;
-    m_settings->value("ms_port", 27016).toInt(&ok);
-    if (!ok) {
-        qCritical("ms_port is not a valid port!");
-        return false;
-    }
-    m_settings->value("port", 27016).toInt(&ok);
-    if (!ok) {
-        qCritical("port is not a valid port!");
-        return false;
-    }
-    m_settings->value("secure_port", -1).toInt(&ok);
-    if (!ok) {
-        qCritical("secure_port is not a valid port!");
-        return false;
-    }
-
-    QString l_auth = m_settings->value("auth", "simple").toString().toLower();
-    if (!(l_auth == "simple" || l_auth == "advanced")) {
-        qCritical("auth is not a valid auth type!");
-        return false;
-    }
-
-    int l_soft_limit = m_settings->value("packet_rate_limit_soft", 10).toInt(&ok);
-    if (!ok) {
-        qCritical("packet_rate_limit_soft is not a valid limit!");
-        return false;
-    }
-    if (l_soft_limit <= 0) {
-        qWarning("packet_rate_limit_soft is 0 or less, warning threshold is disabled!");
-    }
-
-    int l_hard_limit = m_settings->value("packet_rate_limit_hard", 20).toInt(&ok);
-    if (!ok) {
-        qCritical("packet_rate_limit_hard is not a valid limit!");
-        return false;
+    const QStringList l_problems = validateSettings(m_settings);
+    for (const QString &l_problem : l_problems) {
+        qCritical("%s", qUtf8Printable(l_problem));
     }
-    else if (l_soft_limit > 0 && l_hard_limit <= l_soft_limit) {
-        qCritical("packet_rate_limit_hard must be greater than packet_rate_limit_soft!");
+    if (!l_problems.isEmpty()) {
         return false;
     }
-    if (l_hard_limit <= 0) {
-        qWarning("packet_rate_limit_hard is 0 or less, rate limiting is disabled!");
-    }
 
-    m_settings->endGroup();
     m_commands->magic_8ball = (loadConfigFile("8ball"));
     m_commands->praises = (loadConfigFile("praise"));
     m_commands->reprimands = (loadConfigFile("reprimands"));
@@ -174,20 +137,30 @@ QStringList ConfigManager::backgrounds()
 }
 
 MusicList ConfigManager::musiclist()
+{
+    MusicList l_musiclist;
+    QStringList l_ordered;
+    QString l_error;
+    if (!parseMusiclist(l_musiclist, l_ordered, l_error)) { // Non-Terminating error.
+        qWarning() << "Unable to load musiclist. The following error was encounted : " + l_error;
+        return MusicList{}; // Server can still run without music.
+    }
+
+    *m_musicList = l_musiclist;
+    *m_ordered_list = l_ordered;
+    return *m_musicList;
+}
+
+bool ConfigManager::parseMusiclist(MusicList &f_musiclist, QStringList &f_ordered, QString &f_error)
 {
     QFile l_music_json("config/music.json");
     l_music_json.open(QIODevice::ReadOnly | QIODevice::Text);
 
     QJsonParseError l_error;
     QJsonDocument l_music_list_json = QJsonDocument::fromJson(l_music_json.readAll(), &l_error);
-    if (!(l_error.error == QJsonParseError::NoError)) { // Non-Terminating error.
-        qWarning() << "Unable to load musiclist. The following error was encounted : " + l_error.errorString();
-        return QMap<QString, QPair<QString, int>>{}; // Server can still run without music.
-    }
-
-    // Make sure the list is empty before appending new data.
-    if (!m_ordered_list->empty()) {
-        m_ordered_list->clear();
+    if (!(l_error.error == QJsonParseError::NoError)) {
+        f_error = l_error.errorString();
+        return false;
     }
 
     // Akashi expects the musiclist to be contained in a JSON array, even if its only a single category.
@@ -201,8 +174,8 @@ MusicList ConfigManager::musiclist()
         // Technically not a requirement, but neat for organisation.
         QString l_category_name = l_child_obj["category"].toString();
         if (!l_category_name.isEmpty()) {
-            m_musicList->insert(l_category_name, {l_category_name, 0});
-            m_ordered_list->append(l_category_name);
+            f_musiclist.insert(l_category_name, {l_category_name, 0});
+            f_ordered.append(l_category_name);
         }
         else {
             qWarning() << "Category name not set. This may cause the musiclist to be displayed incorrectly.";
@@ -217,13 +190,13 @@ MusicList ConfigManager::musiclist()
                 l_real_name = l_song_name;
             }
             int l_song_duration = l_song_obj["length"].toVariant().toInt();
-            m_musicList->insert(l_song_name, {l_real_name, l_song_duration});
-            m_ordered_list->append(l_song_name);
+            f_musiclist.insert(l_song_name, {l_real_name, l_song_duration});
+            f_ordered.append(l_song_name);
         }
     }
     l_music_json.close();
 
-    return *m_musicList;
+    return true;
 }
 
 QStringList ConfigManager::ordered_songs()
@@ -276,16 +249,41 @@ QSettings *ConfigManager::ambience()
     return m_ambience;
 }
 
+QList<ConfigManager::AreaConfig> ConfigManager::areaConfigs()
+{
+    const QStringList l_groups = m_areas->childGroups();
+    QList<AreaConfig> l_areas;
+    l_areas.reserve(l_groups.size());
+    for (const QString &l_group : l_groups) {
+        AreaConfig l_area;
+        l_area.group = l_group;
+        const qsizetype l_separator = l_group.indexOf(':');
+        l_area.index = l_group.left(l_separator).toInt();
+        if (l_separator != -1) {
+            l_area.name = l_group.mid(l_separator + 1);
+        }
+
+        m_areas->beginGroup(l_group);
+        const QStringList l_keys = m_areas->childKeys();
+        for (const QString &l_key : l_keys) {
+            l_area.values.insert(l_key, m_areas->value(l_key));
+        }
+        m_areas->endGroup();
+        l_areas.append(l_area);
+    }
+
+    // childGroups() sorts lexicographically, which puts "10:" before "2:".
+    std::sort(l_areas.begin(), l_areas.end(), [](const AreaConfig &a, const AreaConfig &b) { return a.index < b.index; });
+    return l_areas;
+}
+
 QStringList ConfigManager::sanitizedAreaNames()
 {
-    QStringList l_area_names = m_areas->childGroups(); // invisibly does a lexicographical sort, because Qt is great like that
-    std::sort(l_area_names.begin(), l_area_names.end(), [](const QString &a, const QString &b) { return a.split(":")[0].toInt() < b.split(":")[0].toInt(); });
+    const QList<AreaConfig> l_areas = areaConfigs();
     QStringList l_sanitized_area_names;
-    for (const QString &areaName : qAsConst(l_area_names)) {
-        QStringList l_nameSplit = areaName.split(":");
-        l_nameSplit.removeFirst();
-        QString l_area_name_sanitized = l_nameSplit.join(":");
-        l_sanitized_area_names.append(l_area_name_sanitized);
+    l_sanitized_area_names.reserve(l_areas.size());
+    for (const AreaConfig &l_area : l_areas) {
+        l_sanitized_area_names.append(l_area.name);
     }
     return l_sanitized_area_names;
 }
@@ -296,6 +294,17 @@ QStringList ConfigManager::rawAreaNames()
 }
 
 QStringList ConfigManager::iprangeBans()
+{
+    QStringList l_range_bans;
+    QString l_error;
+    if (!parseIprangeBans(l_range_bans, "ASN", l_error)) {
+        qWarning() << "Unable to parse JSON file. Error:" << l_error;
+        return {};
+    }
+    return l_range_bans;
+}
+
+bool ConfigManager::parseIprangeBans(QStringList &f_ranges, const QString &f_connection_name, QString &f_error)
 {
     QFile l_json_file("config/ipbans.json");
     l_json_file.open(QIODevice::ReadOnly | QIODevice::Text);
@@ -303,8 +312,8 @@ QStringList ConfigManager::iprangeBans()
     QJsonParseError l_error;
     QJsonDocument l_ip_bans = QJsonDocument::fromJson(l_json_file.readAll(), &l_error);
     if (l_error.error != QJsonParseError::NoError) {
-        qWarning() << "Unable to parse JSON file. Error:" << l_error.errorString();
-        return {};
+        f_error = l_error.errorString();
+        return false;
     }
 
     QJsonObject l_json_obj = l_ip_bans.object();
@@ -313,27 +322,97 @@ QStringList ConfigManager::iprangeBans()
     l_range_bans.append(l_json_obj["ip_range"].toVariant().toStringList());
 
     if (QFile::exists("storage/asn.sqlite3")) {
-        QSqlDatabase asn_db = QSqlDatabase::addDatabase("QSQLITE", "ASN");
-        asn_db.setDatabaseName("storage/asn.sqlite3");
-        asn_db.open();
-
-        // This is a dumb hack. Idk how else I can do this, but who gives a shit?
-        QSqlQuery query("SELECT ip FROM maxmind WHERE asn in (" + l_json_obj["asn"].toVariant().toStringList().join(",") + ")", asn_db);
-        query.exec();
-        while (query.next()) {
-            l_range_bans.append(query.value(0).toString());
+        {
+            QSqlDatabase asn_db = QSqlDatabase::addDatabase("QSQLITE", f_connection_name);
+            asn_db.setDatabaseName("storage/asn.sqlite3");
+            asn_db.open();
+
+            // This is a dumb hack. Idk how else I can do this, but who gives a shit?
+            QSqlQuery query("SELECT ip FROM maxmind WHERE asn in (" + l_json_obj["asn"].toVariant().toStringList().join(",") + ")", asn_db);
+            query.exec();
+            while (query.next()) {
+                l_range_bans.append(query.value(0).toString());
+            }
+            asn_db.close();
         }
-        asn_db.close();
+        // A connection can only be used by the thread that created it, so don't leave it around for the next caller.
+        QSqlDatabase::removeDatabase(f_connection_name);
     }
     l_range_bans.removeDuplicates();
-    return l_range_bans;
+    f_ranges = l_range_bans;
+    return true;
 }
 
-void ConfigManager::reloadSettings()
+QStringList ConfigManager::validateSettings(QSettings *f_settings)
 {
-    m_settings->sync();
-    m_discord->sync();
-    m_logtext->sync();
+    if (f_settings->status() != QSettings::NoError) {
+        return {f_settings->fileName() + " could not be read!"};
+    }
+
+    QStringList l_problems;
+    f_settings->beginGroup("Options");
+    bool ok;
+    f_settings->value("ms_port", 27016).toInt(&ok);
+    if (!ok) {
+        l_problems.append("ms_port is not a valid port!");
+    }
+    f_settings->value("port", 27016).toInt(&ok);
+    if (!ok) {
+        l_problems.append("port is not a valid port!");
+    }
+    f_settings->value("secure_port", -1).toInt(&ok);
+    if (!ok) {
+        l_problems.append("secure_port is not a valid port!");
+    }
+
+    QString l_auth = f_settings->value("auth", "simple").toString().toLower();
+    if (!(l_auth == "simple" || l_auth == "advanced")) {
+        l_problems.append("auth is not a valid auth type!");
+    }
+
+    int l_soft_limit = f_settings->value("packet_rate_limit_soft", 10).toInt(&ok);
+    if (!ok) {
+        l_problems.append("packet_rate_limit_soft is not a valid limit!");
+    }
+    if (l_soft_limit <= 0) {
+        qWarning("packet_rate_limit_soft is 0 or less, warning threshold is disabled!");
+    }
+
+    int l_hard_limit = f_settings->value("packet_rate_limit_hard", 20).toInt(&ok);
+    if (!ok) {
+        l_problems.append("packet_rate_limit_hard is not a valid limit!");
+    }
+    else if (l_soft_limit > 0 && l_hard_limit <= l_soft_limit) {
+        l_problems.append("packet_rate_limit_hard must be greater than packet_rate_limit_soft!");
+    }
+    if (l_hard_limit <= 0) {
+        qWarning("packet_rate_limit_hard is 0 or less, rate limiting is disabled!");
+    }
+    f_settings->endGroup();
+
+    if (f_settings->value("Cluster/enabled", false).toBool() &&
+        ClusterBus::isTcpAddress(f_settings->value("Cluster/address").toString()) &&
+        f_settings->value("Cluster/secret").toString().isEmpty()) {
+        l_problems.append("Cluster secret must be set to use the cluster over TCP!");
+    }
+
+    return l_problems;
+}
+
+void ConfigManager::swapSettings(QSettings *f_settings, QSettings *f_discord, QSettings *f_logtext)
+{
+    for (QSettings *l_old : {m_settings, m_discord, m_logtext}) {
+        delete l_old;
+    }
+    // The new objects are used as they were validated. Only values changed at runtime, like the MOTD, are
+    // carried over, as the files may have been read before the change was written.
+    for (auto l_change = m_runtime_changes.cbegin(); l_change != m_runtime_changes.cend(); ++l_change) {
+        f_settings->setValue(l_change.key(), l_change.value());
+    }
+    m_runtime_changes.clear();
+    m_settings = f_settings;
+    m_discord = f_discord;
+    m_logtext = f_logtext;
 }
 
 QStringList ConfigManager::loadConfigFile(const QString filename)
@@ -406,6 +485,12 @@ DataTypes::AuthType ConfigManager::authType()
     return toDataType<DataTypes::AuthType>(l_auth);
 }
 
+DataTypes::TransportType ConfigManager::transportType()
+{
+    QString l_transport = m_settings->value("Options/transport", "qt").toString().toUpper();
+    return toDataType<DataTypes::TransportType>(l_transport);
+}
+
 QString ConfigManager::modpass()
 {
     return m_settings->value("Options/modpass", "changeme").toString();
@@ -428,6 +513,21 @@ DataTypes::LogType ConfigManager::loggingType()
     return toDataType<DataTypes::LogType>(l_log);
 }
 
+bool ConfigManager::logArchiveEnabled()
+{
+    return m_settings->value("Options/log_archive", false).toBool();
+}
+
+bool ConfigManager::captureTraffic()
+{
+    return m_settings->value("Options/capture_traffic", false).toBool();
+}
+
+QString ConfigManager::packetCoalescingVersion()
+{
+    return m_settings->value("Options/packet_coalescing_version", "2.6.0").toString();
+}
+
 int ConfigManager::maxStatements()
 {
     bool ok;
@@ -449,6 +549,39 @@ int ConfigManager::multiClientLimit()
     return l_limit;
 }
 
+double ConfigManager::connectionRateLimit()
+{
+    bool ok;
+    double l_rate = m_settings->value("Options/connection_rate_limit", 1).toDouble(&ok);
+    if (!ok) {
+        qWarning("connection_rate_limit is not a number!");
+        l_rate = 1;
+    }
+    return l_rate;
+}
+
+int ConfigManager::connectionBurst()
+{
+    bool ok;
+    int l_burst = m_settings->value("Options/connection_burst", 10).toInt(&ok);
+    if (!ok || l_burst < 1) {
+        qWarning("connection_burst is not a positive int!");
+        l_burst = 10;
+    }
+    return l_burst;
+}
+
+int ConfigManager::acceptorThreads()
+{
+    bool ok;
+    int l_threads = m_settings->value("Options/acceptor_threads", 0).toInt(&ok);
+    if (!ok || l_threads < 0) {
+        qWarning("acceptor_threads is not a valid number! Accepting on the main thread.");
+        l_threads = 0;
+    }
+    return l_threads;
+}
+
 int ConfigManager::maxCharacters()
 {
     bool ok;
@@ -504,6 +637,59 @@ int ConfigManager::packetRateLimitHard()
     return l_limit;
 }
 
+QHash<QString, double> ConfigManager::packetWeights()
+{
+    return weights("PacketWeights", false);
+}
+
+QHash<QString, double> ConfigManager::commandWeights()
+{
+    return weights("CommandWeights", true);
+}
+
+QStringList ConfigManager::fanoutPackets()
+{
+    return m_settings->value("RateLimit/fanout_packets", QStringList{"PE", "EE", "DE"}).toStringList();
+}
+
+QStringList ConfigManager::fanoutCommands()
+{
+    QStringList l_commands = m_settings->value("RateLimit/fanout_commands", QStringList{"getareas"}).toStringList();
+    for (QString &l_command : l_commands) {
+        l_command = l_command.toLower();
+    }
+    return l_commands;
+}
+
+double ConfigManager::fanoutBudget()
+{
+    bool ok;
+    double l_budget = m_settings->value("RateLimit/fanout_budget", 100).toDouble(&ok);
+    if (!ok) {
+        qWarning("fanout_budget is not a number!");
+        l_budget = 100;
+    }
+    return l_budget;
+}
+
+QHash<QString, double> ConfigManager::weights(const QString &f_group, bool f_lower_case)
+{
+    QHash<QString, double> l_weights;
+    m_settings->beginGroup(f_group);
+    const QStringList l_keys = m_settings->childKeys();
+    for (const QString &l_key : l_keys) {
+        bool ok;
+        double l_weight = m_settings->value(l_key).toDouble(&ok);
+        if (!ok || l_weight < 0) {
+            qWarning() << l_key << "in" << f_group << "is not a valid weight!";
+            continue;
+        }
+        l_weights.insert(f_lower_case ? l_key.toLower() : l_key, l_weight);
+    }
+    m_settings->endGroup();
+    return l_weights;
+}
+
 QUrl ConfigManager::assetUrl()
 {
     QByteArray l_url = m_settings->value("Options/asset_url", "").toString().toUtf8();
@@ -650,7 +836,7 @@ int ConfigManager::afkTimeout()
 
 void ConfigManager::setAuthType(const DataTypes::AuthType f_auth)
 {
-    m_settings->setValue("Options/auth", fromDataType<DataTypes::AuthType>(f_auth).toLower());
+    setRuntimeValue("Options/auth", fromDataType<DataTypes::AuthType>(f_auth).toLower());
 }
 
 QStringList ConfigManager::diceFaces(const QString f_name)
@@ -708,6 +894,77 @@ bool ConfigManager::advertiseWSProxy()
     return m_settings->value("Advertiser/cloudflare_enabled", "false").toBool();
 }
 
+bool ConfigManager::metricsEnabled()
+{
+    return m_settings->value("Metrics/enabled", false).toBool();
+}
+
+QString ConfigManager::metricsBindIP()
+{
+    return m_settings->value("Metrics/bind_ip", "127.0.0.1").toString();
+}
+
+int ConfigManager::metricsPort()
+{
+    bool ok;
+    int l_port = m_settings->value("Metrics/port", 9146).toInt(&ok);
+    if (!ok) {
+        qWarning("Metrics port is not an int!");
+        l_port = 9146;
+    }
+    return l_port;
+}
+
+bool ConfigManager::clusterEnabled()
+{
+    return m_settings->value("Cluster/enabled", false).toBool();
+}
+
+QString ConfigManager::clusterNodeName()
+{
+    QString l_name = m_settings->value("Cluster/node_name").toString();
+    if (l_name.isEmpty()) {
+        l_name = serverName();
+    }
+    return l_name;
+}
+
+QString ConfigManager::clusterAddress()
+{
+    return m_settings->value("Cluster/address", "akashi-cluster").toString();
+}
+
+QString ConfigManager::clusterSecret()
+{
+    return m_settings->value("Cluster/secret").toString();
+}
+
+bool ConfigManager::clusterReplicateBans()
+{
+    return m_settings->value("Cluster/replicate_bans", false).toBool();
+}
+
+bool ConfigManager::reusePort()
+{
+    return m_settings->value("Restart/reuse_port", false).toBool();
+}
+
+QString ConfigManager::snapshotFile()
+{
+    return m_settings->value("Restart/snapshot_file", "storage/snapshot.bin").toString();
+}
+
+int ConfigManager::drainTimeout()
+{
+    bool ok;
+    int l_timeout = m_settings->value("Restart/drain_timeout", "600").toInt(&ok);
+    if (!ok || l_timeout < 0) {
+        qWarning("drain_timeout is not a valid number! Using default.");
+        l_timeout = 600;
+    }
+    return l_timeout;
+}
+
 ConfigManager::help ConfigManager::commandHelp(QString f_command_name)
 {
     return m_commands_help->value(f_command_name);
@@ -715,7 +972,15 @@ ConfigManager::help ConfigManager::commandHelp(QString f_command_name)
 
 void ConfigManager::setMotd(const QString f_motd)
 {
-    m_settings->setValue("Options/motd", f_motd);
+    setRuntimeValue("Options/motd", f_motd);
+}
+
+void ConfigManager::setRuntimeValue(const QString &f_key, const QVariant &f_value)
+{
+    m_settings->setValue(f_key, f_value);
+    // Written right away, so a reload that starts afterwards reads it from the file.
+    m_settings->sync();
+    m_runtime_changes.insert(f_key, f_value);
 }
 
 bool ConfigManager::fileExists(const QFileInfo &f_file)
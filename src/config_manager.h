@@ -77,6 +77,19 @@ class ConfigManager
      */
     static QStringList ordered_songs();
 
+    /**
+     * @brief Parses config/music.json without touching the loaded musiclist.
+     *
+     * @details Unlike musiclist(), this keeps no state and may be called from any thread.
+     *
+     * @param f_musiclist Receives the songs and categories with their durations.
+     * @param f_ordered Receives the entries in the order they appear in the file.
+     * @param f_error Receives the parser error if the file is not valid JSON.
+     *
+     * @return True if the file could be parsed, false otherwise.
+     */
+    static bool parseMusiclist(MusicList &f_musiclist, QStringList &f_ordered, QString &f_error);
+
     /**
      * @brief Loads help information into m_help_information..
      */
@@ -92,6 +105,24 @@ class ConfigManager
      */
     static QSettings *ambience();
 
+    /**
+     * @brief An area as configured in areas.ini.
+     */
+    struct AreaConfig
+    {
+        QString group;       //!< The group name in areas.ini, like "0:Basement".
+        int index = 0;       //!< The number before the first colon, used to order the areas.
+        QString name;        //!< The group name without the index.
+        QVariantHash values; //!< Every setting of the area, keyed by its name in areas.ini.
+    };
+
+    /**
+     * @brief Reads every area from areas.ini in one pass.
+     *
+     * @return The areas, ordered by their index.
+     */
+    static QList<AreaConfig> areaConfigs();
+
     /**
      * @brief Returns a sanitized QStringList of the areas..
      */
@@ -107,6 +138,19 @@ class ConfigManager
      */
     static QStringList iprangeBans();
 
+    /**
+     * @brief Reads config/ipbans.json and resolves the banned ASNs to IP ranges.
+     *
+     * @details May be called from any thread, as long as no two threads use the same connection name at once.
+     *
+     * @param f_ranges Receives the banned IP ranges.
+     * @param f_connection_name The name of the SQLite connection used for the ASN lookup.
+     * @param f_error Receives the parser error if the file is not valid JSON.
+     *
+     * @return True if the file could be parsed, false otherwise.
+     */
+    static bool parseIprangeBans(QStringList &f_ranges, const QString &f_connection_name, QString &f_error);
+
     /**
      * @brief Returns the maximum number of players the server will allow..
      */
@@ -152,6 +196,11 @@ class ConfigManager
      */
     static DataTypes::AuthType authType();
 
+    /**
+     * @brief Returns the transport serving WebSocket connections.
+     */
+    static DataTypes::TransportType transportType();
+
     /**
      * @brief Returns the server's moderator password..
      */
@@ -167,6 +216,23 @@ class ConfigManager
      */
     static DataTypes::LogType loggingType();
 
+    /**
+     * @brief Returns true if events should also be written to the searchable log archive.
+     */
+    static bool logArchiveEnabled();
+
+    /**
+     * @brief Returns true if inbound network traffic should be recorded for the replay tool.
+     */
+    static bool captureTraffic();
+
+    /**
+     * @brief Returns the lowest client version whose outbound packets are merged into one frame per event loop iteration.
+     *
+     * @return A version in the form X.X.X, or an empty string if packets should never be merged.
+     */
+    static QString packetCoalescingVersion();
+
     /**
      * @brief Returns true if the server should advertise to the master server..
      */
@@ -177,6 +243,21 @@ class ConfigManager
      */
     static int multiClientLimit();
 
+    /**
+     * @brief Returns how many connections per second the same IP may open in the long run. 0 disables the limit.
+     */
+    static double connectionRateLimit();
+
+    /**
+     * @brief Returns how many connections the same IP may open at once before connectionRateLimit() applies.
+     */
+    static int connectionBurst();
+
+    /**
+     * @brief Returns the number of threads accepting connections and performing their handshake. 0 accepts on the main thread.
+     */
+    static int acceptorThreads();
+
     /**
      * @brief Returns the maximum number of characters a message can contain..
      */
@@ -202,6 +283,31 @@ class ConfigManager
      */
     static int packetRateLimitHard();
 
+    /**
+     * @brief Returns the rate limiting weight of every packet header listed in [PacketWeights].
+     */
+    static QHash<QString, double> packetWeights();
+
+    /**
+     * @brief Returns the rate limiting weight of every command listed in [CommandWeights], by lower case name.
+     */
+    static QHash<QString, double> commandWeights();
+
+    /**
+     * @brief Returns the packet headers that draw from the shared fan-out budget.
+     */
+    static QStringList fanoutPackets();
+
+    /**
+     * @brief Returns the commands that draw from the shared fan-out budget, in lower case.
+     */
+    static QStringList fanoutCommands();
+
+    /**
+     * @brief Returns the tokens per second shared by all fan-out operations. 0 disables the shared budget.
+     */
+    static double fanoutBudget();
+
     /**
      * @brief Returns the URL where the server should retrieve remote assets from..
      */
@@ -361,6 +467,61 @@ class ConfigManager
      */
     static bool advertiseWSProxy();
 
+    /**
+     * @brief Returns true if the metrics endpoint is enabled.
+     */
+    static bool metricsEnabled();
+
+    /**
+     * @brief Returns the IP the metrics endpoint listens on.
+     */
+    static QString metricsBindIP();
+
+    /**
+     * @brief Returns the port the metrics endpoint listens on.
+     */
+    static int metricsPort();
+
+    /**
+     * @brief Returns true if this server is part of a cluster.
+     */
+    static bool clusterEnabled();
+
+    /**
+     * @brief Returns the name this server uses on the cluster bus.
+     */
+    static QString clusterNodeName();
+
+    /**
+     * @brief Returns the address of the cluster bus. A plain name is a local socket, `host:port` uses TCP.
+     */
+    static QString clusterAddress();
+
+    /**
+     * @brief Returns the secret the servers of the cluster authenticate each other with.
+     */
+    static QString clusterSecret();
+
+    /**
+     * @brief Returns true if bans issued on other nodes should be written to this server's database.
+     */
+    static bool clusterReplicateBans();
+
+    /**
+     * @brief Returns true if the server should listen with SO_REUSEPORT, allowing a new process to take over the port.
+     */
+    static bool reusePort();
+
+    /**
+     * @brief Returns the path of the state snapshot written on handoff and restored on start.
+     */
+    static QString snapshotFile();
+
+    /**
+     * @brief Returns how long a server that handed off keeps serving its remaining clients, in seconds.
+     */
+    static int drainTimeout();
+
     /**
      * @brief A struct that contains the help information for a command.
      *        It's split in the syntax and the explanation text.
@@ -391,9 +552,25 @@ class ConfigManager
     static void setMotd(const QString f_motd);
 
     /**
-     * @brief Reload the server configuration.
+     * @brief Checks server settings for values the server cannot run with.
+     *
+     * @details Does not modify the loaded configuration, so it can be used on a freshly read config.ini before it
+     * is put in place.
+     *
+     * @param f_settings The settings to check.
+     *
+     * @return A list of problems found, empty if the settings are usable.
      */
-    static void reloadSettings();
+    static QStringList validateSettings(QSettings *f_settings);
+
+    /**
+     * @brief Replaces the loaded server, Discord and logtext configuration.
+     *
+     * @details The previous objects are deleted. The new ones are used as they are, without reading the files again,
+     * except for values set at runtime since the last swap, which are applied on top. The ConfigManager takes ownership
+     * of the new objects, which must live in the main thread.
+     */
+    static void swapSettings(QSettings *f_settings, QSettings *f_discord, QSettings *f_logtext);
 
   private:
     /**
@@ -414,6 +591,14 @@ class ConfigManager
      */
     static bool dirExists(const QFileInfo &dir);
 
+    /**
+     * @brief Reads a group of config.ini that maps names to rate limiting weights.
+     *
+     * @param f_group The name of the group.
+     * @param f_lower_case Whether the names are converted to lower case.
+     */
+    static QHash<QString, double> weights(const QString &f_group, bool f_lower_case);
+
     /**
      * @brief A struct for storing QStringLists loaded from command configuration files.
      */
@@ -438,6 +623,16 @@ class ConfigManager
      */
     static QSettings *m_settings;
 
+    /**
+     * @brief Server configuration values set at runtime since the last swapSettings, by key.
+     */
+    static QVariantHash m_runtime_changes;
+
+    /**
+     * @brief Sets and immediately writes a server configuration value, and remembers it for the next swapSettings.
+     */
+    static void setRuntimeValue(const QString &f_key, const QVariant &f_value);
+
     /**
      * @brief Stores all discord webhook configuration values.
      */
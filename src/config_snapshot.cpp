@@ -0,0 +1,79 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#include "config_snapshot.h"
+
+#include <QThread>
+
+#include "command_extension.h"
+#include "config_manager.h"
+
+ConfigSnapshot *ConfigSnapshot::load(QThread *f_target_thread)
+{
+    ConfigSnapshot *l_snapshot = new ConfigSnapshot;
+
+    l_snapshot->settings = new QSettings("config/config.ini", QSettings::IniFormat);
+    l_snapshot->errors.append(ConfigManager::validateSettings(l_snapshot->settings));
+    l_snapshot->discord = new QSettings("config/discord.ini", QSettings::IniFormat);
+    l_snapshot->logtext = new QSettings("config/text/logtext.ini", QSettings::IniFormat);
+    for (QSettings *l_settings : {l_snapshot->discord, l_snapshot->logtext}) {
+        if (l_settings->status() != QSettings::NoError) {
+            l_snapshot->errors.append(l_settings->fileName() + " could not be read!");
+        }
+    }
+    for (QSettings *l_settings : {l_snapshot->settings, l_snapshot->discord, l_snapshot->logtext}) {
+        l_settings->moveToThread(f_target_thread);
+    }
+
+    QStringList l_ranges;
+    QString l_error;
+    // The main thread owns the "ASN" connection.
+    if (!ConfigManager::parseIprangeBans(l_ranges, "ASN_RELOAD", l_error)) {
+        l_snapshot->errors.append("ipbans.json could not be parsed: " + l_error);
+    }
+    for (const QString &l_range : qAsConst(l_ranges)) {
+        if (!l_snapshot->ipban_ranges.insert(l_range)) {
+            qWarning() << "Ignoring invalid IP range ban" << l_range;
+        }
+    }
+
+    if (!ACLRolesHandler::parseFile("config/acl_roles.ini", l_snapshot->acl_roles)) {
+        l_snapshot->errors.append("acl_roles.ini could not be read!");
+    }
+
+    l_snapshot->command_extensions = new CommandExtensionCollection;
+    l_snapshot->command_extensions->setCommandNameWhitelist(AOClient::COMMANDS.keys());
+    if (!l_snapshot->command_extensions->loadFile("config/command_extensions.ini")) {
+        l_snapshot->errors.append("command_extensions.ini could not be read!");
+    }
+    l_snapshot->command_table = AOClient::buildCommandTable(*l_snapshot->command_extensions);
+    l_snapshot->command_extensions->moveToThread(f_target_thread);
+
+    if (!ConfigManager::parseMusiclist(l_snapshot->musiclist, l_snapshot->ordered_songs, l_error)) {
+        l_snapshot->errors.append("music.json could not be parsed: " + l_error);
+    }
+
+    return l_snapshot;
+}
+
+ConfigSnapshot::~ConfigSnapshot()
+{
+    delete settings;
+    delete discord;
+    delete logtext;
+    delete command_extensions;
+}
@@ -0,0 +1,75 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#ifndef CONFIG_SNAPSHOT_H
+#define CONFIG_SNAPSHOT_H
+
+#include <QHash>
+#include <QSettings>
+#include <QStringList>
+
+#include "acl_roles_handler.h"
+#include "aoclient.h"
+#include "ip_range_set.h"
+#include "typedefs.h"
+
+class CommandExtensionCollection;
+class QThread;
+
+/**
+ * @brief Everything a configuration reload reads from disk, loaded and validated up front.
+ *
+ * @details A snapshot is built away from the main thread and handed to the server as a whole. Members the server
+ * takes over are set to nullptr; whatever is left is deleted together with the snapshot.
+ */
+class ConfigSnapshot
+{
+  public:
+    /**
+     * @brief Reads and validates config.ini, discord.ini, logtext.ini, ipbans.json, acl_roles.ini,
+     * command_extensions.ini and music.json.
+     *
+     * @details Meant to be called from a worker thread. QObjects in the snapshot are moved to f_target_thread
+     * before returning.
+     *
+     * @param f_target_thread The thread the snapshot will be applied on.
+     *
+     * @return A new snapshot. Check #errors before applying it.
+     */
+    static ConfigSnapshot *load(QThread *f_target_thread);
+
+    ConfigSnapshot() = default;
+    ~ConfigSnapshot();
+    Q_DISABLE_COPY(ConfigSnapshot)
+
+    /**
+     * @brief Problems found while loading. A snapshot with errors must not be applied.
+     */
+    QStringList errors;
+
+    QSettings *settings = nullptr;                            //!< config/config.ini
+    QSettings *discord = nullptr;                             //!< config/discord.ini
+    QSettings *logtext = nullptr;                             //!< config/text/logtext.ini
+    IPRangeSet ipban_ranges;                                  //!< config/ipbans.json, with banned ASNs resolved
+    QHash<QString, ACLRole> acl_roles;                        //!< config/acl_roles.ini
+    CommandExtensionCollection *command_extensions = nullptr; //!< config/command_extensions.ini
+    AOClient::CommandTable command_table;                     //!< Built from #command_extensions
+    MusicList musiclist;                                      //!< config/music.json
+    QStringList ordered_songs;                                //!< config/music.json, in file order
+};
+
+#endif // CONFIG_SNAPSHOT_H
@@ -49,6 +49,16 @@ class DataTypes
         FULLAREA
     };
     Q_ENUM(LogType)
+
+    /**
+     * @brief Custom type for the transport serving WebSocket connections.
+     */
+    enum class TransportType
+    {
+        QT,
+        EPOLL
+    };
+    Q_ENUM(TransportType)
 };
 
 template <typename T>
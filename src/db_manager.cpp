@@ -17,6 +17,8 @@
 //////////////////////////////////////////////////////////////////////////////////////
 #include "db_manager.h"
 
+#include "metrics.h"
+
 DBManager::DBManager() :
     DRIVER("QSQLITE")
 {
@@ -42,16 +44,27 @@ DBManager::DBManager() :
     create_user_table.exec();
     if (db_version != DB_VERSION)
         updateDB(db_version);
+    loadIPBans();
 }
 
 QPair<bool, DBManager::BanInfo> DBManager::isIPBanned(QString ipid)
 {
+    auto l_ban = m_ip_bans.constFind(ipid);
+    if (l_ban == m_ip_bans.constEnd())
+        return {false, BanInfo()};
+    return {isActive(*l_ban), *l_ban};
+}
+
+void DBManager::refreshIPBan(const QString &f_ipid)
+{
+    Metrics::ScopedTimer l_timer(Metrics::databaseLatency());
     QSqlQuery query;
-    query.prepare("SELECT * FROM BANS WHERE IPID = ? ORDER BY TIME DESC");
-    query.addBindValue(ipid);
+    query.prepare("SELECT * FROM BANS WHERE IPID = ? ORDER BY TIME DESC, ID DESC");
+    query.addBindValue(f_ipid);
     query.exec();
-    BanInfo ban;
+    m_ip_bans.remove(f_ipid);
     if (query.first()) {
+        BanInfo ban;
         ban.id = query.value(0).toInt();
         ban.ipid = query.value(1).toString();
         ban.hdid = query.value(2).toString();
@@ -60,20 +73,43 @@ QPair<bool, DBManager::BanInfo> DBManager::isIPBanned(QString ipid)
         ban.reason = query.value(5).toString();
         ban.duration = query.value(6).toLongLong();
         ban.moderator = query.value(7).toString();
-        if (ban.duration == -2)
-            return {true, ban};
-        unsigned long current_time = QDateTime::currentDateTime().toSecsSinceEpoch();
-        if (ban.time + ban.duration > current_time)
-            return {true, ban};
-        else
-            return {false, ban};
+        if (isActive(ban))
+            m_ip_bans.insert(f_ipid, ban);
     }
-    else
-        return {false, ban};
+}
+
+void DBManager::loadIPBans()
+{
+    Metrics::ScopedTimer l_timer(Metrics::databaseLatency());
+    m_ip_bans.clear();
+    // Later bans replace earlier ones, so only the latest ban of each IPID is kept, like a lookup by IPID would return.
+    QSqlQuery query("SELECT * FROM BANS ORDER BY TIME ASC, ID ASC");
+    while (query.next()) {
+        BanInfo ban;
+        ban.id = query.value(0).toInt();
+        ban.ipid = query.value(1).toString();
+        ban.hdid = query.value(2).toString();
+        ban.ip = QHostAddress(query.value(3).toString());
+        ban.time = static_cast<unsigned long>(query.value(4).toULongLong());
+        ban.reason = query.value(5).toString();
+        ban.duration = query.value(6).toLongLong();
+        ban.moderator = query.value(7).toString();
+        m_ip_bans.insert(ban.ipid, ban);
+    }
+    m_ip_bans.removeIf([](const QHash<QString, BanInfo>::iterator &f_ban) { return !isActive(f_ban.value()); });
+}
+
+bool DBManager::isActive(const BanInfo &f_ban)
+{
+    if (f_ban.duration == -2)
+        return true;
+    unsigned long current_time = QDateTime::currentDateTime().toSecsSinceEpoch();
+    return f_ban.time + f_ban.duration > current_time;
 }
 
 QPair<bool, DBManager::BanInfo> DBManager::isHDIDBanned(QString hdid)
 {
+    Metrics::ScopedTimer l_timer(Metrics::databaseLatency());
     QSqlQuery query;
     query.prepare("SELECT * FROM BANS WHERE HDID = ? ORDER BY TIME DESC");
     query.addBindValue(hdid);
@@ -102,6 +138,7 @@ QPair<bool, DBManager::BanInfo> DBManager::isHDIDBanned(QString hdid)
 
 int DBManager::getBanID(QString hdid)
 {
+    Metrics::ScopedTimer l_timer(Metrics::databaseLatency());
     QSqlQuery query;
     query.prepare("SELECT ID FROM BANS WHERE HDID = ? ORDER BY TIME DESC");
     query.addBindValue(hdid);
@@ -116,6 +153,7 @@ int DBManager::getBanID(QString hdid)
 
 int DBManager::getBanID(QHostAddress ip)
 {
+    Metrics::ScopedTimer l_timer(Metrics::databaseLatency());
     QSqlQuery query;
     query.prepare("SELECT ID FROM BANS WHERE IP = ? ORDER BY TIME DESC");
     query.addBindValue(ip.toString());
@@ -130,6 +168,7 @@ int DBManager::getBanID(QHostAddress ip)
 
 QList<DBManager::BanInfo> DBManager::getRecentBans()
 {
+    Metrics::ScopedTimer l_timer(Metrics::databaseLatency());
     QList<BanInfo> return_list;
     QSqlQuery query;
     query.prepare("SELECT * FROM BANS ORDER BY TIME DESC LIMIT 5");
@@ -153,6 +192,7 @@ QList<DBManager::BanInfo> DBManager::getRecentBans()
 
 void DBManager::addBan(BanInfo ban)
 {
+    Metrics::ScopedTimer l_timer(Metrics::databaseLatency());
     QSqlQuery query;
     query.prepare("INSERT INTO BANS(IPID, HDID, IP, TIME, REASON, DURATION, MODERATOR) VALUES(?, ?, ?, ?, ?, ?, ?)");
     query.addBindValue(ban.ipid);
@@ -162,14 +202,20 @@ void DBManager::addBan(BanInfo ban)
     query.addBindValue(ban.reason);
     query.addBindValue(ban.duration);
     query.addBindValue(ban.moderator);
-    if (!query.exec())
+    if (!query.exec()) {
         qWarning() << "SQL Error:" << query.lastError().text();
+        return;
+    }
+    ban.id = query.lastInsertId().toInt();
+    if (isActive(ban))
+        m_ip_bans.insert(ban.ipid, ban);
 }
 
 bool DBManager::invalidateBan(int id)
 {
+    Metrics::ScopedTimer l_timer(Metrics::databaseLatency());
     QSqlQuery ban_exists;
-    ban_exists.prepare("SELECT DURATION FROM bans WHERE ID = ?");
+    ban_exists.prepare("SELECT IPID FROM bans WHERE ID = ?");
     ban_exists.addBindValue(id);
     ban_exists.exec();
 
@@ -180,11 +226,13 @@ bool DBManager::invalidateBan(int id)
     query.prepare("UPDATE bans SET DURATION = 0 WHERE ID = ?");
     query.addBindValue(id);
     query.exec();
+    refreshIPBan(ban_exists.value(0).toString());
     return true;
 }
 
 bool DBManager::createUser(QString f_username, QByteArray f_salt, QString f_password, QString f_acl)
 {
+    Metrics::ScopedTimer l_timer(Metrics::databaseLatency());
     QSqlQuery username_exists;
     username_exists.prepare("SELECT ACL FROM users WHERE USERNAME = ?");
     username_exists.addBindValue(f_username);
@@ -209,6 +257,7 @@ bool DBManager::createUser(QString f_username, QByteArray f_salt, QString f_pass
 
 bool DBManager::deleteUser(QString username)
 {
+    Metrics::ScopedTimer l_timer(Metrics::databaseLatency());
     if (username == "root") {
         // To prevent lockout scenarios where an admin may accidentally delete root.
         return false;
@@ -236,6 +285,7 @@ bool DBManager::deleteUser(QString username)
 
 QString DBManager::getACL(QString moderator_name)
 {
+    Metrics::ScopedTimer l_timer(Metrics::databaseLatency());
     if (moderator_name == "")
         return 0;
     QSqlQuery query("SELECT ACL FROM users WHERE USERNAME = ?");
@@ -248,6 +298,7 @@ QString DBManager::getACL(QString moderator_name)
 
 bool DBManager::authenticate(QString username, QString password)
 {
+    Metrics::ScopedTimer l_timer(Metrics::databaseLatency());
     QSqlQuery query_salt("SELECT SALT FROM users WHERE USERNAME = ?");
     query_salt.addBindValue(username);
     query_salt.exec();
@@ -274,6 +325,7 @@ bool DBManager::authenticate(QString username, QString password)
 
 bool DBManager::updateACL(QString f_username, QString f_acl)
 {
+    Metrics::ScopedTimer l_timer(Metrics::databaseLatency());
     QSqlQuery l_username_exists;
     l_username_exists.prepare("SELECT ACL FROM users WHERE USERNAME = ?");
     l_username_exists.addBindValue(f_username);
@@ -292,6 +344,7 @@ bool DBManager::updateACL(QString f_username, QString f_acl)
 
 QStringList DBManager::getUsers()
 {
+    Metrics::ScopedTimer l_timer(Metrics::databaseLatency());
     QStringList users;
 
     QSqlQuery query("SELECT USERNAME FROM users ORDER BY ID");
@@ -304,6 +357,7 @@ QStringList DBManager::getUsers()
 
 QList<DBManager::BanInfo> DBManager::getBanInfo(QString lookup_type, QString id)
 {
+    Metrics::ScopedTimer l_timer(Metrics::databaseLatency());
     QList<BanInfo> return_list;
     QSqlQuery query;
     QList<BanInfo> invalid;
@@ -341,6 +395,7 @@ QList<DBManager::BanInfo> DBManager::getBanInfo(QString lookup_type, QString id)
 
 bool DBManager::updateBan(int ban_id, QString field, QVariant updated_info)
 {
+    Metrics::ScopedTimer l_timer(Metrics::databaseLatency());
     QSqlQuery query;
     if (field == "reason") {
         query.prepare("UPDATE bans SET REASON = ? WHERE ID = ?");
@@ -355,13 +410,19 @@ bool DBManager::updateBan(int ban_id, QString field, QVariant updated_info)
         qWarning() << query.lastError();
         return false;
     }
-    else {
-        return true;
-    }
+
+    QSqlQuery ipid_query;
+    ipid_query.prepare("SELECT IPID FROM bans WHERE ID = ?");
+    ipid_query.addBindValue(ban_id);
+    ipid_query.exec();
+    if (ipid_query.first())
+        refreshIPBan(ipid_query.value(0).toString());
+    return true;
 }
 
 bool DBManager::updatePassword(QString username, QString password)
 {
+    Metrics::ScopedTimer l_timer(Metrics::databaseLatency());
     QByteArray salt = CryptoHelper::randbytes(16);
     QString salted_password = CryptoHelper::hash_password(salt, password);
 
@@ -22,6 +22,7 @@
 
 #include <QDateTime>
 #include <QFileInfo>
+#include <QHash>
 #include <QHostAddress>
 #include <QSqlDatabase>
 #include <QSqlDriver>
@@ -77,6 +78,8 @@ class DBManager : public QObject
     /**
      * @brief Checks if there is a record in the Bans table with the given IPID.
      *
+     * @details Answered from an in-memory copy of the latest ban of every IPID, so no query is run.
+     *
      * @param ipid The IPID to check if it is banned.
      *
      * @return A pair of values:
@@ -85,6 +88,13 @@ class DBManager : public QObject
      */
     QPair<bool, BanInfo> isIPBanned(QString ipid);
 
+    /**
+     * @brief Reloads the latest ban of an IPID into the in-memory copy.
+     *
+     * @details Needed when another server sharing the database banned the IPID.
+     */
+    void refreshIPBan(const QString &f_ipid);
+
     /**
      * @brief Checks if there is a record in the Bans table with the given hardware ID.
      *
@@ -259,6 +269,21 @@ class DBManager : public QObject
      */
     int db_version;
 
+    /**
+     * @brief The latest ban of every IPID that is banned, as checked by isIPBanned().
+     */
+    QHash<QString, BanInfo> m_ip_bans;
+
+    /**
+     * @brief Fills #m_ip_bans from the database.
+     */
+    void loadIPBans();
+
+    /**
+     * @brief Returns true if the ban has not expired yet.
+     */
+    static bool isActive(const BanInfo &f_ban);
+
     /**
      * @brief checkVersion Checks the current server DB version.
      *
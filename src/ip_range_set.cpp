@@ -0,0 +1,92 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#include "ip_range_set.h"
+
+namespace {
+quint32 maskIPv4(quint32 f_address, int f_prefix)
+{
+    // Shifting a 32-bit value by 32 is undefined, so a /0 is handled on its own.
+    return f_prefix == 0 ? 0 : f_address & (~quint32(0) << (32 - f_prefix));
+}
+
+QByteArray maskIPv6(const Q_IPV6ADDR &f_address, int f_prefix)
+{
+    QByteArray l_network(reinterpret_cast<const char *>(f_address.c), 16);
+    for (int i = 0; i < l_network.size(); ++i) {
+        const int l_bits = qBound(0, f_prefix - i * 8, 8);
+        l_network[i] = char(quint8(l_network[i]) & quint8(0xFF00 >> l_bits));
+    }
+    return l_network;
+}
+}
+
+bool IPRangeSet::insert(const QString &f_subnet)
+{
+    const QPair<QHostAddress, int> l_subnet = QHostAddress::parseSubnet(f_subnet);
+    if (l_subnet.first.isNull() || l_subnet.second < 0) {
+        return false;
+    }
+
+    if (l_subnet.first.protocol() == QAbstractSocket::IPv4Protocol) {
+        m_ipv4_ranges[l_subnet.second].insert(maskIPv4(l_subnet.first.toIPv4Address(), l_subnet.second));
+    }
+    else {
+        m_ipv6_ranges[l_subnet.second].insert(maskIPv6(l_subnet.first.toIPv6Address(), l_subnet.second));
+    }
+    return true;
+}
+
+bool IPRangeSet::contains(const QHostAddress &f_address) const
+{
+    if (f_address.protocol() == QAbstractSocket::IPv4Protocol) {
+        const quint32 l_address = f_address.toIPv4Address();
+        for (auto i = m_ipv4_ranges.cbegin(); i != m_ipv4_ranges.cend(); ++i) {
+            if (i.value().contains(maskIPv4(l_address, i.key()))) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    if (f_address.protocol() == QAbstractSocket::IPv6Protocol) {
+        const Q_IPV6ADDR l_address = f_address.toIPv6Address();
+        for (auto i = m_ipv6_ranges.cbegin(); i != m_ipv6_ranges.cend(); ++i) {
+            if (i.value().contains(maskIPv6(l_address, i.key()))) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+int IPRangeSet::size() const
+{
+    int l_size = 0;
+    for (const QSet<quint32> &l_ranges : m_ipv4_ranges) {
+        l_size += l_ranges.size();
+    }
+    for (const QSet<QByteArray> &l_ranges : m_ipv6_ranges) {
+        l_size += l_ranges.size();
+    }
+    return l_size;
+}
+
+bool IPRangeSet::isEmpty() const
+{
+    return m_ipv4_ranges.isEmpty() && m_ipv6_ranges.isEmpty();
+}
@@ -0,0 +1,72 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#ifndef IP_RANGE_SET_H
+#define IP_RANGE_SET_H
+
+#include <QByteArray>
+#include <QHostAddress>
+#include <QMap>
+#include <QSet>
+#include <QString>
+
+/**
+ * @brief A set of IP ranges that can be matched against an address without walking every range.
+ *
+ * @details Ranges are stored by their masked network address, grouped by prefix length. A lookup masks the address
+ * once per distinct prefix length and checks the matching group, so its cost does not grow with the number of bans.
+ */
+class IPRangeSet
+{
+  public:
+    /**
+     * @brief Adds a range in CIDR notation, or a single address.
+     *
+     * @param f_subnet The range, in any format understood by QHostAddress::parseSubnet.
+     *
+     * @return False if the range could not be parsed.
+     */
+    bool insert(const QString &f_subnet);
+
+    /**
+     * @brief Checks if the address is part of any range in the set.
+     */
+    bool contains(const QHostAddress &f_address) const;
+
+    /**
+     * @brief Returns the number of distinct ranges in the set.
+     */
+    int size() const;
+
+    /**
+     * @brief Returns true if the set holds no ranges.
+     */
+    bool isEmpty() const;
+
+  private:
+    /**
+     * @brief IPv4 network addresses, keyed by prefix length.
+     */
+    QMap<int, QSet<quint32>> m_ipv4_ranges;
+
+    /**
+     * @brief IPv6 network addresses, keyed by prefix length.
+     */
+    QMap<int, QSet<QByteArray>> m_ipv6_ranges;
+};
+
+#endif // IP_RANGE_SET_H
@@ -29,6 +29,9 @@ ULogger::ULogger(QObject *parent) :
         writerFull = new WriterFull;
         break;
     }
+    if (ConfigManager::logArchiveEnabled()) {
+        writerArchive = new WriterArchive(this);
+    }
     loadLogtext();
 }
 
@@ -51,6 +54,7 @@ void ULogger::logIC(const QString &f_area_name, const QString &f_ipid, const QSt
     QString l_time = QDateTime::currentDateTime().toString("ddd MMMM d yyyy | hh:mm:ss");
     QString l_logEntry = QString(m_logtext.value("ic") + "\n").arg(l_time, f_area_name, f_ipid, f_id, f_char_name, f_ooc_name, f_message);
     updateAreaBuffer(f_area_name, l_logEntry);
+    archiveEntry(WriterArchive::EntryType::IC, f_area_name, f_ipid, f_ooc_name, f_char_name, f_message);
 }
 
 void ULogger::logMusic(const QString &f_char_name, const QString &f_ooc_name, const QString &f_ipid,
@@ -68,6 +72,7 @@ void ULogger::logOOC(const QString &f_area_name, const QString &f_ipid, const QS
     QString l_logEntry = QString(m_logtext.value("ooc") + "\n")
                              .arg(l_time, f_area_name, f_ipid, f_id, f_char_name, f_ooc_name, f_message);
     updateAreaBuffer(f_area_name, l_logEntry);
+    archiveEntry(WriterArchive::EntryType::OOC, f_area_name, f_ipid, f_ooc_name, f_char_name, f_message);
 }
 
 void ULogger::logLogin(const QString &f_char_name, const QString &f_ooc_name, const QString &f_moderator_name,
@@ -85,6 +90,7 @@ void ULogger::logCMD(const QString &f_char_name, const QString &f_ipid, const QS
 {
     QString l_time = QDateTime::currentDateTime().toString("ddd MMMM d yyyy | hh:mm:ss");
     QString l_logEntry;
+    QString l_archived_command = "/" + f_command;
     // Some commands contain sensitive data, like passwords
     // These must be filtered out
     if (f_command == "login") {
@@ -98,12 +104,15 @@ void ULogger::logCMD(const QString &f_char_name, const QString &f_ipid, const QS
     else if (f_command == "adduser" && !f_args.isEmpty()) {
         l_logEntry = QString(m_logtext.value("adduser") + "\n")
                          .arg(l_time, f_area_name, f_char_name, f_ooc_name, f_args.at(0), f_ipid);
+        l_archived_command += " " + f_args.at(0);
     }
     else {
         l_logEntry = QString(m_logtext.value("cmd") + "\n")
                          .arg(l_time, f_area_name, f_char_name, f_ooc_name, f_command, f_args.join(" "), f_ipid);
+        l_archived_command += " " + f_args.join(" ");
     }
     updateAreaBuffer(f_area_name, l_logEntry);
+    archiveEntry(WriterArchive::EntryType::CMD, f_area_name, f_ipid, f_ooc_name, f_char_name, l_archived_command.trimmed());
 }
 
 void ULogger::logKick(const QString &f_moderator, const QString &f_target_ipid)
@@ -120,6 +129,7 @@ void ULogger::logBan(const QString &f_moderator, const QString &f_target_ipid, c
     QString l_logEntry = QString(m_logtext.value("ban") + "\n")
                              .arg(l_time, f_moderator, f_target_ipid, f_duration);
     updateAreaBuffer("SERVER", l_logEntry);
+    archiveEntry(WriterArchive::EntryType::BAN, "SERVER", f_target_ipid, f_moderator, QString(), f_duration);
 }
 
 void ULogger::logModcall(const QString &f_area_name, const QString &f_ipid, const QString &f_ooc_name, const QString &f_id, const QString &f_char_name)
@@ -128,6 +138,7 @@ void ULogger::logModcall(const QString &f_area_name, const QString &f_ipid, cons
     QString l_logEvent = QString(m_logtext.value("modcall") + "\n")
                              .arg(l_time, f_area_name, f_ipid, f_id, f_char_name, f_ooc_name);
     updateAreaBuffer(f_area_name, l_logEvent);
+    archiveEntry(WriterArchive::EntryType::MODCALL, f_area_name, f_ipid, f_ooc_name, f_char_name, QString());
 
     if (ConfigManager::loggingType() == DataTypes::LogType::MODCALL) {
         writerModcall->flush(f_area_name, buffer(f_area_name));
@@ -140,6 +151,14 @@ void ULogger::logConnectionAttempt(const QString &f_ip_address, const QString &f
     QString l_logEntry = QString(m_logtext.value("connect") + "\n")
                              .arg(l_time, f_ip_address, f_ipid, f_hwid);
     updateAreaBuffer("SERVER", l_logEntry);
+    if (writerArchive != nullptr && !f_hwid.isEmpty()) {
+        m_hwid_cache.insert(f_ipid, f_hwid);
+    }
+}
+
+void ULogger::forgetHwid(const QString &f_ipid)
+{
+    m_hwid_cache.remove(f_ipid);
 }
 
 void ULogger::loadLogtext()
@@ -174,7 +193,26 @@ void ULogger::updateAreaBuffer(const QString &f_area_name, const QString &f_log_
     }
 }
 
+void ULogger::archiveEntry(WriterArchive::EntryType f_type, const QString &f_area_name, const QString &f_ipid,
+                           const QString &f_ooc_name, const QString &f_char_name, const QString &f_message)
+{
+    if (writerArchive == nullptr) {
+        return;
+    }
+    writerArchive->append({QDateTime::currentMSecsSinceEpoch(), f_type, f_area_name, f_ipid, m_hwid_cache.value(f_ipid),
+                           f_ooc_name, f_char_name, f_message});
+}
+
 QQueue<QString> ULogger::buffer(const QString &f_area_name)
 {
     return m_bufferMap.value(f_area_name);
 }
+
+int ULogger::bufferedEntries() const
+{
+    int l_entries = 0;
+    for (const QQueue<QString> &l_buffer : m_bufferMap) {
+        l_entries += l_buffer.size();
+    }
+    return l_entries;
+}
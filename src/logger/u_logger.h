@@ -19,6 +19,7 @@
 #define U_LOGGER_H
 
 #include "config_manager.h"
+#include "logger/writer_archive.h"
 #include "logger/writer_full.h"
 #include "logger/writer_modcall.h"
 #include <QDateTime>
@@ -51,6 +52,11 @@ class ULogger : public QObject
      */
     QQueue<QString> buffer(const QString &f_areaName);
 
+    /**
+     * @brief Returns the total number of entries held in all area buffers.
+     */
+    int bufferedEntries() const;
+
   public slots:
 
     /**
@@ -101,6 +107,11 @@ class ULogger : public QObject
      */
     void logConnectionAttempt(const QString &f_ip_address, const QString &f_ipid, const QString &f_hwid);
 
+    /**
+     * @brief Drops the cached HWID of an IPID once no client of it is connected anymore.
+     */
+    void forgetHwid(const QString &f_ipid);
+
     /**
      * @brief Loads template strings for the logger.
      */
@@ -114,6 +125,14 @@ class ULogger : public QObject
      */
     void updateAreaBuffer(const QString &f_areaName, const QString &f_log_entry);
 
+    /**
+     * @brief Writes an event into the structured log archive, if it is enabled.
+     *
+     * @details The HWID is taken from the last connection attempt of the IPID.
+     */
+    void archiveEntry(WriterArchive::EntryType f_type, const QString &f_area_name, const QString &f_ipid,
+                      const QString &f_ooc_name, const QString &f_char_name, const QString &f_message);
+
     /**
      * @brief QMap of all available area buffers.
      *
@@ -131,6 +150,18 @@ class ULogger : public QObject
      */
     WriterFull *writerFull;
 
+    /**
+     * @brief Pointer to archive writer. Handles the indexed, searchable event archive.
+     *
+     * @details Null if the archive is disabled.
+     */
+    WriterArchive *writerArchive = nullptr;
+
+    /**
+     * @brief Last known HWID of every connected IPID, used to index archived events by HWID.
+     */
+    QHash<QString, QString> m_hwid_cache;
+
     /**
      * @brief Table that contains template strings for text-based logger format.
      * @details To keep ConfigManager cleaner the logstrings are loaded from an inifile by name.
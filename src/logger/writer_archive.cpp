@@ -0,0 +1,238 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#include "logger/writer_archive.h"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QMetaEnum>
+
+WriterArchive::WriterArchive(QObject *parent) :
+    QObject(parent),
+    m_indices(3 * SHARDS, nullptr),
+    m_index_buffers(3 * SHARDS)
+{
+    m_dir.setPath("logs/archive/");
+    if (!m_dir.exists()) {
+        m_dir.mkpath(".");
+    }
+    m_flush_timer.setSingleShot(true);
+    m_flush_timer.setInterval(FLUSH_INTERVAL);
+    connect(&m_flush_timer, &QTimer::timeout, this, &WriterArchive::flush);
+}
+
+WriterArchive::~WriterArchive()
+{
+    flush();
+    closeAll();
+}
+
+void WriterArchive::append(const Entry &f_entry)
+{
+    const QDate l_today = QDateTime::currentDateTimeUtc().date();
+    if (l_today != m_day || !m_records.isOpen()) {
+        openDay(l_today);
+    }
+    if (!m_records.isOpen()) {
+        return;
+    }
+
+    const quint64 l_offset = m_records_size;
+    const qsizetype l_buffered = m_record_buffer.size();
+    QDataStream l_stream(&m_record_buffer, QIODevice::WriteOnly | QIODevice::Append);
+    l_stream.setVersion(QDataStream::Qt_6_0);
+    l_stream << f_entry.timestamp << static_cast<quint8>(f_entry.type) << f_entry.area << f_entry.ipid
+             << f_entry.hwid << f_entry.ooc_name << f_entry.char_name << f_entry.message;
+    m_records_size += m_record_buffer.size() - l_buffered;
+
+    appendIndex(IndexKey::IPID, f_entry.ipid, f_entry.timestamp, l_offset);
+    appendIndex(IndexKey::HWID, f_entry.hwid, f_entry.timestamp, l_offset);
+    appendIndex(IndexKey::AREA, f_entry.area, f_entry.timestamp, l_offset);
+
+    if (m_record_buffer.size() >= MAX_BUFFERED) {
+        flush();
+    }
+    else if (!m_flush_timer.isActive()) {
+        m_flush_timer.start();
+    }
+}
+
+void WriterArchive::flush()
+{
+    m_flush_timer.stop();
+    if (m_record_buffer.isEmpty() || !m_records.isOpen()) {
+        return;
+    }
+
+    // The records have to hit the disk before an index points at them, otherwise a search could map a truncated file.
+    m_records.write(m_record_buffer);
+    m_records.flush();
+    m_record_buffer.clear();
+
+    for (int i = 0; i < m_index_buffers.size(); ++i) {
+        QByteArray &l_buffer = m_index_buffers[i];
+        if (l_buffer.isEmpty()) {
+            continue;
+        }
+        QFile *&l_file = m_indices[i];
+        if (l_file == nullptr) {
+            l_file = new QFile(indexPath(m_day, IndexKey(i / SHARDS), i % SHARDS));
+            if (!l_file->open(QIODevice::WriteOnly | QIODevice::Append)) {
+                qWarning() << "Unable to open log archive index" << l_file->fileName();
+                delete l_file;
+                l_file = nullptr;
+                l_buffer.clear();
+                continue;
+            }
+        }
+        l_file->write(l_buffer);
+        l_file->flush();
+        l_buffer.clear();
+    }
+}
+
+QList<WriterArchive::Entry> WriterArchive::search(IndexKey f_key, const QString &f_value, qint64 f_since, int f_limit)
+{
+    QList<Entry> l_results;
+    const quint64 l_hash = keyHash(f_value);
+    const int l_shard = l_hash % SHARDS;
+    const QDate l_today = QDateTime::currentDateTimeUtc().date();
+    const QDate l_first_day = qMax(QDateTime::fromMSecsSinceEpoch(f_since, Qt::UTC).date(), l_today.addDays(-MAX_SEARCH_DAYS));
+
+    // Walk the time buckets newest first so the limit cuts off the oldest entries.
+    for (QDate l_day = l_today; l_day >= l_first_day && l_results.size() < f_limit; l_day = l_day.addDays(-1)) {
+        QFile l_index(indexPath(l_day, f_key, l_shard));
+        if (!l_index.open(QIODevice::ReadOnly) || l_index.size() < qint64(sizeof(IndexRecord))) {
+            continue;
+        }
+        QFile l_records(dayPath(l_day) + "records.dat");
+        if (!l_records.open(QIODevice::ReadOnly) || l_records.size() == 0) {
+            continue;
+        }
+
+        uchar *l_index_map = l_index.map(0, l_index.size());
+        uchar *l_records_map = l_records.map(0, l_records.size());
+        if (l_index_map == nullptr || l_records_map == nullptr) {
+            qWarning() << "Unable to map log archive of" << l_day.toString(Qt::ISODate);
+            continue;
+        }
+
+        const IndexRecord *l_index_entries = reinterpret_cast<const IndexRecord *>(l_index_map);
+        const qint64 l_count = l_index.size() / sizeof(IndexRecord);
+        const quint64 l_records_size = l_records.size();
+
+        // Index entries are appended in chronological order.
+        for (qint64 i = l_count - 1; i >= 0 && l_results.size() < f_limit; --i) {
+            const IndexRecord &l_record = l_index_entries[i];
+            if (l_record.hash != l_hash || l_record.timestamp < f_since || l_record.offset >= l_records_size) {
+                continue;
+            }
+
+            QByteArray l_data = QByteArray::fromRawData(reinterpret_cast<const char *>(l_records_map + l_record.offset),
+                                                        l_records_size - l_record.offset);
+            QDataStream l_stream(l_data);
+            l_stream.setVersion(QDataStream::Qt_6_0);
+            Entry l_entry;
+            quint8 l_type;
+            l_stream >> l_entry.timestamp >> l_type >> l_entry.area >> l_entry.ipid >> l_entry.hwid
+                >> l_entry.ooc_name >> l_entry.char_name >> l_entry.message;
+            l_entry.type = static_cast<EntryType>(l_type);
+
+            // Hash collisions are possible, so the actual value has to be checked.
+            if (l_stream.status() != QDataStream::Ok || keyValue(l_entry, f_key).compare(f_value, Qt::CaseInsensitive) != 0) {
+                continue;
+            }
+            l_results.append(l_entry);
+        }
+    }
+    return l_results;
+}
+
+quint64 WriterArchive::keyHash(const QString &f_value)
+{
+    quint64 l_hash = 14695981039346656037ULL;
+    const QByteArray l_bytes = f_value.toCaseFolded().toUtf8();
+    for (const char l_byte : l_bytes) {
+        l_hash ^= static_cast<quint8>(l_byte);
+        l_hash *= 1099511628211ULL;
+    }
+    return l_hash;
+}
+
+QString WriterArchive::dayPath(const QDate &f_date)
+{
+    return QString("logs/archive/%1/").arg(f_date.toString("yyyy-MM-dd"));
+}
+
+QString WriterArchive::indexPath(const QDate &f_date, IndexKey f_key, int f_shard)
+{
+    QString l_key = QString(QMetaEnum::fromType<IndexKey>().valueToKey(int(f_key))).toLower();
+    return dayPath(f_date) + QString("%1_%2.idx").arg(l_key).arg(f_shard, 2, 16, QChar('0'));
+}
+
+QString WriterArchive::keyValue(const Entry &f_entry, IndexKey f_key)
+{
+    switch (f_key) {
+    case IndexKey::IPID:
+        return f_entry.ipid;
+    case IndexKey::HWID:
+        return f_entry.hwid;
+    case IndexKey::AREA:
+        return f_entry.area;
+    }
+    return QString();
+}
+
+void WriterArchive::openDay(const QDate &f_date)
+{
+    // Buffered entries belong to the files of the previous day.
+    flush();
+    closeAll();
+    m_day = f_date;
+
+    QString l_path = dayPath(f_date);
+    if (!QDir().mkpath(l_path)) {
+        qWarning() << "Unable to create log archive directory" << l_path;
+        return;
+    }
+    m_records.setFileName(l_path + "records.dat");
+    if (!m_records.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qWarning() << "Unable to open log archive" << m_records.fileName();
+        return;
+    }
+    m_records_size = m_records.size();
+}
+
+void WriterArchive::appendIndex(IndexKey f_key, const QString &f_value, qint64 f_timestamp, quint64 f_offset)
+{
+    if (f_value.isEmpty()) {
+        return;
+    }
+
+    IndexRecord l_record{keyHash(f_value), f_timestamp, f_offset};
+    const int l_shard = l_record.hash % SHARDS;
+    m_index_buffers[int(f_key) * SHARDS + l_shard].append(reinterpret_cast<const char *>(&l_record), sizeof(IndexRecord));
+}
+
+void WriterArchive::closeAll()
+{
+    m_records.close();
+    for (QFile *&l_file : m_indices) {
+        delete l_file;
+        l_file = nullptr;
+    }
+}
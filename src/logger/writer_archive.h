@@ -0,0 +1,232 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#ifndef WRITER_ARCHIVE_H
+#define WRITER_ARCHIVE_H
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+
+/**
+ * @brief A class to handle the structured, append-only log archive.
+ *
+ * @details Every archived event is written as a single record into a per-day record file. Alongside it,
+ * the writer maintains fixed-size index entries keyed by IPID, HWID and area name, sharded by key hash so
+ * a lookup only has to touch a small fraction of the index. The day directory doubles as the time bucket.
+ *
+ * Records and index entries are buffered and written together at most FLUSH_INTERVAL after they were appended, so
+ * logging an event does not touch the disk on the game thread. Searches only see entries that were written.
+ *
+ * Index files are read through memory mappings, which keeps searches over months of data cheap.
+ * The on-disk index layout is host-endian and therefore not meant to be moved between architectures.
+ */
+class WriterArchive : public QObject
+{
+    Q_OBJECT
+
+  public:
+    /**
+     * @brief The kinds of events that are stored in the archive.
+     */
+    enum class EntryType : quint8
+    {
+        IC,
+        OOC,
+        CMD,
+        BAN,
+        MODCALL
+    };
+    Q_ENUM(EntryType)
+
+    /**
+     * @brief The fields by which the archive can be searched.
+     */
+    enum class IndexKey
+    {
+        IPID,
+        HWID,
+        AREA
+    };
+    Q_ENUM(IndexKey)
+
+    /**
+     * @brief A single archived event.
+     */
+    struct Entry
+    {
+        qint64 timestamp;  //!< Time of the event in milliseconds since epoch (UTC).
+        EntryType type;    //!< The type of event.
+        QString area;      //!< Name of the area the event occured in.
+        QString ipid;      //!< IPID of the client the event concerns.
+        QString hwid;      //!< HWID of the client, if known.
+        QString ooc_name;  //!< OOC name of the client, or the moderator name for bans.
+        QString char_name; //!< Character name of the client.
+        QString message;   //!< Message content, command line or ban duration.
+    };
+
+    /**
+     * @brief The largest amount of days a single search may cover.
+     */
+    static const int MAX_SEARCH_DAYS = 90;
+
+    /**
+     * @brief Constructor for the archive logwriter.
+     *
+     * @param QObject pointer to the parent object.
+     */
+    WriterArchive(QObject *parent = nullptr);
+
+    /**
+     * @brief Deconstructor for the archive logwriter. Writes the buffered entries and closes all open files.
+     */
+    virtual ~WriterArchive();
+
+    /**
+     * @brief Appends an entry to the archive of the current day and updates the indices.
+     *
+     * @details The entry is buffered, see flush().
+     *
+     * @param f_entry The entry to archive. It is always written to the files of the current day.
+     */
+    void append(const Entry &f_entry);
+
+    /**
+     * @brief Writes the buffered records, then their index entries, so an index never points past its record file.
+     */
+    void flush();
+
+    /**
+     * @brief Searches the archive for entries matching a key.
+     *
+     * @details This only reads files on disk and can be used independently from a running writer, also from another thread.
+     * Days older than MAX_SEARCH_DAYS are never read.
+     *
+     * @param f_key The index to search in.
+     * @param f_value The value to search for. Comparison is case insensitive.
+     * @param f_since Oldest timestamp, in milliseconds since epoch, an entry may have to be returned.
+     * @param f_limit Maximum number of entries returned.
+     *
+     * @return A list of matching entries, newest first.
+     */
+    static QList<Entry> search(IndexKey f_key, const QString &f_value, qint64 f_since, int f_limit);
+
+  private:
+    /**
+     * @brief Fixed-size index entry. Written raw so the index files can be used through a memory map.
+     */
+    struct IndexRecord
+    {
+        quint64 hash;
+        qint64 timestamp;
+        quint64 offset;
+    };
+
+    /**
+     * @brief Number of shards each index is split into.
+     */
+    static const int SHARDS = 16;
+
+    /**
+     * @brief Longest time an appended entry stays in memory before it is written, in milliseconds.
+     */
+    static const int FLUSH_INTERVAL = 1000;
+
+    /**
+     * @brief Amount of buffered record data, in bytes, that is written right away instead of waiting for the timer.
+     */
+    static const qsizetype MAX_BUFFERED = 1 << 16;
+
+    /**
+     * @brief Returns the 64-bit FNV-1a hash of the case-folded key.
+     */
+    static quint64 keyHash(const QString &f_value);
+
+    /**
+     * @brief Returns the directory path of the time bucket for a given day.
+     */
+    static QString dayPath(const QDate &f_date);
+
+    /**
+     * @brief Returns the path of an index shard file of a given day.
+     */
+    static QString indexPath(const QDate &f_date, IndexKey f_key, int f_shard);
+
+    /**
+     * @brief Returns the field of an entry that is used for a given index.
+     */
+    static QString keyValue(const Entry &f_entry, IndexKey f_key);
+
+    /**
+     * @brief Closes the files of the previous day, if any, and opens the record file of a new day.
+     */
+    void openDay(const QDate &f_date);
+
+    /**
+     * @brief Buffers an index entry for the shard the value belongs to. Empty values are not indexed.
+     */
+    void appendIndex(IndexKey f_key, const QString &f_value, qint64 f_timestamp, quint64 f_offset);
+
+    /**
+     * @brief Closes all open files. Buffered entries have to be flushed first.
+     */
+    void closeAll();
+
+    /**
+     * @brief The day the currently open files belong to.
+     */
+    QDate m_day;
+
+    /**
+     * @brief The record file of the current day.
+     */
+    QFile m_records;
+
+    /**
+     * @brief Size of the record file of the current day, including the buffered records.
+     */
+    quint64 m_records_size = 0;
+
+    /**
+     * @brief Records that were not written yet.
+     */
+    QByteArray m_record_buffer;
+
+    /**
+     * @brief Lazily opened index shard files of the current day, addressed by key * SHARDS + shard.
+     */
+    QVector<QFile *> m_indices;
+
+    /**
+     * @brief Index entries that were not written yet, addressed like #m_indices.
+     */
+    QVector<QByteArray> m_index_buffers;
+
+    /**
+     * @brief Writes the buffered entries once FLUSH_INTERVAL passed since the first of them was appended.
+     */
+    QTimer m_flush_timer;
+
+    /**
+     * @brief Root directory of the archive.
+     */
+    QDir m_dir;
+};
+
+#endif // WRITER_ARCHIVE_H
@@ -20,6 +20,7 @@
 
 #include <cstdlib>
 
+#include <QCommandLineParser>
 #include <QCoreApplication>
 #include <QDebug>
 #include <QDir>
@@ -36,6 +37,14 @@ int main(int argc, char *argv[])
     QCoreApplication app(argc, argv);
     QCoreApplication::setApplicationName("akashi");
     QCoreApplication::setApplicationVersion("jackfruit (1.9)");
+
+    QCommandLineParser l_parser;
+    l_parser.setApplicationDescription("A server for Attorney Online 2");
+    l_parser.addHelpOption();
+    l_parser.addVersionOption();
+    l_parser.addOption({"takeover", "Take over the port and area state of the akashi running from the same directory. Requires reuse_port."});
+    l_parser.process(app);
+
     qInfo() << "Working directory:" << QDir::currentPath();
     std::atexit(cleanup);
 
@@ -48,7 +57,7 @@ int main(int argc, char *argv[])
     }
     else {
         server = new Server(ConfigManager::serverPort(), &app);
-        server->start();
+        server->start(l_parser.isSet("takeover"));
     }
 
     return app.exec();
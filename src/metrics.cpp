@@ -0,0 +1,234 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#include "metrics.h"
+
+#include <QString>
+
+const std::array<const char *, 22> Metrics::HEADERS{
+    "askchaa", "CASEA", "CC", "CH", "CT", "DE", "EE", "HI", "HP", "ID", "MA",
+    "MC", "MS", "PE", "PR", "PW", "RC", "RD", "RM", "RT", "SETCASE", "ZZ"};
+
+std::atomic<bool> Metrics::s_enabled{false};
+std::array<std::atomic<quint64>, Metrics::HEADER_SLOTS> Metrics::s_inbound_packets{};
+std::array<std::atomic<quint64>, Metrics::HEADER_SLOTS> Metrics::s_inbound_bytes{};
+std::array<Metrics::Histogram, Metrics::HEADER_SLOTS> Metrics::s_handler_latency{};
+std::atomic<quint64> Metrics::s_outbound_frames{0};
+std::atomic<quint64> Metrics::s_outbound_packets{0};
+std::atomic<quint64> Metrics::s_outbound_bytes{0};
+std::atomic<qint64> Metrics::s_socket_backlog{0};
+Metrics::Histogram Metrics::s_database_latency;
+Metrics::Histogram Metrics::s_event_loop_lag;
+std::atomic<quint64> Metrics::s_rejected_connections{0};
+Metrics::Histogram Metrics::s_handshake_latency;
+std::array<std::atomic<quint64>, int(Metrics::RateLimitAction::ACTION_COUNT)> Metrics::s_rate_limited{};
+
+namespace {
+/**
+ * @brief Upper bound of the first histogram bucket in nanoseconds.
+ */
+const qint64 FIRST_BUCKET_BOUND = 1000;
+} // namespace
+
+void Metrics::Histogram::observe(qint64 f_nanoseconds)
+{
+    qint64 l_bound = FIRST_BUCKET_BOUND;
+    for (int i = 0; i < BUCKET_COUNT; ++i, l_bound *= 2) {
+        if (f_nanoseconds <= l_bound) {
+            m_buckets[i].fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+    }
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(qMax<qint64>(0, f_nanoseconds), std::memory_order_relaxed);
+}
+
+void Metrics::Histogram::write(QByteArray &f_out, const char *f_name, const QByteArray &f_labels) const
+{
+    const QByteArray l_separator = f_labels.isEmpty() ? QByteArray() : QByteArray(",");
+    quint64 l_cumulative = 0;
+    qint64 l_bound = FIRST_BUCKET_BOUND;
+    for (int i = 0; i < BUCKET_COUNT; ++i, l_bound *= 2) {
+        l_cumulative += m_buckets[i].load(std::memory_order_relaxed);
+        f_out += f_name + QByteArray("_bucket{") + f_labels + l_separator + "le=\"" + QByteArray::number(l_bound / 1e9, 'g', 6) + "\"} "
+                 + QByteArray::number(l_cumulative) + "\n";
+    }
+    const quint64 l_count = count();
+    f_out += f_name + QByteArray("_bucket{") + f_labels + l_separator + "le=\"+Inf\"} " + QByteArray::number(l_count) + "\n";
+    const QByteArray l_labels = f_labels.isEmpty() ? QByteArray() : "{" + f_labels + "}";
+    f_out += f_name + QByteArray("_sum") + l_labels + " " + QByteArray::number(m_sum.load(std::memory_order_relaxed) / 1e9, 'g', 9) + "\n";
+    f_out += f_name + QByteArray("_count") + l_labels + " " + QByteArray::number(l_count) + "\n";
+}
+
+void Metrics::setEnabled(bool f_enabled)
+{
+    s_enabled.store(f_enabled, std::memory_order_relaxed);
+}
+
+void Metrics::recordInbound(QStringView f_header, qint64 f_bytes)
+{
+    const int l_index = headerIndex(f_header);
+    s_inbound_packets[l_index].fetch_add(1, std::memory_order_relaxed);
+    s_inbound_bytes[l_index].fetch_add(f_bytes, std::memory_order_relaxed);
+}
+
+void Metrics::recordHandler(QStringView f_header, qint64 f_nanoseconds)
+{
+    s_handler_latency[headerIndex(f_header)].observe(f_nanoseconds);
+}
+
+void Metrics::recordOutbound(qint64 f_bytes)
+{
+    s_outbound_frames.fetch_add(1, std::memory_order_relaxed);
+    s_outbound_bytes.fetch_add(f_bytes, std::memory_order_relaxed);
+}
+
+void Metrics::recordOutboundPackets(qint64 f_count)
+{
+    s_outbound_packets.fetch_add(f_count, std::memory_order_relaxed);
+}
+
+void Metrics::addSocketBacklog(qint64 f_bytes)
+{
+    s_socket_backlog.fetch_add(f_bytes, std::memory_order_relaxed);
+}
+
+Metrics::Histogram &Metrics::databaseLatency()
+{
+    return s_database_latency;
+}
+
+Metrics::Histogram &Metrics::eventLoopLag()
+{
+    return s_event_loop_lag;
+}
+
+void Metrics::recordRejectedConnection()
+{
+    s_rejected_connections.fetch_add(1, std::memory_order_relaxed);
+}
+
+Metrics::Histogram &Metrics::handshakeLatency()
+{
+    return s_handshake_latency;
+}
+
+void Metrics::recordRateLimited(RateLimitAction f_action)
+{
+    s_rate_limited[int(f_action)].fetch_add(1, std::memory_order_relaxed);
+}
+
+qint64 Metrics::utf8Size(QStringView f_string)
+{
+    qint64 l_size = 0;
+    for (const QChar l_char : f_string) {
+        const char16_t l_unicode = l_char.unicode();
+        if (l_unicode < 0x80)
+            l_size += 1;
+        else if (l_unicode < 0x800 || l_char.isSurrogate())
+            l_size += 2; // A surrogate pair encodes to four bytes.
+        else
+            l_size += 3;
+    }
+    return l_size;
+}
+
+QByteArray Metrics::exposition()
+{
+    QByteArray l_out;
+    l_out.reserve(32 * 1024);
+
+    l_out += "# HELP akashi_inbound_packets_total Packets received, by header.\n"
+             "# TYPE akashi_inbound_packets_total counter\n";
+    for (int i = 0; i < HEADER_SLOTS; ++i) {
+        const char *l_header = i < int(HEADERS.size()) ? HEADERS[i] : "other";
+        l_out += "akashi_inbound_packets_total{header=\"" + QByteArray(l_header) + "\"} "
+                 + QByteArray::number(s_inbound_packets[i].load(std::memory_order_relaxed)) + "\n";
+    }
+
+    l_out += "# HELP akashi_inbound_bytes_total Bytes received, by header.\n"
+             "# TYPE akashi_inbound_bytes_total counter\n";
+    for (int i = 0; i < HEADER_SLOTS; ++i) {
+        const char *l_header = i < int(HEADERS.size()) ? HEADERS[i] : "other";
+        l_out += "akashi_inbound_bytes_total{header=\"" + QByteArray(l_header) + "\"} "
+                 + QByteArray::number(s_inbound_bytes[i].load(std::memory_order_relaxed)) + "\n";
+    }
+
+    l_out += "# HELP akashi_handler_duration_seconds Time spent handling a packet, by header.\n"
+             "# TYPE akashi_handler_duration_seconds histogram\n";
+    for (int i = 0; i < HEADER_SLOTS; ++i) {
+        if (s_handler_latency[i].count() == 0) {
+            continue;
+        }
+        const char *l_header = i < int(HEADERS.size()) ? HEADERS[i] : "other";
+        s_handler_latency[i].write(l_out, "akashi_handler_duration_seconds", "header=\"" + QByteArray(l_header) + "\"");
+    }
+
+    l_out += "# HELP akashi_outbound_frames_total Frames sent to clients.\n"
+             "# TYPE akashi_outbound_frames_total counter\n"
+             "akashi_outbound_frames_total "
+             + QByteArray::number(s_outbound_frames.load(std::memory_order_relaxed)) + "\n";
+    l_out += "# HELP akashi_outbound_packets_total Packets sent to clients. Compare with frames to see how many were merged.\n"
+             "# TYPE akashi_outbound_packets_total counter\n"
+             "akashi_outbound_packets_total "
+             + QByteArray::number(s_outbound_packets.load(std::memory_order_relaxed)) + "\n";
+    l_out += "# HELP akashi_outbound_bytes_total Payload bytes sent to clients.\n"
+             "# TYPE akashi_outbound_bytes_total counter\n"
+             "akashi_outbound_bytes_total "
+             + QByteArray::number(s_outbound_bytes.load(std::memory_order_relaxed)) + "\n";
+    l_out += "# HELP akashi_socket_backlog_bytes Bytes queued on client sockets but not yet written.\n"
+             "# TYPE akashi_socket_backlog_bytes gauge\n"
+             "akashi_socket_backlog_bytes "
+             + QByteArray::number(qMax<qint64>(0, s_socket_backlog.load(std::memory_order_relaxed))) + "\n";
+
+    l_out += "# HELP akashi_database_query_duration_seconds Time spent in database queries.\n"
+             "# TYPE akashi_database_query_duration_seconds histogram\n";
+    s_database_latency.write(l_out, "akashi_database_query_duration_seconds");
+
+    l_out += "# HELP akashi_event_loop_lag_seconds Delay of a periodic timer behind its schedule.\n"
+             "# TYPE akashi_event_loop_lag_seconds histogram\n";
+    s_event_loop_lag.write(l_out, "akashi_event_loop_lag_seconds");
+
+    l_out += "# HELP akashi_rejected_connections_total Connections refused by the acceptor threads before their handshake.\n"
+             "# TYPE akashi_rejected_connections_total counter\n"
+             "akashi_rejected_connections_total "
+             + QByteArray::number(s_rejected_connections.load(std::memory_order_relaxed)) + "\n";
+    l_out += "# HELP akashi_handshake_duration_seconds Time from accepting a connection to completing its WebSocket handshake.\n"
+             "# TYPE akashi_handshake_duration_seconds histogram\n";
+    s_handshake_latency.write(l_out, "akashi_handshake_duration_seconds");
+
+    l_out += "# HELP akashi_rate_limited_total Packets and commands the rate limiter intervened on, by action.\n"
+             "# TYPE akashi_rate_limited_total counter\n";
+    const std::array<const char *, int(RateLimitAction::ACTION_COUNT)> l_actions{"warned", "refused", "disconnected"};
+    for (int i = 0; i < int(l_actions.size()); ++i) {
+        l_out += "akashi_rate_limited_total{action=\"" + QByteArray(l_actions[i]) + "\"} "
+                 + QByteArray::number(s_rate_limited[i].load(std::memory_order_relaxed)) + "\n";
+    }
+
+    return l_out;
+}
+
+int Metrics::headerIndex(QStringView f_header)
+{
+    // The table is small enough that a linear scan beats hashing, and it never allocates.
+    for (int i = 0; i < int(HEADERS.size()); ++i) {
+        if (f_header == QLatin1String(HEADERS[i])) {
+            return i;
+        }
+    }
+    return HEADER_SLOTS - 1;
+}
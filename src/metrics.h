@@ -0,0 +1,211 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QString>
+#include <QStringView>
+
+#include <array>
+#include <atomic>
+
+/**
+ * @brief Process-wide collection of runtime metrics, exposed in the Prometheus text format.
+ *
+ * @details Everything that is recorded on the hot path is a relaxed atomic in static storage, indexed through
+ * a fixed table of packet headers. Recording never allocates or locks; formatting only happens when the metrics
+ * are scraped. The counters are shared by every thread that records: most are only written by the game loop, but
+ * acceptor threads record handshakes and refused connections concurrently, so those may contend on a cache line. Values that can be read from the server state at scrape time, like player counts, are not
+ * collected here but added by the MetricsServer.
+ */
+class Metrics
+{
+  public:
+    /**
+     * @brief A histogram of durations with fixed, exponentially growing buckets.
+     *
+     * @details The upper bounds double from one microsecond to roughly one second. Observations above the
+     * last bound only count towards the implicit +Inf bucket.
+     */
+    class Histogram
+    {
+      public:
+        /**
+         * @brief Records a duration in nanoseconds.
+         */
+        void observe(qint64 f_nanoseconds);
+
+        /**
+         * @brief Appends the buckets, sum and count of the histogram in the Prometheus text format.
+         *
+         * @param f_out The buffer to append to.
+         * @param f_name The metric name.
+         * @param f_labels Additional labels, formatted as `key="value"`, or empty.
+         */
+        void write(QByteArray &f_out, const char *f_name, const QByteArray &f_labels = QByteArray()) const;
+
+        /**
+         * @brief Returns the number of observations.
+         */
+        quint64 count() const { return m_count.load(std::memory_order_relaxed); }
+
+      private:
+        static const int BUCKET_COUNT = 21;
+        std::array<std::atomic<quint64>, BUCKET_COUNT> m_buckets{};
+        std::atomic<quint64> m_count{0};
+        std::atomic<quint64> m_sum{0};
+    };
+
+    /**
+     * @brief Measures the lifetime of the object and records it in a histogram.
+     */
+    class ScopedTimer
+    {
+      public:
+        ScopedTimer(Histogram &f_histogram) :
+            m_histogram(f_histogram)
+        {
+            m_timer.start();
+        }
+
+        ~ScopedTimer() { m_histogram.observe(m_timer.nsecsElapsed()); }
+
+      private:
+        Histogram &m_histogram;
+        QElapsedTimer m_timer;
+    };
+
+    /**
+     * @brief What the rate limiter did to a client.
+     */
+    enum class RateLimitAction
+    {
+        WARNED,
+        REFUSED, //!< A fan-out operation was refused because the shared budget ran out.
+        DISCONNECTED,
+        ACTION_COUNT
+    };
+
+    /**
+     * @brief Returns true if metrics are being collected.
+     *
+     * @details Collection is only enabled while the metrics endpoint is running. Callers check this before
+     * doing any work to compute a value, like measuring the size of a message.
+     */
+    static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Enables or disables metric collection.
+     */
+    static void setEnabled(bool f_enabled);
+
+    /**
+     * @brief Records an inbound packet.
+     *
+     * @param f_header Header of the packet.
+     * @param f_bytes Size of the packet on the wire.
+     */
+    static void recordInbound(QStringView f_header, qint64 f_bytes);
+
+    /**
+     * @brief Records the time spent in the handler of a packet.
+     */
+    static void recordHandler(QStringView f_header, qint64 f_nanoseconds);
+
+    /**
+     * @brief Records an outbound frame.
+     */
+    static void recordOutbound(qint64 f_bytes);
+
+    /**
+     * @brief Records packets queued for sending. Several packets may end up in the same frame.
+     */
+    static void recordOutboundPackets(qint64 f_count);
+
+    /**
+     * @brief Changes the amount of data that is queued on sockets but not yet written.
+     */
+    static void addSocketBacklog(qint64 f_bytes);
+
+    /**
+     * @brief Histogram of database query durations.
+     */
+    static Histogram &databaseLatency();
+
+    /**
+     * @brief Histogram of event loop delays.
+     */
+    static Histogram &eventLoopLag();
+
+    /**
+     * @brief Records a connection refused before its handshake.
+     */
+    static void recordRejectedConnection();
+
+    /**
+     * @brief Histogram of WebSocket handshake durations. Only measured by acceptor threads.
+     */
+    static Histogram &handshakeLatency();
+
+    /**
+     * @brief Records an intervention of the rate limiter.
+     */
+    static void recordRateLimited(RateLimitAction f_action);
+
+    /**
+     * @brief Returns the UTF-8 encoded size of a string without converting it.
+     */
+    static qint64 utf8Size(QStringView f_string);
+
+    /**
+     * @brief Returns all collected metrics in the Prometheus text format.
+     */
+    static QByteArray exposition();
+
+  private:
+    /**
+     * @brief Returns the slot of a header in the fixed header table. Unknown headers share the last slot.
+     */
+    static int headerIndex(QStringView f_header);
+
+    /**
+     * @brief Headers with their own slot. Anything else is counted as "other".
+     */
+    static const std::array<const char *, 22> HEADERS;
+
+    static const int HEADER_SLOTS = 23;
+
+    static std::atomic<bool> s_enabled;
+
+    static std::array<std::atomic<quint64>, HEADER_SLOTS> s_inbound_packets;
+    static std::array<std::atomic<quint64>, HEADER_SLOTS> s_inbound_bytes;
+    static std::array<Histogram, HEADER_SLOTS> s_handler_latency;
+    static std::atomic<quint64> s_outbound_frames;
+    static std::atomic<quint64> s_outbound_packets;
+    static std::atomic<quint64> s_outbound_bytes;
+    static std::atomic<qint64> s_socket_backlog;
+    static Histogram s_database_latency;
+    static Histogram s_event_loop_lag;
+    static std::atomic<quint64> s_rejected_connections;
+    static Histogram s_handshake_latency;
+    static std::array<std::atomic<quint64>, int(RateLimitAction::ACTION_COUNT)> s_rate_limited;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,164 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#include "metrics_server.h"
+
+#include "area_data.h"
+#include "metrics.h"
+#include "server.h"
+#include "string_table.h"
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+
+namespace {
+/**
+ * @brief Interval of the lag timer in milliseconds.
+ */
+const int LAG_INTERVAL = 100;
+
+/**
+ * @brief Upper limit for the size of a request, anything larger is not a scrape.
+ */
+const int MAX_REQUEST_SIZE = 8192;
+} // namespace
+
+MetricsServer::MetricsServer(Server *f_server, QObject *parent) :
+    QObject(parent),
+    m_server(f_server),
+    m_listener(new QTcpServer(this)),
+    m_lag_timer(new QTimer(this))
+{
+    connect(m_listener, &QTcpServer::newConnection, this, &MetricsServer::acceptConnection);
+    connect(m_lag_timer, &QTimer::timeout, this, &MetricsServer::measureLag);
+}
+
+bool MetricsServer::listen(const QHostAddress &f_address, quint16 f_port)
+{
+    if (!m_listener->listen(f_address, f_port)) {
+        qWarning() << "Unable to start metrics listener:" << m_listener->errorString();
+        return false;
+    }
+    m_lag_timer->setTimerType(Qt::PreciseTimer);
+    m_lag_timer->start(LAG_INTERVAL);
+    m_lag_clock.start();
+    qInfo() << "Metrics available on" << f_address.toString() + ":" + QString::number(m_listener->serverPort()) + "/metrics";
+    return true;
+}
+
+void MetricsServer::acceptConnection()
+{
+    while (m_listener->hasPendingConnections()) {
+        QTcpSocket *l_socket = m_listener->nextPendingConnection();
+        connect(l_socket, &QTcpSocket::readyRead, this, [this, l_socket] { readRequest(l_socket); });
+        connect(l_socket, &QTcpSocket::disconnected, l_socket, &QTcpSocket::deleteLater);
+    }
+}
+
+void MetricsServer::readRequest(QTcpSocket *f_socket)
+{
+    if (f_socket->bytesAvailable() > MAX_REQUEST_SIZE) {
+        f_socket->abort();
+        return;
+    }
+    // Wait until the request headers are complete.
+    if (!f_socket->peek(MAX_REQUEST_SIZE).contains("\r\n\r\n")) {
+        return;
+    }
+
+    const QList<QByteArray> l_request_line = f_socket->readLine().trimmed().split(' ');
+    QByteArray l_status;
+    QByteArray l_body;
+    // Scrapers may append a query string, which is ignored.
+    const QByteArray l_path = l_request_line.value(1).split('?').constFirst();
+    if (l_request_line.value(0) == "GET" && l_path == "/metrics") {
+        l_status = "200 OK";
+        l_body = Metrics::exposition() + serverGauges();
+    }
+    else {
+        l_status = "404 Not Found";
+        l_body = "Not found\n";
+    }
+
+    f_socket->write("HTTP/1.1 " + l_status + "\r\n"
+                    "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                    "Content-Length: " + QByteArray::number(l_body.size()) + "\r\n"
+                    "Connection: close\r\n\r\n");
+    f_socket->write(l_body);
+    f_socket->disconnectFromHost();
+}
+
+void MetricsServer::measureLag()
+{
+    qint64 l_elapsed = m_lag_clock.nsecsElapsed();
+    m_lag_clock.start();
+    Metrics::eventLoopLag().observe(qMax<qint64>(0, l_elapsed - qint64(LAG_INTERVAL) * 1000000));
+}
+
+QByteArray MetricsServer::serverGauges() const
+{
+    QByteArray l_out;
+    l_out += "# HELP akashi_clients_connected Clients connected to the server.\n"
+             "# TYPE akashi_clients_connected gauge\n"
+             "akashi_clients_connected "
+             + QByteArray::number(m_server->getClients().size()) + "\n";
+    l_out += "# HELP akashi_clients_joined Clients that completed the handshake.\n"
+             "# TYPE akashi_clients_joined gauge\n"
+             "akashi_clients_joined "
+             + QByteArray::number(m_server->getPlayerCount()) + "\n";
+
+    l_out += "# HELP akashi_area_players Players in an area.\n"
+             "# TYPE akashi_area_players gauge\n";
+    const QVector<AreaData *> l_areas = m_server->getAreas();
+    for (const AreaData *l_area : l_areas) {
+        l_out += "akashi_area_players{area=\"" + escapeLabel(l_area->name()) + "\"} "
+                 + QByteArray::number(l_area->playerCount()) + "\n";
+    }
+
+    l_out += "# HELP akashi_log_buffer_entries Log entries held in the area log buffers.\n"
+             "# TYPE akashi_log_buffer_entries gauge\n"
+             "akashi_log_buffer_entries "
+             + QByteArray::number(m_server->getLogBufferDepth()) + "\n";
+
+    const int l_clients = m_server->getClients().size();
+    const qint64 l_client_bytes = m_server->getClientMemoryFootprint();
+    l_out += "# HELP akashi_client_memory_bytes Approximate memory held by connected clients.\n"
+             "# TYPE akashi_client_memory_bytes gauge\n"
+             "akashi_client_memory_bytes "
+             + QByteArray::number(l_client_bytes) + "\n";
+    l_out += "# HELP akashi_client_memory_bytes_average Approximate memory held per connected client.\n"
+             "# TYPE akashi_client_memory_bytes_average gauge\n"
+             "akashi_client_memory_bytes_average "
+             + QByteArray::number(l_clients ? l_client_bytes / l_clients : 0) + "\n";
+    l_out += "# HELP akashi_string_table_entries Distinct names in the string table.\n"
+             "# TYPE akashi_string_table_entries gauge\n"
+             "akashi_string_table_entries "
+             + QByteArray::number(StringTable::size()) + "\n";
+    l_out += "# HELP akashi_string_table_bytes Approximate memory held by the string table.\n"
+             "# TYPE akashi_string_table_bytes gauge\n"
+             "akashi_string_table_bytes "
+             + QByteArray::number(StringTable::memoryFootprint()) + "\n";
+    return l_out;
+}
+
+QByteArray MetricsServer::escapeLabel(const QString &f_value)
+{
+    QString l_escaped = f_value;
+    l_escaped.replace("\\", "\\\\").replace("\"", "\\\"").replace("\n", "\\n");
+    return l_escaped.toUtf8();
+}
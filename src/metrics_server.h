@@ -0,0 +1,105 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QObject>
+
+class QTcpServer;
+class QTcpSocket;
+class QTimer;
+class Server;
+
+/**
+ * @brief A minimal HTTP listener that serves the collected metrics to Prometheus.
+ *
+ * @details Only `GET /metrics` is answered, with any query string ignored; every response closes the connection. Besides the counters of
+ * Metrics, the response contains gauges read from the server state when the metrics are scraped.
+ * The listener also drives the timer that measures the event loop lag.
+ */
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+
+  public:
+    /**
+     * @brief Constructor for the metrics listener.
+     *
+     * @param f_server Pointer to the server the gauges are read from.
+     * @param parent QObject pointer to the parent object.
+     */
+    MetricsServer(Server *f_server, QObject *parent = nullptr);
+
+    /**
+     * @brief Starts listening for scrapes.
+     *
+     * @return True if the listener could be bound.
+     */
+    bool listen(const QHostAddress &f_address, quint16 f_port);
+
+  private slots:
+    /**
+     * @brief Accepts pending scrape connections.
+     */
+    void acceptConnection();
+
+    /**
+     * @brief Reads the request of a scrape connection and answers it once it is complete.
+     */
+    void readRequest(QTcpSocket *f_socket);
+
+    /**
+     * @brief Records how late the lag timer fired.
+     */
+    void measureLag();
+
+  private:
+    /**
+     * @brief Returns the gauges read from the server state in the Prometheus text format.
+     */
+    QByteArray serverGauges() const;
+
+    /**
+     * @brief Escapes a value for use inside a label.
+     */
+    static QByteArray escapeLabel(const QString &f_value);
+
+    /**
+     * @brief Pointer to the server.
+     */
+    Server *m_server;
+
+    /**
+     * @brief The listening socket.
+     */
+    QTcpServer *m_listener;
+
+    /**
+     * @brief Timer firing at a fixed interval to measure the event loop lag.
+     */
+    QTimer *m_lag_timer;
+
+    /**
+     * @brief Time since the lag timer last fired.
+     */
+    QElapsedTimer m_lag_clock;
+};
+
+#endif // METRICS_SERVER_H
@@ -14,10 +14,12 @@ MusicManager::MusicManager(QStringList f_cdns, MusicList f_root_list, QStringLis
     if (!f_cdns.isEmpty()) {
         m_cdns = f_cdns;
     }
+    m_root_names = QSet<QString>(m_root_ordered.cbegin(), m_root_ordered.cend());
 }
 
 MusicManager::~MusicManager()
 {
+    qDeleteAll(m_fm_packets);
 }
 
 QStringList MusicManager::musiclist(int f_area_id)
@@ -42,6 +44,7 @@ bool MusicManager::registerArea(int f_area_id)
         return false;
     }
     m_custom_lists->insert(f_area_id, {});
+    m_customs_folded.insert(f_area_id, {});
     m_global_enabled.insert(f_area_id, true);
     return true;
 }
@@ -109,24 +112,19 @@ bool MusicManager::addCustomSong(QString f_song_name, QString f_real_name, int f
     }
 
     // Avoid conflicts by checking if it exists.
-    if (m_root_list.contains(l_song_name) && m_global_enabled[f_area_id]) {
+    if (m_root_list.contains(l_song_name) && m_global_enabled.value(f_area_id)) {
         return false;
     }
 
-    if (m_custom_lists->value(f_area_id).contains(f_song_name)) {
+    const MusicList &l_custom_list = (*m_custom_lists)[f_area_id];
+    if (l_custom_list.contains(f_song_name) || l_custom_list.contains(l_song_name)) {
         return false;
     }
 
-    if (m_customs_ordered.value(f_area_id).contains(l_song_name)) {
-        return false;
-    }
-
-    // There should be a way to directly insert into the QMap. Too bad!
-    MusicList l_custom_list = m_custom_lists->value(f_area_id);
-    l_custom_list.insert(l_song_name, {l_real_name, f_duration});
-    m_custom_lists->insert(f_area_id, l_custom_list);
-    m_customs_ordered.insert(f_area_id, (QStringList{m_customs_ordered.value(f_area_id)} << l_song_name));
-    emit sendAreaFMPacket(PacketFactory::createPacket("FM", musiclist(f_area_id)), f_area_id);
+    (*m_custom_lists)[f_area_id].insert(l_song_name, {l_real_name, f_duration});
+    m_customs_ordered[f_area_id].append(l_song_name);
+    m_customs_folded[f_area_id].insert(l_song_name.toCaseFolded());
+    musiclistChanged(f_area_id);
     return true;
 }
 
@@ -150,28 +148,22 @@ bool MusicManager::addCustomCategory(QString f_category_name, int f_area_id)
         return false;
     }
 
-    QMap<QString, QPair<QString, int>> l_custom_list = m_custom_lists->value(f_area_id);
-    l_custom_list.insert(l_category_name, {l_category_name, 0});
-    m_custom_lists->insert(f_area_id, l_custom_list);
-    m_customs_ordered.insert(f_area_id, (QStringList{m_customs_ordered.value(f_area_id)} << l_category_name));
-    emit sendAreaFMPacket(PacketFactory::createPacket("FM", musiclist(f_area_id)), f_area_id);
+    (*m_custom_lists)[f_area_id].insert(l_category_name, {l_category_name, 0});
+    m_customs_ordered[f_area_id].append(l_category_name);
+    m_customs_folded[f_area_id].insert(l_category_name.toCaseFolded());
+    musiclistChanged(f_area_id);
     return true;
 }
 
 bool MusicManager::removeCustomMusic(QString f_songcategory_name, int f_area_id)
 {
     if (!m_root_list.contains(f_songcategory_name)) {
-        MusicList l_custom_list = m_custom_lists->value(f_area_id);
-        if (l_custom_list.contains(f_songcategory_name)) {
-            l_custom_list.remove(f_songcategory_name);
-            m_custom_lists->insert(f_area_id, l_custom_list);
-
+        if ((*m_custom_lists)[f_area_id].remove(f_songcategory_name) > 0) {
             // Updating the list alias too.
-            QStringList l_customs_ordered = m_customs_ordered.value(f_area_id);
-            l_customs_ordered.removeAll(f_songcategory_name);
-            m_customs_ordered.insert(f_area_id, l_customs_ordered);
+            m_customs_ordered[f_area_id].removeAll(f_songcategory_name);
+            rebuildCustomIndex(f_area_id);
 
-            emit sendAreaFMPacket(PacketFactory::createPacket("FM", musiclist(f_area_id)), f_area_id);
+            musiclistChanged(f_area_id);
             return true;
         } // Fallthrough
     }
@@ -184,37 +176,34 @@ bool MusicManager::toggleCustomMusicEnabled(int f_area_id)
     if (m_global_enabled.value(f_area_id)) {
         sanitiseCustomMusicList(f_area_id);
     }
-    emit sendAreaFMPacket(PacketFactory::createPacket("FM", musiclist(f_area_id)), f_area_id);
+    musiclistChanged(f_area_id);
     return m_global_enabled.value(f_area_id);
 }
 
 void MusicManager::sanitiseCustomMusicList(int f_area_id)
 {
-    MusicList l_sanitised_list;
-    QStringList l_sanitised_ordered = m_customs_ordered.value(f_area_id);
-    for (auto iterator = m_custom_lists->value(f_area_id).keyBegin(),
-              end = m_custom_lists->value(f_area_id).keyEnd();
-         iterator != end; ++iterator) {
-        QString l_key = iterator.operator*();
-        if (!m_root_list.contains(l_key)) {
-            l_sanitised_list.insert(l_key, m_custom_lists->value(f_area_id).value(l_key));
+    MusicList &l_custom_list = (*m_custom_lists)[f_area_id];
+    QStringList &l_customs_ordered = m_customs_ordered[f_area_id];
+    for (auto iterator = l_custom_list.begin(); iterator != l_custom_list.end();) {
+        if (m_root_list.contains(iterator.key())) {
+            l_customs_ordered.removeAll(iterator.key());
+            iterator = l_custom_list.erase(iterator);
         }
         else {
-            l_sanitised_ordered.removeAll(l_key);
+            ++iterator;
         }
     }
-    m_custom_lists->insert(f_area_id, l_sanitised_list);
-    m_customs_ordered.insert(f_area_id, l_sanitised_ordered);
+    rebuildCustomIndex(f_area_id);
+    invalidateMusiclist(f_area_id);
 }
 
 void MusicManager::clearCustomMusicList(int f_area_id)
 {
-    m_custom_lists->remove(f_area_id);
-    m_custom_lists->insert(f_area_id, {});
-    m_customs_ordered.remove(f_area_id);
-    m_customs_ordered.insert(f_area_id, {});
+    (*m_custom_lists)[f_area_id].clear();
+    m_customs_ordered[f_area_id].clear();
+    m_customs_folded[f_area_id].clear();
 
-    emit sendAreaFMPacket(PacketFactory::createPacket("FM", musiclist(f_area_id)), f_area_id);
+    musiclistChanged(f_area_id);
 }
 
 QPair<QString, int> MusicManager::songInformation(QString f_song_name, int f_area_id)
@@ -227,20 +216,91 @@ QPair<QString, int> MusicManager::songInformation(QString f_song_name, int f_are
 
 bool MusicManager::isCustom(int f_area_id, QString f_song_name)
 {
-    if (m_customs_ordered.value(f_area_id).contains(f_song_name, Qt::CaseInsensitive)) {
-        return true;
+    return m_customs_folded.value(f_area_id).contains(f_song_name.toCaseFolded());
+}
+
+bool MusicManager::isKnownSong(int f_area_id, const QString &f_song_name) const
+{
+    return m_root_names.contains(f_song_name) || m_customs_folded.value(f_area_id).contains(f_song_name.toCaseFolded());
+}
+
+void MusicManager::writeState(QDataStream &f_stream, int f_area_id) const
+{
+    f_stream << m_global_enabled.value(f_area_id) << m_customs_ordered.value(f_area_id) << m_custom_lists->value(f_area_id);
+}
+
+bool MusicManager::readState(QDataStream &f_stream, int f_area_id)
+{
+    bool l_global_enabled;
+    QStringList l_ordered;
+    MusicList l_custom_list;
+    f_stream >> l_global_enabled >> l_ordered >> l_custom_list;
+    if (f_stream.status() != QDataStream::Ok || !m_custom_lists->contains(f_area_id)) {
+        return false;
     }
-    return false;
+
+    m_global_enabled.insert(f_area_id, l_global_enabled);
+    m_customs_ordered.insert(f_area_id, l_ordered);
+    m_custom_lists->insert(f_area_id, l_custom_list);
+    rebuildCustomIndex(f_area_id);
+    invalidateMusiclist(f_area_id);
+    return true;
 }
 
-void MusicManager::reloadRequest()
+void MusicManager::reloadRequest(const MusicList &f_root_list, const QStringList &f_root_ordered)
 {
-    m_root_list = ConfigManager::musiclist();
-    m_root_ordered = ConfigManager::ordered_songs();
+    m_root_list = f_root_list;
+    m_root_ordered = f_root_ordered;
+    m_root_names = QSet<QString>(m_root_ordered.cbegin(), m_root_ordered.cend());
     m_cdns = ConfigManager::cdnList();
+
+    const QList<int> l_area_ids = m_custom_lists->keys();
+    for (int l_area_id : l_area_ids) {
+        musiclistChanged(l_area_id);
+    }
 }
 
 void MusicManager::userJoinedArea(int f_area_index, int f_user_id)
 {
-    emit sendFMPacket(PacketFactory::createPacket("FM", musiclist(f_area_index)), f_user_id);
+    emit sendFMPacket(fmPacket(f_area_index), musiclistVersion(f_area_index), f_user_id);
+}
+
+quint64 MusicManager::musiclistVersion(int f_area_id)
+{
+    fmPacket(f_area_id);
+    return m_musiclist_versions.value(f_area_id);
+}
+
+AOPacket *MusicManager::fmPacket(int f_area_id)
+{
+    AOPacket *&l_packet = m_fm_packets[f_area_id];
+    if (l_packet == nullptr) {
+        const QStringList l_musiclist = musiclist(f_area_id);
+        l_packet = PacketFactory::createPacket("FM", l_musiclist);
+        // 0 is reserved for clients that have not received any list yet.
+        m_musiclist_versions.insert(f_area_id, qMax<quint64>(qHash(l_musiclist), 1));
+    }
+    return l_packet;
+}
+
+void MusicManager::invalidateMusiclist(int f_area_id)
+{
+    // Packets are sent synchronously, so nobody else holds on to the old one.
+    delete m_fm_packets.take(f_area_id);
+    m_musiclist_versions.remove(f_area_id);
+}
+
+void MusicManager::musiclistChanged(int f_area_id)
+{
+    invalidateMusiclist(f_area_id);
+    emit sendAreaFMPacket(fmPacket(f_area_id), musiclistVersion(f_area_id), f_area_id);
+}
+
+void MusicManager::rebuildCustomIndex(int f_area_id)
+{
+    QSet<QString> &l_folded = m_customs_folded[f_area_id];
+    l_folded.clear();
+    for (const QString &l_entry : qAsConst(m_customs_ordered[f_area_id])) {
+        l_folded.insert(l_entry.toCaseFolded());
+    }
 }
@@ -18,10 +18,12 @@
 #ifndef MUSIC_MANAGER_H
 #define MUSIC_MANAGER_H
 
+#include <QDataStream>
 #include <QHash>
 #include <QMap>
 #include <QObject>
 #include <QPair>
+#include <QSet>
 
 #include "network/aopacket.h"
 #include "typedefs.h"
@@ -147,12 +149,46 @@ class MusicManager : public QObject
      */
     bool isCustom(int f_area_id, QString f_song_name);
 
+    /**
+     * @brief Checks if a song or category can be played in an area.
+     *
+     * @details Root entries have to match exactly, while custom entries are matched case-insensitively like in isCustom().
+     *
+     * @return Returns true if the song is part of the root list or the custom list of the area.
+     */
+    bool isKnownSong(int f_area_id, const QString &f_song_name) const;
+
+    /**
+     * @brief Writes the custom musiclist of an area and whether it includes the root list to a stream.
+     */
+    void writeState(QDataStream &f_stream, int f_area_id) const;
+
+    /**
+     * @brief Restores the state written by writeState() into a registered area.
+     *
+     * @return False if the stream ended early or held invalid data.
+     */
+    bool readState(QDataStream &f_stream, int f_area_id);
+
+    /**
+     * @brief Returns the version of an area's musiclist.
+     *
+     * @details The version is derived from the content of the list, so areas showing the same songs share a version
+     * and clients moving between them do not need to receive the list again. It is never 0.
+     */
+    quint64 musiclistVersion(int f_area_id);
+
   public slots:
 
     /**
      * @brief Updates the root musiclist and CDN list.
+     *
+     * @details Every area is sent its new list. Clients that already have an identical list are skipped.
+     *
+     * @param f_root_list The new root musiclist with durations.
+     * @param f_root_ordered The entries of the root musiclist in display order.
      */
-    void reloadRequest();
+    void reloadRequest(const MusicList &f_root_list, const QStringList &f_root_ordered);
 
     /**
      * @brief Triggers sending of FM packet to client joining a new area.
@@ -166,18 +202,22 @@ class MusicManager : public QObject
      *
      * @param f_packet FM packet with the full musiclist, when enabled, and custom list.
      *
+     * @param f_version Version of the musiclist in the packet, see musiclistVersion().
+     *
      * @param f_user_id temporary userid of the incoming client.
      */
-    void sendFMPacket(AOPacket *f_packet, int f_user_id);
+    void sendFMPacket(AOPacket *f_packet, quint64 f_version, int f_user_id);
 
     /**
      * @brief Sends the FM packet with the musiclist of the area when changes are made.
      *
      * @param f_packet FM packet with the full musiclist, when enabled, and eventual custom list.
      *
+     * @param f_version Version of the musiclist in the packet, see musiclistVersion().
+     *
      * @param f_area_index Index of the current area the edit is made in.
      */
-    void sendAreaFMPacket(AOPacket *f_packet, int f_area_index);
+    void sendAreaFMPacket(AOPacket *f_packet, quint64 f_version, int f_area_index);
 
   private:
     /**
@@ -195,6 +235,46 @@ class MusicManager : public QObject
      */
     QStringList m_root_ordered;
 
+    /**
+     * @brief Every entry of the root musiclist, for constant time lookups.
+     */
+    QSet<QString> m_root_names;
+
+    /**
+     * @brief The case folded entries of each area's custom list, for constant time lookups.
+     */
+    QHash<int, QSet<QString>> m_customs_folded;
+
+    /**
+     * @brief The FM packet of each area, built on first use after the musiclist of the area last changed.
+     */
+    QHash<int, AOPacket *> m_fm_packets;
+
+    /**
+     * @brief The version of each cached FM packet, see musiclistVersion().
+     */
+    QHash<int, quint64> m_musiclist_versions;
+
+    /**
+     * @brief Returns the FM packet of an area, building it if the cached one is outdated.
+     */
+    AOPacket *fmPacket(int f_area_id);
+
+    /**
+     * @brief Discards the cached FM packet and version of an area.
+     */
+    void invalidateMusiclist(int f_area_id);
+
+    /**
+     * @brief Discards the cached FM packet of an area and sends the new one to everyone in the area.
+     */
+    void musiclistChanged(int f_area_id);
+
+    /**
+     * @brief Rebuilds the case folded lookup set of an area's custom list from the ordered list.
+     */
+    void rebuildCustomIndex(int f_area_id);
+
     /**
      * @brief Contains all custom songs ordered in a per-area buffer.
      */
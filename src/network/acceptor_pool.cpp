@@ -0,0 +1,163 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#include "network/acceptor_pool.h"
+
+#include "admission_control.h"
+#include "metrics.h"
+#include "network/listen_socket.h"
+
+#include <QDebug>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QThread>
+#include <QWebSocketServer>
+
+Acceptor::Acceptor(qintptr f_descriptor, QSharedPointer<AdmissionControl> f_admission, QThread *f_target_thread) :
+    QObject(nullptr),
+    m_descriptor(f_descriptor),
+    m_admission(f_admission),
+    m_target_thread(f_target_thread)
+{}
+
+void Acceptor::start()
+{
+    m_clock.start();
+    m_upgrader = new QWebSocketServer("Akashi", QWebSocketServer::NonSecureMode, this);
+    connect(m_upgrader, &QWebSocketServer::newConnection, this, &Acceptor::handleWebSockets);
+
+    m_listener = new QTcpServer(this);
+    // Connections are handed to the upgrader right away, so the pending queue never holds on to them.
+    m_listener->setMaxPendingConnections(1024);
+    if (!m_listener->setSocketDescriptor(m_descriptor)) {
+        qWarning() << "[Acceptor]"
+                   << "Unable to accept connections:" << m_listener->errorString();
+        ListenSocket::close(m_descriptor);
+        return;
+    }
+    connect(m_listener, &QTcpServer::newConnection, this, &Acceptor::handleTcpConnections);
+}
+
+void Acceptor::close()
+{
+    if (m_listener != nullptr) {
+        m_listener->close();
+    }
+}
+
+void Acceptor::handleTcpConnections()
+{
+    while (m_listener->hasPendingConnections()) {
+        QTcpSocket *l_socket = m_listener->nextPendingConnection();
+        const QHostAddress l_address = l_socket->peerAddress();
+        if (m_admission->admit(l_address) != AdmissionControl::Verdict::ADMITTED) {
+            l_socket->abort();
+            l_socket->deleteLater();
+            if (Metrics::isEnabled()) {
+                Metrics::recordRejectedConnection();
+            }
+            continue;
+        }
+
+        // The TCP socket lives as long as the WebSocket built on it, on whichever thread that ends up on.
+        QSharedPointer<AdmissionControl> l_admission = m_admission;
+        connect(l_socket, &QObject::destroyed, [l_admission, l_address] { l_admission->release(l_address); });
+
+        const QPair<QHostAddress, quint16> l_peer(l_address, l_socket->peerPort());
+        m_handshakes.insert(l_peer, m_clock.nsecsElapsed());
+        connect(l_socket, &QTcpSocket::disconnected, this, [this, l_peer] { m_handshakes.remove(l_peer); });
+        m_upgrader->handleConnection(l_socket);
+    }
+}
+
+void Acceptor::handleWebSockets()
+{
+    while (m_upgrader->hasPendingConnections()) {
+        QWebSocket *l_socket = m_upgrader->nextPendingConnection();
+        auto l_handshake = m_handshakes.find(qMakePair(l_socket->peerAddress(), l_socket->peerPort()));
+        if (l_handshake != m_handshakes.end()) {
+            if (Metrics::isEnabled()) {
+                Metrics::handshakeLatency().observe(m_clock.nsecsElapsed() - l_handshake.value());
+            }
+            m_handshakes.erase(l_handshake);
+        }
+
+        // Clients wait for the server to greet them before sending anything, so no message can arrive
+        // while the socket is on its way to the server.
+        l_socket->setParent(nullptr);
+        l_socket->moveToThread(m_target_thread);
+        emit socketReady(l_socket);
+    }
+}
+
+AcceptorPool::AcceptorPool(QSharedPointer<AdmissionControl> f_admission, QObject *parent) :
+    QObject(parent),
+    m_admission(f_admission)
+{}
+
+AcceptorPool::~AcceptorPool()
+{
+    for (QThread *l_thread : qAsConst(m_threads)) {
+        l_thread->quit();
+        l_thread->wait();
+    }
+}
+
+bool AcceptorPool::start(const QHostAddress &f_address, quint16 f_port, int f_threads)
+{
+    QList<qintptr> l_descriptors;
+    for (int i = 0; i < f_threads; i++) {
+        const qintptr l_descriptor = ListenSocket::openReusePort(f_address, f_port);
+        if (l_descriptor == -1) {
+            for (qintptr l_opened : qAsConst(l_descriptors)) {
+                ListenSocket::close(l_opened);
+            }
+            return false;
+        }
+        if (f_port == 0) {
+            f_port = ListenSocket::localPort(l_descriptor);
+        }
+        l_descriptors.append(l_descriptor);
+    }
+    m_port = f_port;
+
+    for (int i = 0; i < l_descriptors.size(); i++) {
+        QThread *l_thread = new QThread(this);
+        l_thread->setObjectName(QString("acceptor %1").arg(i));
+        Acceptor *l_acceptor = new Acceptor(l_descriptors[i], m_admission, thread());
+        l_acceptor->moveToThread(l_thread);
+        connect(l_thread, &QThread::started, l_acceptor, &Acceptor::start);
+        connect(l_thread, &QThread::finished, l_acceptor, &QObject::deleteLater);
+        connect(l_acceptor, &Acceptor::socketReady, this, &AcceptorPool::newConnection);
+        m_threads.append(l_thread);
+        m_acceptors.append(l_acceptor);
+        l_thread->start();
+    }
+    return true;
+}
+
+void AcceptorPool::close()
+{
+    for (Acceptor *l_acceptor : qAsConst(m_acceptors)) {
+        QMetaObject::invokeMethod(l_acceptor, &Acceptor::close);
+    }
+}
+
+quint16 AcceptorPool::serverPort() const
+{
+    return m_port;
+}
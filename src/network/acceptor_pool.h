@@ -0,0 +1,152 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#ifndef ACCEPTOR_POOL_H
+#define ACCEPTOR_POOL_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QHostAddress>
+#include <QList>
+#include <QObject>
+#include <QPair>
+#include <QSharedPointer>
+#include <QWebSocket>
+
+class AdmissionControl;
+class QTcpServer;
+class QThread;
+class QWebSocketServer;
+
+/**
+ * @brief Accepts connections on a listening socket of its own and performs their WebSocket handshake.
+ *
+ * @details Lives on an acceptor thread. Finished connections are moved to the thread of the server.
+ */
+class Acceptor : public QObject
+{
+    Q_OBJECT
+
+  public:
+    /**
+     * @param f_descriptor A listening socket, see ListenSocket::openReusePort(). Ownership passes to the acceptor.
+     * @param f_admission The admission control of the server, shared by all acceptors.
+     * @param f_target_thread The thread finished connections are moved to.
+     */
+    Acceptor(qintptr f_descriptor, QSharedPointer<AdmissionControl> f_admission, QThread *f_target_thread);
+
+  public slots:
+    /**
+     * @brief Starts accepting connections. Must be called on the acceptor thread.
+     */
+    void start();
+
+    /**
+     * @brief Stops accepting connections. Handshakes in progress are still completed.
+     */
+    void close();
+
+  signals:
+    /**
+     * @brief Emitted when a connection completed its handshake. The socket already lives on the target thread.
+     */
+    void socketReady(QWebSocket *f_socket);
+
+  private:
+    /**
+     * @brief Admits pending TCP connections and starts their handshake.
+     */
+    void handleTcpConnections();
+
+    /**
+     * @brief Hands connections that completed their handshake to the target thread.
+     */
+    void handleWebSockets();
+
+    qintptr m_descriptor;
+    QSharedPointer<AdmissionControl> m_admission;
+    QThread *m_target_thread;
+    QTcpServer *m_listener = nullptr;
+    QWebSocketServer *m_upgrader = nullptr;
+
+    /**
+     * @brief When the handshake of each connection started, by remote address and port.
+     */
+    QHash<QPair<QHostAddress, quint16>, qint64> m_handshakes;
+    QElapsedTimer m_clock;
+};
+
+/**
+ * @brief Runs several acceptors, each on its own thread with its own SO_REUSEPORT listener.
+ *
+ * @details The kernel spreads incoming connections over the listeners, so a flood of connection attempts is
+ * handled by the acceptor threads instead of queueing up behind game logic.
+ *
+ * Connections are admitted by the admission control of the server before their handshake. They stay counted until
+ * their TCP socket is destroyed, so the server must not admit or release them again.
+ */
+class AcceptorPool : public QObject
+{
+    Q_OBJECT
+
+  public:
+    /**
+     * @param f_admission The admission control of the server.
+     * @param parent Qt-based parent.
+     */
+    AcceptorPool(QSharedPointer<AdmissionControl> f_admission, QObject *parent = nullptr);
+
+    /**
+     * @brief Stops all acceptor threads. Connections already handed over are not affected.
+     */
+    ~AcceptorPool();
+
+    /**
+     * @brief Opens the listeners and starts the acceptor threads.
+     *
+     * @param f_address The address to listen on.
+     * @param f_port The port to listen on. If 0, all acceptors share the port picked for the first one.
+     * @param f_threads The number of acceptor threads.
+     *
+     * @return False if any listener could not be opened. No acceptor is running then.
+     */
+    bool start(const QHostAddress &f_address, quint16 f_port, int f_threads);
+
+    /**
+     * @brief Stops accepting new connections.
+     */
+    void close();
+
+    /**
+     * @brief Returns the port the acceptors listen on.
+     */
+    quint16 serverPort() const;
+
+  signals:
+    /**
+     * @brief Emitted on the thread of the pool when a connection completed its handshake.
+     */
+    void newConnection(QWebSocket *f_socket);
+
+  private:
+    QSharedPointer<AdmissionControl> m_admission;
+    QList<QThread *> m_threads;
+    QList<Acceptor *> m_acceptors;
+    quint16 m_port = 0;
+};
+
+#endif // ACCEPTOR_POOL_H
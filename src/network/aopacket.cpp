@@ -56,6 +56,9 @@ const QStringList AOPacket::getContent()
 
 QString AOPacket::toString()
 {
+    if (!m_encoded.isNull()) {
+        return m_encoded;
+    }
     if (!isPacketEscaped() && !(getPacketInfo().header == "LE")) {
         // We will never send unescaped data to a client, unless its evidence.
         this->escapeContent();
@@ -64,18 +67,23 @@ QString AOPacket::toString()
         // Of course AO has SOME expection to the rule.
         this->escapeEvidence();
     }
-    return QString("%1#%2#%3").arg(getPacketInfo().header, m_content.join("#"), packetFinished);
+    m_encoded = QString("%1#%2#%3").arg(getPacketInfo().header, m_content.join("#"), packetFinished);
+    return m_encoded;
 }
 
 QByteArray AOPacket::toUtf8()
 {
-    QString l_packet = this->toString();
-    return l_packet.toUtf8();
+    if (m_encoded_utf8.isNull()) {
+        m_encoded_utf8 = toString().toUtf8();
+    }
+    return m_encoded_utf8;
 }
 
 void AOPacket::setContentField(int f_content_index, QString f_content_data)
 {
     m_content[f_content_index] = f_content_data;
+    m_encoded.clear();
+    m_encoded_utf8.clear();
 }
 
 void AOPacket::escapeContent()
@@ -84,6 +92,8 @@ void AOPacket::escapeContent()
         .replaceInStrings("%", "<percent>")
         .replaceInStrings("$", "<dollar>")
         .replaceInStrings("&", "<and>");
+    m_encoded.clear();
+    m_encoded_utf8.clear();
     this->setPacketEscaped(true);
 }
 
@@ -93,6 +103,8 @@ void AOPacket::unescapeContent()
         .replaceInStrings("<percent>", "%")
         .replaceInStrings("<dollar>", "$")
         .replaceInStrings("<and>", "&");
+    m_encoded.clear();
+    m_encoded_utf8.clear();
     this->setPacketEscaped(false);
 }
 
@@ -101,6 +113,8 @@ void AOPacket::escapeEvidence()
     m_content.replaceInStrings("#", "<num>")
         .replaceInStrings("%", "<percent>")
         .replaceInStrings("$", "<dollar>");
+    m_encoded.clear();
+    m_encoded_utf8.clear();
     this->setPacketEscaped(true);
 }
 
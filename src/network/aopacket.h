@@ -55,6 +55,9 @@ class AOPacket
     /**
      * @brief Converts the header and content into a single string.
      *
+     * @details The result is cached until the content changes, so a packet broadcast to many clients is only
+     * escaped and joined once.
+     *
      * @return String converted packet.
      */
     QString toString();
@@ -62,6 +65,8 @@ class AOPacket
     /**
      * @brief Converts the entire packet, header and content, to a UTF8 formatted ByteArray.
      *
+     * @details Cached like toString(), so a packet broadcast to many clients is only encoded once.
+     *
      * @return A UTF-8 representation of the packet.
      */
     QByteArray toUtf8();
@@ -127,6 +132,16 @@ class AOPacket
      */
     bool m_escaped;
 
+    /**
+     * @brief The cached result of toString(). Null if the content changed since it was last built.
+     */
+    QString m_encoded;
+
+    /**
+     * @brief The cached result of toUtf8(). Null if the content changed since it was last built.
+     */
+    QByteArray m_encoded_utf8;
+
     /**
      * @brief According to AO documentation a complete packet is finished using the percent symbol.
      *
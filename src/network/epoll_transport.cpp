@@ -0,0 +1,739 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#include "network/epoll_transport.h"
+#include "network/listen_socket.h"
+#include "network/network_socket.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QSocketNotifier>
+#include <QTimer>
+#include <QtEndian>
+
+#include <utility>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace {
+/**
+ * @brief Opening handshakes larger than this are refused.
+ */
+constexpr qsizetype MAX_HANDSHAKE = 8192;
+
+/**
+ * @brief Bytes read from a connection at once.
+ */
+constexpr qsizetype READ_CHUNK = 16384;
+
+/**
+ * @brief Clients with more than this many bytes waiting to be written are disconnected.
+ */
+constexpr qint64 MAX_OUTBOUND = 2 * 1024 * 1024;
+
+constexpr int MAX_IOVECS = 64;
+constexpr int MAX_EVENTS = 64;
+
+constexpr qint64 HANDSHAKE_TIMEOUT = 10000;
+constexpr qint64 CLOSE_TIMEOUT = 5000;
+constexpr int SWEEP_INTERVAL = 5000;
+
+constexpr quint8 OPCODE_CONTINUATION = 0x0;
+constexpr quint8 OPCODE_TEXT = 0x1;
+constexpr quint8 OPCODE_BINARY = 0x2;
+constexpr quint8 OPCODE_CLOSE = 0x8;
+constexpr quint8 OPCODE_PING = 0x9;
+constexpr quint8 OPCODE_PONG = 0xA;
+
+constexpr quint16 CLOSE_GOING_AWAY = 1001;
+constexpr quint16 CLOSE_PROTOCOL_ERROR = 1002;
+constexpr quint16 CLOSE_TOO_LARGE = 1009;
+
+const QByteArray WEBSOCKET_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+} // namespace
+
+EpollConnection::EpollConnection(EpollTransport *f_transport, int f_descriptor, const QHostAddress &f_peer_address) :
+    m_transport(f_transport),
+    m_descriptor(f_descriptor),
+    m_peer_address(f_peer_address)
+{}
+
+QHostAddress EpollConnection::peerAddress() const
+{
+    return m_peer_address;
+}
+
+void EpollConnection::sendText(const QList<QByteArray> &f_parts)
+{
+    if (m_transport && m_state == State::OPEN) {
+        m_transport->queueFrame(this, OPCODE_TEXT, f_parts);
+    }
+}
+
+void EpollConnection::close(quint16 f_code)
+{
+    if (m_transport) {
+        m_transport->closeConnection(this, f_code);
+    }
+}
+
+void EpollConnection::release()
+{
+    if (!m_transport) {
+        // The transport is gone and already closed the descriptor.
+        delete this;
+        return;
+    }
+    m_transport->release(this);
+}
+
+qint64 EpollConnection::memoryFootprint() const
+{
+    // Queued payloads are shared with every other recipient, so only the list holding them is counted.
+    return sizeof(EpollConnection) + m_inbound.capacity() + m_message.capacity() + m_outbound.capacity() * qint64(sizeof(QByteArray));
+}
+
+#ifdef Q_OS_LINUX
+bool EpollTransport::isSupported()
+{
+    return true;
+}
+
+EpollTransport::EpollTransport(QObject *parent) :
+    QObject(parent),
+    m_sweep_timer(new QTimer(this))
+{
+    m_clock.start();
+    connect(m_sweep_timer, &QTimer::timeout, this, &EpollTransport::sweep);
+}
+
+EpollTransport::~EpollTransport()
+{
+    close();
+    for (EpollConnection *l_connection : qAsConst(m_connections)) {
+        if (l_connection->m_descriptor != -1) {
+            ::close(l_connection->m_descriptor);
+            l_connection->m_descriptor = -1;
+        }
+        l_connection->m_state = EpollConnection::State::CLOSED;
+        // Connections held by a socket free themselves once released.
+        if (l_connection->m_socket == nullptr) {
+            delete l_connection;
+        }
+    }
+    if (m_epoll != -1) {
+        ::close(m_epoll);
+    }
+}
+
+bool EpollTransport::start(qintptr f_descriptor)
+{
+    m_listener = static_cast<int>(f_descriptor);
+    m_epoll = ::epoll_create1(EPOLL_CLOEXEC);
+    const int l_flags = ::fcntl(m_listener, F_GETFL, 0);
+    epoll_event l_event = {};
+    l_event.events = EPOLLIN;
+    l_event.data.ptr = nullptr;
+    if (m_epoll == -1 || l_flags == -1 || ::fcntl(m_listener, F_SETFL, l_flags | O_NONBLOCK) == -1 ||
+        ::epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_listener, &l_event) == -1) {
+        qWarning() << "[EpollTransport]"
+                   << "Unable to set up epoll:" << std::strerror(errno);
+        close();
+        return false;
+    }
+    m_port = ListenSocket::localPort(m_listener);
+
+    m_notifier = new QSocketNotifier(m_epoll, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, &EpollTransport::processEvents);
+    m_sweep_timer->start(SWEEP_INTERVAL);
+    return true;
+}
+
+void EpollTransport::close()
+{
+    if (m_listener == -1) {
+        return;
+    }
+    if (m_epoll != -1 && !m_accept_paused) {
+        ::epoll_ctl(m_epoll, EPOLL_CTL_DEL, m_listener, nullptr);
+    }
+    ::close(m_listener);
+    m_listener = -1;
+}
+
+quint16 EpollTransport::serverPort() const
+{
+    return m_port;
+}
+
+void EpollTransport::processEvents()
+{
+    epoll_event l_events[MAX_EVENTS];
+    const int l_count = ::epoll_wait(m_epoll, l_events, MAX_EVENTS, 0);
+    for (int i = 0; i < l_count; i++) {
+        EpollConnection *l_connection = static_cast<EpollConnection *>(l_events[i].data.ptr);
+        if (l_connection == nullptr) {
+            acceptConnections();
+            continue;
+        }
+        if (l_connection->m_descriptor == -1) {
+            continue;
+        }
+        const quint32 l_ready = l_events[i].events;
+        if (l_ready & EPOLLOUT) {
+            l_connection->m_writable = true;
+            watch(l_connection);
+            writeTo(l_connection);
+        }
+        if (l_connection->m_descriptor != -1 && (l_ready & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+            readFrom(l_connection);
+        }
+    }
+    collect();
+}
+
+void EpollTransport::acceptConnections()
+{
+    while (m_listener != -1) {
+        sockaddr_storage l_address = {};
+        socklen_t l_length = sizeof(l_address);
+        const int l_descriptor = ::accept4(m_listener, reinterpret_cast<sockaddr *>(&l_address), &l_length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (l_descriptor == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EMFILE || errno == ENFILE) {
+                // The listener would stay readable and spin the event loop, so stop watching it for a while.
+                qWarning() << "[EpollTransport]"
+                           << "Out of file descriptors, pausing new connections.";
+                ::epoll_ctl(m_epoll, EPOLL_CTL_DEL, m_listener, nullptr);
+                m_accept_paused = true;
+            }
+            else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                qWarning() << "[EpollTransport]"
+                           << "Unable to accept connection:" << std::strerror(errno);
+            }
+            return;
+        }
+
+        // Writes are already batched per event loop iteration, Nagle would only add latency.
+        const int l_enable = 1;
+        ::setsockopt(l_descriptor, IPPROTO_TCP, TCP_NODELAY, &l_enable, sizeof(l_enable));
+
+        EpollConnection *l_connection = new EpollConnection(this, l_descriptor, QHostAddress(reinterpret_cast<sockaddr *>(&l_address)));
+        l_connection->m_since = m_clock.elapsed();
+        epoll_event l_event = {};
+        l_event.events = EPOLLIN;
+        l_event.data.ptr = l_connection;
+        if (::epoll_ctl(m_epoll, EPOLL_CTL_ADD, l_descriptor, &l_event) == -1) {
+            ::close(l_descriptor);
+            delete l_connection;
+            continue;
+        }
+        m_connections.insert(l_connection);
+    }
+}
+
+void EpollTransport::readFrom(EpollConnection *f_connection)
+{
+    QByteArray &l_inbound = f_connection->m_inbound;
+    const qsizetype l_size = l_inbound.size();
+    l_inbound.resize(l_size + READ_CHUNK);
+    ssize_t l_read;
+    do {
+        l_read = ::recv(f_connection->m_descriptor, l_inbound.data() + l_size, READ_CHUNK, 0);
+    } while (l_read == -1 && errno == EINTR);
+    const int l_error = errno;
+    if (l_read <= 0) {
+        l_inbound.resize(l_size);
+        if (l_read == -1 && (l_error == EAGAIN || l_error == EWOULDBLOCK)) {
+            return;
+        }
+        finish(f_connection);
+        return;
+    }
+    l_inbound.resize(l_size + l_read);
+
+    switch (f_connection->m_state) {
+    case EpollConnection::State::HANDSHAKE:
+        handleHandshake(f_connection);
+        break;
+    case EpollConnection::State::OPEN:
+        handleFrames(f_connection);
+        break;
+    default:
+        // Waiting for the client to close its side, anything it still sends is ignored.
+        l_inbound.clear();
+        break;
+    }
+}
+
+void EpollTransport::handleHandshake(EpollConnection *f_connection)
+{
+    QByteArray &l_inbound = f_connection->m_inbound;
+    const qsizetype l_end = l_inbound.indexOf("\r\n\r\n");
+    if (l_end == -1) {
+        if (l_inbound.size() > MAX_HANDSHAKE) {
+            finish(f_connection);
+        }
+        return;
+    }
+
+    const QList<QByteArray> l_lines = l_inbound.left(l_end).split('\n');
+    l_inbound.remove(0, l_end + 4);
+    bool l_upgrade = false;
+    QByteArray l_key;
+    QByteArray l_version;
+    QByteArray l_real_ip;
+    QByteArray l_forwarded_for;
+    for (qsizetype i = 1; i < l_lines.size(); i++) {
+        const QByteArray &l_line = l_lines.at(i);
+        const qsizetype l_colon = l_line.indexOf(':');
+        if (l_colon == -1) {
+            continue;
+        }
+        const QByteArray l_name = l_line.left(l_colon).trimmed().toLower();
+        const QByteArray l_value = l_line.mid(l_colon + 1).trimmed();
+        if (l_name == "upgrade") {
+            l_upgrade = l_value.toLower().contains("websocket");
+        }
+        else if (l_name == "sec-websocket-key") {
+            l_key = l_value;
+        }
+        else if (l_name == "sec-websocket-version") {
+            l_version = l_value;
+        }
+        else if (l_name == "x-real-ip") {
+            l_real_ip = l_value;
+        }
+        else if (l_name == "x-forwarded-for") {
+            l_forwarded_for = l_value;
+        }
+    }
+
+    if (!l_lines.first().startsWith("GET ") || !l_upgrade || l_key.isEmpty()) {
+        queueRaw(f_connection, "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+        closeConnection(f_connection, 0);
+        return;
+    }
+    if (l_version != "13") {
+        queueRaw(f_connection, "HTTP/1.1 426 Upgrade Required\r\nSec-WebSocket-Version: 13\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+        closeConnection(f_connection, 0);
+        return;
+    }
+
+    const QByteArray l_accept = QCryptographicHash::hash(l_key + WEBSOCKET_GUID, QCryptographicHash::Sha1).toBase64();
+    queueRaw(f_connection, "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: " + l_accept + "\r\n\r\n");
+    f_connection->m_state = EpollConnection::State::OPEN;
+    f_connection->m_since = m_clock.elapsed();
+    f_connection->m_peer_address = NetworkSocket::forwardedAddress(f_connection->m_peer_address, l_real_ip, l_forwarded_for);
+    f_connection->m_socket = new NetworkSocket(f_connection);
+    emit newConnection(f_connection->m_socket);
+
+    if (l_inbound.isEmpty()) {
+        l_inbound.clear();
+    }
+    else {
+        handleFrames(f_connection);
+    }
+}
+
+void EpollTransport::handleFrames(EpollConnection *f_connection)
+{
+    QByteArray &l_inbound = f_connection->m_inbound;
+    qsizetype l_offset = 0;
+    while (f_connection->m_state == EpollConnection::State::OPEN) {
+        const qsizetype l_available = l_inbound.size() - l_offset;
+        if (l_available < 2) {
+            break;
+        }
+        const uchar *l_data = reinterpret_cast<const uchar *>(l_inbound.constData()) + l_offset;
+        const bool l_final = l_data[0] & 0x80;
+        const quint8 l_opcode = l_data[0] & 0x0F;
+        const bool l_control = l_opcode & 0x08;
+        quint64 l_length = l_data[1] & 0x7F;
+        qsizetype l_header = 2;
+
+        // No extension was negotiated, and clients have to mask everything they send.
+        if ((l_data[0] & 0x70) != 0 || (l_data[1] & 0x80) == 0) {
+            closeConnection(f_connection, CLOSE_PROTOCOL_ERROR);
+            break;
+        }
+        if (l_length == 126) {
+            if (l_available < 4) {
+                break;
+            }
+            l_length = qFromBigEndian<quint16>(l_data + 2);
+            l_header = 4;
+        }
+        else if (l_length == 127) {
+            if (l_available < 10) {
+                break;
+            }
+            l_length = qFromBigEndian<quint64>(l_data + 2);
+            l_header = 10;
+        }
+        if (l_control && (!l_final || l_length > 125)) {
+            closeConnection(f_connection, CLOSE_PROTOCOL_ERROR);
+            break;
+        }
+        if (!l_control && quint64(f_connection->m_message.size()) + l_length > quint64(NetworkSocket::MAX_INCOMING_MESSAGE)) {
+            closeConnection(f_connection, CLOSE_TOO_LARGE);
+            break;
+        }
+        if (quint64(l_available) < quint64(l_header) + 4 + l_length) {
+            break;
+        }
+        if (!l_control && (l_opcode == OPCODE_CONTINUATION) != f_connection->m_fragmented) {
+            closeConnection(f_connection, CLOSE_PROTOCOL_ERROR);
+            break;
+        }
+
+        // Unmask straight into the message, or into a scratch buffer for control frames.
+        const uchar *l_mask = l_data + l_header;
+        const uchar *l_payload = l_mask + 4;
+        QByteArray l_control_payload;
+        QByteArray &l_target = l_control ? l_control_payload : f_connection->m_message;
+        const qsizetype l_start = l_target.size();
+        l_target.resize(l_start + qsizetype(l_length));
+        char *l_out = l_target.data() + l_start;
+        for (qsizetype i = 0; i < qsizetype(l_length); i++) {
+            l_out[i] = char(l_payload[i] ^ l_mask[i % 4]);
+        }
+        l_offset += l_header + 4 + qsizetype(l_length);
+
+        if (l_opcode == OPCODE_CLOSE) {
+            // Echo the status code and wait for the client to close the connection.
+            queueFrame(f_connection, OPCODE_CLOSE, {l_control_payload.left(2)});
+            f_connection->m_state = EpollConnection::State::CLOSING;
+            f_connection->m_since = m_clock.elapsed();
+            continue;
+        }
+        if (l_opcode == OPCODE_PING) {
+            queueFrame(f_connection, OPCODE_PONG, {l_control_payload});
+            continue;
+        }
+        if (l_opcode == OPCODE_PONG) {
+            continue;
+        }
+        if (l_opcode == OPCODE_TEXT || l_opcode == OPCODE_BINARY) {
+            f_connection->m_binary = l_opcode == OPCODE_BINARY;
+        }
+        else if (l_opcode != OPCODE_CONTINUATION) {
+            closeConnection(f_connection, CLOSE_PROTOCOL_ERROR);
+            break;
+        }
+
+        f_connection->m_fragmented = !l_final;
+        if (l_final) {
+            const QByteArray l_message = std::exchange(f_connection->m_message, QByteArray());
+            // Binary messages are ignored, like NetworkSocket does for QWebSocket.
+            if (!f_connection->m_binary && f_connection->m_socket != nullptr) {
+                f_connection->m_socket->handleMessage(QString::fromUtf8(l_message));
+            }
+        }
+    }
+
+    if (f_connection->m_state != EpollConnection::State::OPEN || l_offset == l_inbound.size()) {
+        l_inbound.clear();
+    }
+    else {
+        l_inbound.remove(0, l_offset);
+    }
+}
+
+void EpollTransport::queueFrame(EpollConnection *f_connection, quint8 f_opcode, const QList<QByteArray> &f_parts)
+{
+    qint64 l_length = 0;
+    for (const QByteArray &l_part : f_parts) {
+        l_length += l_part.size();
+    }
+
+    char l_header[10];
+    qsizetype l_header_size = 2;
+    l_header[0] = char(0x80 | f_opcode);
+    if (l_length < 126) {
+        l_header[1] = char(l_length);
+    }
+    else if (l_length < 65536) {
+        l_header[1] = char(126);
+        qToBigEndian<quint16>(quint16(l_length), l_header + 2);
+        l_header_size = 4;
+    }
+    else {
+        l_header[1] = char(127);
+        qToBigEndian<quint64>(quint64(l_length), l_header + 2);
+        l_header_size = 10;
+    }
+
+    queueRaw(f_connection, QByteArray(l_header, l_header_size));
+    for (const QByteArray &l_part : f_parts) {
+        if (!l_part.isEmpty()) {
+            queueRaw(f_connection, l_part);
+        }
+    }
+}
+
+void EpollTransport::queueRaw(EpollConnection *f_connection, const QByteArray &f_data)
+{
+    if (f_connection->m_descriptor == -1 || f_connection->m_shut_down) {
+        return;
+    }
+    f_connection->m_outbound.append(f_data);
+    f_connection->m_outbound_size += f_data.size();
+    if (f_connection->m_outbound_size > MAX_OUTBOUND) {
+        qWarning() << "[EpollTransport]"
+                   << "Disconnecting" << f_connection->m_peer_address.toString() << "as it does not read what it is sent.";
+        finish(f_connection);
+        return;
+    }
+
+    if (!f_connection->m_write_queued) {
+        f_connection->m_write_queued = true;
+        m_write_queue.append(f_connection);
+        if (m_write_queue.size() == 1) {
+            QMetaObject::invokeMethod(this, &EpollTransport::writeQueued, Qt::QueuedConnection);
+        }
+    }
+}
+
+void EpollTransport::writeQueued()
+{
+    const QList<EpollConnection *> l_queue = std::exchange(m_write_queue, {});
+    for (EpollConnection *l_connection : l_queue) {
+        l_connection->m_write_queued = false;
+        if (l_connection->m_descriptor != -1 && l_connection->m_writable) {
+            writeTo(l_connection);
+        }
+    }
+    collect();
+}
+
+void EpollTransport::writeTo(EpollConnection *f_connection)
+{
+    QList<QByteArray> &l_outbound = f_connection->m_outbound;
+    while (!l_outbound.isEmpty()) {
+        iovec l_vectors[MAX_IOVECS];
+        int l_count = 0;
+        for (; l_count < MAX_IOVECS && l_count < l_outbound.size(); l_count++) {
+            const QByteArray &l_chunk = l_outbound.at(l_count);
+            const qsizetype l_skip = l_count == 0 ? f_connection->m_outbound_offset : 0;
+            l_vectors[l_count].iov_base = const_cast<char *>(l_chunk.constData() + l_skip);
+            l_vectors[l_count].iov_len = size_t(l_chunk.size() - l_skip);
+        }
+
+        // sendmsg is writev with flags, which keeps a vanished client from raising SIGPIPE.
+        msghdr l_message = {};
+        l_message.msg_iov = l_vectors;
+        l_message.msg_iovlen = l_count;
+        const ssize_t l_written = ::sendmsg(f_connection->m_descriptor, &l_message, MSG_NOSIGNAL);
+        if (l_written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                f_connection->m_writable = false;
+                watch(f_connection);
+                return;
+            }
+            finish(f_connection);
+            return;
+        }
+
+        f_connection->m_outbound_size -= l_written;
+        qsizetype l_left = l_written;
+        while (l_left > 0) {
+            const qsizetype l_rest = l_outbound.first().size() - f_connection->m_outbound_offset;
+            if (l_left < l_rest) {
+                f_connection->m_outbound_offset += l_left;
+                break;
+            }
+            l_left -= l_rest;
+            l_outbound.removeFirst();
+            f_connection->m_outbound_offset = 0;
+        }
+    }
+    if (l_outbound.capacity() > MAX_IOVECS) {
+        l_outbound.squeeze();
+    }
+
+    if (f_connection->m_state == EpollConnection::State::CLOSING && !f_connection->m_shut_down) {
+        ::shutdown(f_connection->m_descriptor, SHUT_WR);
+        f_connection->m_shut_down = true;
+    }
+}
+
+void EpollTransport::closeConnection(EpollConnection *f_connection, quint16 f_code)
+{
+    if (f_connection->m_state == EpollConnection::State::OPEN) {
+        char l_payload[2];
+        qToBigEndian<quint16>(f_code, l_payload);
+        queueFrame(f_connection, OPCODE_CLOSE, {QByteArray(l_payload, 2)});
+    }
+    else if (f_connection->m_state != EpollConnection::State::HANDSHAKE) {
+        return;
+    }
+    // Closing a connection that is still in its handshake sends whatever response was queued.
+    f_connection->m_state = EpollConnection::State::CLOSING;
+    f_connection->m_since = m_clock.elapsed();
+    if (f_connection->m_outbound.isEmpty() && f_connection->m_writable && f_connection->m_descriptor != -1) {
+        writeTo(f_connection);
+    }
+}
+
+void EpollTransport::finish(EpollConnection *f_connection)
+{
+    if (f_connection->m_descriptor == -1) {
+        return;
+    }
+    ::epoll_ctl(m_epoll, EPOLL_CTL_DEL, f_connection->m_descriptor, nullptr);
+    ::close(f_connection->m_descriptor);
+    f_connection->m_descriptor = -1;
+    f_connection->m_state = EpollConnection::State::CLOSED;
+    f_connection->m_inbound.clear();
+    f_connection->m_message.clear();
+    f_connection->m_outbound.clear();
+    f_connection->m_outbound_offset = 0;
+    f_connection->m_outbound_size = 0;
+
+    if (f_connection->m_socket != nullptr) {
+        // Like QWebSocket, the socket learns about the disconnect from the event loop.
+        QMetaObject::invokeMethod(f_connection->m_socket, &NetworkSocket::clientDisconnected, Qt::QueuedConnection);
+    }
+    else {
+        m_graveyard.append(f_connection);
+    }
+}
+
+void EpollTransport::release(EpollConnection *f_connection)
+{
+    f_connection->m_socket = nullptr;
+    if (f_connection->m_state == EpollConnection::State::OPEN) {
+        closeConnection(f_connection, CLOSE_GOING_AWAY);
+    }
+    // Connections that are still closing are collected once they are finished.
+    if (f_connection->m_state != EpollConnection::State::CLOSED) {
+        return;
+    }
+    m_graveyard.append(f_connection);
+    if (!m_collect_queued) {
+        m_collect_queued = true;
+        QMetaObject::invokeMethod(
+            this, [this] {
+                m_collect_queued = false;
+                collect();
+            },
+            Qt::QueuedConnection);
+    }
+}
+
+void EpollTransport::watch(EpollConnection *f_connection)
+{
+    epoll_event l_event = {};
+    l_event.events = EPOLLIN | (f_connection->m_writable ? 0 : EPOLLOUT);
+    l_event.data.ptr = f_connection;
+    ::epoll_ctl(m_epoll, EPOLL_CTL_MOD, f_connection->m_descriptor, &l_event);
+}
+
+void EpollTransport::collect()
+{
+    const QList<EpollConnection *> l_graveyard = std::exchange(m_graveyard, {});
+    for (EpollConnection *l_connection : l_graveyard) {
+        m_connections.remove(l_connection);
+        m_write_queue.removeAll(l_connection);
+        delete l_connection;
+    }
+}
+
+void EpollTransport::sweep()
+{
+    const qint64 l_now = m_clock.elapsed();
+    for (EpollConnection *l_connection : qAsConst(m_connections)) {
+        const qint64 l_age = l_now - l_connection->m_since;
+        if ((l_connection->m_state == EpollConnection::State::HANDSHAKE && l_age > HANDSHAKE_TIMEOUT) ||
+            (l_connection->m_state == EpollConnection::State::CLOSING && l_age > CLOSE_TIMEOUT)) {
+            finish(l_connection);
+        }
+    }
+
+    if (m_accept_paused && m_listener != -1) {
+        epoll_event l_event = {};
+        l_event.events = EPOLLIN;
+        l_event.data.ptr = nullptr;
+        if (::epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_listener, &l_event) == 0) {
+            m_accept_paused = false;
+        }
+    }
+    collect();
+}
+#else
+bool EpollTransport::isSupported()
+{
+    return false;
+}
+
+EpollTransport::EpollTransport(QObject *parent) :
+    QObject(parent),
+    m_sweep_timer(nullptr)
+{}
+
+EpollTransport::~EpollTransport() {}
+
+bool EpollTransport::start(qintptr f_descriptor)
+{
+    qWarning() << "[EpollTransport]"
+               << "The epoll transport is only available on Linux.";
+    ListenSocket::close(f_descriptor);
+    return false;
+}
+
+void EpollTransport::close() {}
+
+quint16 EpollTransport::serverPort() const
+{
+    return 0;
+}
+
+void EpollTransport::queueFrame(EpollConnection *f_connection, quint8 f_opcode, const QList<QByteArray> &f_parts)
+{
+    Q_UNUSED(f_connection)
+    Q_UNUSED(f_opcode)
+    Q_UNUSED(f_parts)
+}
+
+void EpollTransport::closeConnection(EpollConnection *f_connection, quint16 f_code)
+{
+    Q_UNUSED(f_connection)
+    Q_UNUSED(f_code)
+}
+
+void EpollTransport::release(EpollConnection *f_connection)
+{
+    delete f_connection;
+}
+#endif
@@ -0,0 +1,254 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#ifndef EPOLL_TRANSPORT_H
+#define EPOLL_TRANSPORT_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QSet>
+
+class EpollTransport;
+class NetworkSocket;
+class QSocketNotifier;
+class QTimer;
+
+/**
+ * @brief A WebSocket connection served by EpollTransport.
+ *
+ * @details Once its handshake completed, the connection is handed to a NetworkSocket, which releases it when it is
+ * destroyed. The connection is not freed before that, so the NetworkSocket can keep using it after the client
+ * disconnected. Buffers are bounded, a client that sends oversized messages or does not read what it is sent is
+ * disconnected instead.
+ */
+class EpollConnection
+{
+  public:
+    /**
+     * @brief Returns the address of the client, taking proxy headers of the handshake into account.
+     */
+    QHostAddress peerAddress() const;
+
+    /**
+     * @brief Sends a text message made of the given UTF-8 parts, in order, as a single frame.
+     *
+     * @details The parts are queued as they are, so a part shared by many connections is never copied.
+     */
+    void sendText(const QList<QByteArray> &f_parts);
+
+    /**
+     * @brief Starts the closing handshake. Queued messages are sent first.
+     */
+    void close(quint16 f_code);
+
+    /**
+     * @brief Hands the connection back to the transport. It must not be used afterwards.
+     */
+    void release();
+
+    /**
+     * @brief Returns an estimate of the memory held by the connection, in bytes.
+     */
+    qint64 memoryFootprint() const;
+
+  private:
+    friend class EpollTransport;
+
+    enum class State
+    {
+        HANDSHAKE,
+        OPEN,
+        CLOSING,
+        CLOSED
+    };
+
+    EpollConnection(EpollTransport *f_transport, int f_descriptor, const QHostAddress &f_peer_address);
+
+    QPointer<EpollTransport> m_transport;
+    int m_descriptor;
+    State m_state = State::HANDSHAKE;
+    QHostAddress m_peer_address;
+
+    /**
+     * @brief The socket the connection was handed to. Null before the handshake and after release.
+     */
+    NetworkSocket *m_socket = nullptr;
+
+    /**
+     * @brief When the connection entered its current state, on the clock of the transport.
+     */
+    qint64 m_since = 0;
+
+    /**
+     * @brief Bytes received but not parsed yet.
+     */
+    QByteArray m_inbound;
+
+    /**
+     * @brief The unmasked payload of the message being received, which may span several frames.
+     */
+    QByteArray m_message;
+    bool m_fragmented = false;
+    bool m_binary = false;
+
+    /**
+     * @brief Frame headers and payloads waiting to be written, in order.
+     */
+    QList<QByteArray> m_outbound;
+    qsizetype m_outbound_offset = 0;
+    qint64 m_outbound_size = 0;
+
+    bool m_writable = true;
+    bool m_write_queued = false;
+    bool m_shut_down = false;
+};
+
+/**
+ * @brief A lightweight WebSocket server on top of epoll, as an alternative to QWebSocketServer.
+ *
+ * @details Every connection is a plain EpollConnection instead of a QWebSocket and its QTcpSocket. Incoming frames
+ * are unmasked straight into a UTF-8 buffer, and outgoing frames are written with a single gathering send per
+ * connection and event loop iteration, straight from the encoded packets shared by every recipient.
+ *
+ * The transport runs on the thread that created it. Its epoll instance is watched by a single QSocketNotifier, so
+ * it needs no thread of its own. Only available on Linux.
+ */
+class EpollTransport : public QObject
+{
+    Q_OBJECT
+
+  public:
+    /**
+     * @brief Returns whether the transport is available on this platform.
+     */
+    static bool isSupported();
+
+    EpollTransport(QObject *parent = nullptr);
+
+    /**
+     * @brief Closes the listener and every connection that was not handed to a NetworkSocket yet.
+     */
+    ~EpollTransport();
+
+    /**
+     * @brief Starts accepting connections on a listening socket.
+     *
+     * @param f_descriptor A listening socket, as returned by ListenSocket::open. The transport takes ownership of it.
+     *
+     * @return False if the transport could not be set up. The descriptor is closed then.
+     */
+    bool start(qintptr f_descriptor);
+
+    /**
+     * @brief Stops accepting new connections. Connections already accepted are not affected.
+     */
+    void close();
+
+    /**
+     * @brief Returns the port the transport is listening on.
+     */
+    quint16 serverPort() const;
+
+  signals:
+    /**
+     * @brief Emitted when a connection completed its handshake.
+     */
+    void newConnection(NetworkSocket *f_socket);
+
+  private:
+    friend class EpollConnection;
+
+    /**
+     * @brief Handles everything the epoll instance reported as ready.
+     */
+    void processEvents();
+
+    void acceptConnections();
+    void readFrom(EpollConnection *f_connection);
+
+    /**
+     * @brief Answers the opening handshake once the request is complete.
+     */
+    void handleHandshake(EpollConnection *f_connection);
+
+    /**
+     * @brief Parses complete frames and delivers finished messages to the socket.
+     */
+    void handleFrames(EpollConnection *f_connection);
+
+    /**
+     * @brief Queues a frame. It is written at the end of the event loop iteration.
+     */
+    void queueFrame(EpollConnection *f_connection, quint8 f_opcode, const QList<QByteArray> &f_parts);
+
+    /**
+     * @brief Queues raw bytes, like a handshake response.
+     */
+    void queueRaw(EpollConnection *f_connection, const QByteArray &f_data);
+
+    /**
+     * @brief Writes the queued data of every connection that has any.
+     */
+    void writeQueued();
+
+    void writeTo(EpollConnection *f_connection);
+    void closeConnection(EpollConnection *f_connection, quint16 f_code);
+
+    /**
+     * @brief Closes the descriptor and tells the socket the client disconnected.
+     */
+    void finish(EpollConnection *f_connection);
+
+    void release(EpollConnection *f_connection);
+
+    /**
+     * @brief Updates the events epoll reports for a connection.
+     */
+    void watch(EpollConnection *f_connection);
+
+    /**
+     * @brief Frees connections that are closed and no longer referenced.
+     */
+    void collect();
+
+    /**
+     * @brief Drops connections stuck in their opening or closing handshake.
+     */
+    void sweep();
+
+    int m_epoll = -1;
+    int m_listener = -1;
+    quint16 m_port = 0;
+    QSocketNotifier *m_notifier = nullptr;
+    QTimer *m_sweep_timer;
+    QElapsedTimer m_clock;
+    QSet<EpollConnection *> m_connections;
+    QList<EpollConnection *> m_write_queue;
+    QList<EpollConnection *> m_graveyard;
+    bool m_collect_queued = false;
+
+    /**
+     * @brief True while the listener is not watched because the process ran out of descriptors.
+     */
+    bool m_accept_paused = false;
+};
+
+#endif // EPOLL_TRANSPORT_H
@@ -0,0 +1,128 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#include "network/listen_socket.h"
+
+#include <QDebug>
+
+#ifdef Q_OS_UNIX
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#endif
+
+qintptr ListenSocket::openReusePort(const QHostAddress &f_address, quint16 f_port)
+{
+    return open(f_address, f_port, true);
+}
+
+#if defined(Q_OS_UNIX) && defined(SO_REUSEPORT)
+qintptr ListenSocket::open(const QHostAddress &f_address, quint16 f_port, bool f_reuse_port)
+{
+    const bool l_ipv4 = f_address.protocol() == QAbstractSocket::IPv4Protocol;
+    const int l_descriptor = ::socket(l_ipv4 ? AF_INET : AF_INET6, SOCK_STREAM, 0);
+    if (l_descriptor == -1) {
+        qWarning() << "[ListenSocket]"
+                   << "Unable to create socket:" << std::strerror(errno);
+        return -1;
+    }
+
+    const int l_enable = 1;
+    const int l_disable = 0;
+    ::setsockopt(l_descriptor, SOL_SOCKET, SO_REUSEADDR, &l_enable, sizeof(l_enable));
+    if (f_reuse_port && ::setsockopt(l_descriptor, SOL_SOCKET, SO_REUSEPORT, &l_enable, sizeof(l_enable)) == -1) {
+        qWarning() << "[ListenSocket]"
+                   << "Unable to set SO_REUSEPORT:" << std::strerror(errno);
+        ::close(l_descriptor);
+        return -1;
+    }
+
+    int l_result;
+    if (l_ipv4) {
+        sockaddr_in l_addr = {};
+        l_addr.sin_family = AF_INET;
+        l_addr.sin_port = htons(f_port);
+        l_addr.sin_addr.s_addr = htonl(f_address.toIPv4Address());
+        l_result = ::bind(l_descriptor, reinterpret_cast<sockaddr *>(&l_addr), sizeof(l_addr));
+    }
+    else {
+        // Any also takes IPv4 connections, matching what QTcpServer does.
+        if (f_address == QHostAddress::Any) {
+            ::setsockopt(l_descriptor, IPPROTO_IPV6, IPV6_V6ONLY, &l_disable, sizeof(l_disable));
+        }
+        sockaddr_in6 l_addr = {};
+        l_addr.sin6_family = AF_INET6;
+        l_addr.sin6_port = htons(f_port);
+        const Q_IPV6ADDR l_ipv6 = f_address == QHostAddress::Any ? QHostAddress(QHostAddress::AnyIPv6).toIPv6Address() : f_address.toIPv6Address();
+        std::memcpy(&l_addr.sin6_addr, l_ipv6.c, sizeof(l_ipv6.c));
+        l_result = ::bind(l_descriptor, reinterpret_cast<sockaddr *>(&l_addr), sizeof(l_addr));
+    }
+
+    if (l_result == -1 || ::listen(l_descriptor, SOMAXCONN) == -1) {
+        qWarning() << "[ListenSocket]"
+                   << "Unable to listen on port" << f_port << ":" << std::strerror(errno);
+        ::close(l_descriptor);
+        return -1;
+    }
+    return l_descriptor;
+}
+
+quint16 ListenSocket::localPort(qintptr f_descriptor)
+{
+    sockaddr_storage l_addr = {};
+    socklen_t l_length = sizeof(l_addr);
+    if (::getsockname(static_cast<int>(f_descriptor), reinterpret_cast<sockaddr *>(&l_addr), &l_length) == -1) {
+        return 0;
+    }
+    if (l_addr.ss_family == AF_INET) {
+        return ntohs(reinterpret_cast<sockaddr_in *>(&l_addr)->sin_port);
+    }
+    return ntohs(reinterpret_cast<sockaddr_in6 *>(&l_addr)->sin6_port);
+}
+
+void ListenSocket::close(qintptr f_descriptor)
+{
+    if (f_descriptor != -1) {
+        ::close(static_cast<int>(f_descriptor));
+    }
+}
+#else
+qintptr ListenSocket::open(const QHostAddress &f_address, quint16 f_port, bool f_reuse_port)
+{
+    Q_UNUSED(f_address)
+    Q_UNUSED(f_port)
+    Q_UNUSED(f_reuse_port)
+    qWarning() << "[ListenSocket]"
+               << "Native listening sockets are not supported on this platform.";
+    return -1;
+}
+
+quint16 ListenSocket::localPort(qintptr f_descriptor)
+{
+    Q_UNUSED(f_descriptor)
+    return 0;
+}
+
+void ListenSocket::close(qintptr f_descriptor)
+{
+    Q_UNUSED(f_descriptor)
+}
+#endif
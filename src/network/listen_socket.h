@@ -0,0 +1,68 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#ifndef LISTEN_SOCKET_H
+#define LISTEN_SOCKET_H
+
+#include <QHostAddress>
+
+/**
+ * @brief Opens listening sockets that several processes or threads can bind to at the same time.
+ *
+ * @details Qt does not expose SO_REUSEPORT, so the socket is set up natively and handed to Qt afterwards,
+ * for example through QWebSocketServer::setNativeDescriptor.
+ */
+class ListenSocket
+{
+  public:
+    /**
+     * @brief Opens a TCP socket with SO_REUSEPORT set, binds it to the given address and starts listening.
+     *
+     * @details Only available on platforms that support SO_REUSEPORT. Everywhere else this always fails.
+     *
+     * @param f_address The address to bind to. QHostAddress::Any accepts both IPv4 and IPv6 connections.
+     * @param f_port The port to bind to.
+     *
+     * @return The native socket descriptor, or -1 if the socket could not be set up.
+     */
+    static qintptr openReusePort(const QHostAddress &f_address, quint16 f_port);
+
+    /**
+     * @brief Opens a TCP socket, binds it to the given address and starts listening.
+     *
+     * @details Only available on platforms that support SO_REUSEPORT, even if f_reuse_port is false.
+     *
+     * @param f_address The address to bind to. QHostAddress::Any accepts both IPv4 and IPv6 connections.
+     * @param f_port The port to bind to.
+     * @param f_reuse_port Whether SO_REUSEPORT is set on the socket.
+     *
+     * @return The native socket descriptor, or -1 if the socket could not be set up.
+     */
+    static qintptr open(const QHostAddress &f_address, quint16 f_port, bool f_reuse_port);
+
+    /**
+     * @brief Returns the port a socket is bound to, or 0 if it cannot be determined.
+     */
+    static quint16 localPort(qintptr f_descriptor);
+
+    /**
+     * @brief Closes a descriptor returned by open or openReusePort that was never handed over.
+     */
+    static void close(qintptr f_descriptor);
+};
+
+#endif // LISTEN_SOCKET_H
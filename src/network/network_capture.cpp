@@ -0,0 +1,116 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#include "network/network_capture.h"
+
+#include <QDebug>
+
+const QByteArray NetworkCapture::MAGIC = QByteArrayLiteral("AKCAP");
+
+NetworkCapture::NetworkCapture(const QString &f_path, QObject *parent) :
+    QObject(parent),
+    m_file(f_path),
+    m_flush_timer(new QTimer(this))
+{
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Unable to open traffic capture" << f_path;
+        return;
+    }
+    m_stream.setDevice(&m_file);
+    m_stream.setVersion(QDataStream::Qt_6_0);
+    m_stream.writeRawData(MAGIC.constData(), MAGIC.size());
+    m_stream << VERSION;
+    m_clock.start();
+
+    connect(m_flush_timer, &QTimer::timeout, this, [this] { m_file.flush(); });
+    m_flush_timer->start(5000);
+    qInfo() << "Recording network traffic to" << f_path;
+}
+
+NetworkCapture::~NetworkCapture()
+{
+    if (m_file.isOpen()) {
+        m_file.flush();
+        m_file.close();
+    }
+}
+
+bool NetworkCapture::isOpen() const
+{
+    return m_file.isOpen();
+}
+
+quint32 NetworkCapture::nextConnectionId()
+{
+    return m_next_connection++;
+}
+
+void NetworkCapture::recordConnect(quint32 f_connection, const QHostAddress &f_address)
+{
+    writeRecord(RecordType::CONNECT, f_connection, f_address.toString().toUtf8());
+}
+
+void NetworkCapture::recordFrame(quint32 f_connection, const QString &f_data)
+{
+    writeRecord(RecordType::FRAME, f_connection, f_data.toUtf8());
+}
+
+void NetworkCapture::recordDisconnect(quint32 f_connection)
+{
+    writeRecord(RecordType::DISCONNECT, f_connection, QByteArray());
+}
+
+bool NetworkCapture::readFile(const QString &f_path, QList<Record> &f_records)
+{
+    QFile l_file(f_path);
+    if (!l_file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QDataStream l_stream(&l_file);
+    l_stream.setVersion(QDataStream::Qt_6_0);
+
+    QByteArray l_magic(MAGIC.size(), Qt::Uninitialized);
+    quint16 l_version = 0;
+    if (l_stream.readRawData(l_magic.data(), l_magic.size()) != MAGIC.size() || l_magic != MAGIC) {
+        return false;
+    }
+    l_stream >> l_version;
+    if (l_version != VERSION) {
+        qWarning() << "Unsupported capture version" << l_version;
+        return false;
+    }
+
+    while (!l_stream.atEnd()) {
+        Record l_record;
+        quint8 l_type;
+        l_stream >> l_type >> l_record.connection >> l_record.timestamp >> l_record.data;
+        if (l_stream.status() != QDataStream::Ok) {
+            break;
+        }
+        l_record.type = static_cast<RecordType>(l_type);
+        f_records.append(l_record);
+    }
+    return true;
+}
+
+void NetworkCapture::writeRecord(RecordType f_type, quint32 f_connection, const QByteArray &f_data)
+{
+    if (!m_file.isOpen()) {
+        return;
+    }
+    m_stream << static_cast<quint8>(f_type) << f_connection << m_clock.nsecsElapsed() << f_data;
+}
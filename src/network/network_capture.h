@@ -0,0 +1,154 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#ifndef NETWORK_CAPTURE_H
+#define NETWORK_CAPTURE_H
+
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHostAddress>
+#include <QObject>
+#include <QTimer>
+
+/**
+ * @brief Records inbound network traffic into a compact binary capture file.
+ *
+ * @details A capture starts with a small header, followed by one record per event. Every record holds the
+ * record type, the serial of the connection, a monotonic timestamp in nanoseconds since the capture was opened
+ * and the record payload. Connection records carry the remote address, frame records the raw frame
+ * exactly as it was received.
+ *
+ * Captures are meant to be fed back into a server by the replay tool.
+ */
+class NetworkCapture : public QObject
+{
+    Q_OBJECT
+
+  public:
+    /**
+     * @brief The kinds of records stored in a capture.
+     */
+    enum class RecordType : quint8
+    {
+        CONNECT,
+        FRAME,
+        DISCONNECT
+    };
+
+    /**
+     * @brief A single record of a capture.
+     */
+    struct Record
+    {
+        RecordType type;    //!< The type of event.
+        quint32 connection; //!< Serial of the connection the record belongs to.
+        qint64 timestamp;   //!< Nanoseconds since the start of the capture.
+        QByteArray data;    //!< Remote address for connects, UTF-8 frame data for frames, empty otherwise.
+    };
+
+    /**
+     * @brief Opens a new capture file. Existing files are overwritten.
+     *
+     * @param f_path Path of the capture file.
+     * @param parent QObject pointer to the parent object.
+     */
+    NetworkCapture(const QString &f_path, QObject *parent = nullptr);
+
+    /**
+     * @brief Flushes and closes the capture file.
+     */
+    virtual ~NetworkCapture();
+
+    /**
+     * @brief Returns true if the capture file could be opened for writing.
+     */
+    bool isOpen() const;
+
+    /**
+     * @brief Returns a new, unique serial for a connection.
+     */
+    quint32 nextConnectionId();
+
+    /**
+     * @brief Records a new connection.
+     */
+    void recordConnect(quint32 f_connection, const QHostAddress &f_address);
+
+    /**
+     * @brief Records an inbound frame.
+     */
+    void recordFrame(quint32 f_connection, const QString &f_data);
+
+    /**
+     * @brief Records the end of a connection.
+     */
+    void recordDisconnect(quint32 f_connection);
+
+    /**
+     * @brief Reads all records of a capture file.
+     *
+     * @param f_path Path of the capture file.
+     * @param f_records List the records are appended to.
+     *
+     * @return True if the file is a valid capture. A truncated last record is silently dropped.
+     */
+    static bool readFile(const QString &f_path, QList<Record> &f_records);
+
+  private:
+    /**
+     * @brief Writes a single record into the capture file.
+     */
+    void writeRecord(RecordType f_type, quint32 f_connection, const QByteArray &f_data);
+
+    /**
+     * @brief Magic bytes at the start of every capture file.
+     */
+    static const QByteArray MAGIC;
+
+    /**
+     * @brief Format version of the capture.
+     */
+    static const quint16 VERSION = 1;
+
+    /**
+     * @brief The capture file.
+     */
+    QFile m_file;
+
+    /**
+     * @brief Stream used to serialise records.
+     */
+    QDataStream m_stream;
+
+    /**
+     * @brief Monotonic clock started when the capture was opened.
+     */
+    QElapsedTimer m_clock;
+
+    /**
+     * @brief Timer to periodically flush the capture to disk.
+     */
+    QTimer *m_flush_timer;
+
+    /**
+     * @brief Serial of the next connection.
+     */
+    quint32 m_next_connection = 0;
+};
+
+#endif // NETWORK_CAPTURE_H
@@ -16,35 +16,86 @@
 //    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
 //////////////////////////////////////////////////////////////////////////////////////
 #include "network/network_socket.h"
+#include "metrics.h"
+#include "network/epoll_transport.h"
+#include "network/network_capture.h"
 #include "packet/packet_factory.h"
 
+#include <utility>
+
+namespace {
+/**
+ * @brief Returns the size of a server to client WebSocket frame with the given payload size.
+ */
+qint64 frameSize(qint64 f_payload)
+{
+    if (f_payload < 126)
+        return f_payload + 2;
+    if (f_payload < 65536)
+        return f_payload + 4;
+    return f_payload + 10;
+}
+
+/**
+ * @brief Merged frames are sent early once they would grow past this many characters.
+ */
+constexpr qsizetype MAX_COALESCED_LENGTH = 65536;
+} // namespace
+
 NetworkSocket::NetworkSocket(QWebSocket *f_socket, QObject *parent) :
     QObject(parent)
 {
     m_client_socket = f_socket;
-    connect(m_client_socket, &QWebSocket::textMessageReceived, this, &NetworkSocket::handleMessage);
-    connect(m_client_socket, &QWebSocket::disconnected, this, &NetworkSocket::clientDisconnected);
+    // The same limit EpollTransport applies, so both transports refuse the same messages.
+    f_socket->setMaxAllowedIncomingMessageSize(MAX_INCOMING_MESSAGE);
+    connect(f_socket, &QWebSocket::textMessageReceived, this, &NetworkSocket::handleMessage);
+    connect(f_socket, &QWebSocket::disconnected, this, &NetworkSocket::clientDisconnected);
+    connect(f_socket, &QWebSocket::bytesWritten, this, [this](qint64 f_bytes) {
+        f_bytes = qMin(f_bytes, m_backlog);
+        m_backlog -= f_bytes;
+        Metrics::addSocketBacklog(-f_bytes);
+    });
+
+    QNetworkRequest l_request = f_socket->request();
+    m_socket_ip = forwardedAddress(f_socket->peerAddress(), l_request.rawHeader("x-real-ip"), l_request.rawHeader("x-forwarded-for"));
+}
+
+NetworkSocket::NetworkSocket(const QHostAddress &f_address, QObject *parent) :
+    QObject(parent),
+    m_socket_ip(f_address)
+{}
+
+NetworkSocket::NetworkSocket(EpollConnection *f_connection, QObject *parent) :
+    QObject(parent),
+    m_connection(f_connection),
+    m_socket_ip(f_connection->peerAddress())
+{}
 
-    bool l_is_local = (m_client_socket->peerAddress() == QHostAddress::LocalHost) ||
-                      (m_client_socket->peerAddress() == QHostAddress::LocalHostIPv6) ||
-                      (m_client_socket->peerAddress() == QHostAddress("::ffff:127.0.0.1"));
+QHostAddress NetworkSocket::forwardedAddress(const QHostAddress &f_peer, const QByteArray &f_real_ip, const QByteArray &f_forwarded_for)
+{
+    bool l_is_local = (f_peer == QHostAddress::LocalHost) ||
+                      (f_peer == QHostAddress::LocalHostIPv6) ||
+                      (f_peer == QHostAddress("::ffff:127.0.0.1"));
     // TLDR : We check if the header comes trough a proxy/tunnel running locally.
     // This is to ensure nobody can send those headers from the web.
-    QNetworkRequest l_request = m_client_socket->request();
-    if (l_request.hasRawHeader("x-real-ip") && l_is_local) {
-        m_socket_ip = QHostAddress(QString::fromUtf8(l_request.rawHeader("x-real-ip")));
-    }
-    else if (l_request.hasRawHeader("x-forwarded-for") && l_is_local) {
-        m_socket_ip = QHostAddress(QString::fromUtf8(l_request.rawHeader("x-forwarded-for")));
+    if (!f_real_ip.isEmpty() && l_is_local) {
+        return QHostAddress(QString::fromUtf8(f_real_ip));
     }
-    else {
-        m_socket_ip = f_socket->peerAddress();
+    if (!f_forwarded_for.isEmpty() && l_is_local) {
+        return QHostAddress(QString::fromUtf8(f_forwarded_for));
     }
+    return f_peer;
 }
 
 NetworkSocket::~NetworkSocket()
 {
-    m_client_socket->deleteLater();
+    Metrics::addSocketBacklog(-m_backlog);
+    if (m_client_socket) {
+        m_client_socket->deleteLater();
+    }
+    if (m_connection) {
+        m_connection->release();
+    }
 }
 
 QHostAddress NetworkSocket::peerAddress()
@@ -54,15 +105,91 @@ QHostAddress NetworkSocket::peerAddress()
 
 void NetworkSocket::close(QWebSocketProtocol::CloseCode f_code)
 {
+    // Whatever was queued, usually a BD or KK explaining the disconnect, goes out first.
+    flush();
+    if (m_connection) {
+        m_connection->close(f_code);
+        return;
+    }
+    if (!m_client_socket) {
+        // Mimic the asynchronous disconnect of a real socket.
+        if (!m_detached_closed) {
+            m_detached_closed = true;
+            QMetaObject::invokeMethod(this, &NetworkSocket::clientDisconnected, Qt::QueuedConnection);
+        }
+        return;
+    }
     m_client_socket->close(f_code);
 }
 
+void NetworkSocket::setCapture(NetworkCapture *f_capture)
+{
+    m_capture = f_capture;
+    m_capture_id = m_capture->nextConnectionId();
+    m_capture->recordConnect(m_capture_id, m_socket_ip);
+    connect(this, &NetworkSocket::clientDisconnected, this, [this] {
+        m_capture->recordDisconnect(m_capture_id);
+    });
+}
+
+void NetworkSocket::setCoalescing(bool f_enabled)
+{
+    m_coalescing = f_enabled;
+    if (!m_coalescing) {
+        flush();
+    }
+}
+
+bool NetworkSocket::isCoalescing() const
+{
+    return m_coalescing;
+}
+
+qint64 NetworkSocket::memoryFootprint() const
+{
+    qint64 l_bytes = sizeof(NetworkSocket);
+    if (!m_outbound.isNull()) {
+        l_bytes += qint64(sizeof(QArrayData)) + (m_outbound.capacity() + 1) * qint64(sizeof(QChar));
+    }
+    // The queued frames themselves are usually encoded once and shared by every recipient, so only the list counts.
+    if (!m_outbound_utf8.isEmpty()) {
+        l_bytes += qint64(sizeof(QArrayData)) + m_outbound_utf8.capacity() * qint64(sizeof(QByteArray));
+    }
+    if (m_connection) {
+        l_bytes += m_connection->memoryFootprint();
+    }
+    return l_bytes;
+}
+
+void NetworkSocket::flush()
+{
+    if (!m_outbound_utf8.isEmpty()) {
+        const QList<QByteArray> l_parts = std::exchange(m_outbound_utf8, {});
+        if (Metrics::isEnabled()) {
+            Metrics::recordOutbound(frameSize(m_outbound_utf8_size));
+        }
+        m_outbound_utf8_size = 0;
+        m_connection->sendText(l_parts);
+    }
+    if (m_outbound.isEmpty()) {
+        return;
+    }
+    QString l_frame;
+    l_frame.swap(m_outbound);
+    sendFrame(l_frame);
+}
+
 void NetworkSocket::handleMessage(QString f_data)
 {
     QString l_data = f_data;
 
+    if (m_capture) {
+        m_capture->recordFrame(m_capture_id, l_data);
+    }
+
     if (l_data.toUtf8().size() > 30720) {
-        m_client_socket->close(QWebSocketProtocol::CloseCodeTooMuchData);
+        close(QWebSocketProtocol::CloseCodeTooMuchData);
+        return;
     }
 
     QStringList l_all_packets = l_data.split("%");
@@ -74,6 +201,11 @@ void NetworkSocket::handleMessage(QString f_data)
     }
 
     for (const QString &l_single_packet : qAsConst(l_all_packets)) {
+        if (Metrics::isEnabled()) {
+            QStringView l_header = QStringView(l_single_packet).left(l_single_packet.indexOf('#'));
+            Metrics::recordInbound(l_header, Metrics::utf8Size(l_single_packet) + 1);
+        }
+
         AOPacket *l_packet = PacketFactory::createPacket(l_single_packet);
         if (!l_packet) {
             qDebug() << "Unimplemented packet: " << l_single_packet;
@@ -86,5 +218,83 @@ void NetworkSocket::handleMessage(QString f_data)
 
 void NetworkSocket::write(AOPacket *f_packet)
 {
-    m_client_socket->sendTextMessage(f_packet->toString());
+    if (m_connection) {
+        writeUtf8(f_packet->toUtf8());
+        return;
+    }
+    writeEncoded(f_packet->toString());
+}
+
+void NetworkSocket::writeEncoded(const QString &f_packets)
+{
+    if (m_connection) {
+        writeUtf8(f_packets.toUtf8());
+        return;
+    }
+
+    if (Metrics::isEnabled()) {
+        // Escaped content never contains a %, so every one of them terminates a packet.
+        Metrics::recordOutboundPackets(f_packets.count(QLatin1Char('%')));
+    }
+
+    if (!m_coalescing) {
+        sendFrame(f_packets);
+        return;
+    }
+
+    if (m_outbound.size() + f_packets.size() > MAX_COALESCED_LENGTH) {
+        flush();
+    }
+    m_outbound.append(f_packets);
+    scheduleFlush();
+}
+
+void NetworkSocket::writeUtf8(const QByteArray &f_packets)
+{
+    if (Metrics::isEnabled()) {
+        Metrics::recordOutboundPackets(f_packets.count('%'));
+    }
+
+    if (!m_coalescing) {
+        if (Metrics::isEnabled()) {
+            Metrics::recordOutbound(frameSize(f_packets.size()));
+        }
+        m_connection->sendText({f_packets});
+        return;
+    }
+
+    if (m_outbound_utf8_size + f_packets.size() > MAX_COALESCED_LENGTH) {
+        flush();
+    }
+    m_outbound_utf8.append(f_packets);
+    m_outbound_utf8_size += f_packets.size();
+    scheduleFlush();
+}
+
+void NetworkSocket::scheduleFlush()
+{
+    if (!m_flush_queued) {
+        m_flush_queued = true;
+        QMetaObject::invokeMethod(
+            this, [this] {
+                m_flush_queued = false;
+                flush();
+            },
+            Qt::QueuedConnection);
+    }
+}
+
+void NetworkSocket::sendFrame(const QString &f_frame)
+{
+    if (!m_client_socket) {
+        emit detachedWrite(f_frame);
+        return;
+    }
+    if (Metrics::isEnabled()) {
+        qint64 l_frame_size = frameSize(Metrics::utf8Size(f_frame));
+        Metrics::recordOutbound(l_frame_size);
+        m_backlog += l_frame_size;
+        Metrics::addSocketBacklog(l_frame_size);
+    }
+    m_client_socket->sendTextMessage(f_frame);
 }
@@ -25,12 +25,21 @@
 #include "network/aopacket.h"
 
 class AOPacket;
+class EpollConnection;
+class NetworkCapture;
 
 class NetworkSocket : public QObject
 {
     Q_OBJECT
 
   public:
+    /**
+     * @brief Messages larger than this are refused by the transport, which closes the connection.
+     *
+     * @details handleMessage() refuses anything over 30 KiB anyway, this only bounds what is buffered before that.
+     */
+    static constexpr qint64 MAX_INCOMING_MESSAGE = 65536;
+
     /**
      * @brief Constructor for the network socket class.
      * @param QWebSocket for communication with external AO2-Client or WebAO clients.
@@ -38,6 +47,25 @@ class NetworkSocket : public QObject
      */
     NetworkSocket(QWebSocket *f_socket, QObject *parent = nullptr);
 
+    /**
+     * @brief Constructor for a detached network socket that is not backed by a network connection.
+     *
+     * @details Detached sockets are used to feed recorded traffic into the server. Outgoing data is
+     * announced through detachedWrite() instead of being sent.
+     *
+     * @param The remote address the socket pretends to be connected from.
+     * @param Pointer to the parent object.
+     */
+    NetworkSocket(const QHostAddress &f_address, QObject *parent = nullptr);
+
+    /**
+     * @brief Constructor for a socket served by EpollTransport.
+     *
+     * @param The connection, which the socket releases when it is destroyed.
+     * @param Pointer to the parent object.
+     */
+    NetworkSocket(EpollConnection *f_connection, QObject *parent = nullptr);
+
     /**
      * @brief Default destructor for the NetworkSocket object.
      */
@@ -64,6 +92,68 @@ class NetworkSocket : public QObject
      */
     void write(AOPacket *f_packet);
 
+    /**
+     * @brief Writes already encoded packets to the network socket as a single frame.
+     *
+     * @details Clients split frames on the packet terminator, so several packets can share one frame.
+     *
+     * @param One or more complete packets, as returned by AOPacket::toString().
+     */
+    void writeEncoded(const QString &f_packets);
+
+    /**
+     * @brief Starts recording the inbound traffic of this socket into a capture.
+     *
+     * @param Capture the traffic is recorded into. It must outlive the socket.
+     */
+    void setCapture(NetworkCapture *f_capture);
+
+    /**
+     * @brief Sets whether packets written during one event loop iteration are merged into a single frame.
+     *
+     * @details Off by default, as it is only enabled once the client has identified itself as a version that
+     * splits frames on the packet terminator. Turning it off flushes any pending packets.
+     *
+     * @param Whether packets should be merged.
+     */
+    void setCoalescing(bool f_enabled);
+
+    /**
+     * @brief Returns whether the client can be sent several packets in one frame, see setCoalescing().
+     */
+    bool isCoalescing() const;
+
+    /**
+     * @brief Sends the packets that are waiting to be merged right away.
+     */
+    void flush();
+
+    /**
+     * @brief Returns an estimate of the memory held by the socket outside of Qt, in bytes.
+     */
+    qint64 memoryFootprint() const;
+
+    /**
+     * @brief Returns the address a client connected from, honouring the headers set by a local reverse proxy.
+     *
+     * @details The headers are only trusted if the connection itself comes from the local machine, so they cannot
+     * be forged from the web.
+     *
+     * @param The address of the connection.
+     * @param The X-Real-IP header of the handshake, if any.
+     * @param The X-Forwarded-For header of the handshake, if any.
+     */
+    static QHostAddress forwardedAddress(const QHostAddress &f_peer, const QByteArray &f_real_ip, const QByteArray &f_forwarded_for);
+
+  public slots:
+    /**
+     * @brief Handles the processing of WebSocket data.
+     *
+     * @details Decoded packets are emitted through handlePacket(). This is public so recorded frames
+     * can be fed into detached sockets.
+     */
+    void handleMessage(QString f_data);
+
   signals:
     /**
      * @brief handlePacket
@@ -76,16 +166,38 @@ class NetworkSocket : public QObject
      */
     void clientDisconnected();
 
-  private slots:
     /**
-     * @brief Handles the processing of WebSocket data.
+     * @brief Emitted in place of sending data when the socket is detached.
      *
-     * @return Decoded AOPacket to be processed by the child AOClient object.
+     * @param The data that would have been sent to the client.
      */
-    void handleMessage(QString f_data);
+    void detachedWrite(const QString &f_data);
 
   private:
-    QWebSocket *m_client_socket;
+    /**
+     * @brief Sends a frame to the client, or announces it for detached sockets.
+     */
+    void sendFrame(const QString &f_frame);
+
+    /**
+     * @brief Writes UTF-8 encoded packets to an EpollTransport connection, merging them if coalescing.
+     */
+    void writeUtf8(const QByteArray &f_packets);
+
+    /**
+     * @brief Queues a flush at the end of the current event loop iteration.
+     */
+    void scheduleFlush();
+
+    /**
+     * @brief The underlying WebSocket. Null for detached sockets.
+     */
+    QWebSocket *m_client_socket = nullptr;
+
+    /**
+     * @brief The underlying EpollTransport connection. Null unless the socket is served by it.
+     */
+    EpollConnection *m_connection = nullptr;
 
     /**
      * @brief Remote IP of the client.
@@ -93,6 +205,51 @@ class NetworkSocket : public QObject
      * @details In the case of the WebSocket we also check if this has been proxy forwarded.
      */
     QHostAddress m_socket_ip;
+
+    /**
+     * @brief Capture the inbound traffic is recorded into, if any.
+     */
+    NetworkCapture *m_capture = nullptr;
+
+    /**
+     * @brief Serial of this connection within the capture.
+     */
+    quint32 m_capture_id = 0;
+
+    /**
+     * @brief Bytes handed to the WebSocket that have not been written to the network yet.
+     *
+     * @details Only tracked while metrics are enabled.
+     */
+    qint64 m_backlog = 0;
+
+    /**
+     * @brief Whether a detached socket has already been closed.
+     */
+    bool m_detached_closed = false;
+
+    /**
+     * @brief Whether outbound packets are merged, see setCoalescing().
+     */
+    bool m_coalescing = false;
+
+    /**
+     * @brief Encoded packets waiting to be sent at the end of the current event loop iteration.
+     */
+    QString m_outbound;
+
+    /**
+     * @brief Encoded packets waiting to be sent over an EpollTransport connection.
+     *
+     * @details Kept as separate parts, so packets broadcast to many clients are shared instead of copied.
+     */
+    QList<QByteArray> m_outbound_utf8;
+    qsizetype m_outbound_utf8_size = 0;
+
+    /**
+     * @brief Whether a flush has been queued for the current event loop iteration.
+     */
+    bool m_flush_queued = false;
 };
 
 #endif
@@ -25,17 +25,18 @@ void PacketCasea::handlePacket(AreaData *area, AOClient &client) const
 
     QString l_case_title = m_content[0];
     QStringList l_needed_roles;
-    QList<bool> l_needs_list;
+    quint8 l_needs = 0;
     for (int i = 1; i <= 5; i++) {
         bool is_int = false;
         bool need = m_content[i].toInt(&is_int);
         if (!is_int)
             return;
-        l_needs_list.append(need);
+        if (need)
+            l_needs |= 1 << (i - 1);
     }
     QStringList l_roles = {"defense attorney", "prosecutor", "judge", "jurors", "stenographer"};
     for (int i = 0; i < 5; i++) {
-        if (l_needs_list[i])
+        if (l_needs & (1 << i))
             l_needed_roles.append(l_roles[i]);
     }
     if (l_needed_roles.isEmpty())
@@ -44,14 +45,10 @@ void PacketCasea::handlePacket(AreaData *area, AOClient &client) const
     QString l_message = "=== Case Announcement ===\r\n" + (client.name() == "" ? client.character() : client.name()) + " needs " + l_needed_roles.join(", ") + " for " + (l_case_title == "" ? "a case" : l_case_title) + "!";
 
     QList<AOClient *> l_clients_to_alert;
-    QSet<bool> l_needs_set(l_needs_list.begin(), l_needs_list.end());
-
     const QVector<AOClient *> l_clients = client.getServer()->getClients();
     for (AOClient *l_client : l_clients) {
-        QSet<bool> l_matches(l_client->m_casing_preferences.begin(), l_client->m_casing_preferences.end());
-        l_matches.intersect(l_needs_set);
-
-        if (!l_matches.isEmpty() && !l_clients_to_alert.contains(l_client))
+        // Only clients that want to be alerted for at least one of the needed roles.
+        if (l_client->m_casing_preferences & l_needs)
             l_clients_to_alert.append(l_client);
     }
 
@@ -5,6 +5,8 @@
 
 #include <QDebug>
 
+#include <array>
+
 PacketID::PacketID(QStringList &contents) :
     AOPacket(contents)
 {
@@ -50,6 +52,14 @@ void PacketID::handlePacket(AreaData *area, AOClient &client) const
         return;
     }
 
+    // Clients that split frames on the packet terminator get everything sent to them in one event loop iteration as one frame.
+    QRegularExpressionMatch l_coalescing_match = rx.match(ConfigManager::packetCoalescingVersion());
+    if (l_coalescing_match.hasMatch()) {
+        std::array<int, 3> l_coalescing_version{l_coalescing_match.captured(1).toInt(), l_coalescing_match.captured(2).toInt(), l_coalescing_match.captured(3).toInt()};
+        std::array<int, 3> l_client_version{client.m_version.release, client.m_version.major, client.m_version.minor};
+        client.m_socket->setCoalescing(l_client_version >= l_coalescing_version);
+    }
+
     client.sendPacket("PN", {QString::number(client.getServer()->getPlayerCount()), QString::number(ConfigManager::maxPlayers()), ConfigManager::serverDescription()});
 
     QStringList l_feature_list = {
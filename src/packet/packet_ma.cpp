@@ -53,7 +53,7 @@ void PacketMA::handlePacket(AreaData *area, AOClient &client) const
 
     QString moderator_name;
     if (ConfigManager::authType() == DataTypes::AuthType::ADVANCED) {
-        moderator_name = client.m_moderator_name;
+        moderator_name = client.cold().moderator_name;
     }
     else {
         moderator_name = "Moderator";
@@ -66,6 +66,7 @@ void PacketMA::handlePacket(AreaData *area, AOClient &client) const
             subclient->m_socket->close();
         }
 
+        client.getServer()->clusterKick(target->m_ipid, reason);
         Q_EMIT client.logKick(moderator_name, target->m_ipid, reason);
 
         client.sendServerMessage("Kicked " + QString::number(clients.size()) + " client(s) with ipid " + target->m_ipid + " for reason: " + reason);
@@ -98,6 +99,7 @@ void PacketMA::handlePacket(AreaData *area, AOClient &client) const
             subclient->m_socket->close();
         }
 
+        client.getServer()->clusterBan(ban);
         Q_EMIT client.logBan(moderator_name, target->m_ipid, timestamp, reason);
 
         client.sendServerMessage("Banned " + QString::number(clients.size()) + " client(s) with ipid " + target->m_ipid + " for reason: " + reason);
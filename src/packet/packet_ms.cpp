@@ -6,6 +6,9 @@
 #include <QDebug>
 #include <QRegularExpression>
 
+#include <algorithm>
+#include <array>
+
 PacketMS::PacketMS(QStringList &contents) :
     AOPacket(contents)
 {
@@ -32,7 +35,7 @@ void PacketMS::handlePacket(AreaData *area, AOClient &client) const
     }
 
     AOPacket *validated_packet = validateIcPacket(client);
-    if (validated_packet->getPacketInfo().header == "INVALID")
+    if (validated_packet == nullptr)
         return;
 
     if (client.m_pos != "")
@@ -55,26 +58,38 @@ void PacketMS::handlePacket(AreaData *area, AOClient &client) const
     }
 
     if (evidence_presented) {
-        // Send individual packets to each client with correct evidence indices
-        const QVector<AOClient *> l_clients = client.getServer()->getClients();
-        for (AOClient *l_client : l_clients) {
-            if (l_client->areaId() == client.areaId()) {
-                // Create a copy of the packet content
+        // The visible index of the evidence depends on what each client can see,
+        // so clients sharing a view of the evidence list share one set of packets.
+        QHash<AreaData::EvidenceView, Layouts> l_packets;
+        const QVector<int> l_client_ids = area->joinedIDs();
+        for (const int l_client_id : l_client_ids) {
+            AOClient *l_client = client.getServer()->getClientByID(l_client_id);
+            if (l_client == nullptr)
+                continue;
+            bool l_is_cm = l_client->checkPermission(ACLRole::CM);
+            const AreaData::EvidenceView l_view = area->evidenceView(l_client->m_pos, l_is_cm);
+            auto l_view_packets = l_packets.find(l_view);
+            if (l_view_packets == l_packets.end()) {
                 QStringList packet_content = validated_packet->getContent();
 
-                // Convert the real evidence index to visible index for this client
-                int visible_idx = area->getVisibleIndexByEvidenceIndex(real_evidence_idx, l_client->m_pos, l_client->checkPermission(ACLRole::CM));
+                // Convert the real evidence index to visible index for this view
+                int visible_idx = area->getVisibleIndexByEvidenceIndex(real_evidence_idx, l_client->m_pos, l_is_cm);
                 packet_content[11] = QString::number(visible_idx);
-
-                // Send the customized packet to this client
-                AOPacket *custom_packet = PacketFactory::createPacket("MS", packet_content);
-                l_client->sendPacket(custom_packet);
+                l_view_packets = l_packets.insert(l_view, buildLayouts(PacketFactory::createPacket("MS", packet_content)));
             }
+            l_client->sendPacket(l_view_packets.value()[int(layoutFor(*l_client))]);
         }
     }
     else {
         // Normal broadcast for non-evidence messages or non-HIDDEN_CM areas
-        client.getServer()->broadcast(validated_packet, client.areaId());
+        const Layouts l_layouts = buildLayouts(validated_packet);
+        const QVector<int> l_client_ids = area->joinedIDs();
+        for (const int l_client_id : l_client_ids) {
+            AOClient *l_client = client.getServer()->getClientByID(l_client_id);
+            if (l_client == nullptr)
+                continue;
+            l_client->sendPacket(l_layouts[int(layoutFor(*l_client))]);
+        }
     }
 
     emit client.logIC(client.getServer()->getAreaById(client.areaId())->name(), client.m_ipid, client.name(), QString::number(client.clientId()), (client.character() + " " + client.characterName()), client.m_last_message);
@@ -84,6 +99,151 @@ void PacketMS::handlePacket(AreaData *area, AOClient &client) const
     client.getServer()->startMessageFloodguard(ConfigManager::globalMessageFloodguard());
 }
 
+namespace {
+// Desk modifiers a client may send. The legacy "chat" value is handled on its own.
+const std::array<QLatin1String, 6> DESK_MODS{QLatin1String("0"), QLatin1String("1"), QLatin1String("2"),
+                                             QLatin1String("3"), QLatin1String("4"), QLatin1String("5")};
+
+// Emote modifiers we are willing to forward, after 4 has been rewritten to 6.
+constexpr std::array<int, 5> EMOTE_MODS{0, 1, 2, 5, 6};
+
+// Number of fields in the outgoing packet, by the extensions present in the incoming one.
+constexpr int OUTGOING_FIELDS_BASE = 15;
+constexpr int OUTGOING_FIELDS_26 = 23;
+constexpr int OUTGOING_FIELDS_28 = 30;
+
+bool isBoolField(int f_value)
+{
+    return f_value == 0 || f_value == 1;
+}
+
+int outgoingFieldCount(qsizetype f_incoming)
+{
+    if (f_incoming >= 26)
+        return OUTGOING_FIELDS_28 + std::min<int>(f_incoming - 26, 2);
+    if (f_incoming >= 19)
+        return OUTGOING_FIELDS_26;
+    return OUTGOING_FIELDS_BASE;
+}
+
+// The outgoing fields each layout keeps only the x part of, indexed by PacketMS::Layout.
+// 19 and 20 are the "<x>&<y>" offsets of the sender and its pairing partner, which 2.6-2.8 cannot parse.
+const std::array<QList<int>, 2> X_OFFSET_FIELDS{QList<int>{19, 20}, QList<int>{}};
+
+// Everything up to the first &, which is all 2.6-2.8 clients understand of an offset.
+QString xOffset(const QString &f_offset)
+{
+    return f_offset.left(f_offset.indexOf('&'));
+}
+
+bool hasParentSegment(QStringView f_path)
+{
+    qsizetype l_start = 0;
+    while (l_start <= f_path.size()) {
+        qsizetype l_end = f_path.indexOf('/', l_start);
+        if (l_end == -1)
+            l_end = f_path.size();
+        if (f_path.sliced(l_start, l_end - l_start) == u"..")
+            return true;
+        l_start = l_end + 1;
+    }
+    return false;
+}
+} // namespace
+
+PacketMS::Layout PacketMS::layoutFor(const AOClient &f_client)
+{
+    const AOClient::ClientVersion &l_version = f_client.m_version;
+    if (l_version.release == 2 && l_version.major >= 6 && l_version.major <= 8)
+        return Layout::X_OFFSET;
+    return Layout::FULL;
+}
+
+PacketMS::Layouts PacketMS::buildLayouts(AOPacket *f_packet)
+{
+    Layouts l_layouts;
+    l_layouts.fill(f_packet);
+
+    const QStringList l_fields = f_packet->getContent();
+    for (int l_layout = 0; l_layout < int(l_layouts.size()); ++l_layout) {
+        QStringList l_layout_fields = l_fields;
+        bool l_changed = false;
+        for (const int l_field : X_OFFSET_FIELDS[l_layout]) {
+            if (l_field < l_fields.size() && l_fields[l_field].contains('&')) {
+                l_layout_fields[l_field] = xOffset(l_fields[l_field]);
+                l_changed = true;
+            }
+        }
+        if (l_changed)
+            l_layouts[l_layout] = PacketFactory::createPacket("MS", l_layout_fields);
+    }
+    return l_layouts;
+}
+
+bool PacketMS::parseIcMessage(ICMessage &f_message) const
+{
+    // desk modifier
+    const QString &l_desk_mod = m_content[0];
+    if (l_desk_mod == QLatin1String("chat")) {
+        // **WARNING : THIS IS A HACK!**
+        // A proper solution would be to deprecate chat as an argument on the clientside
+        // instead of overwriting correct netcode behaviour on the serverside.
+        f_message.desk_mod = QStringLiteral("1");
+    }
+    else if (std::find(DESK_MODS.cbegin(), DESK_MODS.cend(), l_desk_mod) != DESK_MODS.cend()) {
+        f_message.desk_mod = l_desk_mod;
+    }
+    else {
+        return false;
+    }
+
+    // emote modifier
+    // Now, gather round, y'all. Here is a story that is truly a microcosm of the AO dev experience.
+    // If this value is a 4, it will crash the client. Why? Who knows, but it does.
+    // Now here is the kicker: in certain versions, the client would incorrectly send a 4 here
+    // For a long time, by configuring the client to do a zoom with a preanim, it would send 4
+    // This would crash everyone else's client, and the feature had to be disabled
+    // But, for some reason, nobody traced the cause of this issue for many many years.
+    // The serverside fix is needed to ensure invalid values are not sent, because the client sucks
+    f_message.emote_mod = m_content[7].toInt();
+    if (f_message.emote_mod == 4)
+        f_message.emote_mod = 6;
+    if (std::find(EMOTE_MODS.cbegin(), EMOTE_MODS.cend(), f_message.emote_mod) == EMOTE_MODS.cend())
+        return false;
+
+    f_message.char_id = m_content[8].toInt();
+    f_message.objection_mod = m_content[10].toInt();
+    f_message.evidence = m_content[11].toInt();
+
+    f_message.flip = m_content[12].toInt();
+    if (!isBoolField(f_message.flip))
+        return false;
+
+    f_message.realization = m_content[13].toInt();
+    if (!isBoolField(f_message.realization))
+        return false;
+
+    f_message.text_color = m_content[14].toInt();
+    if (f_message.text_color < 0 || f_message.text_color > 11)
+        return false;
+
+    // 2.6 packet extensions
+    // Immediate is checked later on, as the area may force it.
+    if (m_content.size() >= 19)
+        f_message.immediate = m_content[18].toInt();
+
+    // 2.8 packet extensions
+    if (m_content.size() >= 26) {
+        f_message.sfx_loop = m_content[19].toInt();
+        f_message.screenshake = m_content[20].toInt();
+        f_message.additive = m_content[24].toInt();
+        if (!isBoolField(f_message.sfx_loop) || !isBoolField(f_message.screenshake) || !isBoolField(f_message.additive))
+            return false;
+    }
+
+    return true;
+}
+
 AOPacket *PacketMS::validateIcPacket(AOClient &client) const
 {
     // Welcome to the super cursed server-side IC chat validation hell
@@ -96,84 +256,68 @@ AOPacket *PacketMS::validateIcPacket(AOClient &client) const
     // This packet can be sent with a minimum required args of 15.
     // 2.6+ extensions raise this to 19, and 2.8 further raises this to 26.
 
-    AOPacket *l_invalid = PacketFactory::createPacket("INVALID", {});
-    QStringList l_args;
     if (client.isSpectator() || client.character().isEmpty() || !client.m_joined)
         // Spectators cannot use IC
-        return l_invalid;
+        return nullptr;
     AreaData *area = client.getServer()->getAreaById(client.areaId());
     if (area->lockStatus() == AreaData::LockStatus::SPECTATABLE && !area->invited().contains(client.clientId()) && !client.checkPermission(ACLRole::BYPASS_LOCKS))
         // Non-invited players cannot speak in spectatable areas
-        return l_invalid;
+        return nullptr;
 
-    QList<QVariant> l_incoming_args;
-    for (const QString &l_arg : m_content) {
-        l_incoming_args.append(QVariant(l_arg));
-    }
+    // Reject malformed packets before touching any client state.
+    ICMessage l_message;
+    if (!parseIcMessage(l_message))
+        return nullptr;
+
+    QStringList l_args;
+    l_args.reserve(outgoingFieldCount(m_content.size()));
 
     // desk modifier
-    QStringList allowed_desk_mods;
-    allowed_desk_mods << "chat"
-                      << "0"
-                      << "1"
-                      << "2"
-                      << "3"
-                      << "4"
-                      << "5";
-    QString l_incoming_deskmod = l_incoming_args[0].toString();
-    if (allowed_desk_mods.contains(l_incoming_deskmod)) {
-        // **WARNING : THIS IS A HACK!**
-        // A proper solution would be to deprecate chat as an argument on the clientside
-        // instead of overwriting correct netcode behaviour on the serverside.
-        if (l_incoming_deskmod == "chat") {
-            l_args.append("1");
-        }
-        else {
-            l_args.append(l_incoming_args[0].toString());
-        }
-    }
-    else
-        return l_invalid;
+    l_args.append(l_message.desk_mod);
 
     // preanim
-    l_args.append(l_incoming_args[1].toString());
+    l_args.append(m_content[1]);
 
     // char name
-    if (client.character().toLower() != l_incoming_args[2].toString().toLower()) {
+    const QString &l_incoming_char = m_content[2];
+    // Only looked up, as a folder the table does not know yet cannot be the selected character anyway. Interning
+    // it here would let a client fill the table with folders that are rejected right below.
+    if (StringTable::find(l_incoming_char) != client.characterKey()) {
         // Selected char is different from supplied folder name
         // This means the user is INI-swapped
         if (!area->iniswapAllowed()) {
-            QStringList l_character_split = l_incoming_args[2].toString().split("/");
-            if (!client.getServer()->getCharacters().contains(l_character_split.at(0), Qt::CaseInsensitive) || l_character_split.contains(".."))
-                return l_invalid;
+            QStringView l_folder = QStringView(l_incoming_char).left(l_incoming_char.indexOf('/'));
+            if (!client.getServer()->getCharacters().contains(l_folder, Qt::CaseInsensitive) || hasParentSegment(l_incoming_char))
+                return nullptr;
         }
         qDebug() << "INI swap detected from " << client.getIpid();
     }
-    client.m_current_iniswap = l_incoming_args[2].toString();
-    l_args.append(l_incoming_args[2].toString());
+    client.m_current_iniswap_key = StringTable::intern(l_incoming_char);
+    client.m_current_iniswap = StringTable::share(l_incoming_char);
+    l_args.append(client.m_current_iniswap);
 
     // emote
-    client.m_emote = l_incoming_args[3].toString();
+    client.m_emote = StringTable::share(m_content[3]);
     if (client.m_first_person)
         client.m_emote = "";
     l_args.append(client.m_emote);
 
     // message text
-    if (l_incoming_args[4].toString().size() > ConfigManager::maxCharacters())
-        return l_invalid;
+    if (m_content[4].size() > ConfigManager::maxCharacters())
+        return nullptr;
 
     // Doublepost prevention. Has to ignore blankposts and testimony commands.
-    QString l_incoming_msg = client.dezalgo(l_incoming_args[4].toString().trimmed());
+    QString l_incoming_msg = client.dezalgo(m_content[4].trimmed());
     QRegularExpressionMatch match = isTestimonyJumpCommand(client.decodeMessage(l_incoming_msg));
     bool msg_is_testimony_cmd = (match.hasMatch() || l_incoming_msg == ">" || l_incoming_msg == "<");
     if (!client.m_last_message.isEmpty()           // If the last message you sent isn't empty,
         && l_incoming_msg == client.m_last_message // and it matches the one you're sending,
         && !msg_is_testimony_cmd)                  // and it's not a testimony command,
-        return l_invalid;                          // get it the hell outta here!
+        return nullptr;                            // get it the hell outta here!
 
     if (l_incoming_msg == "" && area->blankpostingAllowed() == false) {
         client.sendServerMessage("Blankposting has been forbidden in this area.");
-        return l_invalid;
+        return nullptr;
     }
 
     client.m_last_message = l_incoming_msg;
@@ -214,107 +358,85 @@ AOPacket *PacketMS::validateIcPacket(AOClient &client) const
 
     // side
     // this is validated clientside so w/e
+    const QString &l_incoming_side = m_content[5];
     QString side = area->side();
     if (side.isEmpty()) {
-        side = l_incoming_args[5].toString();
+        side = l_incoming_side;
     }
     l_args.append(side);
 
-    if (client.m_pos != l_incoming_args[5].toString()) {
-        client.m_pos = l_incoming_args[5].toString();
-        client.m_pos.replace("../", "").replace("..\\", "");
-        client.updateEvidenceList(client.getServer()->getAreaById(client.areaId()));
+    if (client.m_pos != l_incoming_side) {
+        QString l_side = l_incoming_side;
+        client.m_pos = StringTable::share(l_side.replace("../", "").replace("..\\", ""));
+        client.updateEvidenceList(area);
     }
 
     // sfx name
-    l_args.append(l_incoming_args[6].toString());
+    l_args.append(m_content[6]);
 
     // emote modifier
-    // Now, gather round, y'all. Here is a story that is truly a microcosm of the AO dev experience.
-    // If this value is a 4, it will crash the client. Why? Who knows, but it does.
-    // Now here is the kicker: in certain versions, the client would incorrectly send a 4 here
-    // For a long time, by configuring the client to do a zoom with a preanim, it would send 4
-    // This would crash everyone else's client, and the feature had to be disabled
-    // But, for some reason, nobody traced the cause of this issue for many many years.
-    // The serverside fix is needed to ensure invalid values are not sent, because the client sucks
-    int emote_mod = l_incoming_args[7].toInt();
-
-    if (emote_mod == 4)
-        emote_mod = 6;
-    if (emote_mod != 0 && emote_mod != 1 && emote_mod != 2 && emote_mod != 5 && emote_mod != 6)
-        return l_invalid;
-    l_args.append(QString::number(emote_mod));
+    l_args.append(QString::number(l_message.emote_mod));
 
     // char id
-    if (l_incoming_args[8].toInt() != client.m_char_id)
-        return l_invalid;
-    l_args.append(l_incoming_args[8].toString());
+    if (l_message.char_id != client.m_char_id)
+        return nullptr;
+    l_args.append(m_content[8]);
 
     // sfx delay
-    l_args.append(l_incoming_args[9].toString());
+    l_args.append(m_content[9]);
 
     // objection modifier
+    const QString &l_incoming_objection = m_content[10];
     if (area->isShoutAllowed()) {
-        if (l_incoming_args[10].toString().contains("4")) {
+        if (l_incoming_objection.contains('4')) {
             // custom shout includes text metadata
-            l_args.append(l_incoming_args[10].toString());
+            l_args.append(l_incoming_objection);
         }
         else {
-            int l_obj_mod = l_incoming_args[10].toInt();
-            if ((l_obj_mod < 0) || (l_obj_mod > 4)) {
-                return l_invalid;
+            if ((l_message.objection_mod < 0) || (l_message.objection_mod > 4)) {
+                return nullptr;
             }
-            l_args.append(QString::number(l_obj_mod));
+            l_args.append(QString::number(l_message.objection_mod));
         }
     }
     else {
-        if (l_incoming_args[10].toString() != "0") {
+        if (l_incoming_objection != QLatin1String("0")) {
             client.sendServerMessage("Shouts have been disabled in this area.");
         }
         l_args.append("0");
     }
 
     // evidence
-    int evi_idx = l_incoming_args[11].toInt();
-    if (evi_idx > area->evidence().length())
-        return l_invalid;
-
-    l_args.append(QString::number(evi_idx));
+    if (l_message.evidence > area->evidence().length())
+        return nullptr;
+    l_args.append(QString::number(l_message.evidence));
 
     // flipping
-    int l_flip = l_incoming_args[12].toInt();
-    if (l_flip != 0 && l_flip != 1)
-        return l_invalid;
-    client.m_flipping = QString::number(l_flip);
+    client.m_flipping = QString::number(l_message.flip);
     l_args.append(client.m_flipping);
 
     // realization
-    int realization = l_incoming_args[13].toInt();
-    if (realization != 0 && realization != 1)
-        return l_invalid;
-    l_args.append(QString::number(realization));
+    l_args.append(QString::number(l_message.realization));
 
     // text color
-    int text_color = l_incoming_args[14].toInt();
-    if (text_color < 0 || text_color > 11)
-        return l_invalid;
-    l_args.append(QString::number(text_color));
+    l_args.append(QString::number(l_message.text_color));
 
     // 2.6 packet extensions
-    if (l_incoming_args.length() >= 19) {
+    if (m_content.size() >= 19) {
         // showname
-        QString l_incoming_showname = client.dezalgo(l_incoming_args[15].toString().trimmed());
+        const QString &l_raw_showname = m_content[15];
+        QString l_incoming_showname = client.dezalgo(l_raw_showname.trimmed());
         if (!(l_incoming_showname == client.character() || l_incoming_showname.isEmpty()) && !area->shownameAllowed()) {
             client.sendServerMessage("Shownames are not allowed in this area!");
-            return l_invalid;
+            return nullptr;
         }
         if (l_incoming_showname.length() > 30) {
             client.sendServerMessage("Your showname is too long! Please limit it to under 30 characters");
-            return l_invalid;
+            return nullptr;
         }
 
         // if the raw input is not empty but the trimmed input is, use a single space
-        if (l_incoming_showname.isEmpty() && !l_incoming_args[15].toString().isEmpty())
+        if (l_incoming_showname.isEmpty() && !l_raw_showname.isEmpty())
             l_incoming_showname = " ";
         l_args.append(l_incoming_showname);
         client.setCharacterName(l_incoming_showname);
@@ -322,11 +444,15 @@ AOPacket *PacketMS::validateIcPacket(AOClient &client) const
         // other char id
         // things get a bit hairy here
         // don't ask me how this works, because i don't know either
-        QStringList l_pair_data = l_incoming_args[16].toString().split("^");
-        client.m_pairing_with = l_pair_data[0].toInt();
+        // The field is "<char id>^<front/back>", and anything past a second ^ is dropped.
+        QStringView l_pair_data = m_content[16];
+        qsizetype l_pair_separator = l_pair_data.indexOf('^');
+        client.m_pairing_with = l_pair_data.left(l_pair_separator).toInt();
         QString l_front_back = "";
-        if (l_pair_data.length() > 1)
-            l_front_back = "^" + l_pair_data[1];
+        if (l_pair_separator != -1) {
+            QStringView l_order = l_pair_data.sliced(l_pair_separator + 1);
+            l_front_back = "^" + l_order.left(l_order.indexOf('^')).toString();
+        }
         int l_other_charid = client.m_pairing_with;
         bool l_pairing = false;
         QString l_other_name = "0";
@@ -354,65 +480,49 @@ AOPacket *PacketMS::validateIcPacket(AOClient &client) const
         l_args.append(l_other_emote);
 
         // self offset
-        client.m_offset = l_incoming_args[17].toString();
-        // versions 2.6-2.8 cannot validate y-offset so we send them just the x-offset
-        if ((client.m_version.release == 2) && (client.m_version.major == 6 || client.m_version.major == 7 || client.m_version.major == 8)) {
-            QString l_x_offset = client.m_offset.split("&")[0];
-            l_args.append(l_x_offset);
-            QString l_other_x_offset = l_other_offset.split("&")[0];
-            l_args.append(l_other_x_offset);
-        }
-        else {
-            l_args.append(client.m_offset);
-            l_args.append(l_other_offset);
-        }
+        // Recipients on 2.6-2.8 get only the x-offset, see buildLayouts.
+        client.m_offset = m_content[17];
+        l_args.append(client.m_offset);
+        l_args.append(l_other_offset);
         l_args.append(l_other_flip);
 
         // immediate text processing
-        int l_immediate = l_incoming_args[18].toInt();
+        int l_immediate = l_message.immediate;
         if (area->forceImmediate()) {
-            if (l_args[7] == "1" || l_args[7] == "2") {
+            if (l_message.emote_mod == 1 || l_message.emote_mod == 2) {
                 l_args[7] = "0";
                 l_immediate = 1;
             }
-            else if (l_args[7] == "6") {
+            else if (l_message.emote_mod == 6) {
                 l_args[7] = "5";
                 l_immediate = 1;
             }
         }
-        if (l_immediate != 1 && l_immediate != 0)
-            return l_invalid;
+        if (!isBoolField(l_immediate))
+            return nullptr;
         l_args.append(QString::number(l_immediate));
     }
 
     // 2.8 packet extensions
-    if (l_incoming_args.length() >= 26) {
+    if (m_content.size() >= 26) {
         // sfx looping
-        int l_sfx_loop = l_incoming_args[19].toInt();
-        if (l_sfx_loop != 0 && l_sfx_loop != 1)
-            return l_invalid;
-        l_args.append(QString::number(l_sfx_loop));
+        l_args.append(QString::number(l_message.sfx_loop));
 
         // screenshake
-        int l_screenshake = l_incoming_args[20].toInt();
-        if (l_screenshake != 0 && l_screenshake != 1)
-            return l_invalid;
-        l_args.append(QString::number(l_screenshake));
+        l_args.append(QString::number(l_message.screenshake));
 
         // frames shake
-        l_args.append(l_incoming_args[21].toString());
+        l_args.append(m_content[21]);
 
         // frames realization
-        l_args.append(l_incoming_args[22].toString());
+        l_args.append(m_content[22]);
 
         // frames sfx
-        l_args.append(l_incoming_args[23].toString());
+        l_args.append(m_content[23]);
 
         // additive
-        int l_additive = l_incoming_args[24].toInt();
-        if (l_additive != 0 && l_additive != 1)
-            return l_invalid;
-        else if (area->lastICMessage().isEmpty()) {
+        int l_additive = l_message.additive;
+        if (area->lastICMessage().isEmpty()) {
             l_additive = 0;
         }
         else if (!(client.m_char_id == area->lastICMessage()[8].toInt())) {
@@ -424,15 +534,15 @@ AOPacket *PacketMS::validateIcPacket(AOClient &client) const
         l_args.append(QString::number(l_additive));
 
         // effect
-        l_args.append(l_incoming_args[25].toString());
+        l_args.append(m_content[25]);
     }
-    if (l_incoming_args.size() >= 27) {
+    if (m_content.size() >= 27) {
         // blips
-        l_args.append(l_incoming_args[26].toString());
+        l_args.append(m_content[26]);
     }
-    if (l_incoming_args.size() >= 28) {
+    if (m_content.size() >= 28) {
         // slide toggle
-        l_args.append(l_incoming_args[27].toString());
+        l_args.append(m_content[27]);
     }
 
     // Testimony playback
@@ -3,15 +3,93 @@
 
 #include "network/aopacket.h"
 
+#include <array>
+
 class PacketMS : public AOPacket
 {
   public:
+    /**
+     * @brief The field layouts of an outgoing MS packet, by the version of the client receiving it.
+     */
+    enum class Layout
+    {
+        X_OFFSET, //!< 2.6 to 2.8, which only understand the x part of the offsets.
+        FULL      //!< 2.9 and newer, as well as any client we do not know the version of.
+    };
+
+    /**
+     * @brief The outgoing packet of a message in every layout, indexed by Layout.
+     */
+    using Layouts = std::array<AOPacket *, 2>;
+
     PacketMS(QStringList &contents);
     virtual PacketInfo getPacketInfo() const;
     virtual void handlePacket(AreaData *area, AOClient &client) const;
 
-  private:
+    /**
+     * @brief Returns the layout a client expects MS packets in.
+     */
+    static Layout layoutFor(const AOClient &f_client);
+
+    /**
+     * @brief Builds the outgoing packet in every layout from the validated packet.
+     *
+     * @details The validated packet is used as the FULL layout. Layouts that end up with the same fields share
+     * that packet, so a message only gets encoded once per distinct layout.
+     *
+     * @param f_packet The packet returned by validateIcPacket.
+     */
+    static Layouts buildLayouts(AOPacket *f_packet);
+
+    /**
+     * @brief Validates the packet against the state of the sending client and builds the packet to broadcast.
+     *
+     * @details Public so it can be benchmarked and tested on its own.
+     *
+     * @return The validated MS packet in the FULL layout, or nullptr if validation failed.
+     */
     AOPacket *validateIcPacket(AOClient &client) const;
+
+  private:
+    /**
+     * @brief The numeric fields of an incoming MS packet.
+     *
+     * @details Only fields that can be checked without knowing the sender or its area are validated while parsing.
+     * Everything else is left to validateIcPacket, which also reads the plain text fields straight from the packet content.
+     */
+    struct ICMessage
+    {
+        /**
+         * @brief The outgoing desk modifier. The legacy "chat" value is already rewritten to "1".
+         */
+        QString desk_mod;
+
+        int emote_mod = 0;
+        int char_id = -1;
+        int objection_mod = 0;
+        int evidence = 0;
+        int flip = 0;
+        int realization = 0;
+        int text_color = 0;
+
+        // 2.6+
+        int immediate = 0;
+
+        // 2.8+
+        int sfx_loop = 0;
+        int screenshake = 0;
+        int additive = 0;
+    };
+
+    /**
+     * @brief Parses the packet content into an ICMessage.
+     *
+     * @param f_message The message to fill.
+     *
+     * @return False if a field holds a value the protocol does not allow.
+     */
+    bool parseIcMessage(ICMessage &f_message) const;
+
     QRegularExpressionMatch isTestimonyJumpCommand(QString message) const;
 };
 #endif
@@ -21,5 +21,8 @@ void PacketPW::handlePacket(AreaData *area, AOClient &client) const
 {
     Q_UNUSED(area)
 
-    client.m_password = m_content[0];
+    // Clients send this along with every character selection, usually empty.
+    if (!m_content[0].isEmpty() || !client.cold().password.isEmpty()) {
+        client.editCold().password = m_content[0];
+    }
 }
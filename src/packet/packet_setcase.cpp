@@ -21,13 +21,14 @@ void PacketSetcase::handlePacket(AreaData *area, AOClient &client) const
 {
     Q_UNUSED(area)
 
-    QList<bool> l_prefs_list;
+    quint8 l_prefs = 0;
     for (int i = 2; i <= 6; i++) {
         bool is_int = false;
         bool pref = m_content[i].toInt(&is_int);
         if (!is_int)
             return;
-        l_prefs_list.append(pref);
+        if (pref)
+            l_prefs |= 1 << (i - 2);
     }
-    client.m_casing_preferences = l_prefs_list;
+    client.m_casing_preferences = l_prefs;
 }
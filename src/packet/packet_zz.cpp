@@ -40,11 +40,7 @@ void PacketZZ::handlePacket(AreaData *area, AOClient &client) const
     }
     l_modcallNotice.append("Reason: " + m_content[0]);
 
-    const QVector<AOClient *> l_clients = client.getServer()->getClients();
-    for (AOClient *l_client : l_clients) {
-        if (l_client->m_authenticated)
-            l_client->sendPacket(PacketFactory::createPacket("ZZ", {l_modcallNotice}));
-    }
+    client.getServer()->broadcast(PacketFactory::createPacket("ZZ", {l_modcallNotice}), Server::TARGET_TYPE::MODERATORS);
     emit client.logModcall(client.getServer()->getAreaById(client.areaId())->name(), client.m_ipid, client.name(), QString::number(client.clientId()), (client.character() + " " + client.characterName()));
 
     if (ConfigManager::discordModcallWebhookEnabled()) {
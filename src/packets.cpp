@@ -28,35 +28,25 @@
 
 void AOClient::sendEvidenceList(AreaData *area) const
 {
-    const QVector<AOClient *> l_clients = server->getClients();
-    for (AOClient *l_client : l_clients) {
-        if (l_client->areaId() == areaId())
-            l_client->updateEvidenceList(area);
+    // Clients that see the same evidence share a single LE packet.
+    QHash<AreaData::EvidenceView, AOPacket *> l_packets;
+    const QVector<int> l_client_ids = area->joinedIDs();
+    for (const int l_client_id : l_client_ids) {
+        AOClient *l_client = server->getClientByID(l_client_id);
+        if (l_client == nullptr)
+            continue;
+        AreaData::EvidenceView l_view = area->evidenceView(l_client->m_pos, l_client->checkPermission(ACLRole::CM));
+        AOPacket *&l_packet = l_packets[l_view];
+        if (l_packet == nullptr)
+            l_packet = PacketFactory::createPacket("LE", area->evidenceList(l_view));
+        l_client->sendPacket(l_packet);
     }
 }
 
 void AOClient::updateEvidenceList(AreaData *area)
 {
-    QStringList l_evidence_list;
-    QString l_evidence_format("%1&%2&%3");
-
-    const QList<AreaData::Evidence> l_area_evidence = area->evidence();
-    for (const AreaData::Evidence &evidence : l_area_evidence) {
-        if (!checkPermission(ACLRole::CM) && area->eviMod() == AreaData::EvidenceMod::HIDDEN_CM) {
-            QRegularExpression l_regex("<owner=(.*?)>");
-            QRegularExpressionMatch l_match = l_regex.match(evidence.description);
-            if (l_match.hasMatch()) {
-                QStringList owners = l_match.captured(1).split(",");
-                if (!owners.contains("all", Qt::CaseSensitivity::CaseInsensitive) && !owners.contains(m_pos, Qt::CaseSensitivity::CaseInsensitive)) {
-                    continue;
-                }
-            }
-            // no match = show it to all
-        }
-        l_evidence_list.append(l_evidence_format.arg(evidence.name, evidence.description, evidence.image));
-    }
-
-    sendPacket(PacketFactory::createPacket("LE", l_evidence_list));
+    AreaData::EvidenceView l_view = area->evidenceView(m_pos, checkPermission(ACLRole::CM));
+    sendPacket(PacketFactory::createPacket("LE", area->evidenceList(l_view)));
 }
 
 QString AOClient::dezalgo(QString p_text)
@@ -111,6 +101,7 @@ void AOClient::loginAttempt(QString message)
                 sendServerMessage("Logged in as a moderator.");
             m_authenticated = true;
             m_acl_role_id = ACLRolesHandler::SUPER_ID;
+            updatePermissions();
         }
         else {
             sendPacket("AUTH", {"0"}); // Client: "Login unsuccessful."
@@ -132,7 +123,8 @@ void AOClient::loginAttempt(QString message)
         if (server->getDatabaseManager()->authenticate(username, password)) {
             m_authenticated = true;
             m_acl_role_id = server->getDatabaseManager()->getACL(username);
-            m_moderator_name = username;
+            editCold().moderator_name = username;
+            updatePermissions();
             sendPacket("AUTH", {"1"});
             if (m_version.release <= 2 && m_version.major <= 9 && m_version.minor <= 0)
                 sendServerMessage("Logged in as a moderator.");
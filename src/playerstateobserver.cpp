@@ -1,5 +1,61 @@
 #include "playerstateobserver.h"
 
+#include <QMetaObject>
+
+namespace {
+// Keeps the frames of a snapshot or a flush well below what clients buffer comfortably.
+constexpr qsizetype MAX_FRAME_LENGTH = 32768;
+
+/**
+ * @brief Packets encoded once for every recipient, both one by one and merged into frames.
+ *
+ * @details Only clients that coalesce can split a frame holding several packets, the others are sent them one by one.
+ */
+struct EncodedPackets
+{
+    QStringList packets;
+    QStringList frames;
+
+    /**
+     * @brief Appends an encoded packet, merging it into the last frame unless that would grow too long.
+     */
+    void append(AOPacket &&packet)
+    {
+        QString l_encoded = packet.toString();
+        packets.append(l_encoded);
+        if (frames.isEmpty() || frames.last().size() + l_encoded.size() > MAX_FRAME_LENGTH) {
+            frames.append(l_encoded);
+        }
+        else {
+            frames.last().append(l_encoded);
+        }
+    }
+
+    void sendTo(AOClient *client) const
+    {
+        const QStringList &l_frames = client->m_socket->isCoalescing() ? frames : packets;
+        for (const QString &l_frame : l_frames) {
+            client->sendEncodedPackets(l_frame);
+        }
+    }
+};
+
+QString pendingValue(AOClient *client, PacketPU::DATA_TYPE type)
+{
+    switch (type) {
+    case PacketPU::NAME:
+        return client->name();
+    case PacketPU::CHARACTER:
+        return client->character();
+    case PacketPU::CHARACTER_NAME:
+        return client->characterName();
+    case PacketPU::AREA_ID:
+        return QString::number(client->areaId());
+    }
+    return QString();
+}
+} // namespace
+
 PlayerStateObserver::PlayerStateObserver(QObject *parent) :
     QObject{parent}
 {}
@@ -10,29 +66,24 @@ void PlayerStateObserver::registerClient(AOClient *client)
 {
     Q_ASSERT(!m_client_list.contains(client));
 
-    PacketPR packet(client->clientId(), PacketPR::ADD);
-    sendToClientList(packet);
+    sendToClientList(PacketPR(client->clientId(), PacketPR::ADD).toString());
 
-    m_client_list.append(client);
+    m_client_list.insert(client);
 
     connect(client, &AOClient::nameChanged, this, &PlayerStateObserver::notifyNameChanged);
     connect(client, &AOClient::characterChanged, this, &PlayerStateObserver::notifyCharacterChanged);
     connect(client, &AOClient::characterNameChanged, this, &PlayerStateObserver::notifyCharacterNameChanged);
     connect(client, &AOClient::areaIdChanged, this, &PlayerStateObserver::notifyAreaIdChanged);
 
-    QList<AOPacket *> packets;
+    EncodedPackets l_snapshot;
     for (AOClient *i_client : qAsConst(m_client_list)) {
-        packets.append(new PacketPR(i_client->clientId(), PacketPR::ADD));
-        packets.append(new PacketPU(i_client->clientId(), PacketPU::NAME, i_client->name()));
-        packets.append(new PacketPU(i_client->clientId(), PacketPU::CHARACTER, i_client->character()));
-        packets.append(new PacketPU(i_client->clientId(), PacketPU::CHARACTER_NAME, i_client->characterName()));
-        packets.append(new PacketPU(i_client->clientId(), PacketPU::AREA_ID, i_client->areaId()));
-    }
-
-    for (AOPacket *packet : qAsConst(packets)) {
-        client->sendPacket(packet);
-        delete packet;
+        l_snapshot.append(PacketPR(i_client->clientId(), PacketPR::ADD));
+        l_snapshot.append(PacketPU(i_client->clientId(), PacketPU::NAME, i_client->name()));
+        l_snapshot.append(PacketPU(i_client->clientId(), PacketPU::CHARACTER, i_client->character()));
+        l_snapshot.append(PacketPU(i_client->clientId(), PacketPU::CHARACTER_NAME, i_client->characterName()));
+        l_snapshot.append(PacketPU(i_client->clientId(), PacketPU::AREA_ID, i_client->areaId()));
     }
+    l_snapshot.sendTo(client);
 }
 
 void PlayerStateObserver::unregisterClient(AOClient *client)
@@ -41,35 +92,67 @@ void PlayerStateObserver::unregisterClient(AOClient *client)
 
     disconnect(client, nullptr, this, nullptr);
 
-    m_client_list.removeAll(client);
+    m_client_list.remove(client);
+    m_pending_updates.remove(client);
 
-    PacketPR packet(client->clientId(), PacketPR::REMOVE);
-    sendToClientList(packet);
+    sendToClientList(PacketPR(client->clientId(), PacketPR::REMOVE).toString());
 }
 
-void PlayerStateObserver::sendToClientList(const AOPacket &packet)
+void PlayerStateObserver::sendToClientList(const QString &packets)
 {
     for (AOClient *client : qAsConst(m_client_list)) {
-        client->sendPacket(&const_cast<AOPacket &>(packet));
+        client->sendEncodedPackets(packets);
+    }
+}
+
+void PlayerStateObserver::queueUpdate(AOClient *client, PacketPU::DATA_TYPE type)
+{
+    m_pending_updates[client] |= 1 << type;
+    if (!m_flush_queued) {
+        m_flush_queued = true;
+        QMetaObject::invokeMethod(this, &PlayerStateObserver::flushUpdates, Qt::QueuedConnection);
+    }
+}
+
+void PlayerStateObserver::flushUpdates()
+{
+    m_flush_queued = false;
+
+    EncodedPackets l_updates;
+    for (auto i = m_pending_updates.cbegin(); i != m_pending_updates.cend(); ++i) {
+        for (PacketPU::DATA_TYPE type : {PacketPU::NAME, PacketPU::CHARACTER, PacketPU::CHARACTER_NAME, PacketPU::AREA_ID}) {
+            if (i.value() & (1 << type)) {
+                l_updates.append(PacketPU(i.key()->clientId(), type, pendingValue(i.key(), type)));
+            }
+        }
+    }
+    m_pending_updates.clear();
+
+    for (AOClient *client : qAsConst(m_client_list)) {
+        l_updates.sendTo(client);
     }
 }
 
 void PlayerStateObserver::notifyNameChanged(const QString &name)
 {
-    sendToClientList(PacketPU(qobject_cast<AOClient *>(sender())->clientId(), PacketPU::NAME, name));
+    Q_UNUSED(name);
+    queueUpdate(qobject_cast<AOClient *>(sender()), PacketPU::NAME);
 }
 
 void PlayerStateObserver::notifyCharacterChanged(const QString &character)
 {
-    sendToClientList(PacketPU(qobject_cast<AOClient *>(sender())->clientId(), PacketPU::CHARACTER, character));
+    Q_UNUSED(character);
+    queueUpdate(qobject_cast<AOClient *>(sender()), PacketPU::CHARACTER);
 }
 
 void PlayerStateObserver::notifyCharacterNameChanged(const QString &characterName)
 {
-    sendToClientList(PacketPU(qobject_cast<AOClient *>(sender())->clientId(), PacketPU::CHARACTER_NAME, characterName));
+    Q_UNUSED(characterName);
+    queueUpdate(qobject_cast<AOClient *>(sender()), PacketPU::CHARACTER_NAME);
 }
 
 void PlayerStateObserver::notifyAreaIdChanged(int areaId)
 {
-    sendToClientList(PacketPU(qobject_cast<AOClient *>(sender())->clientId(), PacketPU::AREA_ID, areaId));
+    Q_UNUSED(areaId);
+    queueUpdate(qobject_cast<AOClient *>(sender()), PacketPU::AREA_ID);
 }
@@ -3,8 +3,9 @@
 #include "aoclient.h"
 #include "packet/packet_pr.h"
 
-#include <QList>
+#include <QHash>
 #include <QObject>
+#include <QSet>
 #include <QString>
 
 class PlayerStateObserver : public QObject
@@ -17,13 +18,29 @@ class PlayerStateObserver : public QObject
     void unregisterClient(AOClient *client);
 
   private:
-    QList<AOClient *> m_client_list;
+    QSet<AOClient *> m_client_list;
 
-    void sendToClientList(const AOPacket &packet);
+    /**
+     * @brief Fields of each client that changed since the last flush, as a mask of PacketPU::DATA_TYPE bits.
+     */
+    QHash<AOClient *, int> m_pending_updates;
+
+    /**
+     * @brief Whether flushUpdates() has already been queued for the current event loop iteration.
+     */
+    bool m_flush_queued = false;
+
+    void sendToClientList(const QString &packets);
+    void queueUpdate(AOClient *client, PacketPU::DATA_TYPE type);
 
   private Q_SLOTS:
     void notifyNameChanged(const QString &name);
     void notifyCharacterChanged(const QString &character);
     void notifyCharacterNameChanged(const QString &characterName);
     void notifyAreaIdChanged(int areaId);
+
+    /**
+     * @brief Sends one PU per changed field to every client, packed into as few frames as possible for clients that coalesce.
+     */
+    void flushUpdates();
 };
@@ -0,0 +1,114 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#include "rate_limiter.h"
+
+#include "config_manager.h"
+#include "metrics.h"
+
+namespace {
+/**
+ * @brief Refills a bucket for the time passed since its last refill.
+ */
+void refill(RateLimiter::Bucket &f_bucket, double f_capacity, qint64 f_now)
+{
+    if (f_bucket.updated == -1) {
+        f_bucket.tokens = f_capacity;
+    }
+    else {
+        f_bucket.tokens = qMin(f_capacity, f_bucket.tokens + (f_now - f_bucket.updated) * f_capacity / 1000.0);
+    }
+    f_bucket.updated = f_now;
+}
+} // namespace
+
+RateLimiter::RateLimiter()
+{
+    m_clock.start();
+}
+
+void RateLimiter::reload()
+{
+    // Buckets refill their whole capacity once per second, matching the per-second limits used so far.
+    m_capacity = qMax(0, ConfigManager::packetRateLimitHard());
+    m_warning_level = m_capacity - qMax(0, ConfigManager::packetRateLimitSoft()) + 1;
+    m_packet_weights = ConfigManager::packetWeights();
+    m_command_weights = ConfigManager::commandWeights();
+
+    const QStringList l_fanout_packets = ConfigManager::fanoutPackets();
+    m_fanout_packets = QSet<QString>(l_fanout_packets.cbegin(), l_fanout_packets.cend());
+    const QStringList l_fanout_commands = ConfigManager::fanoutCommands();
+    m_fanout_commands = QSet<QString>(l_fanout_commands.cbegin(), l_fanout_commands.cend());
+    m_fanout_budget = ConfigManager::fanoutBudget();
+    m_fanout_bucket = Bucket();
+}
+
+RateLimiter::Result RateLimiter::chargePacket(Bucket &f_bucket, const QString &f_header)
+{
+    return charge(f_bucket, m_packet_weights.value(f_header, 1.0), m_fanout_packets.contains(f_header));
+}
+
+RateLimiter::Result RateLimiter::chargeCommand(Bucket &f_bucket, const QString &f_command)
+{
+    return charge(f_bucket, m_command_weights.value(f_command, 0.0), m_fanout_commands.contains(f_command));
+}
+
+RateLimiter::Result RateLimiter::charge(Bucket &f_bucket, double f_weight, bool f_fanout)
+{
+    const qint64 l_now = m_clock.elapsed();
+    Result l_result = Result::ALLOWED;
+    if (m_capacity > 0) {
+        refill(f_bucket, m_capacity, l_now);
+        // Like the per-second counter this replaced, the packet that reaches a limit already triggers it,
+        // so the last token is held back. Comparing against a whole token keeps that independent of refill drift.
+        if (f_bucket.tokens - f_weight < 1) {
+            f_bucket.tokens = 0;
+            l_result = Result::EXCEEDED;
+        }
+        else {
+            f_bucket.tokens -= f_weight;
+            if (m_warning_level <= m_capacity && f_bucket.tokens < m_warning_level) {
+                l_result = Result::WARNED;
+            }
+        }
+    }
+
+    if (l_result != Result::EXCEEDED && f_fanout && m_fanout_budget > 0) {
+        refill(m_fanout_bucket, m_fanout_budget, l_now);
+        if (m_fanout_bucket.tokens < f_weight) {
+            l_result = Result::BUSY;
+        }
+        else {
+            m_fanout_bucket.tokens -= f_weight;
+        }
+    }
+
+    if (l_result != Result::ALLOWED && Metrics::isEnabled()) {
+        switch (l_result) {
+        case Result::WARNED:
+            Metrics::recordRateLimited(Metrics::RateLimitAction::WARNED);
+            break;
+        case Result::BUSY:
+            Metrics::recordRateLimited(Metrics::RateLimitAction::REFUSED);
+            break;
+        default:
+            Metrics::recordRateLimited(Metrics::RateLimitAction::DISCONNECTED);
+            break;
+        }
+    }
+    return l_result;
+}
@@ -0,0 +1,97 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QSet>
+#include <QString>
+
+/**
+ * @brief Limits how much work clients can cause, weighing every packet and command by its cost.
+ *
+ * @details Every client has a token bucket holding up to packet_rate_limit_hard tokens, refilled at the same rate
+ * per second. Packets and commands take as many tokens as their configured weight. Clients are warned once they
+ * used packet_rate_limit_soft tokens, and disconnected once they would use packet_rate_limit_hard.
+ *
+ * Operations that fan out to many clients or areas also draw from a bucket shared by the whole server, so several
+ * clients cannot overload the server together while each stays under its own limit.
+ */
+class RateLimiter
+{
+  public:
+    /**
+     * @brief The token bucket of a single client.
+     */
+    struct Bucket
+    {
+        double tokens = 0;
+        qint64 updated = -1; //!< Milliseconds on the limiter clock at the last refill. -1 for a full bucket.
+    };
+
+    /**
+     * @brief What to do with a packet or command after charging it.
+     */
+    enum class Result
+    {
+        ALLOWED,
+        WARNED,  //!< Allowed, but the client should slow down.
+        BUSY,    //!< The shared budget for fan-out operations is exhausted. The operation must be refused.
+        EXCEEDED //!< The client ran out of tokens and has to be disconnected.
+    };
+
+    RateLimiter();
+
+    /**
+     * @brief Reads the limits and weights from the configuration.
+     */
+    void reload();
+
+    /**
+     * @brief Charges the weight of a packet to a client.
+     */
+    Result chargePacket(Bucket &f_bucket, const QString &f_header);
+
+    /**
+     * @brief Charges the weight of a command to a client, on top of the packet it arrived in.
+     *
+     * @param f_command The command name in lower case.
+     */
+    Result chargeCommand(Bucket &f_bucket, const QString &f_command);
+
+  private:
+    /**
+     * @brief Takes tokens from a client and, for fan-out operations, from the shared budget.
+     */
+    Result charge(Bucket &f_bucket, double f_weight, bool f_fanout);
+
+    QElapsedTimer m_clock;
+
+    double m_capacity = 0;
+    double m_warning_level = 0;
+    QHash<QString, double> m_packet_weights;
+    QHash<QString, double> m_command_weights;
+
+    QSet<QString> m_fanout_packets;
+    QSet<QString> m_fanout_commands;
+    double m_fanout_budget = 0;
+    Bucket m_fanout_bucket;
+};
+
+#endif // RATE_LIMITER_H
@@ -18,34 +18,80 @@
 #include "server.h"
 
 #include "acl_roles_handler.h"
+#include "admission_control.h"
 #include "aoclient.h"
 #include "area_data.h"
+#include "cluster_bus.h"
 #include "command_extension.h"
 #include "config_manager.h"
+#include "config_snapshot.h"
 #include "db_manager.h"
 #include "discord.h"
 #include "logger/u_logger.h"
+#include "metrics.h"
+#include "metrics_server.h"
 #include "music_manager.h"
+#include "network/acceptor_pool.h"
+#include "network/epoll_transport.h"
+#include "network/listen_socket.h"
+#include "network/network_capture.h"
 #include "network/network_socket.h"
 #include "packet/packet_factory.h"
 #include "serverpublisher.h"
+#include "string_table.h"
+
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QSaveFile>
+#include <QScopeGuard>
+#include <QThread>
+
+#include <future>
+
+namespace {
+
+/**
+ * @brief Runs a configuration loader on a thread of its own.
+ *
+ * @param f_elapsed Receives the time the loader took, in milliseconds. Only valid once the result was retrieved.
+ */
+template <typename Loader>
+auto loadAsync(qint64 &f_elapsed, Loader f_loader)
+{
+    return std::async(std::launch::async, [&f_elapsed, f_loader] {
+        QElapsedTimer l_timer;
+        l_timer.start();
+        auto l_record = qScopeGuard([&] { f_elapsed = l_timer.elapsed(); });
+        return f_loader();
+    });
+}
+
+} // namespace
 
 Server::Server(int p_ws_port, QObject *parent) :
     QObject(parent),
     m_port(p_ws_port),
-    m_player_count(0)
+    m_player_count(0),
+    m_admission(new AdmissionControl)
 {
     timer = new QTimer(this);
 
     db_manager = new DBManager;
-    medieval_parser = new MedievalParser;
 
     acl_roles_handler = new ACLRolesHandler(this);
     acl_roles_handler->loadFile("config/acl_roles.ini");
+    connect(acl_roles_handler, &ACLRolesHandler::rolesChanged, this, [this] {
+        for (AOClient *l_client : qAsConst(m_clients)) {
+            l_client->updatePermissions();
+        }
+    });
 
     command_extension_collection = new CommandExtensionCollection;
     command_extension_collection->setCommandNameWhitelist(AOClient::COMMANDS.keys());
     command_extension_collection->loadFile("config/command_extensions.ini");
+    m_command_table = AOClient::buildCommandTable(*command_extension_collection);
 
     // We create it, even if its not used later on.
     discord = new Discord(this);
@@ -56,8 +102,17 @@ Server::Server(int p_ws_port, QObject *parent) :
     AOPacket::registerPackets();
 }
 
-void Server::start()
+void Server::start(bool f_takeover)
 {
+    m_startup_phases.clear();
+    QElapsedTimer l_startup_timer;
+    l_startup_timer.start();
+    QElapsedTimer l_phase_timer;
+    l_phase_timer.start();
+    auto l_end_phase = [this, &l_phase_timer](const QString &f_phase) {
+        m_startup_phases.append({f_phase, l_phase_timer.restart()});
+    };
+
     QString bind_ip = ConfigManager::bindIP();
     QHostAddress bind_addr;
     if (bind_ip == "all")
@@ -69,54 +124,206 @@ void Server::start()
     }
 
     server = new QWebSocketServer("Akashi", QWebSocketServer::NonSecureMode, this);
-    if (!server->listen(bind_addr, m_port)) {
-        qCritical() << "Server error:" << server->errorString();
+    const int l_acceptor_threads = ConfigManager::acceptorThreads();
+    const bool l_reuse_port = ConfigManager::reusePort() || l_acceptor_threads > 0;
+    bool l_listening = false;
+    quint16 l_port = 0;
+    bool l_epoll = ConfigManager::transportType() == DataTypes::TransportType::EPOLL;
+    if (l_epoll && !EpollTransport::isSupported()) {
+        qWarning() << "The epoll transport is not available on this platform, falling back to Qt WebSockets.";
+        l_epoll = false;
+    }
+    // With reuse_port a second server binds the same port without any error, and the kernel splits players between both.
+    const bool l_port_taken = l_reuse_port && !f_takeover && isHandoffServerRunning();
+    if (l_port_taken) {
+        qCritical() << "Server error: another server is already running on port" << m_port << "- start with --takeover to replace it";
+    }
+    else if (l_epoll) {
+        m_epoll_transport = new EpollTransport(this);
+        connect(m_epoll_transport, &EpollTransport::newConnection, this, [this](NetworkSocket *f_socket) {
+            if (m_capture) {
+                f_socket->setCapture(m_capture);
+            }
+            acceptSocket(f_socket);
+        });
+        const qintptr l_descriptor = ListenSocket::open(bind_addr, m_port, l_reuse_port);
+        l_listening = l_descriptor != -1 && m_epoll_transport->start(l_descriptor);
+        l_port = m_epoll_transport->serverPort();
+        if (!l_listening) {
+            qCritical() << "Server error: unable to listen on port" << m_port << "with the epoll transport";
+        }
+    }
+    else if (l_acceptor_threads > 0) {
+        m_acceptor_pool = new AcceptorPool(m_admission, this);
+        connect(m_acceptor_pool, &AcceptorPool::newConnection, this, [this](QWebSocket *f_socket) { acceptWebSocket(f_socket, true); });
+        l_listening = m_acceptor_pool->start(bind_addr, m_port, l_acceptor_threads);
+        l_port = m_acceptor_pool->serverPort();
+        if (!l_listening) {
+            qCritical() << "Server error: unable to start" << l_acceptor_threads << "acceptor threads on port" << m_port;
+        }
+    }
+    else if (l_reuse_port) {
+        // Binding before the handoff keeps the port open while the old server stops accepting.
+        const qintptr l_descriptor = ListenSocket::openReusePort(bind_addr, m_port);
+        l_listening = l_descriptor != -1 && server->setNativeDescriptor(l_descriptor);
+        if (!l_listening) {
+            ListenSocket::close(l_descriptor);
+            qCritical() << "Server error: unable to listen on port" << m_port << "with SO_REUSEPORT";
+        }
     }
     else {
+        l_listening = server->listen(bind_addr, m_port);
+        if (!l_listening) {
+            qCritical() << "Server error:" << server->errorString();
+        }
+        if (f_takeover) {
+            qWarning() << "[Handoff]"
+                       << "--takeover requires reuse_port to be enabled.";
+        }
+    }
+    if (l_listening && m_acceptor_pool == nullptr && m_epoll_transport == nullptr) {
         connect(server, &QWebSocketServer::newConnection,
                 this, &Server::clientConnected);
-        qInfo() << "Server listening on" << server->serverPort();
+        l_port = server->serverPort();
+    }
+    if (l_listening) {
+        qInfo() << "Server listening on" << l_port;
+    }
+
+    if (l_listening && f_takeover && l_reuse_port) {
+        requestHandoff();
+    }
+
+    // Serve runtime metrics if requested.
+    if (ConfigManager::metricsEnabled()) {
+        m_metrics_server = new MetricsServer(this, this);
+        Metrics::setEnabled(m_metrics_server->listen(QHostAddress(ConfigManager::metricsBindIP()), ConfigManager::metricsPort()));
+    }
+
+    // Join the other servers of the cluster if requested.
+    if (ConfigManager::clusterEnabled()) {
+        m_cluster_bus = new ClusterBus(ConfigManager::clusterNodeName(), ConfigManager::clusterAddress(), ConfigManager::clusterSecret(), this);
+        connect(m_cluster_bus, &ClusterBus::messageReceived, this, &Server::handleClusterMessage);
+        if (!m_cluster_bus->start()) {
+            delete m_cluster_bus;
+            m_cluster_bus = nullptr;
+        }
+    }
+
+    // Record inbound traffic for later replay if requested.
+    if (ConfigManager::captureTraffic()) {
+        QDir().mkpath("captures");
+        QString l_capture_path = QString("captures/%1.akcap").arg(QDateTime::currentDateTime().toString("yyyy-MM-dd_hh-mm-ss"));
+        m_capture = new NetworkCapture(l_capture_path, this);
+        if (!m_capture->isOpen()) {
+            m_capture->deleteLater();
+            m_capture = nullptr;
+        }
     }
 
     // Checks if any Discord webhooks are enabled.
     handleDiscordIntegration();
 
     // Construct modern advertiser if enabled in config
-    server_publisher = new ServerPublisher(server->serverPort(), &m_player_count, this);
-
-    // Get characters from config file
-    m_characters = ConfigManager::charlist();
-
-    // Get backgrounds from config file
-    m_backgrounds = ConfigManager::backgrounds();
+    server_publisher = new ServerPublisher(l_port, &m_player_count, this);
+
+    l_end_phase("network");
+
+    // None of the configuration files depend on each other, so they are read side by side.
+    // areas.ini is read on this thread meanwhile, as its QSettings object lives here.
+    qint64 l_characters_time = 0;
+    qint64 l_backgrounds_time = 0;
+    qint64 l_musiclist_time = 0;
+    qint64 l_command_help_time = 0;
+    qint64 l_ipbans_time = 0;
+    qint64 l_autorp_time = 0;
+    auto l_characters = loadAsync(l_characters_time, &ConfigManager::charlist);
+    auto l_backgrounds = loadAsync(l_backgrounds_time, &ConfigManager::backgrounds);
+    auto l_musiclist = loadAsync(l_musiclist_time, &ConfigManager::musiclist);
+    // The command help information is not stored inside the server.
+    auto l_command_help = loadAsync(l_command_help_time, &ConfigManager::loadCommandHelp);
+    auto l_ipbans = loadAsync(l_ipbans_time, &ConfigManager::iprangeBans);
+    auto l_medieval_parser = loadAsync(l_autorp_time, [] { return new MedievalParser; });
+
+    QElapsedTimer l_areas_timer;
+    l_areas_timer.start();
+    const QList<ConfigManager::AreaConfig> l_area_configs = ConfigManager::areaConfigs();
+    const qint64 l_areas_time = l_areas_timer.elapsed();
+
+    m_characters = l_characters.get();
+    m_backgrounds = l_backgrounds.get();
+    m_character_ids.clear();
+    m_character_ids.reserve(m_characters.size());
+    for (int i = 0; i < m_characters.size(); ++i) {
+        m_characters[i] = StringTable::share(m_characters[i]);
+        const StringTable::Id l_id = StringTable::intern(m_characters[i]);
+        if (!m_character_ids.contains(l_id)) {
+            m_character_ids.insert(l_id, i);
+        }
+    }
+    for (QString &l_background : m_backgrounds) {
+        l_background = StringTable::share(l_background);
+    }
+    for (const char *l_position : {"def", "pro", "wit", "jud", "hld", "hlp", "jur", "sea"}) {
+        StringTable::intern(l_position);
+    }
+    const MusicList l_root_musiclist = l_musiclist.get();
+    l_command_help.get();
+    const QStringList l_range_bans = l_ipbans.get();
+    medieval_parser = l_medieval_parser.get();
+    l_end_phase("config files");
+    m_startup_phases.append({"  characters.txt", l_characters_time});
+    m_startup_phases.append({"  backgrounds.txt", l_backgrounds_time});
+    m_startup_phases.append({"  music.json", l_musiclist_time});
+    m_startup_phases.append({"  commandhelp.json", l_command_help_time});
+    m_startup_phases.append({"  ipbans.json", l_ipbans_time});
+    m_startup_phases.append({"  autorp.json", l_autorp_time});
+    m_startup_phases.append({"  areas.ini", l_areas_time});
 
     // Build our music manager.
-
-    MusicList l_musiclist = ConfigManager::musiclist();
-    music_manager = new MusicManager(ConfigManager::cdnList(), l_musiclist, ConfigManager::ordered_songs(), this);
-    connect(music_manager, &MusicManager::sendFMPacket, this, &Server::unicast);
-    connect(music_manager, &MusicManager::sendAreaFMPacket, this, QOverload<AOPacket *, int>::of(&Server::broadcast));
+    music_manager = new MusicManager(ConfigManager::cdnList(), l_root_musiclist, ConfigManager::ordered_songs(), this);
+    connect(music_manager, &MusicManager::sendFMPacket, this, &Server::unicastMusiclist);
+    connect(music_manager, &MusicManager::sendAreaFMPacket, this, &Server::broadcastMusiclist);
 
     // Get musiclist from config file
     m_music_list = music_manager->rootMusiclist();
 
     // Assembles the area list
-    m_area_names = ConfigManager::sanitizedAreaNames();
-    for (int i = 0; i < m_area_names.length(); i++) {
-        QString area_name = QString::number(i) + ":" + m_area_names[i];
-        AreaData *l_area = new AreaData(area_name, i, music_manager);
+    m_area_names.clear();
+    m_area_names.reserve(l_area_configs.size());
+    for (int i = 0; i < l_area_configs.size(); i++) {
+        m_area_names.append(StringTable::share(l_area_configs[i].name));
+        AreaData *l_area = new AreaData(l_area_configs[i], i, music_manager);
         m_areas.insert(i, l_area);
         connect(l_area, &AreaData::sendAreaPacket, this, QOverload<AOPacket *, int>::of(&Server::broadcast));
         connect(l_area, &AreaData::sendAreaPacketClient, this, &Server::unicast);
         connect(l_area, &AreaData::userJoinedArea, music_manager, &MusicManager::userJoinedArea);
+        connect(l_area, &AreaData::ownersChanged, this, [this](int f_client_id) {
+            AOClient *l_client = getClientByID(f_client_id);
+            if (l_client != nullptr) {
+                l_client->updatePermissions();
+            }
+        });
         music_manager->registerArea(i);
     }
-
-    // Loads the command help information. This is not stored inside the server.
-    ConfigManager::loadCommandHelp();
+    l_end_phase("areas");
+
+    // Pick up the state of the previous server.
+    const QString l_snapshot_path = ConfigManager::snapshotFile();
+    if (QFile::exists(l_snapshot_path)) {
+        restoreSnapshot(l_snapshot_path);
+        QFile::remove(l_snapshot_path);
+        l_end_phase("snapshot");
+    }
 
     // Get IP bans
-    m_ipban_list = ConfigManager::iprangeBans();
+    for (const QString &l_ipban : l_range_bans) {
+        m_ipban_ranges.insert(l_ipban);
+    }
+    m_admission->setBannedRanges(m_ipban_ranges);
+    m_admission->configure(ConfigManager::multiClientLimit(), ConfigManager::connectionRateLimit(), ConfigManager::connectionBurst());
+
+    m_rate_limiter.reload();
 
     // Rate-Limiter for IC-Chat
     m_message_floodguard_timer = new QTimer(this);
@@ -128,46 +335,279 @@ void Server::start()
         m_available_ids.push(i);
         m_clients_ids.insert(i, nullptr);
     }
+    l_end_phase("clients");
+
+    if (l_listening && l_reuse_port) {
+        listenForHandoff();
+    }
+
+    QStringList l_report;
+    for (const QPair<QString, qint64> &l_phase : qAsConst(m_startup_phases)) {
+        l_report.append(QString("%1 %2ms").arg(l_phase.first.trimmed()).arg(l_phase.second));
+    }
+    qInfo().noquote() << "Started in" << QString("%1ms").arg(l_startup_timer.elapsed()) << "(" + l_report.join(", ") + ")";
 }
 
-QVector<AOClient *> Server::getClients()
+QList<QPair<QString, qint64>> Server::startupPhases() const
 {
-    return m_clients;
+    return m_startup_phases;
 }
 
-void Server::clientConnected()
+bool Server::saveSnapshot(const QString &f_path)
 {
-    QWebSocket *socket = server->nextPendingConnection();
-    NetworkSocket *l_socket = new NetworkSocket(socket, socket);
+    QElapsedTimer l_timer;
+    l_timer.start();
+
+    QByteArray l_payload;
+    QDataStream l_stream(&l_payload, QIODevice::WriteOnly);
+    l_stream.setVersion(QDataStream::Qt_6_0);
+    l_stream << qint32(m_areas.size());
+    for (int i = 0; i < m_areas.size(); i++) {
+        AreaData *l_area = m_areas.value(i);
+        QStringList l_owner_ipids;
+        for (int l_client_id : l_area->owners()) {
+            AOClient *l_client = getClientByID(l_client_id);
+            if (l_client != nullptr) {
+                l_owner_ipids.append(l_client->getIpid());
+            }
+        }
+        QStringList l_invited_ipids;
+        for (int l_client_id : l_area->invited()) {
+            AOClient *l_client = getClientByID(l_client_id);
+            if (l_client != nullptr) {
+                l_invited_ipids.append(l_client->getIpid());
+            }
+        }
+
+        // Each area is a blob of its own, so areas can be skipped if they were removed from areas.ini meanwhile.
+        QByteArray l_area_state;
+        QDataStream l_area_stream(&l_area_state, QIODevice::WriteOnly);
+        l_area_stream.setVersion(QDataStream::Qt_6_0);
+        l_area->writeState(l_area_stream);
+        l_area_stream << l_owner_ipids << l_invited_ipids;
+        music_manager->writeState(l_area_stream, i);
+        l_stream << m_area_names.value(i) << l_area_state;
+    }
+
+    QDir().mkpath(QFileInfo(f_path).path());
+    QSaveFile l_file(f_path);
+    if (!l_file.open(QIODevice::WriteOnly)) {
+        qWarning() << "[Snapshot]"
+                   << "Unable to write" << f_path << ":" << l_file.errorString();
+        return false;
+    }
+    QDataStream l_header(&l_file);
+    l_header << SNAPSHOT_MAGIC << SNAPSHOT_VERSION;
+    l_file.write(qCompress(l_payload));
+    if (!l_file.commit()) {
+        qWarning() << "[Snapshot]"
+                   << "Unable to write" << f_path << ":" << l_file.errorString();
+        return false;
+    }
+    qInfo() << "[Snapshot]"
+            << "Saved" << m_areas.size() << "areas in" << l_timer.elapsed() << "ms";
+    return true;
+}
+
+bool Server::restoreSnapshot(const QString &f_path)
+{
+    QElapsedTimer l_timer;
+    l_timer.start();
+
+    QFile l_file(f_path);
+    if (!l_file.open(QIODevice::ReadOnly)) {
+        qWarning() << "[Snapshot]"
+                   << "Unable to read" << f_path << ":" << l_file.errorString();
+        return false;
+    }
+    QDataStream l_header(&l_file);
+    quint32 l_magic = 0;
+    quint32 l_version = 0;
+    l_header >> l_magic >> l_version;
+    if (l_magic != SNAPSHOT_MAGIC || l_version != SNAPSHOT_VERSION) {
+        qWarning() << "[Snapshot]" << f_path << "is not a snapshot of this version of akashi, ignoring it.";
+        return false;
+    }
 
-    // Too many players. Reject connection!
-    // This also enforces the maximum playercount.
-    if (m_available_ids.empty()) {
-        AOPacket *disconnect_reason = PacketFactory::createPacket("BD", {"Maximum playercount has been reached."});
-        l_socket->write(disconnect_reason);
-        l_socket->close();
-        l_socket->deleteLater();
+    const QByteArray l_payload = qUncompress(l_file.readAll());
+    QDataStream l_stream(l_payload);
+    l_stream.setVersion(QDataStream::Qt_6_0);
+    qint32 l_area_count = 0;
+    l_stream >> l_area_count;
+    int l_restored = 0;
+    for (int i = 0; i < l_area_count && l_stream.status() == QDataStream::Ok; i++) {
+        QString l_area_name;
+        QByteArray l_area_state;
+        l_stream >> l_area_name >> l_area_state;
+        const int l_area_id = m_area_names.indexOf(l_area_name);
+        if (l_area_id == -1) {
+            continue;
+        }
+
+        AreaData *l_area = m_areas.value(l_area_id);
+        QDataStream l_area_stream(l_area_state);
+        l_area_stream.setVersion(QDataStream::Qt_6_0);
+        QStringList l_owner_ipids;
+        QStringList l_invited_ipids;
+        if (!l_area->readState(l_area_stream)) {
+            qWarning() << "[Snapshot]"
+                       << "Unable to restore area" << l_area_name;
+            continue;
+        }
+        l_area_stream >> l_owner_ipids >> l_invited_ipids;
+        l_area->restoreRoles(l_owner_ipids, l_invited_ipids);
+        music_manager->readState(l_area_stream, l_area_id);
+        l_restored++;
+    }
+
+    if (l_stream.status() != QDataStream::Ok) {
+        qWarning() << "[Snapshot]" << f_path << "is truncated, restored" << l_restored << "areas.";
+        return false;
+    }
+    qInfo() << "[Snapshot]"
+            << "Restored" << l_restored << "areas in" << l_timer.elapsed() << "ms";
+    return true;
+}
+
+QString Server::handoffSocketName() const
+{
+    return QString("akashi-handoff-%1").arg(m_port);
+}
+
+bool Server::isHandoffServerRunning() const
+{
+    QLocalSocket l_socket;
+    l_socket.connectToServer(handoffSocketName());
+    return l_socket.waitForConnected(HANDOFF_PROBE_TIMEOUT);
+}
+
+void Server::listenForHandoff()
+{
+    // A server that crashed leaves its socket behind on Unix, but one that still answers must keep it.
+    if (isHandoffServerRunning()) {
+        qWarning() << "[Handoff]"
+                   << "Unable to wait for takeovers: another server still listens on" << handoffSocketName();
         return;
     }
+    QLocalServer::removeServer(handoffSocketName());
+    m_handoff_server = new QLocalServer(this);
+    // Other local users must not be able to make this server hand over.
+    m_handoff_server->setSocketOptions(QLocalServer::UserAccessOption);
+    if (!m_handoff_server->listen(handoffSocketName())) {
+        qWarning() << "[Handoff]"
+                   << "Unable to wait for takeovers:" << m_handoff_server->errorString();
+        return;
+    }
+    connect(m_handoff_server, &QLocalServer::newConnection, this, [this] {
+        QLocalSocket *l_socket = m_handoff_server->nextPendingConnection();
+        connect(l_socket, &QLocalSocket::disconnected, l_socket, &QLocalSocket::deleteLater);
+        connect(l_socket, &QLocalSocket::readyRead, this, [this, l_socket] {
+            if (l_socket->canReadLine() && l_socket->readLine().trimmed() == "handoff" && !m_draining) {
+                handOff(l_socket);
+            }
+        });
+    });
+}
 
-    int user_id = m_available_ids.pop();
-    AOClient *client = new AOClient(this, l_socket, l_socket, user_id, music_manager);
-    m_clients_ids.insert(user_id, client);
+bool Server::requestHandoff()
+{
+    QLocalSocket l_socket;
+    l_socket.connectToServer(handoffSocketName());
+    if (!l_socket.waitForConnected(HANDOFF_TIMEOUT)) {
+        qWarning() << "[Handoff]"
+                   << "No server to take over from:" << l_socket.errorString();
+        return false;
+    }
 
-    int multiclient_count = 1;
-    bool is_at_multiclient_limit = false;
-    client->calculateIpid();
-    auto ban = db_manager->isIPBanned(client->getIpid());
-    bool is_banned = ban.first;
-    for (AOClient *joined_client : qAsConst(m_clients)) {
-        if (client->m_remote_ip.isEqual(joined_client->m_remote_ip))
-            multiclient_count++;
+    QElapsedTimer l_timer;
+    l_timer.start();
+    l_socket.write("handoff\n");
+    l_socket.flush();
+    while (!l_socket.canReadLine() && l_socket.waitForReadyRead(HANDOFF_TIMEOUT)) {
+    }
+    const QByteArray l_reply = l_socket.readLine().trimmed();
+    if (l_reply != "ready") {
+        qWarning() << "[Handoff]"
+                   << "The previous server did not hand over its state.";
+        return false;
+    }
+    qInfo() << "[Handoff]"
+            << "Took over from the previous server in" << l_timer.elapsed() << "ms";
+    return true;
+}
+
+void Server::handOff(QLocalSocket *f_socket)
+{
+    // The new server already listens on the same port, so it gets every connection from here on.
+    server->close();
+    if (m_acceptor_pool != nullptr) {
+        m_acceptor_pool->close();
+    }
+    if (m_epoll_transport != nullptr) {
+        m_epoll_transport->close();
     }
+    m_handoff_server->close();
+    m_draining = true;
+
+    const bool l_saved = saveSnapshot(ConfigManager::snapshotFile());
+    f_socket->write(l_saved ? "ready\n" : "failed\n");
+    f_socket->flush();
+
+    broadcast(PacketFactory::createPacket("CT", {ConfigManager::serverNickname(), "This server is restarting. Reconnect to join the new one; "
+                                                                                "anything that happens here from now on will not carry over.",
+                                                 "1"}));
+
+    const int l_drain_timeout = ConfigManager::drainTimeout();
+    qInfo() << "[Handoff]"
+            << "Handed over to a new server, serving" << m_clients.size() << "remaining clients for up to" << l_drain_timeout << "seconds.";
+    if (m_clients.isEmpty()) {
+        QCoreApplication::quit();
+        return;
+    }
+    QTimer::singleShot(l_drain_timeout * 1000, qApp, &QCoreApplication::quit);
+}
+
+QVector<AOClient *> Server::getClients()
+{
+    return m_clients;
+}
 
-    if (multiclient_count > ConfigManager::multiClientLimit() && !client->m_remote_ip.isLoopback())
-        is_at_multiclient_limit = true;
+void Server::clientConnected()
+{
+    acceptWebSocket(server->nextPendingConnection());
+}
+
+void Server::acceptWebSocket(QWebSocket *f_socket, bool f_admitted)
+{
+    // Loopback peers pass the acceptors unchecked. Behind a local proxy the forwarded address is only known once
+    // the handshake completed, so it has to be admitted here.
+    if (f_admitted && f_socket->peerAddress().isLoopback()) {
+        f_admitted = false;
+    }
+    NetworkSocket *l_socket = new NetworkSocket(f_socket, f_socket);
+    if (m_capture) {
+        l_socket->setCapture(m_capture);
+    }
+    acceptSocket(l_socket, f_admitted);
+}
 
-    if (is_banned) {
+void Server::acceptSocket(NetworkSocket *f_socket, bool f_admitted)
+{
+    // Everything up to the ban check runs before anything is allocated for the client.
+    const QHostAddress l_remote_ip = f_socket->peerAddress();
+    AdmissionControl::Verdict l_verdict = AdmissionControl::Verdict::SERVER_FULL;
+    if (!m_available_ids.empty()) {
+        l_verdict = f_admitted ? AdmissionControl::Verdict::ADMITTED : m_admission->admit(l_remote_ip);
+    }
+    if (l_verdict != AdmissionControl::Verdict::ADMITTED) {
+        f_socket->writeEncoded(m_admission->rejectionFrame(l_verdict));
+        f_socket->close();
+        f_socket->deleteLater();
+        return;
+    }
+
+    auto ban = db_manager->isIPBanned(AOClient::ipidForAddress(l_remote_ip));
+    if (ban.first) {
         QString ban_duration;
         if (!(ban.second.duration == -2)) {
             ban_duration = QDateTime::fromSecsSinceEpoch(ban.second.time).addSecs(ban.second.duration).toString("MM/dd/yyyy, hh:mm");
@@ -176,39 +616,46 @@ void Server::clientConnected()
             ban_duration = "Permanently.";
         }
         AOPacket *ban_reason = PacketFactory::createPacket("BD", {"Reason: " + ban.second.reason + "\nBan ID: " + QString::number(ban.second.id) + "\nUntil: " + ban_duration});
-        socket->sendTextMessage(ban_reason->toUtf8());
-    }
-    if (is_banned || is_at_multiclient_limit) {
-        client->deleteLater();
-        l_socket->close(QWebSocketProtocol::CloseCodeNormal);
-        markIDFree(user_id);
+        f_socket->write(ban_reason);
+        if (!f_admitted) {
+            m_admission->release(l_remote_ip);
+        }
+        f_socket->close();
+        f_socket->deleteLater();
         return;
     }
 
-    QHostAddress l_remote_ip = client->m_remote_ip;
-    if (l_remote_ip.protocol() == QAbstractSocket::IPv6Protocol) {
-        l_remote_ip = parseToIPv4(l_remote_ip);
-    }
-
-    if (isIPBanned(l_remote_ip)) {
-        QString l_reason = "Your IP has been banned by a moderator.";
-        AOPacket *l_ban_reason = PacketFactory::createPacket("BD", {l_reason});
-        l_socket->write(l_ban_reason);
-        client->deleteLater();
-        l_socket->close(QWebSocketProtocol::CloseCodeNormal);
-        markIDFree(user_id);
-        return;
-    }
+    int user_id = m_available_ids.pop();
+    AOClient *client = new AOClient(this, f_socket, f_socket, user_id, music_manager);
+    m_clients_ids.insert(user_id, client);
+    client->calculateIpid();
 
     m_clients.append(client);
-    connect(l_socket, &NetworkSocket::clientDisconnected, this, [=, this] {
+    m_client_index.insert(client);
+    // Area owners and invited users of a restored snapshot get their role back.
+    for (AreaData *l_area : qAsConst(m_areas)) {
+        l_area->claimRestoredRoles(user_id, client->getIpid());
+    }
+    connect(f_socket, &NetworkSocket::clientDisconnected, this, [=, this] {
         if (client->hasJoined()) {
             decreasePlayerCount();
         }
         m_clients.removeAll(client);
-        l_socket->deleteLater();
+        m_client_index.remove(client);
+        if (getClientsByIpid(client->getIpid()).isEmpty()) {
+            logger->forgetHwid(client->getIpid());
+        }
+        if (!f_admitted) {
+            m_admission->release(l_remote_ip);
+        }
+        f_socket->deleteLater();
+        if (m_draining && m_clients.isEmpty()) {
+            qInfo() << "[Handoff]"
+                    << "The last client left, shutting down.";
+            QCoreApplication::quit();
+        }
     });
-    connect(l_socket, &NetworkSocket::handlePacket, client, &AOClient::handlePacket);
+    connect(f_socket, &NetworkSocket::handlePacket, client, &AOClient::handlePacket);
 
     // This is the infamous workaround for
     // tsuserver4. It should disable fantacrypt
@@ -246,7 +693,7 @@ QStringList Server::getCursedCharsTaken(AOClient *client, QStringList chars_take
 {
     QStringList chars_taken_cursed;
     for (int i = 0; i < chars_taken.length(); i++) {
-        if (!client->m_charcurse_list.contains(i))
+        if (!client->cold().charcurse_list.contains(i))
             chars_taken_cursed.append("-1");
         else
             chars_taken_cursed.append(chars_taken.value(i));
@@ -281,16 +728,65 @@ PlayerStateObserver *Server::getPlayerStateObserver()
     return &m_player_state_observer;
 }
 
-void Server::reloadSettings()
+bool Server::reloadSettings(int f_requester_id)
+{
+    if (m_reload_thread != nullptr) {
+        return false;
+    }
+
+    QThread *l_main_thread = thread();
+    m_reload_thread = QThread::create([this, l_main_thread] {
+        m_pending_snapshot = ConfigSnapshot::load(l_main_thread);
+    });
+    connect(m_reload_thread, &QThread::finished, this, [this, f_requester_id] {
+        ConfigSnapshot *l_snapshot = m_pending_snapshot;
+        m_pending_snapshot = nullptr;
+        m_reload_thread->deleteLater();
+        m_reload_thread = nullptr;
+
+        QString l_result = "Reloaded configurations";
+        if (l_snapshot->errors.isEmpty()) {
+            applyConfigSnapshot(l_snapshot);
+        }
+        else {
+            qWarning() << "Configuration reload aborted:" << l_snapshot->errors;
+            l_result = "Configurations were not reloaded:\n" + l_snapshot->errors.join("\n");
+        }
+        delete l_snapshot;
+
+        AOClient *l_requester = getClientByID(f_requester_id);
+        if (l_requester != nullptr) {
+            l_requester->sendServerMessage(l_result);
+        }
+    });
+    m_reload_thread->start();
+    return true;
+}
+
+void Server::applyConfigSnapshot(ConfigSnapshot *f_snapshot)
 {
-    ConfigManager::reloadSettings();
+    // Everything was loaded up front, so this only swaps objects and no client sees a half-applied reload.
+    ConfigManager::swapSettings(f_snapshot->settings, f_snapshot->discord, f_snapshot->logtext);
+    f_snapshot->settings = nullptr;
+    f_snapshot->discord = nullptr;
+    f_snapshot->logtext = nullptr;
+
+    m_ipban_ranges = std::move(f_snapshot->ipban_ranges);
+    m_admission->setBannedRanges(m_ipban_ranges);
+    m_admission->configure(ConfigManager::multiClientLimit(), ConfigManager::connectionRateLimit(), ConfigManager::connectionBurst());
+    m_rate_limiter.reload();
+    // This also resolves the permissions of every client again, under the possibly changed authentication type.
+    acl_roles_handler->setRoles(f_snapshot->acl_roles);
+    // The previous collection is deleted along with the snapshot.
+    std::swap(command_extension_collection, f_snapshot->command_extensions);
+    m_command_table = std::move(f_snapshot->command_table);
+    music_manager->reloadRequest(f_snapshot->musiclist, f_snapshot->ordered_songs);
+    m_music_list = music_manager->rootMusiclist();
+
     emit reloadRequest(ConfigManager::serverNickname(), ConfigManager::serverDescription());
     emit updateHTTPConfiguration();
     handleDiscordIntegration();
     logger->loadLogtext();
-    m_ipban_list = ConfigManager::iprangeBans();
-    acl_roles_handler->loadFile("config/acl_roles.ini");
-    command_extension_collection->loadFile("config/command_extensions.ini");
 }
 
 void Server::broadcast(AOPacket *packet, int area_index)
@@ -309,42 +805,45 @@ void Server::broadcast(AOPacket *packet)
 }
 
 void Server::broadcast(AOPacket *packet, TARGET_TYPE target)
+{
+    deliver(packet, packet, target);
+    publishBroadcast(packet, packet, target);
+}
+
+void Server::broadcast(AOPacket *packet, AOPacket *other_packet, TARGET_TYPE target)
+{
+    deliver(packet, other_packet, target);
+    publishBroadcast(packet, other_packet, target);
+}
+
+void Server::deliver(AOPacket *f_packet, AOPacket *f_other_packet, TARGET_TYPE f_target)
 {
     for (AOClient *l_client : qAsConst(m_clients)) {
-        switch (target) {
+        switch (f_target) {
+        case TARGET_TYPE::AUTHENTICATED:
+            if (l_client->m_global_enabled) {
+                l_client->sendPacket(l_client->isAuthenticated() ? f_other_packet : f_packet);
+            }
+            break;
         case TARGET_TYPE::MODCHAT:
             if (l_client->checkPermission(ACLRole::MODCHAT)) {
-                l_client->sendPacket(packet);
+                l_client->sendPacket(f_packet);
             }
             break;
         case TARGET_TYPE::ADVERT:
             if (l_client->m_advert_enabled) {
-                l_client->sendPacket(packet);
+                l_client->sendPacket(f_packet);
             }
             break;
-        default:
-            break;
-        }
-    }
-}
-
-void Server::broadcast(AOPacket *packet, AOPacket *other_packet, TARGET_TYPE target)
-{
-    switch (target) {
-    case TARGET_TYPE::AUTHENTICATED:
-        for (AOClient *l_client : qAsConst(m_clients)) {
-            if (l_client->m_global_enabled) {
-                if (l_client->isAuthenticated()) {
-                    l_client->sendPacket(other_packet);
-                }
-                else {
-                    l_client->sendPacket(packet);
-                }
+        case TARGET_TYPE::MODERATORS:
+            if (l_client->isAuthenticated()) {
+                l_client->sendPacket(f_packet);
             }
+            break;
+        case TARGET_TYPE::EVERYONE:
+            l_client->sendPacket(f_packet);
+            break;
         }
-    default:
-        // Unimplemented, so not handled.
-        break;
     }
 }
 
@@ -357,24 +856,40 @@ void Server::unicast(AOPacket *f_packet, int f_client_id)
     }
 }
 
-QList<AOClient *> Server::getClientsByIpid(QString ipid)
+void Server::unicastMusiclist(AOPacket *f_packet, quint64 f_version, int f_client_id)
 {
-    QList<AOClient *> return_clients;
-    for (AOClient *l_client : qAsConst(m_clients)) {
-        if (l_client->getIpid() == ipid)
-            return_clients.append(l_client);
+    AOClient *l_client = getClientByID(f_client_id);
+    if (l_client != nullptr) {
+        l_client->sendMusiclist(f_packet, f_version);
     }
-    return return_clients;
 }
 
-QList<AOClient *> Server::getClientsByHwid(QString f_hwid)
+void Server::broadcastMusiclist(AOPacket *f_packet, quint64 f_version, int f_area_index)
 {
-    QList<AOClient *> return_clients;
-    for (AOClient *l_client : qAsConst(m_clients)) {
-        if (l_client->getHwid() == f_hwid)
-            return_clients.append(l_client);
+    const QVector<int> l_client_ids = m_areas.value(f_area_index)->joinedIDs();
+    for (const int l_client_id : l_client_ids) {
+        getClientByID(l_client_id)->sendMusiclist(f_packet, f_version);
     }
-    return return_clients;
+}
+
+const QList<AOClient *> &Server::getClientsByIpid(const QString &ipid) const
+{
+    return m_client_index.byIpid(ipid);
+}
+
+const QList<AOClient *> &Server::getClientsByHwid(const QString &f_hwid) const
+{
+    return m_client_index.byHwid(f_hwid);
+}
+
+const QList<AOClient *> &Server::getClientsByIp(const QHostAddress &f_ip) const
+{
+    return m_client_index.byIp(f_ip);
+}
+
+void Server::indexHwid(AOClient *f_client)
+{
+    m_client_index.insertHwid(f_client);
 }
 
 AOClient *Server::getClientByID(int id)
@@ -410,13 +925,7 @@ QString Server::getCharacterById(int f_chr_id)
 
 int Server::getCharID(QString char_name)
 {
-    for (int i = 0; i < m_characters.length(); i++) {
-        if (m_characters[i].toLower() == char_name.toLower()) {
-            return i;
-        }
-    }
-
-    return -1; // character does not exist
+    return m_character_ids.value(StringTable::find(char_name), -1);
 }
 
 QVector<AreaData *> Server::getAreas()
@@ -445,6 +954,19 @@ QQueue<QString> Server::getAreaBuffer(const QString &f_areaName)
     return logger->buffer(f_areaName);
 }
 
+int Server::getLogBufferDepth()
+{
+    return logger->bufferedEntries();
+}
+
+qint64 Server::getClientMemoryFootprint() const
+{
+    qint64 l_bytes = 0;
+    for (const AOClient *l_client : qAsConst(m_clients))
+        l_bytes += l_client->memoryFootprint();
+    return l_bytes;
+}
+
 QStringList Server::getAreaNames()
 {
     return m_area_names;
@@ -486,6 +1008,16 @@ ACLRolesHandler *Server::getACLRolesHandler()
     return acl_roles_handler;
 }
 
+const AOClient::CommandTable &Server::getCommandTable() const
+{
+    return m_command_table;
+}
+
+RateLimiter &Server::getRateLimiter()
+{
+    return m_rate_limiter;
+}
+
 CommandExtensionCollection *Server::getCommandExtensionCollection()
 {
     return command_extension_collection;
@@ -547,20 +1079,153 @@ void Server::decreasePlayerCount()
     emit playerCountUpdated(m_player_count);
 }
 
-bool Server::isIPBanned(QHostAddress f_remote_IP)
+namespace {
+QJsonObject packetToJson(AOPacket *f_packet)
 {
-    bool l_match_found = false;
-    for (const QString &l_ipban : qAsConst(m_ipban_list)) {
-        if (f_remote_IP.isInSubnet(QHostAddress::parseSubnet(l_ipban))) {
-            l_match_found = true;
-            break;
+    return QJsonObject{{"header", f_packet->getPacketInfo().header},
+                       {"contents", QJsonArray::fromStringList(f_packet->getContent())},
+                       {"escaped", f_packet->isPacketEscaped()}};
+}
+
+AOPacket *packetFromJson(const QJsonObject &f_json)
+{
+    QStringList l_contents;
+    const QJsonArray l_array = f_json["contents"].toArray();
+    for (const QJsonValue &l_value : l_array) {
+        l_contents.append(l_value.toString());
+    }
+    AOPacket *l_packet = PacketFactory::createPacket(f_json["header"].toString(), l_contents);
+    l_packet->setPacketEscaped(f_json["escaped"].toBool());
+    return l_packet;
+}
+} // namespace
+
+void Server::publishBroadcast(AOPacket *f_packet, AOPacket *f_other_packet, TARGET_TYPE f_target)
+{
+    if (m_cluster_bus == nullptr) {
+        return;
+    }
+
+    QJsonObject l_payload{{"target", int(f_target)}, {"packet", packetToJson(f_packet)}};
+    if (f_other_packet != f_packet) {
+        l_payload.insert("other_packet", packetToJson(f_other_packet));
+    }
+    m_cluster_bus->publish("broadcast", l_payload);
+}
+
+void Server::clusterKick(const QString &f_ipid, const QString &f_reason)
+{
+    if (m_cluster_bus != nullptr) {
+        m_cluster_bus->publish("kick", {{"ipid", f_ipid}, {"reason", f_reason}});
+    }
+}
+
+void Server::clusterBan(const DBManager::BanInfo &f_ban)
+{
+    if (m_cluster_bus != nullptr) {
+        m_cluster_bus->publish("ban", {{"ipid", f_ban.ipid},
+                                       {"ip", f_ban.ip.toString()},
+                                       {"hdid", f_ban.hdid},
+                                       {"time", qint64(f_ban.time)},
+                                       {"reason", f_ban.reason},
+                                       {"duration", f_ban.duration},
+                                       {"moderator", f_ban.moderator}});
+    }
+}
+
+void Server::clusterUnban(const DBManager::BanInfo &f_ban)
+{
+    if (m_cluster_bus != nullptr) {
+        m_cluster_bus->publish("unban", {{"ipid", f_ban.ipid}, {"time", qint64(f_ban.time)}});
+    }
+}
+
+bool Server::isClustered() const
+{
+    return m_cluster_bus != nullptr;
+}
+
+void Server::handleClusterMessage(const QString &f_node, const QString &f_type, const QJsonObject &f_payload)
+{
+    if (f_type == "broadcast") {
+        AOPacket *l_packet = packetFromJson(f_payload["packet"].toObject());
+        AOPacket *l_other_packet = f_payload.contains("other_packet") ? packetFromJson(f_payload["other_packet"].toObject()) : l_packet;
+        deliver(l_packet, l_other_packet, TARGET_TYPE(f_payload["target"].toInt()));
+        if (l_other_packet != l_packet) {
+            delete l_other_packet;
+        }
+        delete l_packet;
+    }
+    else if (f_type == "kick") {
+        const QList<AOClient *> l_targets = getClientsByIpid(f_payload["ipid"].toString());
+        for (AOClient *l_client : l_targets) {
+            l_client->sendPacket("KK", {f_payload["reason"].toString()});
+            l_client->m_socket->close();
         }
     }
-    return l_match_found;
+    else if (f_type == "ban") {
+        DBManager::BanInfo l_ban;
+        l_ban.ipid = f_payload["ipid"].toString();
+        l_ban.ip = QHostAddress(f_payload["ip"].toString());
+        l_ban.hdid = f_payload["hdid"].toString();
+        l_ban.time = f_payload["time"].toInteger();
+        l_ban.reason = f_payload["reason"].toString();
+        l_ban.duration = f_payload["duration"].toInteger();
+        l_ban.moderator = f_payload["moderator"].toString();
+        if (ConfigManager::clusterReplicateBans()) {
+            db_manager->addBan(l_ban);
+        }
+        else {
+            // The ban is already in the shared database, but not in our copy of it.
+            db_manager->refreshIPBan(l_ban.ipid);
+        }
+
+        QString l_ban_duration;
+        if (!(l_ban.duration == -2)) {
+            l_ban_duration = QDateTime::fromSecsSinceEpoch(l_ban.time).addSecs(l_ban.duration).toString("MM/dd/yyyy, hh:mm");
+        }
+        else {
+            l_ban_duration = "Permanently.";
+        }
+        const QList<AOClient *> l_targets = getClientsByIpid(l_ban.ipid);
+        for (AOClient *l_client : l_targets) {
+            l_client->sendPacket("KB", {l_ban.reason + "\nUntil: " + l_ban_duration});
+            l_client->m_socket->close();
+        }
+        qInfo() << "[Cluster]" << l_ban.moderator << "on" << f_node << "banned" << l_ban.ipid;
+    }
+    else if (f_type == "unban") {
+        const QString l_ipid = f_payload["ipid"].toString();
+        if (ConfigManager::clusterReplicateBans()) {
+            // Replicated bans have their own IDs on every node, they are matched by IPID and time instead.
+            const QList<DBManager::BanInfo> l_bans = db_manager->getBanInfo("ipid", l_ipid);
+            for (const DBManager::BanInfo &l_ban : l_bans) {
+                if (qint64(l_ban.time) == f_payload["time"].toInteger()) {
+                    db_manager->invalidateBan(l_ban.id);
+                }
+            }
+        }
+        else {
+            // The ban is already lifted in the shared database, but not in our copy of it.
+            db_manager->refreshIPBan(l_ipid);
+        }
+        qInfo() << "[Cluster]"
+                << "a ban on" << l_ipid << "was lifted on" << f_node;
+    }
+}
+
+bool Server::isIPBanned(QHostAddress f_remote_IP)
+{
+    return m_ipban_ranges.contains(f_remote_IP);
 }
 
 Server::~Server()
 {
+    if (m_reload_thread != nullptr) {
+        m_reload_thread->wait();
+        delete m_pending_snapshot;
+        delete m_reload_thread;
+    }
     for (AOClient *l_client : qAsConst(m_clients)) {
         l_client->deleteLater();
     }
@@ -20,28 +20,45 @@
 
 #include <QCoreApplication>
 #include <QDebug>
+#include <QDir>
 #include <QFile>
+#include <QJsonObject>
 #include <QMap>
 #include <QSettings>
+#include <QSharedPointer>
 #include <QStack>
 #include <QString>
 #include <QTimer>
 #include <QWebSocket>
 #include <QWebSocketServer>
 
+#include "admission_control.h"
+#include "client_index.h"
+#include "db_manager.h"
+#include "ip_range_set.h"
 #include "medieval_parser.h"
 #include "network/aopacket.h"
 #include "playerstateobserver.h"
+#include "rate_limiter.h"
+#include "string_table.h"
 
 class ACLRolesHandler;
+class AcceptorPool;
+class ClusterBus;
+class QLocalServer;
+class QLocalSocket;
 class ServerPublisher;
 class AOClient;
 class AreaData;
 class CommandExtensionCollection;
 class ConfigManager;
-class DBManager;
+class ConfigSnapshot;
 class Discord;
+class MetricsServer;
 class MusicManager;
+class NetworkCapture;
+class NetworkSocket;
+class EpollTransport;
 class ULogger;
 
 /**
@@ -73,8 +90,41 @@ class Server : public QObject
      * @details Starts listening for incoming connections on the given port.
      *
      * Advertising is not done here -- see Advertiser::contactMasterServer() for that.
+     *
+     * If a state snapshot is present, it is restored once the areas are built and removed afterwards.
+     *
+     * @param f_takeover If true, asks a server already running on the same port to stop accepting connections
+     * and hand over its state. Requires reuse_port in both servers. Without it, the server refuses to listen on a
+     * reuse_port port another server is running on.
+     */
+    void start(bool f_takeover = false);
+
+    /**
+     * @brief Writes the state of every area to a snapshot file.
+     *
+     * @details Area owners and invited users are stored by IPID, so they get their role back when they reconnect
+     * to the server restoring the snapshot.
+     *
+     * @return True if the snapshot was written.
+     */
+    bool saveSnapshot(const QString &f_path);
+
+    /**
+     * @brief Restores the state of the areas from a snapshot file.
+     *
+     * @details Areas are matched by name. Areas that no longer exist are skipped.
+     *
+     * @return True if the snapshot was read.
+     */
+    bool restoreSnapshot(const QString &f_path);
+
+    /**
+     * @brief Returns how long each phase of start() took, in milliseconds.
+     *
+     * @details Configuration files are read in parallel. Their individual times follow the "config files" phase
+     * with their names indented, and do not add up to it.
      */
-    void start();
+    QList<QPair<QString, qint64>> startupPhases() const;
 
     /**
      * @brief Enum to specifc different targets to send altered packets to a specific usergroup.
@@ -83,7 +133,9 @@ class Server : public QObject
     {
         AUTHENTICATED,
         MODCHAT,
-        ADVERT
+        ADVERT,
+        MODERATORS, //!< Every authenticated client.
+        EVERYONE
     };
     Q_ENUM(TARGET_TYPE)
 
@@ -111,8 +163,10 @@ class Server : public QObject
      * @param ipid The IPID to look for.
      *
      * @return A list of clients whose IPID match. List may be empty.
+     *
+     * @see ClientIndex for how long the returned list stays valid.
      */
-    QList<AOClient *> getClientsByIpid(QString ipid);
+    const QList<AOClient *> &getClientsByIpid(const QString &ipid) const;
 
     /**
      * @brief Gets a list of pointers to all clients with the given HWID.
@@ -120,8 +174,24 @@ class Server : public QObject
      * @param HWID The HWID to look for.
      *
      * @return A list of clients whose HWID match. List may be empty.
+     *
+     * @see ClientIndex for how long the returned list stays valid.
+     */
+    const QList<AOClient *> &getClientsByHwid(const QString &f_hwid) const;
+
+    /**
+     * @brief Gets a list of pointers to all clients connected from the given address.
+     *
+     * @return A list of clients whose remote IP match. List may be empty.
+     *
+     * @see ClientIndex for how long the returned list stays valid.
+     */
+    const QList<AOClient *> &getClientsByIp(const QHostAddress &f_ip) const;
+
+    /**
+     * @brief Makes a client findable by its HWID. Called once the client sent it.
      */
-    QList<AOClient *> getClientsByHwid(QString f_hwid);
+    void indexHwid(AOClient *f_client);
 
     /**
      * @brief Gets a pointer to a client by user ID.
@@ -191,6 +261,8 @@ class Server : public QObject
     /**
      * @brief Sends a packet to a specific usergroup..
      *
+     * @details Usergroups span the cluster, so the packet is forwarded to the other nodes if there are any.
+     *
      * @param The packet to send to the clients.
      *
      * @param ENUM to determine the targets of the altered packet.
@@ -200,6 +272,8 @@ class Server : public QObject
     /**
      * @brief Sends a packet to clients, sends an altered packet to a specific usergroup.
      *
+     * @details Like the single packet version, this reaches the whole cluster.
+     *
      * @param The packet to send to the clients.
      *
      * @param The altered packet to send to the other clients.
@@ -208,6 +282,39 @@ class Server : public QObject
      */
     void broadcast(AOPacket *packet, AOPacket *other_packet, enum TARGET_TYPE target);
 
+    /**
+     * @brief Asks the other nodes of the cluster to disconnect their clients with the given IPID.
+     *
+     * @details Clients on this server are not affected. Does nothing outside of a cluster.
+     *
+     * @param f_ipid The IPID of the clients to kick.
+     * @param f_reason The reason shown to the clients.
+     */
+    void clusterKick(const QString &f_ipid, const QString &f_reason);
+
+    /**
+     * @brief Announces a ban to the other nodes of the cluster, so they disconnect matching clients.
+     *
+     * @details Clients on this server are not affected. Does nothing outside of a cluster.
+     *
+     * @param f_ban The ban as it was written to the database.
+     */
+    void clusterBan(const DBManager::BanInfo &f_ban);
+
+    /**
+     * @brief Announces a lifted ban to the other nodes of the cluster, so they stop rejecting its IPID.
+     *
+     * @details Does nothing outside of a cluster.
+     *
+     * @param f_ban The ban as it was stored before it was lifted.
+     */
+    void clusterUnban(const DBManager::BanInfo &f_ban);
+
+    /**
+     * @brief Returns true if this server is connected to a cluster.
+     */
+    bool isClustered() const;
+
     /**
      * @brief Sends a packet to a single client.
      *
@@ -217,6 +324,28 @@ class Server : public QObject
      */
     void unicast(AOPacket *f_packet, int f_client_id);
 
+    /**
+     * @brief Sends an FM packet to a single client, unless it already received this version of the musiclist.
+     *
+     * @param The FM packet.
+     *
+     * @param The version of the musiclist, see MusicManager::musiclistVersion().
+     *
+     * @param The temporary userID of the client.
+     */
+    void unicastMusiclist(AOPacket *f_packet, quint64 f_version, int f_client_id);
+
+    /**
+     * @brief Sends an FM packet to every client in an area that did not receive this version of the musiclist yet.
+     *
+     * @param The FM packet.
+     *
+     * @param The version of the musiclist, see MusicManager::musiclistVersion().
+     *
+     * @param The index of the area.
+     */
+    void broadcastMusiclist(AOPacket *f_packet, quint64 f_version, int f_area_index);
+
     /**
      * @brief Returns the character's character ID (= their index in the character list).
      *
@@ -258,6 +387,18 @@ class Server : public QObject
      */
     QQueue<QString> getAreaBuffer(const QString &f_areaName);
 
+    /**
+     * @brief Getter for the number of entries held in the log buffers of all areas.
+     */
+    int getLogBufferDepth();
+
+    /**
+     * @brief Getter for the approximate number of bytes held by all connected clients.
+     *
+     * @see AOClient::memoryFootprint
+     */
+    qint64 getClientMemoryFootprint() const;
+
     /**
      * @brief The names of the areas on the server.
      *
@@ -310,6 +451,18 @@ class Server : public QObject
      */
     CommandExtensionCollection *getCommandExtensionCollection();
 
+    /**
+     * @brief Returns the table every command name and alias is dispatched through.
+     *
+     * @see AOClient::buildCommandTable
+     */
+    const AOClient::CommandTable &getCommandTable() const;
+
+    /**
+     * @brief Returns the rate limiter every packet and command is charged to.
+     */
+    RateLimiter &getRateLimiter();
+
     /**
      * @brief The server-wide global timer.
      */
@@ -343,9 +496,16 @@ class Server : public QObject
 
   public slots:
     /**
-     * @brief Convenience class to call a reload of available configuraiton elements.
+     * @brief Reloads the available configuration elements in the background.
+     *
+     * @details The files are read and validated on a worker thread, then put in place all at once by
+     * applyConfigSnapshot(). If any of them fails validation, the running configuration is left untouched.
+     *
+     * @param f_requester_id The ID of the client to report the result to, or -1 if nobody asked for it.
+     *
+     * @return False if a reload is already in progress.
      */
-    void reloadSettings();
+    bool reloadSettings(int f_requester_id = -1);
 
     /**
      * @brief Handles a new connection.
@@ -355,6 +515,27 @@ class Server : public QObject
      */
     void clientConnected();
 
+    /**
+     * @brief Handles a connection that already completed its WebSocket handshake.
+     *
+     * @param f_socket The socket of the connection. It must live on the thread of the server.
+     * @param f_admitted See acceptSocket(). Ignored for loopback peers, which the acceptors do not check, so the
+     * address forwarded by a local proxy is admitted here instead.
+     */
+    void acceptWebSocket(QWebSocket *f_socket, bool f_admitted = false);
+
+    /**
+     * @brief Admits a connection into the server, creating its client if it is not rejected.
+     *
+     * @details Performs the playercount, ban and multiclient checks. Used for both network connections
+     * and detached sockets, like the ones of the replay tool.
+     *
+     * @param f_socket The socket of the new connection. Ownership passes to the server.
+     * @param f_admitted True if the connection already passed the admission control, like the ones from the acceptor
+     * threads. It is then neither checked nor released again.
+     */
+    void acceptSocket(NetworkSocket *f_socket, bool f_admitted = false);
+
     /**
      * @brief Method to construct and reconstruct Discord Webhook Integration.
      *
@@ -445,6 +626,110 @@ class Server : public QObject
      */
     MusicManager *music_manager;
 
+    /**
+     * @brief Serves runtime metrics. Null if the metrics endpoint is disabled.
+     */
+    MetricsServer *m_metrics_server = nullptr;
+
+    /**
+     * @brief Connects this server to the rest of the cluster. Null if clustering is disabled.
+     */
+    ClusterBus *m_cluster_bus = nullptr;
+
+    /**
+     * @brief Waits for a new server that wants to take over. Null unless reuse_port is enabled.
+     */
+    QLocalServer *m_handoff_server = nullptr;
+
+    /**
+     * @brief Accepts connections on several threads. Null unless acceptor_threads is set.
+     */
+    AcceptorPool *m_acceptor_pool = nullptr;
+
+    /**
+     * @brief Serves WebSocket connections instead of the QWebSocketServer. Null unless transport is set to epoll.
+     */
+    EpollTransport *m_epoll_transport = nullptr;
+
+    /**
+     * @brief True once another server took over. The server quits when its last client leaves.
+     */
+    bool m_draining = false;
+
+    /**
+     * @brief Identifies snapshot files, "AKSS".
+     */
+    static constexpr quint32 SNAPSHOT_MAGIC = 0x414B5353;
+
+    /**
+     * @brief The snapshot format version. Snapshots of any other version are ignored.
+     */
+    static constexpr quint32 SNAPSHOT_VERSION = 1;
+
+    /**
+     * @brief How long a takeover waits for the previous server to answer, in milliseconds.
+     */
+    static constexpr int HANDOFF_TIMEOUT = 10000;
+
+    /**
+     * @brief How long to wait for an answer when checking whether another server owns the handoff socket, in milliseconds.
+     */
+    static constexpr int HANDOFF_PROBE_TIMEOUT = 1000;
+
+    /**
+     * @brief Returns the name of the local socket used to hand over this server's port.
+     */
+    QString handoffSocketName() const;
+
+    /**
+     * @brief Returns whether another server answers on the handoff socket of this port.
+     */
+    bool isHandoffServerRunning() const;
+
+    /**
+     * @brief Starts waiting for a new server to take over.
+     *
+     * @details A stale socket left by a crashed server is removed, one another server still answers on is kept.
+     */
+    void listenForHandoff();
+
+    /**
+     * @brief Asks the server running on the same port to hand over, blocking until its snapshot is written.
+     *
+     * @return True if the other server handed over.
+     */
+    bool requestHandoff();
+
+    /**
+     * @brief Stops accepting connections, writes the snapshot and answers the new server.
+     *
+     * @details The server then keeps serving the clients that are still connected until they leave or the drain
+     * timeout expires.
+     */
+    void handOff(QLocalSocket *f_socket);
+
+    /**
+     * @brief Sends packets to a usergroup on this server only.
+     *
+     * @see broadcast(AOPacket *, AOPacket *, TARGET_TYPE)
+     */
+    void deliver(AOPacket *f_packet, AOPacket *f_other_packet, TARGET_TYPE f_target);
+
+    /**
+     * @brief Forwards a usergroup broadcast to the other nodes of the cluster.
+     */
+    void publishBroadcast(AOPacket *f_packet, AOPacket *f_other_packet, TARGET_TYPE f_target);
+
+    /**
+     * @brief Acts on a message published by another node of the cluster.
+     */
+    void handleClusterMessage(const QString &f_node, const QString &f_type, const QJsonObject &f_payload);
+
+    /**
+     * @brief Records inbound traffic for the replay tool. Null if capturing is disabled.
+     */
+    NetworkCapture *m_capture = nullptr;
+
     /**
      * @brief The port through which the server will accept WebSocket connections.
      */
@@ -455,6 +740,11 @@ class Server : public QObject
      */
     QVector<AOClient *> m_clients;
 
+    /**
+     * @brief Connected clients by IPID, HWID and remote IP.
+     */
+    ClientIndex m_client_index;
+
     /**
      * @brief Collection of all clients with their userID as key.
      */
@@ -477,6 +767,13 @@ class Server : public QObject
      */
     QStringList m_characters;
 
+    /**
+     * @brief The index of every character in m_characters, keyed by the interned ID of its name.
+     *
+     * @details When characters.txt lists a name twice, the first entry wins.
+     */
+    QHash<StringTable::Id, int> m_character_ids;
+
     /**
      * @brief The areas on the server.
      */
@@ -490,6 +787,11 @@ class Server : public QObject
      */
     QStringList m_area_names;
 
+    /**
+     * @brief The phases of the last start() call with their duration in milliseconds.
+     */
+    QList<QPair<QString, qint64>> m_startup_phases;
+
     /**
      * @brief The available songs on the server.
      *
@@ -504,9 +806,31 @@ class Server : public QObject
     QStringList m_backgrounds;
 
     /**
-     * @brief Collection of all IPs that are banned.
+     * @brief Collection of all IP ranges that are banned.
+     */
+    IPRangeSet m_ipban_ranges;
+
+    /**
+     * @brief Rejects connections before anything is allocated for them. Shared with the acceptor threads.
+     */
+    QSharedPointer<AdmissionControl> m_admission;
+
+    /**
+     * @brief The worker thread of a running reload, or nullptr.
+     */
+    QThread *m_reload_thread = nullptr;
+
+    /**
+     * @brief The snapshot the running reload is loading. Only touched by the main thread once the worker finished.
      */
-    QStringList m_ipban_list;
+    ConfigSnapshot *m_pending_snapshot = nullptr;
+
+    /**
+     * @brief Replaces the running configuration with a loaded one.
+     *
+     * @param f_snapshot A snapshot without errors. Objects taken over by the server are cleared from it.
+     */
+    void applyConfigSnapshot(ConfigSnapshot *f_snapshot);
 
     /**
      * @brief Timer until the next IC message can be sent.
@@ -526,7 +850,7 @@ class Server : public QObject
     /**
      * @brief Medieval mode text parser class
      */
-    MedievalParser *medieval_parser;
+    MedievalParser *medieval_parser = nullptr;
 
     /**
      * @see ACLRolesHandler
@@ -538,6 +862,16 @@ class Server : public QObject
      */
     CommandExtensionCollection *command_extension_collection;
 
+    /**
+     * @brief The command dispatch table, rebuilt whenever the command extensions are loaded.
+     */
+    AOClient::CommandTable m_command_table;
+
+    /**
+     * @see RateLimiter
+     */
+    RateLimiter m_rate_limiter;
+
     /**
      * @brief Connects new AOClient to logger and disconnect handling.
      **/
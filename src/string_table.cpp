@@ -0,0 +1,91 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#include "string_table.h"
+
+QHash<QString, StringTable::Id> StringTable::s_spellings{{QString(""), StringTable::EMPTY}};
+QHash<QString, StringTable::Id> StringTable::s_folded{{QString(""), StringTable::EMPTY}};
+QList<QString> StringTable::s_names{QString("")};
+
+StringTable::Id StringTable::intern(const QString &f_string)
+{
+    auto l_spelling = s_spellings.constFind(f_string);
+    if (l_spelling != s_spellings.cend()) {
+        return l_spelling.value();
+    }
+
+    const QString l_folded = f_string.toCaseFolded();
+    Id l_id = s_folded.value(l_folded, UNKNOWN);
+    if (s_spellings.size() >= MAX_SPELLINGS) {
+        return l_id;
+    }
+    if (l_id == UNKNOWN) {
+        l_id = Id(s_names.size());
+        s_names.append(f_string);
+        s_folded.insert(l_folded, l_id);
+    }
+    s_spellings.insert(f_string, l_id);
+    return l_id;
+}
+
+StringTable::Id StringTable::find(const QString &f_string)
+{
+    auto l_spelling = s_spellings.constFind(f_string);
+    if (l_spelling != s_spellings.cend()) {
+        return l_spelling.value();
+    }
+    return s_folded.value(f_string.toCaseFolded(), UNKNOWN);
+}
+
+QString StringTable::share(const QString &f_string)
+{
+    intern(f_string);
+    auto l_spelling = s_spellings.constFind(f_string);
+    if (l_spelling != s_spellings.cend()) {
+        return l_spelling.key();
+    }
+    return f_string;
+}
+
+const QString &StringTable::string(Id f_id)
+{
+    static const QString l_unknown;
+    if (f_id >= Id(s_names.size())) {
+        return l_unknown;
+    }
+    return s_names.at(f_id);
+}
+
+int StringTable::size()
+{
+    return s_names.size();
+}
+
+qint64 StringTable::memoryFootprint()
+{
+    // The first spelling of a name shares its storage with the spelling key, so only the keys are counted.
+    qint64 l_bytes = 0;
+    for (auto l_it = s_spellings.cbegin(); l_it != s_spellings.cend(); ++l_it) {
+        l_bytes += qint64(sizeof(QArrayData)) + (l_it.key().capacity() + 1) * qint64(sizeof(QChar));
+    }
+    for (auto l_it = s_folded.cbegin(); l_it != s_folded.cend(); ++l_it) {
+        l_bytes += qint64(sizeof(QArrayData)) + (l_it.key().capacity() + 1) * qint64(sizeof(QChar));
+    }
+    l_bytes += (s_spellings.capacity() + s_folded.capacity()) * qint64(sizeof(QString) + sizeof(Id));
+    l_bytes += s_names.capacity() * qint64(sizeof(QString));
+    return l_bytes;
+}
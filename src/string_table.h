@@ -0,0 +1,114 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#ifndef STRING_TABLE_H
+#define STRING_TABLE_H
+
+#include <QHash>
+#include <QList>
+#include <QString>
+
+#include <limits>
+
+/**
+ * @brief Interns the names that every client repeats, like character folders, emotes, positions and area names.
+ *
+ * @details Each distinct name, ignoring case, gets a small integer ID, so names can be compared without folding
+ * their case. Each distinct spelling is stored once, and share() hands out copies of it, so a name held by
+ * hundreds of clients and area logs takes up memory only once.
+ *
+ * Clients can send any name they like, so the table stops growing after MAX_SPELLINGS spellings. Names seen after
+ * that are not interned and behave like plain strings: they get UNKNOWN as their ID, which matches no other name.
+ *
+ * The table is only used from the main thread.
+ */
+class StringTable
+{
+  public:
+    using Id = quint32;
+
+    /**
+     * @brief The ID of the empty string.
+     */
+    static constexpr Id EMPTY = 0;
+
+    /**
+     * @brief The ID of a name that is not in the table.
+     */
+    static constexpr Id UNKNOWN = std::numeric_limits<Id>::max();
+
+    /**
+     * @brief The number of spellings after which the table stops growing.
+     */
+    static const int MAX_SPELLINGS = 16384;
+
+    /**
+     * @brief Returns the ID of a name, adding it to the table if there is room.
+     *
+     * @return The ID shared by every spelling of the name, or UNKNOWN if it is new and the table is full.
+     */
+    static Id intern(const QString &f_string);
+
+    /**
+     * @brief Returns the ID of a name without adding it to the table.
+     *
+     * @return The ID shared by every spelling of the name, or UNKNOWN if it was never interned.
+     */
+    static Id find(const QString &f_string);
+
+    /**
+     * @brief Returns a copy of a string that shares the storage of the same spelling in the table.
+     *
+     * @details The string is interned if there is room. The result always compares equal to f_string, case included.
+     */
+    static QString share(const QString &f_string);
+
+    /**
+     * @brief Returns the spelling the name with the given ID was first interned with.
+     */
+    static const QString &string(Id f_id);
+
+    /**
+     * @brief Returns the number of distinct names in the table.
+     */
+    static int size();
+
+    /**
+     * @brief Returns an estimate of the memory held by the table, in bytes.
+     */
+    static qint64 memoryFootprint();
+
+  private:
+    /**
+     * @brief Every spelling seen so far, mapped to the ID of its name.
+     *
+     * @details Looked up first, so names that are always spelled the same way are never case folded.
+     */
+    static QHash<QString, Id> s_spellings;
+
+    /**
+     * @brief The case folded form of every name, mapped to its ID.
+     */
+    static QHash<QString, Id> s_folded;
+
+    /**
+     * @brief The first spelling of every name, indexed by ID.
+     */
+    static QList<QString> s_names;
+};
+
+#endif // STRING_TABLE_H
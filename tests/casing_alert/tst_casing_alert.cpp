@@ -0,0 +1,97 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#include "server.h"
+#include "test_fixture.h"
+
+#include <QTest>
+
+/**
+ * @brief Checks which clients are sent a case announcement.
+ */
+class tst_CasingAlert : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+    void initTestCase();
+    void alert_data();
+    void alert();
+
+  private:
+    /**
+     * @brief Joins a client that records every CASEA packet it is sent.
+     */
+    NetworkSocket *joinRecording(const QString &f_hwid, int *f_alerts);
+
+    Server *m_server = nullptr;
+    NetworkSocket *m_announcer = nullptr;
+    int m_next_address = 1;
+};
+
+void tst_CasingAlert::initTestCase()
+{
+    m_server = new Server(0, qApp);
+    m_server->start();
+    m_announcer = AkashiTest::joinClient(m_server, QHostAddress("10.0.4.250"), "announcer");
+}
+
+NetworkSocket *tst_CasingAlert::joinRecording(const QString &f_hwid, int *f_alerts)
+{
+    NetworkSocket *l_socket = AkashiTest::joinClient(m_server, QHostAddress(QString("10.0.4.%1").arg(m_next_address++)), f_hwid);
+    connect(l_socket, &NetworkSocket::detachedWrite, this, [f_alerts](const QString &f_data) {
+        *f_alerts += f_data.count("CASEA#");
+    });
+    return l_socket;
+}
+
+void tst_CasingAlert::alert_data()
+{
+    // Roles in the order of the packets: defense, prosecution, judge, jurors, stenographer.
+    QTest::addColumn<QString>("preferences");
+    QTest::addColumn<QString>("needed");
+    QTest::addColumn<bool>("alerted");
+
+    QTest::newRow("wants the needed role") << "1#0#0#0#0" << "1#0#0#0#0" << true;
+    QTest::newRow("wants one of the needed roles") << "0#0#1#0#0" << "1#0#1#0#0" << true;
+    QTest::newRow("wants another role") << "0#0#1#0#0" << "1#0#0#0#0" << false;
+    QTest::newRow("wants no role") << "0#0#0#0#0" << "1#0#0#0#0" << false;
+    QTest::newRow("wants every role") << "1#1#1#1#1" << "0#0#0#0#1" << true;
+    QTest::newRow("every role is needed") << "0#1#0#0#0" << "1#1#1#1#1" << true;
+}
+
+void tst_CasingAlert::alert()
+{
+    QFETCH(QString, preferences);
+    QFETCH(QString, needed);
+    QFETCH(bool, alerted);
+
+    int l_alerts = 0;
+    NetworkSocket *l_socket = joinRecording(QString("casing%1").arg(m_next_address), &l_alerts);
+    l_socket->handleMessage("SETCASE#cases#0#" + preferences + "#%");
+
+    m_announcer->handleMessage("CASEA#test#" + needed + "#%");
+    // Packets to clients that merge frames are only sent once the event loop runs.
+    QCoreApplication::processEvents();
+    QCOMPARE(l_alerts, alerted ? 1 : 0);
+
+    l_socket->close();
+    QCoreApplication::processEvents();
+}
+
+AKASHI_TEST_MAIN(tst_CasingAlert)
+#include "tst_casing_alert.moc"
@@ -0,0 +1,207 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#include "aoclient.h"
+#include "server.h"
+#include "test_fixture.h"
+
+#include <QRandomGenerator>
+#include <QSet>
+#include <QTest>
+
+/**
+ * @brief Checks the client index against a scan over every client while clients come and go.
+ */
+class tst_ClientIndex : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+    void initTestCase();
+    void churn();
+
+  private:
+    /**
+     * @brief Connects a client from an address, which sends its HWID right away unless it is empty.
+     */
+    void connectClient(const QHostAddress &f_address, const QString &f_hwid);
+
+    /**
+     * @brief Disconnects a client and lets the server process it.
+     */
+    void disconnectClient(NetworkSocket *f_socket);
+
+    /**
+     * @brief Compares every index with a linear scan, for every key the test uses.
+     *
+     * @return An empty string if they all agree, otherwise a description of the first difference.
+     */
+    QString firstMismatch() const;
+
+    static constexpr int ADDRESSES = 6;
+    static constexpr int HWIDS = 5;
+    static constexpr int MAX_CLIENTS = 40;
+
+    Server *m_server = nullptr;
+    QList<QHostAddress> m_addresses;
+    QStringList m_hwids;
+
+    /**
+     * @brief The connected sockets, and the HWID each has sent so far.
+     */
+    QHash<NetworkSocket *, QString> m_sockets;
+};
+
+void tst_ClientIndex::initTestCase()
+{
+    m_server = new Server(0, qApp);
+    m_server->start();
+    for (int i = 0; i < ADDRESSES; ++i) {
+        m_addresses.append(QHostAddress(QString("10.0.2.%1").arg(i + 1)));
+    }
+    for (int i = 0; i < HWIDS; ++i) {
+        m_hwids.append(QString("hwid%1").arg(i));
+    }
+}
+
+void tst_ClientIndex::churn()
+{
+    QRandomGenerator l_random(46);
+    for (int l_step = 0; l_step < 2000; ++l_step) {
+        const QList<NetworkSocket *> l_sockets = m_sockets.keys();
+        NetworkSocket *l_socket = l_sockets.isEmpty() ? nullptr : l_sockets[l_random.bounded(l_sockets.size())];
+        const QHostAddress l_address = m_addresses[l_random.bounded(ADDRESSES)];
+        const QString l_hwid = m_hwids[l_random.bounded(HWIDS)];
+        QString l_action;
+
+        int l_choice = l_random.bounded(5);
+        if (l_socket == nullptr) {
+            l_choice = 0;
+        }
+        else if (m_sockets.size() >= MAX_CLIENTS) {
+            l_choice = 1;
+        }
+        switch (l_choice) {
+        case 0:
+            l_action = "connect from " + l_address.toString();
+            connectClient(l_address, l_random.bounded(2) ? l_hwid : QString());
+            break;
+        case 1:
+            l_action = "disconnect";
+            disconnectClient(l_socket);
+            break;
+        case 2:
+            // Clients that did not identify yet get their first HWID, the others are disconnected for sending another.
+            l_action = "send HWID " + l_hwid;
+            l_socket->handleMessage(QString("HI#%1#%").arg(l_hwid));
+            if (m_sockets.value(l_socket).isEmpty()) {
+                m_sockets[l_socket] = l_hwid;
+            }
+            else {
+                QCoreApplication::processEvents();
+                m_sockets.remove(l_socket);
+            }
+            break;
+        case 3:
+            // The IPID follows the address, so a user changes it by reconnecting from another one.
+            l_action = "reconnect from " + l_address.toString();
+            connectClient(l_address, m_sockets.value(l_socket));
+            disconnectClient(l_socket);
+            break;
+        case 4:
+            l_action = "connect a second client from " + l_address.toString();
+            connectClient(l_address, l_hwid);
+            connectClient(l_address, l_hwid);
+            break;
+        }
+
+        QCOMPARE(m_server->getClients().size(), m_sockets.size());
+        const QString l_mismatch = firstMismatch();
+        if (!l_mismatch.isEmpty()) {
+            QFAIL(qPrintable(QString("After step %1 (%2): %3").arg(l_step).arg(l_action, l_mismatch)));
+        }
+    }
+}
+
+void tst_ClientIndex::connectClient(const QHostAddress &f_address, const QString &f_hwid)
+{
+    NetworkSocket *l_socket = new NetworkSocket(f_address);
+    m_server->acceptSocket(l_socket);
+    if (!f_hwid.isEmpty()) {
+        l_socket->handleMessage(QString("HI#%1#%").arg(f_hwid));
+    }
+    m_sockets.insert(l_socket, f_hwid);
+}
+
+void tst_ClientIndex::disconnectClient(NetworkSocket *f_socket)
+{
+    f_socket->close();
+    // Detached sockets report the disconnect asynchronously, like real ones.
+    QCoreApplication::processEvents();
+    m_sockets.remove(f_socket);
+}
+
+QString tst_ClientIndex::firstMismatch() const
+{
+    const QVector<AOClient *> l_clients = m_server->getClients();
+    const auto l_compare = [](const QString &f_index, const QString &f_key, const QList<AOClient *> &f_indexed,
+                              const QList<AOClient *> &f_scanned) -> QString {
+        if (f_indexed.size() != f_scanned.size() ||
+            QSet<AOClient *>(f_indexed.cbegin(), f_indexed.cend()) != QSet<AOClient *>(f_scanned.cbegin(), f_scanned.cend())) {
+            return QString("%1 %2 holds %3 clients, the scan found %4").arg(f_index, f_key).arg(f_indexed.size()).arg(f_scanned.size());
+        }
+        return QString();
+    };
+
+    for (const QHostAddress &l_address : m_addresses) {
+        const QString l_ipid = AOClient::ipidForAddress(l_address);
+        QList<AOClient *> l_by_ip;
+        QList<AOClient *> l_by_ipid;
+        for (AOClient *l_client : l_clients) {
+            if (l_client->m_remote_ip == l_address) {
+                l_by_ip.append(l_client);
+            }
+            if (l_client->getIpid() == l_ipid) {
+                l_by_ipid.append(l_client);
+            }
+        }
+        QString l_mismatch = l_compare("IP", l_address.toString(), m_server->getClientsByIp(l_address), l_by_ip);
+        if (l_mismatch.isEmpty()) {
+            l_mismatch = l_compare("IPID", l_ipid, m_server->getClientsByIpid(l_ipid), l_by_ipid);
+        }
+        if (!l_mismatch.isEmpty()) {
+            return l_mismatch;
+        }
+    }
+
+    for (const QString &l_hwid : m_hwids) {
+        QList<AOClient *> l_by_hwid;
+        for (AOClient *l_client : l_clients) {
+            if (l_client->getHwid() == l_hwid) {
+                l_by_hwid.append(l_client);
+            }
+        }
+        const QString l_mismatch = l_compare("HWID", l_hwid, m_server->getClientsByHwid(l_hwid), l_by_hwid);
+        if (!l_mismatch.isEmpty()) {
+            return l_mismatch;
+        }
+    }
+    return QString();
+}
+
+AKASHI_TEST_MAIN(tst_ClientIndex)
+#include "tst_client_index.moc"
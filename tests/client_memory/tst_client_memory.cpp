@@ -0,0 +1,155 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#include "aoclient.h"
+#include "server.h"
+#include "test_fixture.h"
+
+#include <QTest>
+
+/**
+ * @brief Checks the size of a client and that the reported client memory follows what a client actually holds.
+ */
+class tst_ClientMemory : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+    void initTestCase();
+    void clientSize();
+    void baseline();
+    void ownedString();
+    void sharedString();
+    void coldState();
+    void emptyPassword();
+
+  private:
+    /**
+     * @brief Upper bound of sizeof(AOClient) on 64-bit platforms, a little above its size after the hot/cold split.
+     *
+     * @details Every connected client pays for it. Raising it should be a deliberate decision.
+     */
+    static constexpr qsizetype MAX_CLIENT_SIZE = 544;
+
+    /**
+     * @brief Upper bound of sizeof(AOClient::ColdState) on 64-bit platforms.
+     */
+    static constexpr qsizetype MAX_COLD_STATE_SIZE = 96;
+
+    /**
+     * @brief Slack allowed on top of the contents of a string or list: its allocation header and rounding.
+     */
+    static constexpr qint64 STRING_OVERHEAD = 64;
+
+    Server *m_server = nullptr;
+    NetworkSocket *m_socket = nullptr;
+    AOClient *m_client = nullptr;
+};
+
+void tst_ClientMemory::initTestCase()
+{
+    m_server = new Server(0, qApp);
+    m_server->start();
+    m_socket = AkashiTest::joinClient(m_server, QHostAddress("10.0.3.1"), "memory");
+    m_socket->handleMessage("CC#0#0#memory#%");
+    QCOMPARE(m_server->getClients().size(), 1);
+    m_client = m_server->getClients().first();
+}
+
+void tst_ClientMemory::clientSize()
+{
+    if (sizeof(void *) != 8) {
+        QSKIP("The bounds are set for 64-bit platforms.");
+    }
+    QVERIFY2(qsizetype(sizeof(AOClient)) <= MAX_CLIENT_SIZE, qPrintable(QString("sizeof(AOClient) is %1").arg(sizeof(AOClient))));
+    QVERIFY2(qsizetype(sizeof(AOClient::ColdState)) <= MAX_COLD_STATE_SIZE,
+             qPrintable(QString("sizeof(AOClient::ColdState) is %1").arg(sizeof(AOClient::ColdState))));
+}
+
+void tst_ClientMemory::baseline()
+{
+    QVERIFY(m_client->memoryFootprint() >= qint64(sizeof(AOClient) + sizeof(NetworkSocket)));
+
+    NetworkSocket *l_other = AkashiTest::joinClient(m_server, QHostAddress("10.0.3.2"), "memory2");
+    qint64 l_sum = 0;
+    for (const AOClient *l_client : m_server->getClients()) {
+        l_sum += l_client->memoryFootprint();
+    }
+    QCOMPARE(m_server->getClientMemoryFootprint(), l_sum);
+    l_other->close();
+    QCoreApplication::processEvents();
+}
+
+void tst_ClientMemory::ownedString()
+{
+    m_client->m_ooc_name = QString();
+    const qint64 l_before = m_client->memoryFootprint();
+    m_client->m_ooc_name = QString(100, 'a');
+    const qint64 l_growth = m_client->memoryFootprint() - l_before;
+    QVERIFY(l_growth >= 100 * qint64(sizeof(QChar)));
+    QVERIFY(l_growth <= 100 * qint64(sizeof(QChar)) + STRING_OVERHEAD);
+}
+
+void tst_ClientMemory::sharedString()
+{
+    // Strings held by something else as well are not counted against the client.
+    const QString l_shared(64, 'x');
+    m_client->m_showname = QString();
+    const qint64 l_before = m_client->memoryFootprint();
+    m_client->m_showname = l_shared;
+    QCOMPARE(m_client->memoryFootprint(), l_before);
+}
+
+void tst_ClientMemory::coldState()
+{
+    // Allocating the cold state costs exactly its size, everything in it is empty at first.
+    const qint64 l_before = m_client->memoryFootprint();
+    m_client->editCold();
+    QCOMPARE(m_client->memoryFootprint() - l_before, qint64(sizeof(AOClient::ColdState)));
+
+    const qint64 l_before_name = m_client->memoryFootprint();
+    m_client->editCold().moderator_name = QString(40, 'm');
+    const qint64 l_name_growth = m_client->memoryFootprint() - l_before_name;
+    QVERIFY(l_name_growth >= 40 * qint64(sizeof(QChar)));
+    QVERIFY(l_name_growth <= 40 * qint64(sizeof(QChar)) + STRING_OVERHEAD);
+
+    const qint64 l_before_list = m_client->memoryFootprint();
+    m_client->editCold().charcurse_list = {0, 1, 2};
+    const qint64 l_list_growth = m_client->memoryFootprint() - l_before_list;
+    QVERIFY(l_list_growth >= 3 * qint64(sizeof(int)));
+    QVERIFY(l_list_growth <= 3 * qint64(sizeof(int)) + STRING_OVERHEAD);
+}
+
+void tst_ClientMemory::emptyPassword()
+{
+    // Clients send an empty password with every character selection, which must not allocate the cold state.
+    NetworkSocket *l_socket = AkashiTest::joinClient(m_server, QHostAddress("10.0.3.3"), "memory3");
+    AOClient *l_client = m_server->getClientsByHwid("memory3").first();
+    const qint64 l_before = l_client->memoryFootprint();
+    l_socket->handleMessage("PW##%");
+    QCOMPARE(l_client->memoryFootprint(), l_before);
+
+    l_socket->handleMessage("PW#secret#%");
+    const qint64 l_growth = l_client->memoryFootprint() - l_before;
+    QVERIFY(l_growth >= qint64(sizeof(AOClient::ColdState)) + 6 * qint64(sizeof(QChar)));
+    QVERIFY(l_growth <= qint64(sizeof(AOClient::ColdState)) + 6 * qint64(sizeof(QChar)) + STRING_OVERHEAD);
+    l_socket->close();
+    QCoreApplication::processEvents();
+}
+
+AKASHI_TEST_MAIN(tst_ClientMemory)
+#include "tst_client_memory.moc"
@@ -0,0 +1,134 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#ifndef TEST_FIXTURE_H
+#define TEST_FIXTURE_H
+
+#include "network/network_socket.h"
+#include "server.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QDirIterator>
+#include <QHostAddress>
+#include <QProcess>
+#include <QSettings>
+#include <QTemporaryDir>
+#include <QTest>
+
+namespace AkashiTest {
+
+/**
+ * @brief Environment variable marking the process that runs inside the generated fixture.
+ */
+inline const char *FIXTURE_ENV = "AKASHI_TEST_FIXTURE";
+
+/**
+ * @brief Copies the sample configuration into a directory and turns off everything that reaches outside the process.
+ */
+inline bool createFixture(const QString &f_path)
+{
+    QDir l_sample(AKASHI_CONFIG_SAMPLE);
+    QDir l_target(f_path + "/config");
+    QDirIterator l_files(l_sample.path(), QDir::Files, QDirIterator::Subdirectories);
+    while (l_files.hasNext()) {
+        QString l_source = l_files.next();
+        QString l_destination = l_target.filePath(l_sample.relativeFilePath(l_source));
+        if (!QDir().mkpath(QFileInfo(l_destination).path()) || !QFile::copy(l_source, l_destination)) {
+            qCritical() << "Unable to copy" << l_source;
+            return false;
+        }
+    }
+
+    QSettings l_config(l_target.filePath("config.ini"), QSettings::IniFormat);
+    l_config.setValue("Options/multiclient_limit", 100);
+    l_config.setValue("Options/connection_rate_limit", 0);
+    l_config.setValue("Options/packet_rate_limit_soft", 0);
+    l_config.setValue("Options/packet_rate_limit_hard", 0);
+    l_config.setValue("Options/message_floodguard", 0);
+    l_config.setValue("Options/log_archive", false);
+    l_config.setValue("Options/capture_traffic", false);
+    l_config.setValue("Advertiser/advertise", false);
+    l_config.sync();
+    return l_config.status() == QSettings::NoError;
+}
+
+/**
+ * @brief Connects a detached client and walks it through the handshake until it has joined.
+ *
+ * @param f_version The client version sent in the ID packet.
+ */
+inline NetworkSocket *joinClient(Server *f_server, const QHostAddress &f_address, const QString &f_hwid,
+                                 const QString &f_version = "2.10.1")
+{
+    NetworkSocket *l_socket = new NetworkSocket(f_address);
+    f_server->acceptSocket(l_socket);
+    l_socket->handleMessage(QString("HI#%1#%").arg(f_hwid));
+    l_socket->handleMessage(QString("ID#AO2#%1#%").arg(f_version));
+    l_socket->handleMessage("askchaa#%");
+    l_socket->handleMessage("RD#%");
+    return l_socket;
+}
+
+/**
+ * @brief Runs a test object inside a fresh copy of the sample configuration.
+ *
+ * @details The configuration is read from the working directory when the process starts,
+ * so the test runs in a child process started inside the generated fixture.
+ */
+template <class T>
+int run(int argc, char *argv[])
+{
+    QCoreApplication l_app(argc, argv);
+
+    if (qEnvironmentVariableIsSet(FIXTURE_ENV)) {
+        T l_test;
+        return QTest::qExec(&l_test, argc, argv);
+    }
+
+    QTemporaryDir l_fixture;
+    if (!l_fixture.isValid() || !createFixture(l_fixture.path())) {
+        qCritical() << "Unable to create the test fixture.";
+        return EXIT_FAILURE;
+    }
+
+    QProcess l_child;
+    QProcessEnvironment l_environment = QProcessEnvironment::systemEnvironment();
+    l_environment.insert(FIXTURE_ENV, "1");
+    l_child.setProcessEnvironment(l_environment);
+    l_child.setWorkingDirectory(l_fixture.path());
+    l_child.setProcessChannelMode(QProcess::ForwardedChannels);
+    l_child.start(QCoreApplication::applicationFilePath(), l_app.arguments().mid(1));
+    if (!l_child.waitForFinished(-1) || l_child.exitStatus() != QProcess::NormalExit) {
+        qCritical() << "Test process failed:" << l_child.errorString();
+        return EXIT_FAILURE;
+    }
+    return l_child.exitCode();
+}
+
+} // namespace AkashiTest
+
+/**
+ * @brief Implements main() for a test object that needs a server, see AkashiTest::run.
+ */
+#define AKASHI_TEST_MAIN(TestObject)                    \
+    int main(int argc, char *argv[])                    \
+    {                                                   \
+        return AkashiTest::run<TestObject>(argc, argv); \
+    }
+
+#endif // TEST_FIXTURE_H
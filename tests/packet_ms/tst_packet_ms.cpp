@@ -0,0 +1,145 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#include "aoclient.h"
+#include "packet/packet_factory.h"
+#include "packet/packet_ms.h"
+#include "server.h"
+#include "string_table.h"
+#include "test_fixture.h"
+
+#include <QTest>
+
+class tst_PacketMS : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+    void initTestCase();
+    void encode_data();
+    void encode();
+    void layoutFor_data();
+    void layoutFor();
+    void rejectedIniswap();
+
+  private:
+    Server *m_server = nullptr;
+    AOClient *m_speaker = nullptr;
+};
+
+void tst_PacketMS::initTestCase()
+{
+    m_server = new Server(0, qApp);
+    m_server->start();
+
+    // Character 0 is Adrian in the sample configuration.
+    NetworkSocket *l_socket = AkashiTest::joinClient(m_server, QHostAddress("10.0.0.1"), "speaker");
+    l_socket->handleMessage("CC#0#0#speaker#%");
+    m_speaker = m_server->getClientByID(0);
+    QVERIFY(m_speaker != nullptr);
+    QCOMPARE(m_speaker->character(), QString("Adrian"));
+}
+
+void tst_PacketMS::encode_data()
+{
+    QTest::addColumn<QString>("incoming");
+    QTest::addColumn<QByteArray>("full");
+    QTest::addColumn<QByteArray>("x_offset");
+
+    // The expected packets are the ones the server sent before MS packets were parsed into typed fields.
+    // Every row uses another message, as repeating one would be rejected as a double post.
+    QTest::newRow("2.5")
+        << "MS#chat#-#Adrian#normal#Hello 1#wit#0#0#0#0#0#0#0#0#0#"
+        << QByteArray("MS#1#-#Adrian#normal#Hello 1#wit#0#0#0#0#0#0#0#0#0#%")
+        << QByteArray("MS#1#-#Adrian#normal#Hello 1#wit#0#0#0#0#0#0#0#0#0#%");
+    QTest::newRow("2.6")
+        << "MS#chat#-#Adrian#normal#Hello 2#wit#0#0#0#0#0#0#0#0#0#Adrian#-1#0#0#"
+        << QByteArray("MS#1#-#Adrian#normal#Hello 2#wit#0#0#0#0#0#0#0#0#0#Adrian#-1#0#0#0#0#0#0#%")
+        << QByteArray("MS#1#-#Adrian#normal#Hello 2#wit#0#0#0#0#0#0#0#0#0#Adrian#-1#0#0#0#0#0#0#%");
+    QTest::newRow("2.8")
+        << "MS#chat#-#Adrian#normal#Hello 3#wit#0#0#0#0#0#0#0#0#0#Adrian#-1#0#0#0#0#-#-#-#0#-||#"
+        << QByteArray("MS#1#-#Adrian#normal#Hello 3#wit#0#0#0#0#0#0#0#0#0#Adrian#-1#0#0#0#0#0#0#0#0#-#-#-#0#-||#%")
+        << QByteArray("MS#1#-#Adrian#normal#Hello 3#wit#0#0#0#0#0#0#0#0#0#Adrian#-1#0#0#0#0#0#0#0#0#-#-#-#0#-||#%");
+    // Only 2.9+ clients can parse a y-offset, older ones get the x part of it.
+    QTest::newRow("2.10 y-offset")
+        << "MS#chat#-#Adrian#normal#Hello 4#wit#0#0#0#0#0#0#0#0#0#Adrian#-1#10<and>5#0#0#0#-#-#-#0#-||#male#1#"
+        << QByteArray("MS#1#-#Adrian#normal#Hello 4#wit#0#0#0#0#0#0#0#0#0#Adrian#-1#0#0#10<and>5#0#0#0#0#0#-#-#-#0#-||#male#1#%")
+        << QByteArray("MS#1#-#Adrian#normal#Hello 4#wit#0#0#0#0#0#0#0#0#0#Adrian#-1#0#0#10#0#0#0#0#0#-#-#-#0#-||#male#1#%");
+}
+
+void tst_PacketMS::encode()
+{
+    QFETCH(QString, incoming);
+    QFETCH(QByteArray, full);
+    QFETCH(QByteArray, x_offset);
+
+    PacketMS *l_packet = static_cast<PacketMS *>(PacketFactory::createPacket(incoming));
+    AOPacket *l_validated = l_packet->validateIcPacket(*m_speaker);
+    QVERIFY(l_validated != nullptr);
+
+    const PacketMS::Layouts l_layouts = PacketMS::buildLayouts(l_validated);
+    QCOMPARE(l_layouts[int(PacketMS::Layout::FULL)]->toUtf8(), full);
+    QCOMPARE(l_layouts[int(PacketMS::Layout::X_OFFSET)]->toUtf8(), x_offset);
+    if (full == x_offset) {
+        // Layouts without differences share the packet, so it is only encoded once.
+        QCOMPARE(l_layouts[int(PacketMS::Layout::X_OFFSET)], l_layouts[int(PacketMS::Layout::FULL)]);
+    }
+}
+
+void tst_PacketMS::layoutFor_data()
+{
+    QTest::addColumn<int>("release");
+    QTest::addColumn<int>("major");
+    QTest::addColumn<int>("layout");
+
+    QTest::newRow("2.5") << 2 << 5 << int(PacketMS::Layout::FULL);
+    QTest::newRow("2.6") << 2 << 6 << int(PacketMS::Layout::X_OFFSET);
+    QTest::newRow("2.8") << 2 << 8 << int(PacketMS::Layout::X_OFFSET);
+    QTest::newRow("2.9") << 2 << 9 << int(PacketMS::Layout::FULL);
+    QTest::newRow("2.10") << 2 << 10 << int(PacketMS::Layout::FULL);
+    QTest::newRow("unknown") << -1 << -1 << int(PacketMS::Layout::FULL);
+}
+
+void tst_PacketMS::layoutFor()
+{
+    QFETCH(int, release);
+    QFETCH(int, major);
+    QFETCH(int, layout);
+
+    const AOClient::ClientVersion l_version = m_speaker->m_version;
+    m_speaker->m_version = {release, major, 0};
+    QCOMPARE(int(PacketMS::layoutFor(*m_speaker)), layout);
+    m_speaker->m_version = l_version;
+}
+
+void tst_PacketMS::rejectedIniswap()
+{
+    // The speaker is in the Basement, which does not allow iniswaps.
+    const int l_size = StringTable::size();
+    for (int i = 0; i < 100; ++i) {
+        const QString l_folder = QString("Junk%1").arg(i);
+        PacketMS *l_packet = static_cast<PacketMS *>(PacketFactory::createPacket(
+            QString("MS#chat#-#%1#normal#Rejected %2#wit#0#0#0#0#0#0#0#0#0#").arg(l_folder).arg(i)));
+        QVERIFY(l_packet->validateIcPacket(*m_speaker) == nullptr);
+        QCOMPARE(StringTable::find(l_folder), StringTable::UNKNOWN);
+        delete l_packet;
+    }
+    QCOMPARE(StringTable::size(), l_size);
+}
+
+AKASHI_TEST_MAIN(tst_PacketMS)
+#include "tst_packet_ms.moc"
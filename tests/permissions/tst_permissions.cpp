@@ -0,0 +1,250 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#include "acl_roles_handler.h"
+#include "aoclient.h"
+#include "area_data.h"
+#include "config_manager.h"
+#include "crypto_helper.h"
+#include "db_manager.h"
+#include "server.h"
+#include "test_fixture.h"
+
+#include <QMetaEnum>
+#include <QTest>
+
+/**
+ * @brief Checks that the permissions cached on AOClient agree with resolving them on every check.
+ */
+class tst_Permissions : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+    void initTestCase();
+    void unauthenticated();
+    void simpleLogin();
+    void caseManager();
+    void logout();
+    void advancedLogin();
+    void roleChanges();
+
+  private:
+    /**
+     * @brief Resolves a permission the way checkPermission did before permissions were cached.
+     */
+    bool uncachedPermission(AOClient *f_client, ACLRole::Permission f_permission) const;
+
+    /**
+     * @brief Compares the cached and uncached result of every permission for every test client.
+     *
+     * @return An empty string if they all agree, otherwise a description of the first difference.
+     */
+    QString firstDifference() const;
+
+    /**
+     * @brief Sends an OOC message, which may be a command, as the given client.
+     */
+    void ooc(NetworkSocket *f_socket, const QString &f_message);
+
+    Server *m_server = nullptr;
+    QList<NetworkSocket *> m_sockets;
+    QList<AOClient *> m_clients;
+};
+
+void tst_Permissions::initTestCase()
+{
+    m_server = new Server(0, qApp);
+    m_server->start();
+    QCOMPARE(ConfigManager::authType(), DataTypes::AuthType::SIMPLE);
+
+    for (int i = 0; i < 2; ++i) {
+        NetworkSocket *l_socket = AkashiTest::joinClient(m_server, QHostAddress(QString("10.0.1.%1").arg(i + 1)), QString("client%1").arg(i));
+        l_socket->handleMessage(QString("CC#0#%1#client%1#%").arg(i));
+        // The first area of the sample configuration is protected, nobody can become CM there.
+        l_socket->handleMessage(QString("MC#%1#%2#%").arg(m_server->getAreaName(1)).arg(i));
+        m_sockets.append(l_socket);
+        m_clients.append(m_server->getClientByID(i));
+        QVERIFY(m_clients.last() != nullptr);
+        QCOMPARE(m_clients.last()->areaId(), 1);
+    }
+}
+
+void tst_Permissions::unauthenticated()
+{
+    const QString l_difference = firstDifference();
+    QVERIFY2(l_difference.isEmpty(), qPrintable(l_difference));
+    QVERIFY(!m_clients[0]->checkPermission(ACLRole::KICK));
+    QVERIFY(m_clients[0]->checkPermission(ACLRole::NONE));
+}
+
+void tst_Permissions::simpleLogin()
+{
+    ooc(m_sockets[0], "/login");
+    ooc(m_sockets[0], ConfigManager::modpass());
+    QVERIFY(m_clients[0]->isAuthenticated());
+
+    const QString l_difference = firstDifference();
+    QVERIFY2(l_difference.isEmpty(), qPrintable(l_difference));
+    QVERIFY(m_clients[0]->checkPermission(ACLRole::KICK));
+}
+
+void tst_Permissions::caseManager()
+{
+    AreaData *l_courtroom = m_server->getAreaById(1);
+    ooc(m_sockets[1], "/cm");
+    QVERIFY(l_courtroom->owners().contains(m_clients[1]->clientId()));
+    QString l_difference = firstDifference();
+    QVERIFY2(l_difference.isEmpty(), qPrintable(l_difference));
+    QVERIFY(m_clients[1]->checkPermission(ACLRole::CM));
+
+    // Ownership only counts in the area the client is in.
+    m_sockets[1]->handleMessage(QString("MC#%1#1#%").arg(m_server->getAreaName(0)));
+    QCOMPARE(m_clients[1]->areaId(), 0);
+    l_difference = firstDifference();
+    QVERIFY2(l_difference.isEmpty(), qPrintable(l_difference));
+
+    m_sockets[1]->handleMessage(QString("MC#%1#1#%").arg(m_server->getAreaName(1)));
+    l_difference = firstDifference();
+    QVERIFY2(l_difference.isEmpty(), qPrintable(l_difference));
+
+    // Leaving an area may have given up the ownership.
+    if (!l_courtroom->owners().contains(m_clients[1]->clientId())) {
+        ooc(m_sockets[1], "/cm");
+    }
+    ooc(m_sockets[1], "/uncm");
+    QVERIFY(!l_courtroom->owners().contains(m_clients[1]->clientId()));
+    l_difference = firstDifference();
+    QVERIFY2(l_difference.isEmpty(), qPrintable(l_difference));
+    QVERIFY(!m_clients[1]->checkPermission(ACLRole::CM));
+
+    // Owners can also change without the client doing anything, for example through /cm <id> of another CM.
+    l_courtroom->addOwner(m_clients[1]->clientId());
+    l_difference = firstDifference();
+    QVERIFY2(l_difference.isEmpty(), qPrintable(l_difference));
+    l_courtroom->removeOwner(m_clients[1]->clientId());
+    l_difference = firstDifference();
+    QVERIFY2(l_difference.isEmpty(), qPrintable(l_difference));
+}
+
+void tst_Permissions::logout()
+{
+    ooc(m_sockets[0], "/logout");
+    QVERIFY(!m_clients[0]->isAuthenticated());
+
+    const QString l_difference = firstDifference();
+    QVERIFY2(l_difference.isEmpty(), qPrintable(l_difference));
+    QVERIFY(!m_clients[0]->checkPermission(ACLRole::KICK));
+}
+
+void tst_Permissions::advancedLogin()
+{
+    // Switching to advanced authentication logs the root user out.
+    ooc(m_sockets[0], "/login");
+    ooc(m_sockets[0], ConfigManager::modpass());
+    ooc(m_sockets[0], "/changeauth");
+    ooc(m_sockets[0], "/rootpass Akashi!2024");
+    QCOMPARE(ConfigManager::authType(), DataTypes::AuthType::ADVANCED);
+    QString l_difference = firstDifference();
+    QVERIFY2(l_difference.isEmpty(), qPrintable(l_difference));
+
+    QVERIFY(m_server->getDatabaseManager()->createUser("judge", CryptoHelper::randbytes(16), "password", "moderator"));
+    ooc(m_sockets[0], "/login");
+    ooc(m_sockets[0], "judge password");
+    QVERIFY(m_clients[0]->isAuthenticated());
+    l_difference = firstDifference();
+    QVERIFY2(l_difference.isEmpty(), qPrintable(l_difference));
+    QVERIFY(m_clients[0]->checkPermission(ACLRole::KICK));
+    QVERIFY(!m_clients[0]->checkPermission(ACLRole::MODIFY_USERS));
+}
+
+void tst_Permissions::roleChanges()
+{
+    ACLRolesHandler *l_roles = m_server->getACLRolesHandler();
+    QVERIFY(m_clients[0]->isAuthenticated());
+
+    ACLRole l_role;
+    l_role.setPermissions(ACLRole::KICK | ACLRole::MODIFY_USERS);
+    QVERIFY(l_roles->insertRole("moderator", l_role));
+    QString l_difference = firstDifference();
+    QVERIFY2(l_difference.isEmpty(), qPrintable(l_difference));
+    QVERIFY(m_clients[0]->checkPermission(ACLRole::MODIFY_USERS));
+
+    QVERIFY(l_roles->removeRole("moderator"));
+    l_difference = firstDifference();
+    QVERIFY2(l_difference.isEmpty(), qPrintable(l_difference));
+    QVERIFY(!m_clients[0]->checkPermission(ACLRole::KICK));
+
+    QHash<QString, ACLRole> l_reloaded;
+    QVERIFY(ACLRolesHandler::parseFile("config/acl_roles.ini", l_reloaded));
+    l_roles->setRoles(l_reloaded);
+    l_difference = firstDifference();
+    QVERIFY2(l_difference.isEmpty(), qPrintable(l_difference));
+    QVERIFY(m_clients[0]->checkPermission(ACLRole::KICK));
+
+    l_roles->clearRoles();
+    l_difference = firstDifference();
+    QVERIFY2(l_difference.isEmpty(), qPrintable(l_difference));
+    QVERIFY(!m_clients[0]->checkPermission(ACLRole::KICK));
+}
+
+bool tst_Permissions::uncachedPermission(AOClient *f_client, ACLRole::Permission f_permission) const
+{
+    if (f_permission == ACLRole::NONE) {
+        return true;
+    }
+
+    if ((f_permission == ACLRole::CM) && m_server->getAreaById(f_client->areaId())->owners().contains(f_client->clientId())) {
+        return true;
+    }
+
+    if (!f_client->isAuthenticated()) {
+        return false;
+    }
+
+    if (ConfigManager::authType() == DataTypes::AuthType::SIMPLE) {
+        return true;
+    }
+
+    const ACLRole l_role = m_server->getACLRolesHandler()->getRoleById(f_client->m_acl_role_id);
+    return l_role.checkPermission(f_permission);
+}
+
+QString tst_Permissions::firstDifference() const
+{
+    const QMetaEnum l_permissions = QMetaEnum::fromType<ACLRole::Permission>();
+    for (AOClient *l_client : m_clients) {
+        for (int i = 0; i < l_permissions.keyCount(); ++i) {
+            const auto l_permission = ACLRole::Permission(l_permissions.value(i));
+            const bool l_cached = l_client->checkPermission(l_permission);
+            if (l_cached != uncachedPermission(l_client, l_permission)) {
+                return QString("Client %1 has %2 %3 cached")
+                    .arg(l_client->clientId())
+                    .arg(l_permissions.key(i), l_cached ? "granted" : "denied");
+            }
+        }
+    }
+    return QString();
+}
+
+void tst_Permissions::ooc(NetworkSocket *f_socket, const QString &f_message)
+{
+    f_socket->handleMessage(QString("CT#tester#%1#%").arg(f_message));
+}
+
+AKASHI_TEST_MAIN(tst_Permissions)
+#include "tst_permissions.moc"
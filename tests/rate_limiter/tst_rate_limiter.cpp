@@ -0,0 +1,77 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#include "rate_limiter.h"
+#include "test_fixture.h"
+
+#include <QSettings>
+#include <QTest>
+
+/**
+ * @brief Checks that the rate limits trigger at the same packet as the per-second counters they replaced.
+ */
+class tst_RateLimiter : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+    void thresholds_data();
+    void thresholds();
+};
+
+void tst_RateLimiter::thresholds_data()
+{
+    QTest::addColumn<int>("soft");
+    QTest::addColumn<int>("hard");
+
+    QTest::newRow("sample limits") << 10 << 20;
+    QTest::newRow("close limits") << 3 << 5;
+    QTest::newRow("warn on every packet") << 1 << 2;
+    QTest::newRow("no warning") << 0 << 5;
+    QTest::newRow("disconnect on the first packet") << 0 << 1;
+}
+
+void tst_RateLimiter::thresholds()
+{
+    QFETCH(int, soft);
+    QFETCH(int, hard);
+
+    QSettings l_config("config/config.ini", QSettings::IniFormat);
+    l_config.setValue("Options/packet_rate_limit_soft", soft);
+    l_config.setValue("Options/packet_rate_limit_hard", hard);
+    l_config.sync();
+
+    RateLimiter l_limiter;
+    l_limiter.reload();
+    RateLimiter::Bucket l_bucket;
+
+    // Unlisted packets weigh 1, so the n-th packet is the n-th token. The old counter warned from packet number
+    // packet_rate_limit_soft on and disconnected at packet number packet_rate_limit_hard.
+    for (int l_packet = 1; l_packet <= hard; ++l_packet) {
+        RateLimiter::Result l_expected = RateLimiter::Result::ALLOWED;
+        if (l_packet == hard) {
+            l_expected = RateLimiter::Result::EXCEEDED;
+        }
+        else if (soft > 0 && l_packet >= soft) {
+            l_expected = RateLimiter::Result::WARNED;
+        }
+        QCOMPARE(l_limiter.chargePacket(l_bucket, "ZZ"), l_expected);
+    }
+}
+
+AKASHI_TEST_MAIN(tst_RateLimiter)
+#include "tst_rate_limiter.moc"
@@ -0,0 +1,450 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#include "network/aopacket.h"
+#include "network/epoll_transport.h"
+#include "network/listen_socket.h"
+#include "network/network_socket.h"
+
+#include <QPointer>
+#include <QTcpSocket>
+#include <QTest>
+#include <QWebSocketServer>
+#include <QtEndian>
+
+namespace {
+constexpr quint8 FIN = 0x80;
+constexpr quint8 OPCODE_CONTINUATION = 0x0;
+constexpr quint8 OPCODE_TEXT = 0x1;
+constexpr quint8 OPCODE_CLOSE = 0x8;
+constexpr quint8 OPCODE_PING = 0x9;
+constexpr quint8 OPCODE_PONG = 0xA;
+
+/**
+ * @brief A frame sent by the server.
+ */
+struct Frame
+{
+    quint8 opcode = 0;
+    QByteArray payload;
+
+    /**
+     * @brief Returns the status code of a close frame.
+     */
+    quint16 closeCode() const
+    {
+        return payload.size() < 2 ? 0 : qFromBigEndian<quint16>(payload.constData());
+    }
+};
+
+/**
+ * @brief A WebSocket client writing raw frames, so it can send what a well-behaved client never would.
+ */
+class RawClient
+{
+  public:
+    RawClient()
+    {
+        QObject::connect(&m_socket, &QTcpSocket::readyRead, &m_socket, [this] { m_inbound.append(m_socket.readAll()); });
+    }
+
+    /**
+     * @brief Connects and completes the opening handshake.
+     */
+    bool open(quint16 f_port)
+    {
+        m_socket.connectToHost(QHostAddress::LocalHost, f_port);
+        if (!QTest::qWaitFor([this] { return m_socket.state() == QAbstractSocket::ConnectedState; })) {
+            return false;
+        }
+        m_socket.write("GET / HTTP/1.1\r\n"
+                       "Host: 127.0.0.1:" +
+                       QByteArray::number(f_port) +
+                       "\r\n"
+                       "Upgrade: websocket\r\n"
+                       "Connection: Upgrade\r\n"
+                       "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                       "Sec-WebSocket-Version: 13\r\n\r\n");
+        if (!QTest::qWaitFor([this] { return m_inbound.contains("\r\n\r\n"); })) {
+            return false;
+        }
+        const qsizetype l_end = m_inbound.indexOf("\r\n\r\n") + 4;
+        const bool l_upgraded = m_inbound.startsWith("HTTP/1.1 101");
+        m_inbound.remove(0, l_end);
+        return l_upgraded;
+    }
+
+    /**
+     * @brief Sends a single frame.
+     *
+     * @param f_head The first byte of the frame: the FIN bit and the opcode.
+     * @param f_masked Clients must mask every frame, this allows testing one that does not.
+     */
+    void send(quint8 f_head, const QByteArray &f_payload, bool f_masked = true)
+    {
+        const char l_mask_bit = f_masked ? char(0x80) : char(0);
+        QByteArray l_frame(1, char(f_head));
+        if (f_payload.size() < 126) {
+            l_frame.append(char(l_mask_bit | f_payload.size()));
+        }
+        else if (f_payload.size() < 65536) {
+            l_frame.append(char(l_mask_bit | 126));
+            char l_length[2];
+            qToBigEndian(quint16(f_payload.size()), l_length);
+            l_frame.append(l_length, 2);
+        }
+        else {
+            l_frame.append(char(l_mask_bit | 127));
+            char l_length[8];
+            qToBigEndian(quint64(f_payload.size()), l_length);
+            l_frame.append(l_length, 8);
+        }
+
+        if (!f_masked) {
+            l_frame.append(f_payload);
+        }
+        else {
+            const char l_mask[4] = {0x12, 0x34, 0x56, 0x78};
+            l_frame.append(l_mask, 4);
+            QByteArray l_payload = f_payload;
+            for (qsizetype i = 0; i < l_payload.size(); ++i) {
+                l_payload[i] = char(l_payload[i] ^ l_mask[i % 4]);
+            }
+            l_frame.append(l_payload);
+        }
+        m_socket.write(l_frame);
+    }
+
+    /**
+     * @brief Sends a close frame with a status code.
+     */
+    void sendClose(quint16 f_code)
+    {
+        char l_code[2];
+        qToBigEndian(f_code, l_code);
+        send(FIN | OPCODE_CLOSE, QByteArray(l_code, 2));
+    }
+
+    /**
+     * @brief Waits for the server to send a frame with the given opcode. Frames with other opcodes are skipped.
+     */
+    bool waitForFrame(quint8 f_opcode, Frame *f_frame, int f_timeout = 5000)
+    {
+        return QTest::qWaitFor(
+            [&] {
+                Frame l_frame;
+                while (nextFrame(&l_frame)) {
+                    if (l_frame.opcode == f_opcode) {
+                        *f_frame = l_frame;
+                        return true;
+                    }
+                }
+                return false;
+            },
+            f_timeout);
+    }
+
+    void disconnect()
+    {
+        m_socket.disconnectFromHost();
+    }
+
+  private:
+    /**
+     * @brief Takes the next complete frame out of the received data. Server frames are never masked.
+     */
+    bool nextFrame(Frame *f_frame)
+    {
+        if (m_inbound.size() < 2) {
+            return false;
+        }
+        const uchar *l_data = reinterpret_cast<const uchar *>(m_inbound.constData());
+        quint64 l_length = l_data[1] & 0x7F;
+        qsizetype l_header = 2;
+        if (l_length == 126) {
+            if (m_inbound.size() < 4) {
+                return false;
+            }
+            l_length = qFromBigEndian<quint16>(l_data + 2);
+            l_header = 4;
+        }
+        else if (l_length == 127) {
+            if (m_inbound.size() < 10) {
+                return false;
+            }
+            l_length = qFromBigEndian<quint64>(l_data + 2);
+            l_header = 10;
+        }
+        if (quint64(m_inbound.size()) < quint64(l_header) + l_length) {
+            return false;
+        }
+        f_frame->opcode = l_data[0] & 0x0F;
+        f_frame->payload = m_inbound.mid(l_header, qsizetype(l_length));
+        m_inbound.remove(0, l_header + qsizetype(l_length));
+        return true;
+    }
+
+    QTcpSocket m_socket;
+    QByteArray m_inbound;
+};
+} // namespace
+
+/**
+ * @brief Sends the same raw frames to the Qt and the epoll transport and checks that both handle them alike.
+ */
+class tst_Transports : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+    void initTestCase();
+    void cleanup();
+    void fragmented_data();
+    void fragmented();
+    void oversizeFrame_data();
+    void oversizeFrame();
+    void oversizeMessage_data();
+    void oversizeMessage();
+    void unmasked_data();
+    void unmasked();
+    void ping_data();
+    void ping();
+    void close_data();
+    void close();
+
+  private:
+    /**
+     * @brief Adds a row for each transport available on this platform.
+     */
+    static void addTransports();
+
+    /**
+     * @brief Starts the transport of the current row and connects the client to it.
+     */
+    bool start(RawClient &f_client);
+
+    /**
+     * @brief Records what the server side socket receives.
+     */
+    void accept(NetworkSocket *f_socket);
+
+    QWebSocketServer *m_qt_server = nullptr;
+    EpollTransport *m_epoll = nullptr;
+    QPointer<NetworkSocket> m_socket;
+
+    /**
+     * @brief The packets the server received, as header and fields joined by #.
+     */
+    QStringList m_packets;
+    bool m_disconnected = false;
+};
+
+void tst_Transports::initTestCase()
+{
+    AOPacket::registerPackets();
+}
+
+void tst_Transports::cleanup()
+{
+    // The socket has to be released before the transport that accepted it goes away.
+    delete m_socket;
+    delete m_epoll;
+    m_epoll = nullptr;
+    delete m_qt_server;
+    m_qt_server = nullptr;
+    m_packets.clear();
+    m_disconnected = false;
+}
+
+void tst_Transports::addTransports()
+{
+    QTest::addColumn<QString>("transport");
+    QTest::newRow("qt") << "qt";
+    if (EpollTransport::isSupported()) {
+        QTest::newRow("epoll") << "epoll";
+    }
+}
+
+bool tst_Transports::start(RawClient &f_client)
+{
+    QFETCH(QString, transport);
+    quint16 l_port = 0;
+    if (transport == "epoll") {
+        m_epoll = new EpollTransport;
+        connect(m_epoll, &EpollTransport::newConnection, this, &tst_Transports::accept);
+        if (!m_epoll->start(ListenSocket::open(QHostAddress::LocalHost, 0, false))) {
+            return false;
+        }
+        l_port = m_epoll->serverPort();
+    }
+    else {
+        m_qt_server = new QWebSocketServer("akashi", QWebSocketServer::NonSecureMode);
+        connect(m_qt_server, &QWebSocketServer::newConnection, this, [this] {
+            QWebSocket *l_socket = m_qt_server->nextPendingConnection();
+            accept(new NetworkSocket(l_socket, l_socket));
+        });
+        if (!m_qt_server->listen(QHostAddress::LocalHost)) {
+            return false;
+        }
+        l_port = m_qt_server->serverPort();
+    }
+    return f_client.open(l_port) && QTest::qWaitFor([this] { return !m_socket.isNull(); });
+}
+
+void tst_Transports::accept(NetworkSocket *f_socket)
+{
+    m_socket = f_socket;
+    connect(f_socket, &NetworkSocket::handlePacket, this, [this](AOPacket *f_packet) {
+        m_packets.append((QStringList{f_packet->getPacketInfo().header} + f_packet->getContent()).join("#"));
+        delete f_packet;
+    });
+    connect(f_socket, &NetworkSocket::clientDisconnected, this, [this] { m_disconnected = true; });
+}
+
+void tst_Transports::fragmented_data()
+{
+    addTransports();
+}
+
+void tst_Transports::fragmented()
+{
+    RawClient l_client;
+    QVERIFY(start(l_client));
+
+    // A control frame may arrive between the fragments of a message.
+    l_client.send(OPCODE_TEXT, "HI#frag");
+    l_client.send(FIN | OPCODE_PING, "between");
+    l_client.send(FIN | OPCODE_CONTINUATION, "ment#%");
+
+    Frame l_pong;
+    QVERIFY(l_client.waitForFrame(OPCODE_PONG, &l_pong));
+    QCOMPARE(l_pong.payload, QByteArray("between"));
+    QTRY_COMPARE(m_packets, QStringList{"HI#fragment"});
+    QVERIFY(!m_disconnected);
+}
+
+void tst_Transports::oversizeFrame_data()
+{
+    addTransports();
+}
+
+void tst_Transports::oversizeFrame()
+{
+    RawClient l_client;
+    QVERIFY(start(l_client));
+
+    l_client.send(FIN | OPCODE_TEXT, "HI#" + QByteArray(70000, 'a') + "#%");
+
+    Frame l_close;
+    QVERIFY(l_client.waitForFrame(OPCODE_CLOSE, &l_close));
+    QCOMPARE(l_close.closeCode(), quint16(1009));
+    QVERIFY(m_packets.isEmpty());
+}
+
+void tst_Transports::oversizeMessage_data()
+{
+    addTransports();
+}
+
+void tst_Transports::oversizeMessage()
+{
+    RawClient l_client;
+    QVERIFY(start(l_client));
+
+    // Every fragment is small, only the reassembled message is too large to parse.
+    l_client.send(OPCODE_TEXT, "HI#" + QByteArray(20000, 'a'));
+    l_client.send(FIN | OPCODE_CONTINUATION, QByteArray(20000, 'a') + "#%");
+
+    Frame l_close;
+    QVERIFY(l_client.waitForFrame(OPCODE_CLOSE, &l_close));
+    QCOMPARE(l_close.closeCode(), quint16(1009));
+    QVERIFY(m_packets.isEmpty());
+}
+
+void tst_Transports::unmasked_data()
+{
+    addTransports();
+}
+
+void tst_Transports::unmasked()
+{
+    QFETCH(QString, transport);
+    RawClient l_client;
+    QVERIFY(start(l_client));
+
+    l_client.send(FIN | OPCODE_TEXT, "HI#unmasked#%", false);
+
+    // RFC 6455 requires closing on unmasked client frames, which the epoll transport does. QWebSocket accepts
+    // them on some versions, so the Qt transport may deliver the packet instead, but it must never be mangled.
+    Frame l_close;
+    if (transport == "epoll") {
+        QVERIFY(l_client.waitForFrame(OPCODE_CLOSE, &l_close));
+        QCOMPARE(l_close.closeCode(), quint16(1002));
+        QVERIFY(m_packets.isEmpty());
+    }
+    else if (l_client.waitForFrame(OPCODE_CLOSE, &l_close, 1000)) {
+        QCOMPARE(l_close.closeCode(), quint16(1002));
+        QVERIFY(m_packets.isEmpty());
+    }
+    else {
+        QCOMPARE(m_packets, QStringList{"HI#unmasked"});
+    }
+}
+
+void tst_Transports::ping_data()
+{
+    addTransports();
+}
+
+void tst_Transports::ping()
+{
+    RawClient l_client;
+    QVERIFY(start(l_client));
+
+    l_client.send(FIN | OPCODE_PING, "akashi");
+
+    Frame l_pong;
+    QVERIFY(l_client.waitForFrame(OPCODE_PONG, &l_pong));
+    QCOMPARE(l_pong.payload, QByteArray("akashi"));
+
+    l_client.send(FIN | OPCODE_TEXT, "HI#after#%");
+    QTRY_COMPARE(m_packets, QStringList{"HI#after"});
+}
+
+void tst_Transports::close_data()
+{
+    addTransports();
+}
+
+void tst_Transports::close()
+{
+    RawClient l_client;
+    QVERIFY(start(l_client));
+
+    l_client.sendClose(1000);
+
+    Frame l_close;
+    QVERIFY(l_client.waitForFrame(OPCODE_CLOSE, &l_close));
+    QCOMPARE(l_close.closeCode(), quint16(1000));
+
+    l_client.disconnect();
+    QTRY_VERIFY(m_disconnected);
+    QVERIFY(m_packets.isEmpty());
+}
+
+QTEST_GUILESS_MAIN(tst_Transports)
+#include "tst_transports.moc"
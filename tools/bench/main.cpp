@@ -0,0 +1,611 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#include "aoclient.h"
+#include "area_data.h"
+#include "config_manager.h"
+#include "music_manager.h"
+#include "network/aopacket.h"
+#include "network/network_socket.h"
+#include "packet/packet_factory.h"
+#include "packet/packet_ms.h"
+#include "server.h"
+#include "string_table.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QTcpServer>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+#include <QTimer>
+#include <QWebSocket>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <limits>
+
+namespace {
+
+/**
+ * @brief Number of heap allocations made by the process so far.
+ */
+std::atomic<quint64> g_allocations{0};
+
+} // namespace
+
+#if defined(__GLIBC__)
+// Interpose the C allocator so allocations made inside Qt, which mostly bypasses operator new, are counted too.
+extern "C" {
+void *__libc_malloc(size_t);
+void *__libc_calloc(size_t, size_t);
+void *__libc_realloc(void *, size_t);
+
+void *malloc(size_t f_size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(f_size);
+}
+
+void *calloc(size_t f_count, size_t f_size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(f_count, f_size);
+}
+
+void *realloc(void *f_pointer, size_t f_size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(f_pointer, f_size);
+}
+}
+#else
+void *operator new(std::size_t f_size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *l_pointer = std::malloc(f_size ? f_size : 1)) {
+        return l_pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *f_pointer) noexcept
+{
+    std::free(f_pointer);
+}
+
+void operator delete(void *f_pointer, std::size_t) noexcept
+{
+    std::free(f_pointer);
+}
+#endif
+
+namespace {
+
+/**
+ * @brief Environment variable marking the process that runs inside the generated fixture.
+ */
+const char *FIXTURE_ENV = "AKASHI_BENCH_FIXTURE";
+
+/**
+ * @brief Number of characters in the generated character list.
+ */
+const int CHARACTER_COUNT = 500;
+
+/**
+ * @brief Runs a benchmark and prints its result.
+ *
+ * @details The iteration count is doubled until one batch takes at least 10ms. Nine batches are then timed,
+ * the median time and the smallest allocation count per operation are reported.
+ */
+class BenchRunner
+{
+  public:
+    BenchRunner(QTextStream &f_out, const QString &f_filter) :
+        m_out(f_out),
+        m_filter(f_filter)
+    {
+        m_out << qSetFieldWidth(40) << Qt::left << "benchmark" << qSetFieldWidth(12) << Qt::right << "iterations"
+              << "ns/op" << "spread" << "allocs/op" << qSetFieldWidth(0) << Qt::endl;
+    }
+
+    void run(const QString &f_name, const std::function<void()> &f_body)
+    {
+        if (!f_name.contains(m_filter)) {
+            return;
+        }
+
+        const qint64 l_min_batch = 10 * 1000 * 1000;
+        qint64 l_iterations = 1;
+        QElapsedTimer l_timer;
+        forever {
+            l_timer.start();
+            for (qint64 i = 0; i < l_iterations; ++i) {
+                f_body();
+            }
+            if (l_timer.nsecsElapsed() >= l_min_batch || l_iterations >= (qint64(1) << 30)) {
+                break;
+            }
+            l_iterations *= 2;
+        }
+
+        QVector<double> l_samples;
+        quint64 l_allocations = std::numeric_limits<quint64>::max();
+        for (int l_batch = 0; l_batch < 9; ++l_batch) {
+            quint64 l_allocations_before = g_allocations.load(std::memory_order_relaxed);
+            l_timer.start();
+            for (qint64 i = 0; i < l_iterations; ++i) {
+                f_body();
+            }
+            qint64 l_elapsed = l_timer.nsecsElapsed();
+            l_allocations = std::min(l_allocations, g_allocations.load(std::memory_order_relaxed) - l_allocations_before);
+            l_samples.append(double(l_elapsed) / l_iterations);
+        }
+        std::sort(l_samples.begin(), l_samples.end());
+        double l_median = l_samples.at(4);
+        double l_spread = l_median > 0 ? (l_samples.last() - l_samples.first()) / l_median * 100 : 0;
+
+        m_out << qSetFieldWidth(40) << Qt::left << f_name << qSetFieldWidth(12) << Qt::right << l_iterations
+              << QString::number(l_median, 'f', 1) << QString::number(l_spread, 'f', 1) + "%"
+              << QString::number(double(l_allocations) / l_iterations, 'f', 2) << qSetFieldWidth(0) << Qt::endl;
+    }
+
+  private:
+    QTextStream &m_out;
+    QString m_filter;
+};
+
+/**
+ * @brief Builds a representative 26 field MS packet as sent by a 2.8+ client.
+ */
+QString rawMessage(const QString &f_character, int f_char_id, const QString &f_text)
+{
+    QStringList l_fields{"MS", "chat", "-", f_character, "normal", f_text, "wit", "0", "0", QString::number(f_char_id),
+                         "0", "0", "0", "0", "0", "0", f_character, "-1", "0", "0", "0", "0", "0", "0", "0", "0",
+                         "-||"};
+    return l_fields.join("#") + "#%";
+}
+
+/**
+ * @brief Copies the sample configuration into a directory and scales it up for benchmarking.
+ *
+ * @param f_area_count Number of areas to generate, or 0 to keep the sample areas.
+ * @param f_song_count Number of songs in the generated musiclist, spread over 20 categories.
+ */
+bool createFixture(const QString &f_path, int f_area_count, int f_song_count)
+{
+    QDir l_sample(AKASHI_CONFIG_SAMPLE);
+    QDir l_target(f_path + "/config");
+    QDirIterator l_files(l_sample.path(), QDir::Files, QDirIterator::Subdirectories);
+    while (l_files.hasNext()) {
+        QString l_source = l_files.next();
+        QString l_destination = l_target.filePath(l_sample.relativeFilePath(l_source));
+        if (!QDir().mkpath(QFileInfo(l_destination).path()) || !QFile::copy(l_source, l_destination)) {
+            qCritical() << "Unable to copy" << l_source;
+            return false;
+        }
+    }
+
+    QFile l_characters(l_target.filePath("characters.txt"));
+    if (!l_characters.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        return false;
+    }
+    for (int i = 0; i < CHARACTER_COUNT; ++i) {
+        l_characters.write(QString("Character %1\n").arg(i, 3, 10, QChar('0')).toUtf8());
+    }
+    l_characters.close();
+
+    if (f_area_count > 0) {
+        QFile l_areas(l_target.filePath("areas.ini"));
+        if (!l_areas.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+            return false;
+        }
+        for (int i = 0; i < f_area_count; ++i) {
+            l_areas.write(QString("[%1:Area %1]\nbackground=gs4\nevidence_mod=%2\n\n").arg(i).arg(i % 2 ? "ffa" : "hidden_cm").toUtf8());
+        }
+        l_areas.close();
+    }
+
+    QJsonArray l_categories;
+    for (int l_category = 0; l_category < 20; ++l_category) {
+        QJsonArray l_songs;
+        for (int l_song = 0; l_song < f_song_count / 20; ++l_song) {
+            l_songs.append(QJsonObject{{"name", QString("Category %1/Song %2.opus").arg(l_category).arg(l_song)}, {"length", -1}});
+        }
+        l_categories.append(QJsonObject{{"category", QString("== Category %1 ==").arg(l_category)}, {"songs", l_songs}});
+    }
+    QFile l_music(l_target.filePath("music.json"));
+    if (!l_music.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    l_music.write(QJsonDocument(l_categories).toJson());
+    l_music.close();
+
+    QSettings l_config(l_target.filePath("config.ini"), QSettings::IniFormat);
+    l_config.setValue("Options/max_players", 2000);
+    l_config.setValue("Options/multiclient_limit", 2000);
+    l_config.setValue("Options/connection_rate_limit", 0);
+    l_config.setValue("Options/packet_rate_limit_soft", 0);
+    l_config.setValue("Options/packet_rate_limit_hard", 0);
+    l_config.setValue("Options/logging", "modcall");
+    l_config.setValue("Options/message_floodguard", 0);
+    l_config.setValue("Options/log_archive", false);
+    l_config.setValue("Options/capture_traffic", false);
+    l_config.setValue("Advertiser/advertise", false);
+    l_config.sync();
+    return l_config.status() == QSettings::NoError;
+}
+
+/**
+ * @brief Connects a detached client and walks it through the handshake until it has joined.
+ */
+NetworkSocket *joinClient(Server *f_server, int f_index)
+{
+    NetworkSocket *l_socket = new NetworkSocket(QHostAddress(QString("10.%1.%2.1").arg(f_index / 250).arg(f_index % 250)));
+    f_server->acceptSocket(l_socket);
+    l_socket->handleMessage(QString("HI#bench%1#%").arg(f_index));
+    l_socket->handleMessage("ID#AO2#2.10.1#%");
+    l_socket->handleMessage("askchaa#%");
+    l_socket->handleMessage("RD#%");
+    return l_socket;
+}
+
+/**
+ * @brief WebSocket clients that speak or listen in several areas, living on a thread of their own.
+ *
+ * @details The server runs on the main thread of the benchmark. Keeping the clients off it means a round measures
+ * the server reading, handling and writing the messages.
+ */
+class AreaSwarm
+{
+  public:
+    AreaSwarm()
+    {
+        m_thread.start();
+        m_context = new QObject;
+        m_context->moveToThread(&m_thread);
+    }
+
+    ~AreaSwarm()
+    {
+        QMetaObject::invokeMethod(
+            m_context, [this] {
+                qDeleteAll(m_speakers);
+                qDeleteAll(m_listeners);
+                delete m_context;
+            },
+            Qt::BlockingQueuedConnection);
+        m_thread.quit();
+        m_thread.wait();
+    }
+
+    /**
+     * @brief Opens a speaker and a number of listeners in each area. The server still has to accept them.
+     *
+     * @param f_areas The names of the areas.
+     * @param f_characters The character of each speaker, with its ID being the index plus one.
+     */
+    void open(const QUrl &f_url, const QStringList &f_areas, const QStringList &f_characters, int f_listeners)
+    {
+        QMetaObject::invokeMethod(
+            m_context, [=, this] {
+                for (int i = 0; i < f_areas.size(); ++i) {
+                    const int l_char_id = i + 1;
+                    m_speakers.append(connectClient(f_url, QString("benchws%1_0").arg(i),
+                                                    {QString("CC#0#%1#bench#%").arg(l_char_id), QString("MC#%1#%2#%").arg(f_areas[i]).arg(l_char_id)}, false));
+                    m_messages.append(rawMessage(f_characters[i], l_char_id, "Hold it!"));
+                    m_messages.append(rawMessage(f_characters[i], l_char_id, "Objection!"));
+                    for (int j = 1; j <= f_listeners; ++j) {
+                        m_listeners.append(connectClient(f_url, QString("benchws%1_%2").arg(i).arg(j), {QString("MC#%1#-1#%").arg(f_areas[i])}, true));
+                    }
+                }
+            },
+            Qt::BlockingQueuedConnection);
+    }
+
+    /**
+     * @brief Lets every speaker send a message. The loop is quit once every listener received one.
+     */
+    void speak(qint64 f_round, QEventLoop *f_loop)
+    {
+        QMetaObject::invokeMethod(m_context, [=, this] {
+            m_loop = f_loop;
+            m_pending = m_listeners.size();
+            for (int i = 0; i < m_speakers.size(); ++i) {
+                m_speakers[i]->sendTextMessage(m_messages[i * 2 + f_round % 2]);
+            }
+        });
+    }
+
+  private:
+    /**
+     * @brief Opens a client that joins the server, then sends the given messages.
+     *
+     * @param f_listening True to count the messages the client receives towards the rounds.
+     */
+    QWebSocket *connectClient(const QUrl &f_url, const QString &f_hwid, const QStringList &f_after_join, bool f_listening)
+    {
+        QWebSocket *l_socket = new QWebSocket;
+        QObject::connect(l_socket, &QWebSocket::connected, l_socket, [=] {
+            for (const QString &l_message : QStringList{QString("HI#%1#%").arg(f_hwid), "ID#AO2#2.10.1#%", "askchaa#%", "RD#%"} + f_after_join) {
+                l_socket->sendTextMessage(l_message);
+            }
+        });
+        if (f_listening) {
+            QObject::connect(l_socket, &QWebSocket::textMessageReceived, l_socket, [this](const QString &f_message) {
+                if (m_loop != nullptr && f_message.startsWith("MS#") && --m_pending == 0) {
+                    QMetaObject::invokeMethod(m_loop, &QEventLoop::quit, Qt::QueuedConnection);
+                    m_loop = nullptr;
+                }
+            });
+        }
+        l_socket->open(f_url);
+        return l_socket;
+    }
+
+    QThread m_thread;
+    QObject *m_context;
+    QList<QWebSocket *> m_speakers;
+    QList<QWebSocket *> m_listeners;
+    QStringList m_messages;
+
+    /**
+     * @brief The loop waiting for the current round, and the number of listeners that did not receive it yet.
+     */
+    QEventLoop *m_loop = nullptr;
+    int m_pending = 0;
+};
+
+int runBenchmarks(const QStringList &f_arguments)
+{
+    QCommandLineParser l_parser;
+    l_parser.addOptions({
+        {"filter", "Only run benchmarks containing this text.", "text"},
+        {"clients", "Number of joined clients used by the fan-out benchmarks.", "count", "500"},
+        {"areas", "Number of areas in the generated configuration, 0 keeps the sample areas.", "count", "0"},
+        {"songs", "Number of songs in the generated musiclist.", "count", "1000"},
+        {"listeners", "Number of WebSocket clients listening in each active area.", "count", "10"},
+    });
+    l_parser.parse(f_arguments);
+    int l_client_count = qMax(1, l_parser.value("clients").toInt());
+
+    if (!ConfigManager::verifyServerConfig()) {
+        qCritical() << "The generated fixture is invalid.";
+        return EXIT_FAILURE;
+    }
+
+    QTextStream l_out(stdout);
+    // The WebSocket benchmarks need to know the port, so pick a free one up front.
+    QTcpServer l_port_finder;
+    l_port_finder.listen(QHostAddress::LocalHost);
+    const quint16 l_port = l_port_finder.serverPort();
+    l_port_finder.close();
+
+    QElapsedTimer l_startup_timer;
+    l_startup_timer.start();
+    Server *l_server = new Server(l_port, qApp);
+    l_server->start();
+    const qint64 l_startup_time = l_startup_timer.elapsed();
+
+    // The first client takes character 0 and is the one speaking.
+    NetworkSocket *l_speaker_socket = joinClient(l_server, 0);
+    for (int i = 1; i < l_client_count; ++i) {
+        joinClient(l_server, i);
+    }
+    l_speaker_socket->handleMessage("CC#0#0#bench0#%");
+    AOClient *l_speaker = l_server->getClientByID(0);
+    AreaData *l_area = l_server->getAreaById(l_speaker->areaId());
+
+    BenchRunner l_runner(l_out, l_parser.value("filter"));
+
+    const QString l_raw_ms = rawMessage(l_speaker->character(), 0, "The defense calls [evidence] to the stand!");
+    l_runner.run("PacketFactory::createPacket(MS)", [&] {
+        delete PacketFactory::createPacket(l_raw_ms.chopped(1));
+    });
+
+    l_runner.run("AOPacket::toString(MS)", [&] {
+        AOPacket *l_packet = PacketFactory::createPacket(l_raw_ms.chopped(1));
+        l_packet->toString();
+        delete l_packet;
+    });
+
+    l_runner.run("AOPacket::toUtf8(MS)", [&] {
+        AOPacket *l_packet = PacketFactory::createPacket(l_raw_ms.chopped(1));
+        l_packet->toUtf8();
+        delete l_packet;
+    });
+
+    // Alternate between two messages, as repeating one would be rejected as a double post.
+    QList<PacketMS *> l_ms_packets{
+        static_cast<PacketMS *>(PacketFactory::createPacket(rawMessage(l_speaker->character(), 0, "Hold it!").chopped(1))),
+        static_cast<PacketMS *>(PacketFactory::createPacket(rawMessage(l_speaker->character(), 0, "Objection!").chopped(1)))};
+    int l_ms_index = 0;
+    l_runner.run("PacketMS::validateIcPacket", [&] {
+        AOPacket *l_validated = l_ms_packets.at(l_ms_index++ % 2)->validateIcPacket(*l_speaker);
+        delete l_validated;
+    });
+
+    // A message with a y-offset needs a second packet for 2.6-2.8 recipients.
+    PacketMS *l_offset_message = static_cast<PacketMS *>(PacketFactory::createPacket(rawMessage(l_speaker->character(), 0, "Take that!").chopped(1)));
+    AOPacket *l_offset_packet = l_offset_message->validateIcPacket(*l_speaker);
+    l_offset_packet->setContentField(19, "10&-5");
+    l_runner.run("PacketMS::buildLayouts(y-offset)", [&] {
+        delete PacketMS::buildLayouts(l_offset_packet)[int(PacketMS::Layout::X_OFFSET)];
+    });
+
+    AOPacket *l_broadcast = PacketFactory::createPacket(l_raw_ms.chopped(1));
+    l_runner.run(QString("Server::broadcast(area, %1 clients)").arg(l_client_count), [&] {
+        l_server->broadcast(l_broadcast, l_area->index());
+    });
+
+    l_runner.run(QString("AOClient::arup(%1 clients)").arg(l_client_count), [&] {
+        l_speaker->arup(AOClient::ARUPType::PLAYER_COUNT, true);
+    });
+
+    l_runner.run(QString("Server::updateCharsTaken(%1 chars)").arg(CHARACTER_COUNT), [&] {
+        l_server->updateCharsTaken(l_area);
+    });
+
+    // One speaker and a number of listeners per area, all speaking at once, as on a server with many busy courtrooms.
+    // The clients connect over loopback, so every message is read, handled and written to each listener through
+    // real sockets. Use --areas 50 for 50 active areas.
+    // Allocations made by the clients are counted as well.
+    const int l_active_areas = qMin(50, l_server->getAreaCount());
+    const int l_listeners = qMax(1, l_parser.value("listeners").toInt());
+    QStringList l_area_names;
+    QStringList l_area_characters;
+    for (int i = 0; i < l_active_areas; ++i) {
+        l_area_names.append(l_server->getAreaName(i));
+        l_area_characters.append(l_server->getCharacterById(i + 1));
+    }
+    QEventLoop l_round_loop;
+    bool l_round_failed = false;
+    {
+        AreaSwarm l_swarm;
+        l_swarm.open(QUrl(QString("ws://127.0.0.1:%1").arg(l_port)), l_area_names, l_area_characters, l_listeners);
+
+        // Wait until every speaker holds its character and every client reached its area.
+        QElapsedTimer l_join_timer;
+        l_join_timer.start();
+        forever {
+            int l_ready = 0;
+            const QVector<AOClient *> l_clients = l_server->getClients();
+            for (const AOClient *l_client : l_clients) {
+                const QString l_hwid = l_client->getHwid();
+                if (!l_hwid.startsWith("benchws")) {
+                    continue;
+                }
+                const int l_area_id = l_hwid.section('_', 0, 0).mid(7).toInt();
+                const bool l_speaker = l_hwid.endsWith("_0");
+                if (l_client->areaId() == l_area_id && (!l_speaker || l_client->character() == l_area_characters[l_area_id])) {
+                    ++l_ready;
+                }
+            }
+            if (l_ready == l_active_areas * (1 + l_listeners)) {
+                break;
+            }
+            if (l_join_timer.elapsed() > 30000) {
+                qCritical() << "Only" << l_ready << "of" << l_active_areas * (1 + l_listeners) << "WebSocket clients joined their area.";
+                return EXIT_FAILURE;
+            }
+            QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+        }
+
+        qint64 l_round = 0;
+        l_runner.run(QString("WebSocket MS round(%1 areas)").arg(l_active_areas), [&] {
+            if (l_round_failed) {
+                return;
+            }
+            QTimer l_timeout;
+            l_timeout.setSingleShot(true);
+            QObject::connect(&l_timeout, &QTimer::timeout, &l_round_loop, [&] {
+                l_round_failed = true;
+                l_round_loop.quit();
+            });
+            l_timeout.start(10000);
+            l_swarm.speak(l_round++, &l_round_loop);
+            l_round_loop.exec();
+        });
+    }
+    if (l_round_failed) {
+        qCritical() << "A WebSocket round timed out, its messages were not delivered to every listener.";
+        return EXIT_FAILURE;
+    }
+
+    MusicManager l_music_manager(ConfigManager::cdnList(), ConfigManager::musiclist(), ConfigManager::ordered_songs());
+    l_music_manager.registerArea(0);
+    l_runner.run("MusicManager::musiclist", [&] {
+        l_music_manager.musiclist(0);
+    });
+
+    // Starting the server is too slow to repeat, so it is timed once and reported by phase.
+    if (QString("Server::start").contains(l_parser.value("filter"))) {
+        l_out << Qt::endl
+              << qSetFieldWidth(40) << Qt::left << QString("Server::start(%1 areas)").arg(l_server->getAreaCount())
+              << qSetFieldWidth(12) << Qt::right << QString("%1ms").arg(l_startup_time) << qSetFieldWidth(0) << Qt::endl;
+        const QList<QPair<QString, qint64>> l_phases = l_server->startupPhases();
+        for (const QPair<QString, qint64> &l_phase : l_phases) {
+            l_out << qSetFieldWidth(40) << Qt::left << "  " + l_phase.first << qSetFieldWidth(12) << Qt::right
+                  << QString("%1ms").arg(l_phase.second) << qSetFieldWidth(0) << Qt::endl;
+        }
+    }
+
+    if (QString("AOClient::memoryFootprint").contains(l_parser.value("filter"))) {
+        const qint64 l_bytes = l_server->getClientMemoryFootprint();
+        const int l_connected = l_server->getClients().size();
+        l_out << Qt::endl
+              << qSetFieldWidth(40) << Qt::left << QString("AOClient::memoryFootprint(%1 clients)").arg(l_connected)
+              << qSetFieldWidth(12) << Qt::right << QString("%1B").arg(l_bytes / l_connected) << qSetFieldWidth(0) << Qt::endl;
+        l_out << qSetFieldWidth(40) << Qt::left << QString("  StringTable(%1 names)").arg(StringTable::size())
+              << qSetFieldWidth(12) << Qt::right << QString("%1B").arg(StringTable::memoryFootprint()) << qSetFieldWidth(0) << Qt::endl;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("akashi_bench");
+
+    if (qEnvironmentVariableIsSet(FIXTURE_ENV)) {
+        return runBenchmarks(app.arguments());
+    }
+
+    QCommandLineParser l_parser;
+    l_parser.setApplicationDescription("Micro-benchmarks for akashi's packet and broadcast paths.");
+    l_parser.addHelpOption();
+    l_parser.addOptions({
+        {"filter", "Only run benchmarks containing this text.", "text"},
+        {"clients", "Number of joined clients used by the fan-out benchmarks.", "count", "500"},
+        {"areas", "Number of areas in the generated configuration, 0 keeps the sample areas.", "count", "0"},
+        {"songs", "Number of songs in the generated musiclist.", "count", "1000"},
+        {"listeners", "Number of WebSocket clients listening in each active area.", "count", "10"},
+    });
+    l_parser.process(app);
+
+    // The configuration is read from the working directory when the process starts,
+    // so the benchmarks run in a child process started inside the generated fixture.
+    QTemporaryDir l_fixture;
+    if (!l_fixture.isValid() || !createFixture(l_fixture.path(), l_parser.value("areas").toInt(), qMax(20, l_parser.value("songs").toInt()))) {
+        qCritical() << "Unable to create the benchmark fixture.";
+        return EXIT_FAILURE;
+    }
+
+    QProcess l_child;
+    QProcessEnvironment l_environment = QProcessEnvironment::systemEnvironment();
+    l_environment.insert(FIXTURE_ENV, "1");
+    l_child.setProcessEnvironment(l_environment);
+    l_child.setWorkingDirectory(l_fixture.path());
+    l_child.setProcessChannelMode(QProcess::ForwardedChannels);
+    l_child.start(QCoreApplication::applicationFilePath(), app.arguments().mid(1));
+    if (!l_child.waitForFinished(-1) || l_child.exitStatus() != QProcess::NormalExit) {
+        qCritical() << "Benchmark process failed:" << l_child.errorString();
+        return EXIT_FAILURE;
+    }
+    return l_child.exitCode();
+}
@@ -0,0 +1,78 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#ifndef LATENCY_STATS_H
+#define LATENCY_STATS_H
+
+#include <QString>
+#include <QVector>
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * @brief Collects latency samples in nanoseconds and reports percentiles over them.
+ */
+class LatencyStats
+{
+  public:
+    /**
+     * @brief Adds a sample.
+     */
+    void add(qint64 f_nanoseconds)
+    {
+        m_samples.append(f_nanoseconds);
+        m_sorted = false;
+    }
+
+    /**
+     * @brief Returns the number of samples.
+     */
+    qsizetype count() const { return m_samples.size(); }
+
+    /**
+     * @brief Returns the given percentile, between 0 and 1, of all samples or 0 if there are none.
+     */
+    qint64 percentile(double f_percentile)
+    {
+        if (m_samples.isEmpty()) {
+            return 0;
+        }
+        if (!m_sorted) {
+            std::sort(m_samples.begin(), m_samples.end());
+            m_sorted = true;
+        }
+        qsizetype l_index = static_cast<qsizetype>(std::ceil(f_percentile * m_samples.size())) - 1;
+        return m_samples.at(std::clamp<qsizetype>(l_index, 0, m_samples.size() - 1));
+    }
+
+    /**
+     * @brief Formats a nanosecond value as microseconds.
+     */
+    static QString micros(qint64 f_nanoseconds) { return QString::number(f_nanoseconds / 1000.0, 'f', 1); }
+
+    /**
+     * @brief Formats a nanosecond value as milliseconds.
+     */
+    static QString millis(qint64 f_nanoseconds) { return QString::number(f_nanoseconds / 1000000.0, 'f', 2); }
+
+  private:
+    QVector<qint64> m_samples;
+    bool m_sorted = true;
+};
+
+#endif // LATENCY_STATS_H
@@ -0,0 +1,30 @@
+#!/bin/sh
+# Runs the load generator against the Qt WebSockets transport and the epoll transport in turn, with the same load,
+# so their latency and memory use can be compared side by side.
+#
+# Usage: tools/loadgen/compare_transports.sh [akashi_loadgen options]
+#
+# Build with -DAKASHI_BUILD_TOOLS=ON first. Each server runs from a scratch copy of bin/config_sample and listens on
+# port 27016, so nothing else may be using it.
+set -eu
+
+BIN=$(cd "$(dirname "$0")/../../bin" && pwd)
+
+for TRANSPORT in qt epoll; do
+    WORKDIR=$(mktemp -d)
+    cp -r "$BIN/config_sample" "$WORKDIR/config"
+    sed -i -e "s/^transport=.*/transport=$TRANSPORT/" \
+        -e "s/^max_players=.*/max_players=5000/" \
+        "$WORKDIR/config/config.ini"
+
+    (cd "$WORKDIR" && exec "$BIN/akashi") >"$WORKDIR/server.log" 2>&1 &
+    SERVER_PID=$!
+    sleep 2
+
+    echo "== transport=$TRANSPORT =="
+    "$BIN/akashi_loadgen" --server-pid "$SERVER_PID" "$@" || echo "akashi_loadgen failed, see $WORKDIR/server.log"
+
+    kill "$SERVER_PID"
+    wait "$SERVER_PID" 2>/dev/null || true
+    echo
+done
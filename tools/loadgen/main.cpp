@@ -0,0 +1,462 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#include "latency_stats.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QRandomGenerator>
+#include <QTextStream>
+#include <QTimer>
+#include <QUrl>
+#include <QWebSocket>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+/**
+ * @brief Marker placed in chat messages to carry the send time of the message.
+ */
+const QString TOKEN_PREFIX = QStringLiteral("[lg:");
+
+/**
+ * @brief Relative weights of the actions a simulated user performs.
+ */
+struct ActionMix
+{
+    int ms = 50;
+    int ct = 30;
+    int mc = 10;
+    int area = 10;
+
+    int total() const { return ms + ct + mc + area; }
+};
+
+/**
+ * @brief Settings and results shared by all simulated users.
+ */
+struct Swarm
+{
+    QUrl url;
+    ActionMix mix;
+    double action_rate = 0.2;
+    int ping_interval = 5000;
+    QElapsedTimer clock;
+
+    int connected = 0;
+    int joined = 0;
+    int failed = 0;
+    quint64 sent_ms = 0;
+    quint64 sent_ct = 0;
+    quint64 sent_mc = 0;
+    quint64 sent_area = 0;
+    quint64 received_frames = 0;
+    quint64 received_bytes = 0;
+    LatencyStats handshake;
+    LatencyStats ping;
+    LatencyStats fanout_ms;
+    LatencyStats fanout_ct;
+};
+
+/**
+ * @brief A single headless AO2 client.
+ *
+ * @details Performs the same handshake a real client does, picks a free character and then performs
+ * random actions drawn from the configured mix. Chat messages carry their send time, so every user
+ * receiving them can measure the fan-out latency of the server.
+ */
+class SimulatedUser : public QObject
+{
+  public:
+    SimulatedUser(Swarm *f_swarm, int f_index, QObject *parent = nullptr) :
+        QObject(parent),
+        m_swarm(f_swarm),
+        m_hwid(QString("loadgen%1").arg(f_index)),
+        m_socket(new QWebSocket(QString(), QWebSocketProtocol::VersionLatest, this)),
+        m_action_timer(new QTimer(this)),
+        m_ping_timer(new QTimer(this))
+    {
+        m_action_timer->setSingleShot(true);
+        connect(m_action_timer, &QTimer::timeout, this, [this] { performAction(); });
+        connect(m_ping_timer, &QTimer::timeout, this, [this] {
+            m_ping_sent = m_swarm->clock.nsecsElapsed();
+            send({"CH", QString::number(m_char_id)});
+        });
+        connect(m_socket, &QWebSocket::connected, this, [this] {
+            m_swarm->connected++;
+            send({"HI", m_hwid});
+        });
+        connect(m_socket, &QWebSocket::disconnected, this, [this] {
+            if (!m_joined && !m_stopping) {
+                m_swarm->failed++;
+            }
+            m_action_timer->stop();
+            m_ping_timer->stop();
+        });
+        connect(m_socket, &QWebSocket::textMessageReceived, this, [this](const QString &f_message) { handleMessage(f_message); });
+    }
+
+    void start()
+    {
+        m_handshake_start = m_swarm->clock.nsecsElapsed();
+        m_socket->open(m_swarm->url);
+    }
+
+    void stop()
+    {
+        m_stopping = true;
+        m_action_timer->stop();
+        m_ping_timer->stop();
+        m_socket->close();
+    }
+
+  private:
+    void send(const QStringList &f_packet)
+    {
+        m_socket->sendTextMessage(f_packet.join("#") + "#%");
+    }
+
+    void handleMessage(const QString &f_message)
+    {
+        m_swarm->received_frames++;
+        m_swarm->received_bytes += f_message.size();
+
+        const QStringList l_packets = f_message.split("%", Qt::SkipEmptyParts);
+        for (const QString &l_packet : l_packets) {
+            QStringList l_fields = l_packet.split("#");
+            if (!l_fields.isEmpty() && l_fields.last().isEmpty()) {
+                l_fields.removeLast();
+            }
+            if (l_fields.isEmpty()) {
+                continue;
+            }
+            handlePacket(l_fields.takeFirst(), l_fields);
+        }
+    }
+
+    void handlePacket(const QString &f_header, const QStringList &f_content)
+    {
+        if (f_header == "ID") {
+            send({"ID", "AO2", "2.10.1"});
+        }
+        else if (f_header == "PN") {
+            send({"askchaa"});
+        }
+        else if (f_header == "SI") {
+            send({"RC"});
+        }
+        else if (f_header == "SC") {
+            m_characters = f_content;
+            send({"RM"});
+        }
+        else if (f_header == "SM") {
+            m_music = f_content;
+            send({"RD"});
+        }
+        else if (f_header == "FA") {
+            m_areas = f_content;
+        }
+        else if (f_header == "CharsCheck") {
+            m_taken = f_content;
+        }
+        else if (f_header == "DONE") {
+            handleJoined();
+        }
+        else if (f_header == "PV") {
+            m_char_id = f_content.value(2).toInt();
+        }
+        else if (f_header == "CHECK") {
+            if (m_ping_sent >= 0) {
+                m_swarm->ping.add(m_swarm->clock.nsecsElapsed() - m_ping_sent);
+                m_ping_sent = -1;
+            }
+        }
+        else if (f_header == "MS") {
+            recordFanout(f_content.value(4), m_swarm->fanout_ms);
+        }
+        else if (f_header == "CT") {
+            recordFanout(f_content.value(1), m_swarm->fanout_ct);
+        }
+    }
+
+    void handleJoined()
+    {
+        if (m_joined) {
+            return;
+        }
+        m_joined = true;
+        m_swarm->joined++;
+        m_swarm->handshake.add(m_swarm->clock.nsecsElapsed() - m_handshake_start);
+
+        // Songs are the music list entries with a file extension, the rest are areas and categories.
+        m_music = m_music.mid(m_areas.size());
+        m_music.erase(std::remove_if(m_music.begin(), m_music.end(), [](const QString &f_entry) { return !f_entry.contains('.'); }),
+                      m_music.end());
+
+        pickCharacter();
+        m_ping_timer->start(m_swarm->ping_interval);
+        scheduleAction();
+    }
+
+    void pickCharacter()
+    {
+        if (m_characters.isEmpty()) {
+            return;
+        }
+        int l_offset = QRandomGenerator::global()->bounded(m_characters.size());
+        for (int i = 0; i < m_characters.size(); ++i) {
+            int l_char_id = (l_offset + i) % m_characters.size();
+            if (m_taken.value(l_char_id) != "-1") {
+                send({"CC", "0", QString::number(l_char_id), m_hwid});
+                return;
+            }
+        }
+    }
+
+    void recordFanout(const QString &f_message, LatencyStats &f_stats)
+    {
+        qsizetype l_start = f_message.indexOf(TOKEN_PREFIX);
+        if (l_start == -1) {
+            return;
+        }
+        l_start += TOKEN_PREFIX.size();
+        qsizetype l_end = f_message.indexOf(']', l_start);
+        bool ok;
+        qint64 l_sent = f_message.mid(l_start, l_end - l_start).toLongLong(&ok);
+        if (ok) {
+            f_stats.add(m_swarm->clock.nsecsElapsed() - l_sent);
+        }
+    }
+
+    QString token() const
+    {
+        return TOKEN_PREFIX + QString::number(m_swarm->clock.nsecsElapsed()) + "]";
+    }
+
+    void scheduleAction()
+    {
+        if (m_swarm->action_rate <= 0) {
+            return;
+        }
+        // Exponentially distributed gaps make the users act independently of each other.
+        double l_uniform = 1.0 - QRandomGenerator::global()->generateDouble();
+        int l_delay = static_cast<int>(-std::log(l_uniform) / m_swarm->action_rate * 1000);
+        m_action_timer->start(l_delay);
+    }
+
+    void performAction()
+    {
+        const ActionMix &l_mix = m_swarm->mix;
+        int l_roll = QRandomGenerator::global()->bounded(qMax(1, l_mix.total()));
+        QString l_character = m_characters.value(m_char_id);
+
+        if (l_roll < l_mix.ms && m_char_id >= 0) {
+            send({"MS", "chat", "-", l_character, "normal", "Objection! " + token(), "wit", "0", "0",
+                  QString::number(m_char_id), "0", "0", "0", "0", "0", "0", l_character, "-1", "0", "0",
+                  "0", "0", "0", "0", "0", "0", "||"});
+            m_swarm->sent_ms++;
+        }
+        else if (l_roll < l_mix.ms + l_mix.ct) {
+            send({"CT", m_hwid, "Hello " + token()});
+            m_swarm->sent_ct++;
+        }
+        else if (l_roll < l_mix.ms + l_mix.ct + l_mix.mc && m_char_id >= 0 && !m_music.isEmpty()) {
+            QString l_song = m_music.at(QRandomGenerator::global()->bounded(m_music.size()));
+            send({"MC", l_song, QString::number(m_char_id), l_character, "0", "0", "0"});
+            m_swarm->sent_mc++;
+        }
+        else if (!m_areas.isEmpty()) {
+            QString l_area = m_areas.at(QRandomGenerator::global()->bounded(m_areas.size()));
+            send({"MC", l_area, QString::number(m_char_id)});
+            m_swarm->sent_area++;
+        }
+        scheduleAction();
+    }
+
+    Swarm *m_swarm;
+    QString m_hwid;
+    QWebSocket *m_socket;
+    QTimer *m_action_timer;
+    QTimer *m_ping_timer;
+    qint64 m_handshake_start = 0;
+    qint64 m_ping_sent = -1;
+    bool m_joined = false;
+    bool m_stopping = false;
+    int m_char_id = -1;
+    QStringList m_characters;
+    QStringList m_music;
+    QStringList m_areas;
+    QStringList m_taken;
+};
+
+/**
+ * @brief Returns the resident set size of a process in kilobytes, or -1 if it is unavailable.
+ */
+qint64 residentSetSize(qint64 f_pid)
+{
+    QFile l_status(QString("/proc/%1/status").arg(f_pid));
+    if (!l_status.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return -1;
+    }
+    while (!l_status.atEnd()) {
+        QByteArray l_line = l_status.readLine();
+        if (l_line.startsWith("VmRSS:")) {
+            return l_line.mid(6).trimmed().split(' ').value(0).toLongLong();
+        }
+    }
+    return -1;
+}
+
+bool parseMix(const QString &f_value, ActionMix &f_mix)
+{
+    const QStringList l_parts = f_value.split(",", Qt::SkipEmptyParts);
+    for (const QString &l_part : l_parts) {
+        QStringList l_pair = l_part.split("=");
+        bool ok;
+        int l_weight = l_pair.value(1).toInt(&ok);
+        if (l_pair.size() != 2 || !ok || l_weight < 0) {
+            return false;
+        }
+        QString l_action = l_pair.at(0).trimmed().toLower();
+        if (l_action == "ms")
+            f_mix.ms = l_weight;
+        else if (l_action == "ct")
+            f_mix.ct = l_weight;
+        else if (l_action == "mc")
+            f_mix.mc = l_weight;
+        else if (l_action == "area")
+            f_mix.area = l_weight;
+        else
+            return false;
+    }
+    return true;
+}
+
+void printLatency(QTextStream &f_out, const QString &f_name, LatencyStats &f_stats)
+{
+    f_out << qSetFieldWidth(14) << Qt::left << f_name << Qt::right << f_stats.count()
+          << LatencyStats::millis(f_stats.percentile(0.5)) << LatencyStats::millis(f_stats.percentile(0.9))
+          << LatencyStats::millis(f_stats.percentile(0.99)) << LatencyStats::millis(f_stats.percentile(1))
+          << qSetFieldWidth(0) << "\n";
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("akashi_loadgen");
+
+    QCommandLineParser l_parser;
+    l_parser.setApplicationDescription("Simulates a swarm of AO2 clients against a local akashi server.");
+    l_parser.addHelpOption();
+    l_parser.addOptions({
+        {"url", "WebSocket URL of the server.", "url", "ws://127.0.0.1:27016"},
+        {"clients", "Number of simulated users.", "count", "100"},
+        {"ramp", "New connections opened per second.", "rate", "100"},
+        {"duration", "Seconds to run after the last connection was opened.", "seconds", "60"},
+        {"rate", "Actions per user and second.", "rate", "0.2"},
+        {"mix", "Weights of the actions, as ms=N,ct=N,mc=N,area=N.", "mix", "ms=50,ct=30,mc=10,area=10"},
+        {"ping", "Interval of CH keepalives in milliseconds.", "ms", "5000"},
+        {"server-pid", "Process ID of the server, to report its memory usage.", "pid"},
+    });
+    l_parser.process(app);
+
+    Swarm l_swarm;
+    l_swarm.url = QUrl(l_parser.value("url"));
+    l_swarm.action_rate = l_parser.value("rate").toDouble();
+    l_swarm.ping_interval = qMax(100, l_parser.value("ping").toInt());
+    int l_client_count = l_parser.value("clients").toInt();
+    int l_ramp = qMax(1, l_parser.value("ramp").toInt());
+    int l_duration = l_parser.value("duration").toInt();
+    qint64 l_server_pid = l_parser.value("server-pid").toLongLong();
+
+    if (!l_swarm.url.isValid() || l_client_count <= 0 || !parseMix(l_parser.value("mix"), l_swarm.mix)) {
+        l_parser.showHelp(EXIT_FAILURE);
+    }
+    if (!QStringList{"127.0.0.1", "localhost", "::1"}.contains(l_swarm.url.host())) {
+        qWarning() << "The load generator is meant to be run against a local server.";
+    }
+
+    QTextStream l_out(stdout);
+    QList<SimulatedUser *> l_users;
+    l_swarm.clock.start();
+
+    // Open connections at the requested ramp, in ticks of 10ms.
+    QTimer l_ramp_timer;
+    int l_per_tick = qMax(1, l_ramp / 100);
+    l_ramp_timer.setInterval(qMax(1, 1000 * l_per_tick / l_ramp));
+    QObject::connect(&l_ramp_timer, &QTimer::timeout, [&] {
+        for (int i = 0; i < l_per_tick && l_users.size() < l_client_count; ++i) {
+            SimulatedUser *l_user = new SimulatedUser(&l_swarm, l_users.size(), &app);
+            l_users.append(l_user);
+            l_user->start();
+        }
+        if (l_users.size() >= l_client_count) {
+            l_ramp_timer.stop();
+            QTimer::singleShot(l_duration * 1000, [&] {
+                for (SimulatedUser *l_user : qAsConst(l_users)) {
+                    l_user->stop();
+                }
+                QTimer::singleShot(500, &app, &QCoreApplication::quit);
+            });
+        }
+    });
+    l_ramp_timer.start();
+
+    // Progress and server memory, once per second.
+    qint64 l_peak_rss = -1;
+    qint64 l_rss = -1;
+    QTimer l_sample_timer;
+    QObject::connect(&l_sample_timer, &QTimer::timeout, [&] {
+        if (l_server_pid > 0) {
+            l_rss = residentSetSize(l_server_pid);
+            l_peak_rss = qMax(l_peak_rss, l_rss);
+        }
+        l_out << "[" << l_swarm.clock.elapsed() / 1000 << "s] connected " << l_swarm.connected << ", joined "
+              << l_swarm.joined << ", failed " << l_swarm.failed;
+        if (l_rss >= 0) {
+            l_out << ", server RSS " << l_rss / 1024 << " MiB";
+        }
+        l_out << Qt::endl;
+    });
+    l_sample_timer.start(1000);
+
+    int l_result = app.exec();
+    double l_seconds = l_swarm.clock.elapsed() / 1000.0;
+
+    l_out << "\nUsers: " << l_client_count << " started, " << l_swarm.joined << " joined, " << l_swarm.failed << " failed\n";
+    l_out << "Sent: " << l_swarm.sent_ms << " MS, " << l_swarm.sent_ct << " CT, " << l_swarm.sent_mc << " MC, "
+          << l_swarm.sent_area << " area changes\n";
+    l_out << "Received: " << l_swarm.received_frames << " frames, " << l_swarm.received_bytes << " characters ("
+          << QString::number(l_swarm.received_frames / l_seconds, 'f', 1) << " frames/s)\n";
+    if (l_peak_rss >= 0) {
+        l_out << "Server RSS: " << l_rss / 1024 << " MiB at the end, " << l_peak_rss / 1024 << " MiB peak\n";
+    }
+    l_out << "\n"
+          << qSetFieldWidth(14) << Qt::left << "latency" << Qt::right << "samples"
+          << "p50 (ms)" << "p90 (ms)" << "p99 (ms)" << "max (ms)" << qSetFieldWidth(0) << "\n";
+    printLatency(l_out, "handshake", l_swarm.handshake);
+    printLatency(l_out, "CH->CHECK", l_swarm.ping);
+    printLatency(l_out, "MS fan-out", l_swarm.fanout_ms);
+    printLatency(l_out, "CT fan-out", l_swarm.fanout_ct);
+    return l_result;
+}
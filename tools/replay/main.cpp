@@ -0,0 +1,255 @@
+//////////////////////////////////////////////////////////////////////////////////////
+//    akashi - a server for Attorney Online 2                                       //
+//    Copyright (C) 2020  scatterflower                                             //
+//                                                                                  //
+//    This program is free software: you can redistribute it and/or modify          //
+//    it under the terms of the GNU Affero General Public License as                //
+//    published by the Free Software Foundation, either version 3 of the            //
+//    License, or (at your option) any later version.                               //
+//                                                                                  //
+//    This program is distributed in the hope that it will be useful,               //
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 //
+//    GNU Affero General Public License for more details.                           //
+//                                                                                  //
+//    You should have received a copy of the GNU Affero General Public License      //
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.        //
+//////////////////////////////////////////////////////////////////////////////////////
+#include "config_manager.h"
+#include "latency_stats.h"
+#include "network/network_capture.h"
+#include "network/network_socket.h"
+#include "server.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QPointer>
+#include <QTextStream>
+#include <QTimer>
+
+#include <limits>
+
+/**
+ * @brief Feeds a traffic capture into an in-process server through detached sockets.
+ *
+ * @details Records are replayed in capture order. With a speed factor the original timing is kept,
+ * scaled by that factor. Without one, records are fed as fast as the server handles them, yielding
+ * to the event loop between batches so queued work like disconnects still gets processed.
+ */
+class Replay
+{
+  public:
+    Replay(Server *f_server, const QList<NetworkCapture::Record> &f_records, double f_speed) :
+        m_server(f_server),
+        m_records(f_records),
+        m_speed(f_speed)
+    {
+    }
+
+    void start()
+    {
+        m_first_timestamp = m_records.isEmpty() ? 0 : m_records.first().timestamp;
+        m_clock.start();
+        QTimer::singleShot(0, [this] { step(); });
+    }
+
+  private:
+    static const int BATCH_SIZE = 256;
+
+    void step()
+    {
+        qint64 l_due = std::numeric_limits<qint64>::max();
+        if (m_speed > 0) {
+            l_due = static_cast<qint64>(m_clock.nsecsElapsed() * m_speed);
+        }
+
+        for (int l_processed = 0; m_position < m_records.size() && l_processed < BATCH_SIZE; ++l_processed) {
+            const NetworkCapture::Record &l_record = m_records.at(m_position);
+            if (l_record.timestamp - m_first_timestamp > l_due) {
+                break;
+            }
+            process(l_record);
+            ++m_position;
+        }
+
+        if (m_position >= m_records.size()) {
+            finish();
+            return;
+        }
+
+        int l_wait_ms = 0;
+        if (m_speed > 0) {
+            qint64 l_next = (m_records.at(m_position).timestamp - m_first_timestamp) / m_speed;
+            l_wait_ms = qMax<qint64>(0, (l_next - m_clock.nsecsElapsed()) / 1000000);
+        }
+        QTimer::singleShot(l_wait_ms, Qt::PreciseTimer, [this] { step(); });
+    }
+
+    void process(const NetworkCapture::Record &f_record)
+    {
+        switch (f_record.type) {
+        case NetworkCapture::RecordType::CONNECT:
+        {
+            NetworkSocket *l_socket = new NetworkSocket(QHostAddress(QString::fromUtf8(f_record.data)));
+            QObject::connect(l_socket, &NetworkSocket::detachedWrite, [this](const QString &f_data) {
+                m_outbound_frames++;
+                m_outbound_bytes += f_data.toUtf8().size();
+            });
+            QObject::connect(l_socket, &NetworkSocket::handlePacket, [this] { m_packets++; });
+            m_sockets.insert(f_record.connection, l_socket);
+            m_connections++;
+            m_server->acceptSocket(l_socket);
+            break;
+        }
+        case NetworkCapture::RecordType::FRAME:
+        {
+            QPointer<NetworkSocket> l_socket = m_sockets.value(f_record.connection);
+            if (l_socket.isNull()) {
+                m_skipped_frames++;
+                break;
+            }
+            QElapsedTimer l_timer;
+            l_timer.start();
+            l_socket->handleMessage(QString::fromUtf8(f_record.data));
+            m_latencies[frameHeader(f_record.data)].add(l_timer.nsecsElapsed());
+            m_frames++;
+            m_inbound_bytes += f_record.data.size();
+            break;
+        }
+        case NetworkCapture::RecordType::DISCONNECT:
+        {
+            QPointer<NetworkSocket> l_socket = m_sockets.take(f_record.connection);
+            if (!l_socket.isNull()) {
+                l_socket->close();
+            }
+            break;
+        }
+        }
+    }
+
+    void finish()
+    {
+        qint64 l_elapsed = m_clock.nsecsElapsed();
+        for (const QPointer<NetworkSocket> &l_socket : qAsConst(m_sockets)) {
+            if (!l_socket.isNull()) {
+                l_socket->close();
+            }
+        }
+        m_sockets.clear();
+
+        // Let the queued disconnects run before reporting.
+        QTimer::singleShot(0, [this, l_elapsed] {
+            report(l_elapsed);
+            QCoreApplication::quit();
+        });
+    }
+
+    void report(qint64 f_elapsed)
+    {
+        QTextStream l_out(stdout);
+        double l_seconds = f_elapsed / 1e9;
+        l_out << "Replayed " << m_frames << " frames (" << m_packets << " packets) from " << m_connections
+              << " connections in " << QString::number(l_seconds, 'f', 3) << " s\n";
+        if (m_skipped_frames > 0) {
+            l_out << "Skipped " << m_skipped_frames << " frames of rejected or closed connections\n";
+        }
+        if (l_seconds > 0) {
+            l_out << "Throughput: " << QString::number(m_frames / l_seconds, 'f', 1) << " frames/s, "
+                  << QString::number(m_packets / l_seconds, 'f', 1) << " packets/s\n";
+        }
+        l_out << "Inbound: " << m_inbound_bytes << " bytes\n";
+        l_out << "Outbound: " << m_outbound_frames << " frames, " << m_outbound_bytes << " bytes\n\n";
+
+        l_out << qSetFieldWidth(12) << Qt::left << "header" << Qt::right << "count"
+              << "p50 (us)" << "p90 (us)" << "p99 (us)" << "max (us)" << qSetFieldWidth(0) << "\n";
+        QStringList l_headers = m_latencies.keys();
+        l_headers.sort();
+        for (const QString &l_header : qAsConst(l_headers)) {
+            LatencyStats &l_samples = m_latencies[l_header];
+            l_out << qSetFieldWidth(12) << Qt::left << l_header << Qt::right << l_samples.count()
+                  << LatencyStats::micros(l_samples.percentile(0.5)) << LatencyStats::micros(l_samples.percentile(0.9))
+                  << LatencyStats::micros(l_samples.percentile(0.99)) << LatencyStats::micros(l_samples.percentile(1))
+                  << qSetFieldWidth(0) << "\n";
+        }
+    }
+
+    static QString frameHeader(const QByteArray &f_frame)
+    {
+        qsizetype l_end = f_frame.indexOf('#');
+        if (l_end == -1) {
+            l_end = f_frame.indexOf('%');
+        }
+        return QString::fromUtf8(f_frame.left(l_end == -1 ? f_frame.size() : l_end));
+    }
+
+    Server *m_server;
+    QList<NetworkCapture::Record> m_records;
+    double m_speed;
+    qsizetype m_position = 0;
+    qint64 m_first_timestamp = 0;
+    QElapsedTimer m_clock;
+    QHash<quint32, QPointer<NetworkSocket>> m_sockets;
+    QHash<QString, LatencyStats> m_latencies;
+    quint64 m_connections = 0;
+    quint64 m_frames = 0;
+    quint64 m_skipped_frames = 0;
+    quint64 m_packets = 0;
+    quint64 m_inbound_bytes = 0;
+    quint64 m_outbound_frames = 0;
+    quint64 m_outbound_bytes = 0;
+};
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("akashi_replay");
+
+    QCommandLineParser l_parser;
+    l_parser.setApplicationDescription("Replays a traffic capture into an in-process akashi server.\n"
+                                       "Run it from a copy of the server directory, as replayed traffic modifies "
+                                       "the database and logs like real traffic would.");
+    l_parser.addHelpOption();
+    l_parser.addPositionalArgument("capture", "The capture file to replay.");
+    l_parser.addOption({"speed", "Replay speed factor, or \"max\" to replay as fast as possible.", "factor", "1"});
+    l_parser.process(app);
+
+    if (l_parser.positionalArguments().size() != 1) {
+        l_parser.showHelp(EXIT_FAILURE);
+    }
+
+    double l_speed = 0;
+    QString l_speed_arg = l_parser.value("speed");
+    if (l_speed_arg != "max") {
+        bool ok;
+        l_speed = l_speed_arg.toDouble(&ok);
+        if (!ok || l_speed <= 0) {
+            qCritical() << "Invalid replay speed" << l_speed_arg;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!ConfigManager::verifyServerConfig()) {
+        qCritical() << "config.ini is invalid!";
+        return EXIT_FAILURE;
+    }
+    if (ConfigManager::publishServerEnabled() || ConfigManager::discordWebhookEnabled()) {
+        qCritical() << "Refusing to replay with the advertiser or Discord webhooks enabled.";
+        return EXIT_FAILURE;
+    }
+
+    QList<NetworkCapture::Record> l_records;
+    if (!NetworkCapture::readFile(l_parser.positionalArguments().first(), l_records)) {
+        qCritical() << "Unable to read capture" << l_parser.positionalArguments().first();
+        return EXIT_FAILURE;
+    }
+
+    // Listen on an ephemeral port, the replay never touches the network.
+    Server *l_server = new Server(0, &app);
+    l_server->start();
+
+    Replay l_replay(l_server, l_records, l_speed);
+    l_replay.start();
+    return app.exec();
+}